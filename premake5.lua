@@ -82,4 +82,22 @@ project "YEET"
 		{
 			"src/win32/**.h",
 			"src/win32/**.cpp"
-		}
\ No newline at end of file
+		}
+    filter "system:linux"
+        cppdialect "C++17"
+
+		defines
+		{
+			"PLATFORM_LINUX#1",
+        }
+
+		files 
+		{
+			"src/posix/**.h",
+			"src/posix/**.cpp"
+		}
+
+		links
+		{
+			"pthread"
+		}
@@ -0,0 +1,173 @@
+#include "binary_data.h"
+#include "encoding.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/memory.h>
+
+bool Binary_Data::open(const ch::Path& _path) {
+	if (!map_file(_path, &file)) return false;
+
+	path = _path;
+	dirty_pages.allocator = ch::get_heap_allocator();
+	return true;
+}
+
+static void free_pages(ch::Array<Binary_Page>* pages) {
+	for (Binary_Page& page : *pages) ch_delete[] page.bytes;
+	pages->count = 0;
+}
+
+void Binary_Data::close() {
+	free_pages(&dirty_pages);
+	dirty_pages.free();
+	unmap_file(&file);
+}
+
+// Where page_index is in dirty_pages, or where it would go
+static usize find_page(const ch::Array<Binary_Page>& pages, usize page_index) {
+	usize lo = 0;
+	usize hi = pages.count;
+	while (lo < hi) {
+		const usize mid = lo + (hi - lo) / 2;
+		if (pages[mid].index < page_index) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+usize Binary_Data::read(usize offset, u8* out, usize count) const {
+	if (offset >= file.size) return 0;
+	count = ch::min(count, file.size - offset);
+
+	usize done = 0;
+	usize slot = find_page(dirty_pages, offset / binary_page_size);
+	while (done < count) {
+		const usize at = offset + done;
+		const usize page_index = at / binary_page_size;
+		const usize page_offset = at % binary_page_size;
+		const usize amount = ch::min(count - done, binary_page_size - page_offset);
+
+		while (slot < dirty_pages.count && dirty_pages[slot].index < page_index) slot += 1;
+		if (slot < dirty_pages.count && dirty_pages[slot].index == page_index) {
+			ch::mem_copy(out + done, dirty_pages[slot].bytes + page_offset, amount);
+		} else {
+			ch::mem_copy(out + done, file.data + at, amount);
+		}
+		done += amount;
+	}
+	return count;
+}
+
+bool Binary_Data::is_changed(usize offset) const {
+	if (offset >= file.size) return false;
+
+	const usize page_index = offset / binary_page_size;
+	const usize slot = find_page(dirty_pages, page_index);
+	if (slot >= dirty_pages.count || dirty_pages[slot].index != page_index) return false;
+	return dirty_pages[slot].bytes[offset % binary_page_size] != file.data[offset];
+}
+
+void Binary_Data::set_byte(usize offset, u8 value) {
+	assert(offset < file.size);
+
+	const usize page_index = offset / binary_page_size;
+	const usize slot = find_page(dirty_pages, page_index);
+	if (slot >= dirty_pages.count || dirty_pages[slot].index != page_index) {
+		const usize start = page_index * binary_page_size;
+		Binary_Page page;
+		page.index = page_index;
+		page.bytes = ch_new u8[binary_page_size];
+		ch::mem_copy(page.bytes, file.data + start, ch::min(binary_page_size, file.size - start));
+		dirty_pages.insert(page, slot);
+	}
+	dirty_pages[slot].bytes[offset % binary_page_size] = value;
+}
+
+// Files up to this size are saved as a new copy renamed over the old one, like text is. Copying anything bigger
+// to change a few bytes isn't worth it, those get the changed pages written in place.
+static const usize binary_rewrite_limit = 16 * 1024 * 1024;
+
+// The whole file with edits applied, synced and renamed over path. The old mapping stays until there's a new one
+// to take its place, so a failure anywhere leaves the bytes readable and the edits dirty.
+static bool rewrite_file(const ch::Path& path, Mapped_File* file, const ch::Array<Binary_Page>& pages) {
+	ch::Path temp_path = path;
+	if (!append_path_suffix(&temp_path, CH_TEXT(".save"))) return false;
+
+	ch::Array<IO_Slice> slices(ch::get_heap_allocator());
+	defer(slices.free());
+	usize at = 0;
+	for (const Binary_Page& page : pages) {
+		const usize start = page.index * binary_page_size;
+		const usize size = ch::min(binary_page_size, file->size - start);
+		if (start > at) slices.push({ file->data + at, start - at });
+		slices.push({ page.bytes, size });
+		at = start + size;
+	}
+	if (at < file->size) slices.push({ file->data + at, file->size - at });
+
+	const OS_File os_file = create_write_file(temp_path);
+	if (os_file == invalid_os_file) return false;
+	const bool written = write_file_gather(os_file, slices.data, slices.count) && sync_os_file(os_file);
+	close_os_file(os_file);
+
+	Mapped_File new_file;
+	if (!written || !map_file(temp_path, &new_file)) {
+		delete_file(temp_path);
+		return false;
+	}
+
+	// @NOTE: Windows won't replace a file that's still mapped. The mapping of the copy follows it through the rename.
+	unmap_file(file);
+	if (!replace_file(temp_path, path)) {
+		// The copy reads the same as the old file with the edits on top, so it stands in if path can't be mapped again
+		if (map_file(path, file)) {
+			unmap_file(&new_file);
+			delete_file(temp_path);
+		} else {
+			*file = new_file;
+		}
+		return false;
+	}
+	*file = new_file;
+	return true;
+}
+
+// Writes the changed pages over the file. The mapping sees them as they land, so it never has to go.
+static bool write_pages_in_place(const ch::Path& path, const ch::Array<Binary_Page>& pages) {
+	const OS_File os_file = open_write_file(path);
+	if (os_file == invalid_os_file) return false;
+
+	File_Stamp stamp;
+	bool succeeded = get_file_stamp(path, &stamp);
+	for (usize i = 0; succeeded && i < pages.count; i++) {
+		const u64 start = (u64)pages[i].index * binary_page_size;
+		if (start >= stamp.size) break;
+		const usize size = (usize)ch::min((u64)binary_page_size, stamp.size - start);
+		succeeded = write_file_at(os_file, start, pages[i].bytes, size);
+	}
+	succeeded = succeeded && sync_os_file(os_file);
+	close_os_file(os_file);
+	return succeeded;
+}
+
+bool Binary_Data::save() {
+	bool succeeded;
+	if (file.size <= binary_rewrite_limit) {
+		succeeded = rewrite_file(path, &file, dirty_pages);
+	} else {
+		succeeded = write_pages_in_place(path, dirty_pages);
+	}
+	if (succeeded) free_pages(&dirty_pages);
+	return succeeded;
+}
+
+bool is_binary_file(const ch::Path& path) {
+	Mapped_File file;
+	if (!map_file(path, &file)) return false;
+	defer(unmap_file(&file));
+
+	return looks_binary(file.data, file.size);
+}
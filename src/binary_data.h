@@ -0,0 +1,41 @@
+#pragma once
+
+#include "platform.h"
+
+// Bytes shown on one row of the hex view
+const usize hex_row_size = 16;
+// Edits copy the page they land in out of the mapping. Everything else is only ever read from it.
+const usize binary_page_size = 4096;
+
+struct Binary_Page {
+	usize index;
+	u8* bytes;
+};
+
+/* Raw bytes of a file that isn't text. The file stays mapped and nothing is decoded. Edits overwrite bytes in
+   place so the size never changes, which keeps rows at fixed offsets. Saving writes a new copy and renames it over
+   the file, except for big files where it's a write of just the pages that changed. */
+struct Binary_Data {
+	ch::Path path;
+	Mapped_File file;
+	// Sorted by index
+	ch::Array<Binary_Page> dirty_pages;
+
+	bool open(const ch::Path& path);
+	void close();
+
+	CH_FORCEINLINE usize get_size() const { return file.size; }
+	CH_FORCEINLINE usize get_row_count() const { return (file.size + hex_row_size - 1) / hex_row_size; }
+
+	// Copies up to count bytes at offset into out with edits applied. Returns how many there were.
+	usize read(usize offset, u8* out, usize count) const;
+	// True when the byte at offset differs from what's in the file
+	bool is_changed(usize offset) const;
+	void set_byte(usize offset, u8 value);
+
+	// Edits stay dirty and the bytes readable when it fails
+	bool save();
+};
+
+// Looks at the start of path to tell whether it should open as binary
+bool is_binary_file(const ch::Path& path);
@@ -1,4 +1,78 @@
 #include "buffer.h"
+#include "mapped_text.h"
+#include "binary_data.h"
+#include "encoding.h"
+#include "platform.h"
+#include "text_scan.h"
+#include "buffer_loader.h"
+#include "text_writer.h"
+#include "diff.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/memory.h>
+
+// Room left after a freshly loaded file so the first edits don't have to grow the gap
+static const usize load_gap_size = 4096;
+
+// Throws away the contents and allocates room for capacity codepoints, all of it gap.
+static u32* reset_gap_buffer(ch::Gap_Buffer<u32>* gap_buffer, usize capacity) {
+	gap_buffer->free();
+	gap_buffer->data = (u32*)gap_buffer->allocator.alloc(capacity * sizeof(u32));
+	gap_buffer->allocated = capacity;
+	gap_buffer->gap = gap_buffer->data;
+	gap_buffer->gap_size = capacity;
+	return gap_buffer->data;
+}
+
+// Moves the gap so it starts at index
+static void move_gap(ch::Gap_Buffer<u32>* gap_buffer, usize index) {
+	const usize front = gap_buffer->gap - gap_buffer->data;
+	if (index < front) {
+		const usize amount = front - index;
+		ch::mem_move(gap_buffer->gap + gap_buffer->gap_size - amount, gap_buffer->data + index, amount * sizeof(u32));
+	} else if (index > front) {
+		const usize amount = index - front;
+		ch::mem_move(gap_buffer->gap, gap_buffer->gap + gap_buffer->gap_size, amount * sizeof(u32));
+	}
+	gap_buffer->gap = gap_buffer->data + index;
+}
+
+// Reallocates so the gap can hold at least min_gap_size codepoints
+static void grow_gap(ch::Gap_Buffer<u32>* gap_buffer, usize min_gap_size) {
+	if (gap_buffer->gap_size >= min_gap_size) return;
+
+	const usize front = gap_buffer->gap - gap_buffer->data;
+	const usize back = gap_buffer->allocated - front - gap_buffer->gap_size;
+	const usize new_gap_size = ch::max(min_gap_size, (front + back) / 2 + load_gap_size);
+	const usize new_allocated = front + back + new_gap_size;
+
+	u32* new_data = (u32*)gap_buffer->allocator.alloc(new_allocated * sizeof(u32));
+	if (gap_buffer->data) {
+		ch::mem_copy(new_data, gap_buffer->data, front * sizeof(u32));
+		ch::mem_copy(new_data + front + new_gap_size, gap_buffer->gap + gap_buffer->gap_size, back * sizeof(u32));
+		gap_buffer->allocator.free(gap_buffer->data);
+	}
+
+	gap_buffer->data = new_data;
+	gap_buffer->allocated = new_allocated;
+	gap_buffer->gap = new_data + front;
+	gap_buffer->gap_size = new_gap_size;
+}
+
+static ch::Array<Buffer_Edit_Hook> edit_hooks;
+
+void add_buffer_edit_hook(Buffer_Edit_Hook hook) {
+	edit_hooks.allocator = ch::get_heap_allocator();
+	edit_hooks.push(hook);
+}
+
+static void notify_edit(Buffer* buffer, usize index, usize removed, const u32* inserted, usize inserted_count) {
+	Text_Edit edit;
+	edit.index = index;
+	edit.removed = removed;
+	edit.inserted = inserted_count;
+	for (Buffer_Edit_Hook hook : edit_hooks) hook(buffer, edit, inserted);
+}
 
 Buffer::Buffer() {
 	eol_table.allocator = ch::get_heap_allocator();
@@ -14,56 +88,368 @@ Buffer::Buffer(Buffer_ID _id) : id(_id) {
 	eol_table.push(0);
 }
 
-void Buffer::add_char(u32 c, usize index) {
-	gap_buffer.insert(c, index);
+void Buffer::free() {
+	if (loader) {
+		cancel_buffer_load(loader);
+		loader = nullptr;
+	}
 
-	ssize index_line = -1;
-	usize index_column = 0;
+	if (mapped) {
+		mapped->close();
+		ch_delete mapped;
+		mapped = nullptr;
+	}
 
-	usize current_index = 0;
-	for (usize i = 0; i < eol_table.count; i++) {
-		usize line_size = eol_table[i];
+	if (binary) {
+		binary->close();
+		ch_delete binary;
+		binary = nullptr;
+	}
 
-		if (index < current_index + line_size) {
-			index_column = index - current_index;
-			break;
-		}
+	gap_buffer.free();
+	eol_table.free();
+	line_endings.free();
+}
 
-		current_index += line_size;
-		index_line += 1;
+bool Buffer::open_mapped(const ch::Path& path) {
+	assert(!mapped);
+
+	Mapped_Text* text = ch_new Mapped_Text;
+	if (!text->open(path)) {
+		ch_delete text;
+		return false;
 	}
 
-	if (c == ch::eol) {
-		const usize line_size = eol_table[index_line];
-		eol_table[index_line] = index_column + 1;
-		eol_table.insert(line_size - index_column, index_line + 1);
-	} else if (index_line < eol_table.count) { // @Hack
-		eol_table[index_line] += 1;
+	mapped = text;
+	full_path = path;
+	get_file_stamp(path, &disk_stamp);
+	return true;
+}
+
+bool Buffer::open_binary(const ch::Path& path) {
+	assert(!mapped && !binary);
+
+	File_Stamp stamp;
+	if (!get_file_stamp(path, &stamp)) return false;
+
+	Binary_Data* data = ch_new Binary_Data;
+	if (!data->open(path)) {
+		ch_delete data;
+		return false;
 	}
+
+	binary = data;
+	full_path = path;
+	disk_stamp = stamp;
+	return true;
 }
 
-void Buffer::remove_char(usize index) {
-	usize index_line = 0;
-	usize current_index = 0;
-	for (usize i = 0; i < eol_table.count; i++) {
-		usize line_size = eol_table[i];
+bool Buffer::load_from_path(const ch::Path& path, const Known_Lines* known) {
+	assert(!is_read_only());
+
+	// @NOTE: Stamp goes first so a write that lands while we read shows up as a change later instead of getting lost
+	File_Stamp stamp;
+	if (!get_file_stamp(path, &stamp)) return false;
+
+	Mapped_File file;
+	if (!map_file(path, &file)) return false;
+	defer(unmap_file(&file));
+
+	if (known && known->stamp == stamp) {
+		load_from_memory(file.data, file.size, known->sizes, known->count);
+	} else {
+		load_from_memory(file.data, file.size);
+	}
+	full_path = path;
+	disk_stamp = stamp;
+	return true;
+}
 
-		if (index < current_index + line_size) {
-			break;
+void Buffer::load_from_memory(const u8* data, usize size, const usize* line_sizes, usize line_count) {
+	assert(!is_read_only());
+
+	usize bom_size;
+	format = detect_text_format(data, size, &bom_size);
+	data += bom_size;
+	size -= bom_size;
+
+	// @NOTE: No encoding decodes to more codepoints than bytes so the size is an upper bound.
+	//        Whatever multibyte sequences save just becomes extra gap.
+	u32* storage = reset_gap_buffer(&gap_buffer, size + load_gap_size);
+	usize count = decode_text(format.encoding, data, size, storage);
+
+	line_endings.free();
+	line_endings.ending = detect_line_ending(storage, count);
+	count = normalize_line_endings(storage, count, line_endings.ending, 0, &line_endings.exceptions);
+
+	gap_buffer.gap = storage + count;
+	gap_buffer.gap_size = gap_buffer.allocated - count;
+
+	if (line_count) {
+		eol_table.count = 0;
+		eol_table.reserve(line_count);
+		usize total = 0;
+		for (usize i = 0; i < line_count; i++) {
+			eol_table.push(line_sizes[i]);
+			total += line_sizes[i];
 		}
+		if (total == count) return;
+	}
+	rebuild_eol_table();
+}
 
-		current_index += line_size;
-		index_line += 1;
+bool Buffer::reload_from_path(ch::Array<Text_Edit>* out_edits) {
+	assert(!is_loading());
+
+	File_Stamp stamp;
+	if (!get_file_stamp(full_path, &stamp)) return false;
+
+	if (mapped) {
+		// Nothing is cached past the visible pages, so a mapped view just starts over
+		const ch::Path path = full_path;
+		mapped->close();
+		ch_delete mapped;
+		mapped = nullptr;
+		return open_mapped(path);
+	}
+
+	if (binary) {
+		// Rows are at fixed offsets, there's nothing to diff. Unsaved bytes were already a conflict and never get here.
+		const ch::Path path = full_path;
+		binary->close();
+		ch_delete binary;
+		binary = nullptr;
+		if (!open_binary(path)) return false;
+		saved_version = version;
+		return true;
 	}
 
-	eol_table[index_line] -= 1;
+	Mapped_File file;
+	if (!map_file(full_path, &file)) return false;
+	defer(unmap_file(&file));
+
+	usize bom_size;
+	const Text_Format new_format = detect_text_format(file.data, file.size, &bom_size);
+
+	u32* text = ch_new u32[file.size + 1];
+	defer(ch_delete[] text);
+	usize count = decode_text(new_format.encoding, file.data + bom_size, file.size - bom_size, text);
+
+	Line_Endings new_endings;
+	new_endings.ending = detect_line_ending(text, count);
+	count = normalize_line_endings(text, count, new_endings.ending, 0, &new_endings.exceptions);
 
+	apply_line_diff(this, text, count, out_edits);
+
+	// @NOTE: The text now matches the file line for line, so its endings can be taken as is
+	line_endings.free();
+	line_endings = new_endings;
+	format = new_format;
+	disk_stamp = stamp;
+	saved_version = version;
+	return true;
+}
+
+bool Buffer::save_to_path(const ch::Path& path) {
+	assert(!is_read_only() && !is_loading() && !is_binary());
+
+	const OS_File file = create_write_file(path);
+	if (file == invalid_os_file) return false;
+
+	const bool written = write_text(file, get_halves(), &line_endings, format);
+	close_os_file(file);
+	if (written) {
+		saved_version = version;
+		get_file_stamp(path, &disk_stamp);
+	}
+	return written;
+}
+
+Buffer_Halves Buffer::get_halves() const {
+	Buffer_Halves result;
+	result.front = gap_buffer.data;
+	result.front_count = gap_buffer.gap - gap_buffer.data;
+	result.back = gap_buffer.gap + gap_buffer.gap_size;
+	result.back_count = gap_buffer.allocated - result.front_count - gap_buffer.gap_size;
+	return result;
+}
+
+bool Buffer::load_from_path_async(const ch::Path& path, const Known_Lines* known) {
+	assert(!is_read_only() && !is_loading());
+
+	File_Stamp stamp;
+	if (!get_file_stamp(path, &stamp)) return false;
+
+	Buffer_Loader* new_loader = start_buffer_load(path, id, known && known->stamp == stamp ? known : nullptr);
+	if (!new_loader) return false;
+	disk_stamp = stamp;
+
+	// Everything up front so appending loaded chunks never reallocates
+	reset_gap_buffer(&gap_buffer, get_buffer_load_size(new_loader) + load_gap_size);
+	eol_table.count = 0;
+	eol_table.push(0);
+	line_endings.free();
+	format = get_buffer_load_format(new_loader);
+
+	loader = new_loader;
+	full_path = path;
+	return true;
+}
+
+void Buffer::insert_raw(usize index, const u32* text, usize count) {
+	assert(index <= gap_buffer.count());
+	grow_gap(&gap_buffer, count);
+	move_gap(&gap_buffer, index);
+
+	ch::mem_copy(gap_buffer.gap, text, count * sizeof(u32));
+	gap_buffer.gap += count;
+	gap_buffer.gap_size -= count;
+}
+
+void Buffer::rebuild_eol_table() {
+	build_eol_table(get_halves(), &eol_table);
+}
+
+usize Buffer::get_line_index(usize index, usize* out_line_start) const {
+	usize line_start = 0;
+	usize line = 0;
+	for (; line + 1 < eol_table.count; line++) {
+		const usize line_size = eol_table[line];
+		if (index < line_start + line_size) break;
+		line_start += line_size;
+	}
+
+	if (out_line_start) *out_line_start = line_start;
+	return line;
+}
+
+// Makes room for count entries at index
+static void insert_lines(ch::Array<usize>* table, usize index, usize count) {
+	const usize old_count = table->count;
+	for (usize i = 0; i < count; i++) table->push(0);
+	ch::mem_move(table->data + index + count, table->data + index, (old_count - index) * sizeof(usize));
+}
+
+static void remove_lines(ch::Array<usize>* table, usize index, usize count) {
+	ch::mem_move(table->data + index, table->data + index + count, (table->count - index - count) * sizeof(usize));
+	table->count -= count;
+}
+
+void Buffer::replace_contents(u32* text, usize count, usize capacity, const Text_Edit& edit) {
+	assert(!is_read_only() && !is_loading() && !is_binary());
+	assert(count <= capacity);
+	version += 1;
+
+	gap_buffer.free();
+	gap_buffer.data = text;
+	gap_buffer.allocated = capacity;
+	gap_buffer.gap = text + count;
+	gap_buffer.gap_size = capacity - count;
+	rebuild_eol_table();
+
+	notify_edit(this, edit.index, edit.removed, text + edit.index, edit.inserted);
+}
+
+void Buffer::insert_text(usize index, const u32* text, usize count) {
+	assert(!is_read_only());
+	if (!count) return;
+	version += 1;
+
+	usize line_start;
+	const usize line = get_line_index(index, &line_start);
+	insert_raw(index, text, count);
+
+	defer(notify_edit(this, index, 0, text, count));
+
+	const usize eol_count = count_codepoint(text, count, ch::eol);
+	if (!eol_count) {
+		eol_table[line] += count;
+		return;
+	}
+
+	// The line gets cut at index. Its head ends at the first new eol and its tail goes on the end of the last new line.
+	const usize column = index - line_start;
+	const usize tail = eol_table[line] - column;
+	insert_lines(&eol_table, line + 1, eol_count);
+
+	usize slot = line;
+	usize prev = 0;
+	for (usize at = find_codepoint(text, count, ch::eol); at < count; at = prev + find_codepoint(text + prev, count - prev, ch::eol)) {
+		eol_table[slot] = at + 1 - prev;
+		if (slot == line) eol_table[slot] += column;
+		slot += 1;
+		prev = at + 1;
+	}
+	eol_table[slot] = count - prev + tail;
+
+	line_endings.on_lines_inserted(line, eol_count);
+}
+
+void Buffer::remove_text(usize index, usize count) {
+	assert(!is_read_only());
+	assert(index + count <= gap_buffer.count());
+	if (!count) return;
+	version += 1;
+
+	const usize line = get_line_index(index);
+	const usize eol_count = count_codepoint(get_halves(), index, index + count, ch::eol);
+
+	// Whatever is left of the lines the range touched becomes one line
+	usize merged = 0;
+	for (usize i = line; i <= line + eol_count; i++) merged += eol_table[i];
+	remove_lines(&eol_table, line + 1, eol_count);
+	eol_table[line] = merged - count;
+	line_endings.on_lines_removed(line, eol_count);
+
+	move_gap(&gap_buffer, index);
+	gap_buffer.gap_size += count;
+
+	notify_edit(this, index, count, nullptr, 0);
+}
+
+void Buffer::add_char(u32 c, usize index) {
+	assert(!is_read_only());
+	version += 1;
+
+	usize line_start;
+	const usize line = get_line_index(index, &line_start);
+	gap_buffer.insert(c, index);
+
+	if (c == ch::eol) {
+		const usize column = index - line_start;
+		const usize line_size = eol_table[line];
+		eol_table[line] = column + 1;
+		eol_table.insert(line_size - column, line + 1);
+		line_endings.on_lines_inserted(line, 1);
+	} else {
+		eol_table[line] += 1;
+	}
+
+	notify_edit(this, index, 0, &c, 1);
+}
+
+void Buffer::remove_char(usize index) {
+	assert(!is_read_only());
+	version += 1;
+
+	const usize line = get_line_index(index);
+	eol_table[line] -= 1;
+
+	// Deleting an eol pulls the next line up onto this one
 	const u32 c = gap_buffer[index];
 	if (c == ch::eol) {
-		const size_t amount_on_line = eol_table[index_line];
-		eol_table.remove(index_line);
-		eol_table[index_line - 1] += amount_on_line;
+		eol_table[line] += eol_table[line + 1];
+		eol_table.remove(line + 1);
+		line_endings.on_lines_removed(line, 1);
 	}
 
 	gap_buffer.remove_at_index(index);
+
+	notify_edit(this, index, 1, nullptr, 0);
+}
+
+void Buffer::overwrite_byte(usize offset, u8 value) {
+	assert(is_binary());
+	binary->set_byte(offset, value);
+	version += 1;
 }
@@ -4,6 +4,13 @@
 #include <ch_stl/gap_buffer.h>
 #include <ch_stl/hash.h>
 #include "draw.h"
+#include "line_endings.h"
+#include "encoding.h"
+#include "platform.h"
+
+struct Mapped_Text;
+struct Buffer_Loader;
+struct Binary_Data;
 
 using Buffer_ID = usize;
 
@@ -11,15 +18,111 @@ CH_FORCEINLINE u64 hash(Buffer_ID id) {
 	return ch::fnv1_hash(&id, sizeof(Buffer_ID));
 }
 
+// One replacement of removed codepoints at index with inserted new ones
+struct Text_Edit {
+	usize index;
+	usize removed;
+	usize inserted;
+};
+
+// Logical range [start, end) of a buffer's text
+struct Text_Span {
+	usize start;
+	usize end;
+};
+
+// Called after every edit to a buffer that has a hook set. inserted holds edit.inserted codepoints.
+using Buffer_Edit_Hook = void (*)(struct Buffer* buffer, const Text_Edit& edit, const u32* inserted);
+void add_buffer_edit_hook(Buffer_Edit_Hook hook);
+
+// The two contiguous runs of codepoints on either side of the gap
+struct Buffer_Halves {
+	const u32* front;
+	usize front_count;
+	const u32* back;
+	usize back_count;
+};
+
+// Line sizes of a file from an earlier load, so loading it again can skip looking for line breaks. Only used
+// while the file still has stamp.
+struct Known_Lines {
+	File_Stamp stamp;
+	const usize* sizes;
+	usize count;
+};
+
 struct Buffer {
 	Buffer_ID id;
 	ch::Gap_Buffer<u32> gap_buffer;
 	ch::Path full_path;
 	ch::Array<usize> eol_table;
+	// How the file ended its lines. The text itself only has '\n'.
+	Line_Endings line_endings;
+	// Encoding the file came in, saving writes the same one back
+	Text_Format format;
+	// What full_path looked like when it was last loaded or saved
+	File_Stamp disk_stamp;
+
+	// Set when the buffer is a read only view of a mapped file. gap_buffer and eol_table are unused then.
+	Mapped_Text* mapped = nullptr;
+	// Set while the rest of the file is still being decoded in the background. Everything in gap_buffer is usable.
+	Buffer_Loader* loader = nullptr;
+	// Set when the file isn't text and is shown as bytes. gap_buffer and eol_table are unused then.
+	Binary_Data* binary = nullptr;
+
+	// Bumped on every edit. saved_version is the version that's on disk.
+	u64 version = 0;
+	u64 saved_version = 0;
 
 	Buffer();
 	Buffer(Buffer_ID _id);
 
+	void free();
+
+	CH_FORCEINLINE bool is_read_only() const { return mapped != nullptr; }
+	CH_FORCEINLINE bool is_loading() const { return loader != nullptr; }
+	CH_FORCEINLINE bool is_binary() const { return binary != nullptr; }
+	CH_FORCEINLINE bool is_dirty() const { return version != saved_version; }
+
+	// Opens path as a read only view that only decodes what gets looked at. For files too big to load.
+	bool open_mapped(const ch::Path& path);
+	// Opens path as raw bytes that can be overwritten but never decoded. For files that aren't text.
+	bool open_binary(const ch::Path& path);
+	// Replaces the contents with the decoded file. The gap buffer is filled in place, no per char inserts.
+	bool load_from_path(const ch::Path& path, const Known_Lines* known = nullptr);
+	// Replaces the contents with text from memory in whatever encoding it looks like, with line endings normalized.
+	// Doesn't touch full_path. Line sizes that don't add up to the text get thrown away and rebuilt.
+	void load_from_memory(const u8* data, usize size, const usize* line_sizes = nullptr, usize line_count = 0);
+
+	// Starts decoding path on a background thread. Whatever has been decoded so far shows up in the buffer every tick.
+	bool load_from_path_async(const ch::Path& path, const Known_Lines* known = nullptr);
+
+	// Re-reads full_path and applies only the lines that changed as edits, so everything else stays where it was.
+	// Pushes the edits in the order they were applied. The buffer ends up not dirty.
+	bool reload_from_path(ch::Array<Text_Edit>* out_edits);
+
+	// Streams the contents out in the original encoding and line endings without making a contiguous copy
+	bool save_to_path(const ch::Path& path);
+
+	Buffer_Halves get_halves() const;
+	void rebuild_eol_table();
+	// Line that index is on and where that line starts. An index past the end is on the last line.
+	usize get_line_index(usize index, usize* out_line_start = nullptr) const;
+
+	// Copies text in at index without touching eol_table. Callers keep the line index up to date themselves.
+	void insert_raw(usize index, const u32* text, usize count);
+
+	// Takes over text, count codepoints in a heap allocation with room for capacity, as the whole contents. edit is
+	// the one span that differs from what was there, which is all edit hooks get told about. Line endings are left
+	// to the caller.
+	void replace_contents(u32* text, usize count, usize capacity, const Text_Edit& edit);
+
+	void insert_text(usize index, const u32* text, usize count);
+	void remove_text(usize index, usize count);
+
 	void add_char(u32 c, usize index);
 	void remove_char(usize index);
+
+	// Binary buffers only. Replaces the byte at offset, nothing moves.
+	void overwrite_byte(usize offset, u8 value);
 };
@@ -0,0 +1,270 @@
+#include "buffer_loader.h"
+#include "editor.h"
+#include "encoding.h"
+#include "platform.h"
+#include "session.h"
+#include "text_scan.h"
+
+#include <ch_stl/math.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// The first chunk is small so the first screen doesn't wait on a big decode
+static const usize first_load_chunk_size = 64 * 1024;
+static const usize load_chunk_size = 4 * 1024 * 1024;
+
+struct Load_Chunk {
+	u32* codepoints;
+	usize count;
+	// Line lengths of the chunk as if it was its own text. The first one continues the buffer's last line.
+	ch::Array<usize> line_lengths;
+	// Lines that don't end in the main ending, numbered from the start of the chunk
+	ch::Array<Line_Ending_Exception> line_endings;
+};
+
+struct Buffer_Loader {
+	Buffer_ID buffer_id;
+	Mapped_File file;
+	std::thread thread;
+	// Worked out up front so the buffer knows how to save before anything is decoded
+	Text_Format format;
+	usize bom_size = 0;
+	// Picked from the first chunk. Only read after that chunk came through ready_mutex.
+	Line_Ending line_ending = LE_LF;
+
+	// Line sizes from an earlier load, which chunks get split by instead of looking for line breaks. Decode thread
+	// only until finished, like known_lines_wrong, which is set when the text didn't add up to them.
+	ch::Array<usize> known_lines;
+	usize known_line = 0;
+	usize known_line_left = 0;
+	bool known_lines_wrong = false;
+
+	std::mutex ready_mutex;
+	ch::Array<Load_Chunk*> ready;
+
+	// Main thread only. Chunks wait here while appending them would mean moving a lot of text around the gap.
+	ch::Array<Load_Chunk*> pending;
+	usize pending_count = 0;
+
+	std::atomic<usize> decoded_bytes;
+	std::atomic<bool> finished;
+	std::atomic<bool> cancel;
+};
+
+static ch::Array<Buffer_Loader*> active_loaders;
+
+static void free_chunk(Load_Chunk* chunk) {
+	ch_delete[] chunk->codepoints;
+	chunk->line_lengths.free();
+	chunk->line_endings.free();
+	ch_delete chunk;
+}
+
+// The line lengths of the next count codepoints as build_eol_table would find them, from known_lines. Returns false
+// when the text goes on past the last known line.
+static bool take_known_lines(Buffer_Loader* loader, usize count, ch::Array<usize>* out_lengths) {
+	usize current = 0;
+	for (;;) {
+		const usize taken = ch::min(loader->known_line_left, count);
+		current += taken;
+		count -= taken;
+		loader->known_line_left -= taken;
+		if (loader->known_line_left) break;
+
+		// The last line has no eol, nothing can come after it
+		if (loader->known_line + 1 == loader->known_lines.count) {
+			if (count) return false;
+			break;
+		}
+		out_lengths->push(current);
+		current = 0;
+		loader->known_line += 1;
+		loader->known_line_left = loader->known_lines[loader->known_line];
+	}
+	out_lengths->push(current);
+	return true;
+}
+
+static void decode_file(Buffer_Loader* loader) {
+	const u8* data = loader->file.data;
+	const usize size = loader->file.size;
+
+	const Text_Encoding encoding = loader->format.encoding;
+
+	usize chunk_size = first_load_chunk_size;
+	usize pos = loader->bom_size;
+	while (pos < size && !loader->cancel.load(std::memory_order_relaxed)) {
+		usize end = ch::min(pos + chunk_size, size);
+		// Don't split a character between chunks
+		if (end < size) end = pos + complete_text_prefix(encoding, data + pos, end - pos);
+
+		Load_Chunk* chunk = ch_new Load_Chunk;
+		chunk->codepoints = ch_new u32[end - pos];
+		chunk->count = decode_text(encoding, data + pos, end - pos, chunk->codepoints);
+		chunk->line_lengths.allocator = ch::get_heap_allocator();
+		chunk->line_endings.allocator = ch::get_heap_allocator();
+
+		// Or a CRLF. A trailing '\r' waits for the next chunk to see what comes after it.
+		if (end < size && chunk->count > 1 && chunk->codepoints[chunk->count - 1] == '\r') {
+			chunk->count -= 1;
+			end -= get_code_unit_size(encoding);
+		}
+
+		if (pos == loader->bom_size) loader->line_ending = detect_line_ending(chunk->codepoints, chunk->count);
+		chunk->count = normalize_line_endings(chunk->codepoints, chunk->count, loader->line_ending, 0, &chunk->line_endings);
+
+		const bool known = loader->known_lines.count && !loader->known_lines_wrong;
+		if (!known || !take_known_lines(loader, chunk->count, &chunk->line_lengths)) {
+			if (known) loader->known_lines_wrong = true;
+
+			Buffer_Halves halves = {};
+			halves.front = chunk->codepoints;
+			halves.front_count = chunk->count;
+			build_eol_table(halves, &chunk->line_lengths);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(loader->ready_mutex);
+			loader->ready.push(chunk);
+		}
+
+		discard_mapped_range(loader->file, pos, end - pos);
+		pos = end;
+		loader->decoded_bytes.store(pos, std::memory_order_relaxed);
+		chunk_size = load_chunk_size;
+	}
+
+	// Text that ended before the known lines did
+	if (loader->known_lines.count && (loader->known_line + 1 != loader->known_lines.count || loader->known_line_left)) {
+		loader->known_lines_wrong = true;
+	}
+	loader->finished.store(true, std::memory_order_release);
+}
+
+Buffer_Loader* start_buffer_load(const ch::Path& path, Buffer_ID buffer_id, const Known_Lines* known) {
+	Buffer_Loader* loader = ch_new Buffer_Loader;
+	if (!map_file(path, &loader->file)) {
+		ch_delete loader;
+		return nullptr;
+	}
+
+	loader->buffer_id = buffer_id;
+	loader->format = detect_text_format(loader->file.data, loader->file.size, &loader->bom_size);
+	loader->ready.allocator = ch::get_heap_allocator();
+	loader->pending.allocator = ch::get_heap_allocator();
+	loader->known_lines.allocator = ch::get_heap_allocator();
+	if (known && known->count) {
+		loader->known_lines.reserve(known->count);
+		ch::mem_copy(loader->known_lines.data, known->sizes, known->count * sizeof(usize));
+		loader->known_lines.count = known->count;
+		loader->known_line_left = known->sizes[0];
+	}
+	loader->decoded_bytes.store(0);
+	loader->finished.store(false);
+	loader->cancel.store(false);
+	loader->thread = std::thread(decode_file, loader);
+
+	active_loaders.allocator = ch::get_heap_allocator();
+	active_loaders.push(loader);
+	return loader;
+}
+
+static void destroy_loader(Buffer_Loader* loader) {
+	if (loader->thread.joinable()) loader->thread.join();
+
+	for (Load_Chunk* chunk : loader->ready) free_chunk(chunk);
+	for (Load_Chunk* chunk : loader->pending) free_chunk(chunk);
+	loader->ready.free();
+	loader->pending.free();
+	loader->known_lines.free();
+
+	unmap_file(&loader->file);
+
+	const ssize index = active_loaders.find(loader);
+	if (index != -1) active_loaders.remove(index);
+
+	ch_delete loader;
+}
+
+void cancel_buffer_load(Buffer_Loader* loader) {
+	loader->cancel.store(true);
+	destroy_loader(loader);
+}
+
+Text_Format get_buffer_load_format(const Buffer_Loader* loader) {
+	return loader->format;
+}
+
+usize get_buffer_load_size(const Buffer_Loader* loader) {
+	return loader->file.size;
+}
+
+f32 get_buffer_load_progress(const Buffer_Loader* loader) {
+	if (!loader->file.size) return 1.f;
+	return (f32)loader->decoded_bytes.load(std::memory_order_relaxed) / (f32)loader->file.size;
+}
+
+static void flush_pending_chunks(Buffer* buffer, Buffer_Loader* loader) {
+	buffer->line_endings.ending = loader->line_ending;
+
+	for (Load_Chunk* chunk : loader->pending) {
+		buffer->insert_raw(buffer->gap_buffer.count(), chunk->codepoints, chunk->count);
+
+		// Chunks land after every line that's already there, so appending keeps the exceptions sorted
+		const usize first_line = buffer->eol_table.count - 1;
+		for (Line_Ending_Exception exception : chunk->line_endings) {
+			exception.line += first_line;
+			buffer->line_endings.exceptions.push(exception);
+		}
+
+		ch::Array<usize>& eol_table = buffer->eol_table;
+		eol_table[eol_table.count - 1] += chunk->line_lengths[0];
+		for (usize i = 1; i < chunk->line_lengths.count; i++) {
+			eol_table.push(chunk->line_lengths[i]);
+		}
+
+		free_chunk(chunk);
+	}
+	loader->pending.count = 0;
+	loader->pending_count = 0;
+}
+
+void tick_buffer_loads() {
+	for (usize i = 0; i < active_loaders.count;) {
+		Buffer_Loader* loader = active_loaders[i];
+		Buffer* buffer = find_buffer(loader->buffer_id);
+		assert(buffer && buffer->loader == loader);
+
+		// @NOTE: read finished before draining so we can't miss the last chunk
+		const bool finished = loader->finished.load(std::memory_order_acquire);
+		{
+			std::lock_guard<std::mutex> lock(loader->ready_mutex);
+			for (Load_Chunk* chunk : loader->ready) {
+				loader->pending.push(chunk);
+				loader->pending_count += chunk->count;
+			}
+			loader->ready.count = 0;
+		}
+
+		// Appending goes to the end of the buffer. If the gap is somewhere else because the user is editing,
+		// everything behind it has to move, so wait until that's cheap compared to what we're adding.
+		const Buffer_Halves halves = buffer->get_halves();
+		const bool gap_at_end = halves.back_count == 0;
+		if (loader->pending.count && (gap_at_end || finished || loader->pending_count * 4 >= halves.back_count)) {
+			flush_pending_chunks(buffer, loader);
+		}
+
+		if (finished && !loader->pending.count) {
+			if (loader->known_lines_wrong) buffer->rebuild_eol_table();
+			buffer->line_endings.choose_main_ending(buffer->eol_table.count - 1);
+			buffer->loader = nullptr;
+			destroy_loader(loader);
+			restore_session_cursors(buffer->id);
+			continue;
+		}
+
+		i += 1;
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "buffer.h"
+
+/* Decodes a file on a background thread and hands it to its buffer a chunk at a time, so the first screen
+   shows up right away and the loaded part can be scrolled and edited while the rest comes in. */
+
+// known is only passed when it's for the file as it is now. Its sizes get copied.
+Buffer_Loader* start_buffer_load(const ch::Path& path, Buffer_ID buffer_id, const Known_Lines* known = nullptr);
+void cancel_buffer_load(Buffer_Loader* loader);
+
+Text_Format get_buffer_load_format(const Buffer_Loader* loader);
+// Upper bound of how many codepoints the buffer will end up with
+usize get_buffer_load_size(const Buffer_Loader* loader);
+f32 get_buffer_load_progress(const Buffer_Loader* loader);
+
+// Moves decoded chunks into their buffers. Called once a tick on the main thread.
+void tick_buffer_loads();
@@ -1,6 +1,19 @@
 #include "buffer_view.h"
 #include "input.h"
 #include "editor.h"
+#include "mapped_text.h"
+#include "buffer_loader.h"
+#include "save.h"
+#include "file_watch.h"
+#include "platform.h"
+#include "session.h"
+#include "binary_data.h"
+#include "search.h"
+#include "find.h"
+#include "text_scan.h"
+#include "file_finder.h"
+#include "project_walk.h"
+#include "word_index.h"
 
 #include <ch_stl/math.h>
 
@@ -9,11 +22,55 @@ Buffer_View* hovered_view;
 ch::Array<Buffer_View*> views;
 static const f32 scroll_speed = 5.f;
 
+// Hex digits overwrite the byte after the cursor, high half first. Backspace steps back without changing anything.
+static void enter_hex_char(Buffer_View* view, Buffer* buffer, u32 c) {
+	if (c == CH_KEY_BACKSPACE) {
+		if (view->hex_low_nibble) {
+			view->hex_low_nibble = false;
+		} else if (view->cursor > -1) {
+			view->cursor -= 1;
+		}
+		return;
+	}
+
+	u8 nibble;
+	if (c >= '0' && c <= '9') {
+		nibble = (u8)(c - '0');
+	} else if (c >= 'a' && c <= 'f') {
+		nibble = (u8)(c - 'a' + 10);
+	} else if (c >= 'A' && c <= 'F') {
+		nibble = (u8)(c - 'A' + 10);
+	} else {
+		return;
+	}
+
+	const usize offset = (usize)(view->cursor + 1);
+	u8 byte;
+	if (!buffer->binary->read(offset, &byte, 1)) return;
+
+	byte = view->hex_low_nibble ? (u8)((byte & 0xF0) | nibble) : (u8)((nibble << 4) | (byte & 0x0F));
+	buffer->overwrite_byte(offset, byte);
+
+	if (view->hex_low_nibble) view->cursor += 1;
+	view->hex_low_nibble = !view->hex_low_nibble;
+}
+
 void Buffer_View::on_char_entered(u32 c) {
 	Buffer* buffer = find_buffer(the_buffer);
 	assert(buffer);
+	if (buffer->is_read_only()) return;
+
+	if (buffer->is_binary()) {
+		reset_cursor_timer();
+		enter_hex_char(this, buffer, c);
+		return;
+	}
 
 	if (c == '\r') c = ch::eol;
+	// Enter in the file finder opens a file instead of breaking the query
+	if (c == ch::eol && open_finder_selection(this)) return;
+	// Shortcuts like ctrl+s come through as control characters too
+	if (c < ' ' && c != ch::eol && c != '\t' && c != CH_KEY_BACKSPACE) return;
 
 	reset_cursor_timer();
 	switch (c) {
@@ -34,8 +91,18 @@ void Buffer_View::on_action_entered(const Action_Bind& action) {
 
 }
 
+// Decoded pages a mapped buffer keeps when the system is short on memory
+static const usize low_memory_page_count = 4;
+
 void tick_views(f32 dt) {
+	const bool memory_low = is_memory_low();
+
 	for (Buffer_View* view : views) {
+		if (memory_low) {
+			Buffer* buffer = find_buffer(view->the_buffer);
+			if (buffer && buffer->mapped) buffer->mapped->trim(low_memory_page_count);
+		}
+
 		view->current_scroll_y = ch::interp_to(view->current_scroll_y, view->target_scroll_y, dt, scroll_speed);
 
 		u32 blink_time;
@@ -56,11 +123,189 @@ static const ch::Color foreground_color = 0xd6b58dFF;
 static const ch::Color cursor_color = 0x81E38EFF;
 static const ch::Color selection_color = 0x000EFFFF;
 static const ch::Color selected_text_color = ch::white;
+static const ch::Color changed_byte_color = 0xE3B081FF;
+static const ch::Color find_match_color = 0x2F5A3CFF;
+
+static void immediate_codepoint(u32 c, f32* x, f32 y) {
+	if (c == '\t') {
+		const Font_Glyph* space_glyph = the_font[' '];
+		assert(space_glyph);
+		*x += space_glyph->advance * 4.f;
+		return;
+	}
+
+	ch::Color color = foreground_color;
+	const Font_Glyph* glyph = the_font[c];
+	if (!glyph) {
+		glyph = the_font['?'];
+		color = ch::magenta;
+	}
+
+	immediate_glyph(*glyph, the_font, *x, y, color);
+	*x += glyph->advance;
+}
+
+// Draws only the lines that are on screen. Pages get decoded as we walk into them.
+static void draw_mapped_buffer_view(const Buffer_View& view, Mapped_Text* text, f32 x0, f32 y0, f32 x1, f32 y1) {
+	const f32 font_height = the_font.size;
+	const f32 bar_height = font_height + 1.f;
+
+	the_font.bind();
+	immediate_begin();
+
+	immediate_quad(x0, y0, x1, y1, background_color);
+
+	// @NOTE: draw visible lines
+	{
+		const usize first_line = view.current_scroll_y > 0.f ? (usize)(view.current_scroll_y / font_height) : 0;
+		const usize visible_lines = (usize)((y1 - y0 - bar_height) / font_height) + 1;
+
+		usize line_offset = text->get_line_offset(first_line);
+		f32 y = y0;
+		for (usize i = 0; i < visible_lines && line_offset < text->file.size; i++) {
+			const usize next_line_offset = text->get_next_line_offset(line_offset);
+
+			usize page_index = text->get_page_index(line_offset);
+			const Mapped_Page* page = text->get_page(page_index);
+			usize cp = page ? text->get_codepoint_index(*page, line_offset) : 0;
+
+			f32 x = x0;
+			while (page && x < x1) {
+				if (cp >= page->count) {
+					if (page->byte_end >= next_line_offset) break;
+					page_index += 1;
+					page = text->get_page(page_index);
+					cp = 0;
+					continue;
+				}
+
+				const u32 c = page->codepoints[cp++];
+				if (c == ch::eol) break;
+				// Mapped text isn't normalized, CRLF files still have their '\r'
+				if (c == '\r') continue;
+				immediate_codepoint(c, &x, y);
+			}
+
+			line_offset = next_line_offset;
+			y += font_height;
+		}
+	}
+	// @NOTE: draw info bar
+	{
+		immediate_quad(x0, y1 - bar_height, x1, y1, foreground_color);
+
+		tchar text_buffer[1024];
+		const f32 progress = text->get_index_progress();
+		if (progress < 1.f) {
+			ch::sprintf(text_buffer, CH_TEXT("%llu+ lines (read only, indexing %d%%)"), text->get_known_line_count(), (s32)(progress * 100.f));
+		} else {
+			ch::sprintf(text_buffer, CH_TEXT("%llu lines (read only)"), text->get_known_line_count());
+		}
+		immediate_string(text_buffer, the_font, x0 + 0.5f, (y1 - bar_height) + 0.5f, background_color);
+	}
+	immediate_flush();
+}
+
+// What the info bar says after the line count about the buffer's state on disk
+static const tchar* get_save_text(const Buffer* buffer) {
+	switch (get_save_state(buffer->id)) {
+	case SS_Saving:
+		return CH_TEXT(" (saving)");
+	case SS_Failed:
+		return CH_TEXT(" (save failed)");
+	default:
+		if (has_disk_conflict(buffer->id)) return CH_TEXT("* (changed on disk)");
+		if (buffer->is_dirty()) return CH_TEXT("*");
+		return CH_TEXT("");
+	}
+}
+
+// Offset, hex and ASCII columns for only the rows that are on screen. Every row is hex_row_size bytes so which
+// ones those are comes straight from the scroll position, there's no line index.
+static void draw_binary_buffer_view(const Buffer_View& view, const Buffer* buffer, f32 x0, f32 y0, f32 x1, f32 y1) {
+	const Binary_Data* data = buffer->binary;
+	const f32 font_height = the_font.size;
+	const f32 bar_height = font_height + 1.f;
+
+	the_font.bind();
+	immediate_begin();
+
+	immediate_quad(x0, y0, x1, y1, background_color);
+
+	// @NOTE: draw visible rows
+	{
+		static const char hex_digits[] = "0123456789abcdef";
+		auto draw_char = [](u32 c, f32 x, f32 y, const ch::Color& color) {
+			const Font_Glyph* glyph = the_font[c];
+			if (glyph) immediate_glyph(*glyph, the_font, x, y, color);
+		};
+
+		const f32 cell_width = the_font['0']->advance;
+		const f32 row_height = the_font.ascent - the_font.descent;
+		// Offsets only get wider than 32 bits when the file needs it
+		const s32 offset_digits = data->get_size() > 0xFFFFFFFFull ? 16 : 8;
+		const f32 hex_x = x0 + cell_width * (f32)(offset_digits + 2);
+		const f32 ascii_x = hex_x + cell_width * (f32)(hex_row_size * 3 + 2);
+		const usize cursor_offset = (usize)(view.cursor + 1);
+
+		const usize first_row = view.current_scroll_y > 0.f ? (usize)(view.current_scroll_y / font_height) : 0;
+		const usize visible_rows = (usize)((y1 - y0 - bar_height) / font_height) + 1;
+		const usize last_row = ch::min(first_row + visible_rows, data->get_row_count());
+
+		f32 y = y0;
+		for (usize row = first_row; row < last_row; row++) {
+			const usize row_offset = row * hex_row_size;
+			u8 bytes[hex_row_size];
+			const usize count = data->read(row_offset, bytes, hex_row_size);
+
+			tchar offset_text[32];
+			ch::sprintf(offset_text, CH_TEXT("%0*llx"), offset_digits, (unsigned long long)row_offset);
+			immediate_string(offset_text, the_font, x0, y, foreground_color);
+
+			for (usize i = 0; i < count; i++) {
+				const usize offset = row_offset + i;
+				// A wider gap halfway through the row
+				const f32 x = hex_x + cell_width * (f32)(i * 3 + (i >= hex_row_size / 2 ? 1 : 0));
+				const ch::Color color = data->is_changed(offset) ? changed_byte_color : foreground_color;
+
+				if (offset == cursor_offset && view.show_cursor) {
+					const f32 cursor_x = x + (view.hex_low_nibble ? cell_width : 0.f);
+					immediate_quad(cursor_x, y, cursor_x + cell_width, y + row_height, cursor_color);
+					immediate_quad(ascii_x + cell_width * (f32)i, y, ascii_x + cell_width * (f32)(i + 1), y + row_height, selection_color);
+				}
+				draw_char(hex_digits[bytes[i] >> 4], x, y, color);
+				draw_char(hex_digits[bytes[i] & 0xF], x + cell_width, y, color);
+
+				const u32 c = bytes[i] >= ' ' && bytes[i] < 0x7F ? bytes[i] : '.';
+				draw_char(c, ascii_x + cell_width * (f32)i, y, color);
+			}
+			y += font_height;
+		}
+	}
+	// @NOTE: draw info bar
+	{
+		immediate_quad(x0, y1 - bar_height, x1, y1, foreground_color);
+
+		tchar text_buffer[1024];
+		ch::sprintf(text_buffer, CH_TEXT("%llu bytes (binary)%s"), (unsigned long long)data->get_size(), get_save_text(buffer));
+		immediate_string(text_buffer, the_font, x0 + 0.5f, (y1 - bar_height) + 0.5f, background_color);
+	}
+	immediate_flush();
+}
 
 static void draw_buffer_view(const Buffer_View& view, f32 x0, f32 y0, f32 x1, f32 y1) {
 	const Buffer* buffer = find_buffer(view.the_buffer);
 	assert(buffer);
 
+	if (buffer->mapped) {
+		draw_mapped_buffer_view(view, buffer->mapped, x0, y0, x1, y1);
+		return;
+	}
+	if (buffer->binary) {
+		draw_binary_buffer_view(view, buffer, x0, y0, x1, y1);
+		return;
+	}
+
 	the_font.bind();
 	immediate_begin();
 	const f32 font_height = the_font.size;
@@ -83,10 +328,25 @@ static void draw_buffer_view(const Buffer_View& view, f32 x0, f32 y0, f32 x1, f3
 
 		const f32 original_x = x0;
 		const f32 original_y = y0;
+		const f32 text_bottom = y1 - (font_height + 1.f);
+
+		// Skip everything above the first visible line
+		const usize first_line = view.current_scroll_y > 0.f ? (usize)(view.current_scroll_y / font_height) : 0;
+		usize first_index = 0;
+		for (usize line = 0; line < first_line && line < buffer->eol_table.count; line++) {
+			first_index += buffer->eol_table[line];
+		}
+
+		const Find_Matches* matches = get_find_matches(buffer->id);
+		usize match_index = matches ? matches->find_first_ending_after(first_index) : 0;
 
 		f32 x = original_x;
 		f32 y = original_y;
-		for (usize i = 0; i < gap_buffer.count(); i++) {
+		for (usize i = first_index; i < gap_buffer.count() && y < text_bottom; i++) {
+			if (matches) {
+				while (match_index < matches->count() && (*matches)[match_index].end <= i) match_index += 1;
+			}
+
 			if (gap_buffer[i] == ch::eol) {
 				y += font_height;
 				x = original_x;
@@ -117,13 +377,15 @@ static void draw_buffer_view(const Buffer_View& view, f32 x0, f32 y0, f32 x1, f3
 
 			if (is_in_cursor) {
 				draw_rect_at_char(x, y, *glyph, cursor_color);
+			} else if (matches && match_index < matches->count() && (*matches)[match_index].start <= i) {
+				draw_rect_at_char(x, y, *glyph, find_match_color);
 			}
 			immediate_glyph(*glyph, the_font, x, y, color);
 
 			x += glyph->advance;
 		}
 
-		if (view.cursor + 1 == gap_buffer.count() && show_cursor) draw_rect_at_char(x, y, *the_font[' '], cursor_color);
+		if (view.cursor + 1 == gap_buffer.count() && show_cursor && y < text_bottom) draw_rect_at_char(x, y, *the_font[' '], cursor_color);
 	}
 	// @NOTE(CHall): draw info bar
 	{
@@ -131,8 +393,18 @@ static void draw_buffer_view(const Buffer_View& view, f32 x0, f32 y0, f32 x1, f3
 		const f32 bar_height = font_height + padding.x;
 		immediate_quad(x0, y1 - bar_height, x1, y1, foreground_color);
 
+		const tchar* save_text = get_save_text(buffer);
+
 		tchar text_buffer[1024];
-		ch::sprintf(text_buffer, CH_TEXT("%llu"), buffer->eol_table.count);
+		if (buffer->is_loading()) {
+			const s32 percent = (s32)(get_buffer_load_progress(buffer->loader) * 100.f);
+			ch::sprintf(text_buffer, CH_TEXT("%llu (loading %d%%)%s"), buffer->eol_table.count, percent, save_text);
+		} else if (const Find_Matches* matches = get_find_matches(buffer->id)) {
+			const tchar* searching_text = is_find_done(buffer->id) ? CH_TEXT("") : CH_TEXT(" (searching)");
+			ch::sprintf(text_buffer, CH_TEXT("%llu%s %llu matches%s"), buffer->eol_table.count, save_text, matches->count(), searching_text);
+		} else {
+			ch::sprintf(text_buffer, CH_TEXT("%llu%s"), buffer->eol_table.count, save_text);
+		}
 		immediate_string(text_buffer, the_font, x0 + (padding.x / 2.f), (y1 - bar_height) + (padding.y / 2.f), background_color);
 	}
 	immediate_flush();
@@ -157,7 +429,185 @@ void draw_views() {
 	}
 }
 
+// Caret position after an edit. Carets inside the replaced text go to its start.
+static ssize shift_caret(ssize caret, const Text_Edit& edit) {
+	if (caret < 0) return caret;
+
+	const usize position = (usize)caret + 1;
+	if (position >= edit.index + edit.removed) return (ssize)(position - edit.removed + edit.inserted) - 1;
+	if (position > edit.index) return (ssize)edit.index - 1;
+	return caret;
+}
+
+void shift_view_cursors(Buffer_ID the_buffer, const Text_Edit& edit) {
+	for (Buffer_View* view : views) {
+		if (view->the_buffer != the_buffer) continue;
+		view->cursor = shift_caret(view->cursor, edit);
+		view->selection = shift_caret(view->selection, edit);
+	}
+}
+
+bool get_selected_text(const Buffer_View* view, ch::Array<u32>* out) {
+	const Buffer* buffer = find_buffer(view->the_buffer);
+	if (!buffer || buffer->is_read_only() || buffer->is_binary() || buffer->is_loading() || !view->has_selection()) return false;
+
+	const usize start = (usize)(ch::min(view->cursor, view->selection) + 1);
+	const usize end = (usize)(ch::max(view->cursor, view->selection) + 1);
+	out->reserve(end - start);
+	copy_codepoints(buffer->get_halves(), start, end, out->data + out->count);
+	out->count += end - start;
+	return true;
+}
+
+void find_selection(Buffer_View* view, bool backwards) {
+	ch::Array<u32> text(ch::get_heap_allocator());
+	defer(text.free());
+	if (!get_selected_text(view, &text)) return;
+
+	Buffer* buffer = find_buffer(view->the_buffer);
+	const usize start = (usize)(ch::min(view->cursor, view->selection) + 1);
+	const usize end = (usize)(ch::max(view->cursor, view->selection) + 1);
+	const usize total = buffer->gap_buffer.count();
+
+	Literal_Pattern pattern;
+	pattern.set(text.data, text.count, 0);
+	defer(pattern.free());
+
+	// Every other match gets highlighted as the search over the whole buffer comes in
+	start_find(buffer, text.data, text.count, 0);
+
+	const Buffer_Halves halves = buffer->get_halves();
+	usize found;
+	if (backwards) {
+		found = find_literal_reverse(halves, pattern, 0, start);
+		if (found == no_match) found = find_literal_reverse(halves, pattern, start, total);
+	} else {
+		found = find_literal(halves, pattern, end, total);
+		if (found == no_match) found = find_literal(halves, pattern, 0, end);
+	}
+	if (found == no_match) return;
+
+	view->selection = (ssize)found - 1;
+	view->cursor = (ssize)(found + text.count) - 1;
+	view->reset_cursor_timer();
+
+	// @NOTE: Leaves a few lines above the match so it doesn't end up against the top edge
+	const usize line = buffer->get_line_index(found);
+	view->target_scroll_y = (f32)(line > 4 ? line - 4 : 0) * the_font.size;
+}
+
+// Most words going through completions cycles through
+static const usize max_completions = 16;
+
+// Where the last completion went, so going again goes on from it
+struct Completion_Cycle {
+	Buffer_View* view = nullptr;
+	Buffer_ID the_buffer;
+	u64 version = 0;
+	usize start = 0;
+	// The words to go through one after another, what was typed last
+	ch::Array<u32> text;
+	ch::Array<usize> ends;
+	usize current = 0;
+};
+
+static Completion_Cycle completion_cycle;
+
+void complete_word(Buffer_View* view) {
+	Buffer* buffer = find_buffer(view->the_buffer);
+	if (!buffer || buffer->is_read_only() || buffer->is_binary() || buffer->is_loading()) return;
+
+	Completion_Cycle& cycle = completion_cycle;
+	cycle.text.allocator = ch::get_heap_allocator();
+	cycle.ends.allocator = ch::get_heap_allocator();
+	const usize cursor_end = (usize)(view->cursor + 1);
+
+	auto get_start = [&](usize index) { return index ? cycle.ends[index - 1] : 0; };
+	const bool is_going_on = cycle.view == view && cycle.the_buffer == buffer->id && cycle.version == buffer->version && cycle.ends.count &&
+		cursor_end == cycle.start + cycle.ends[cycle.current] - get_start(cycle.current);
+	if (!is_going_on) {
+		usize start = cursor_end;
+		while (start > 0 && is_name_codepoint(buffer->gap_buffer[start - 1])) start -= 1;
+		if (start == cursor_end) return;
+
+		ch::Array<u32> prefix(ch::get_heap_allocator());
+		defer(prefix.free());
+		prefix.reserve(cursor_end - start);
+		copy_codepoints(buffer->get_halves(), start, cursor_end, prefix.data);
+		prefix.count = cursor_end - start;
+
+		// The word being typed counts as a use of itself, so one more is asked for in case it comes back
+		ch::Array<Word_Completion> completions(ch::get_heap_allocator());
+		defer(completions.free());
+		find_completions(prefix.data, prefix.count, max_completions + 1, &completions);
+
+		cycle.text.count = 0;
+		cycle.ends.count = 0;
+		for (const Word_Completion& completion : completions) {
+			if (completion.count == prefix.count || cycle.ends.count == max_completions) continue;
+			for (usize i = 0; i < completion.count; i++) cycle.text.push(completion.text[i]);
+			cycle.ends.push(cycle.text.count);
+		}
+		if (!cycle.ends.count) return;
+		for (u32 c : prefix) cycle.text.push(c);
+		cycle.ends.push(cycle.text.count);
+
+		cycle.view = view;
+		cycle.the_buffer = buffer->id;
+		cycle.start = start;
+		cycle.current = cycle.ends.count - 1;
+	}
+
+	const usize old_count = cycle.ends[cycle.current] - get_start(cycle.current);
+	cycle.current = (cycle.current + 1) % cycle.ends.count;
+	const usize new_start = get_start(cycle.current);
+	const usize new_count = cycle.ends[cycle.current] - new_start;
+
+	buffer->remove_text(cycle.start, old_count);
+	buffer->insert_text(cycle.start, cycle.text.data + new_start, new_count);
+	cycle.version = buffer->version;
+
+	view->cursor = (ssize)(cycle.start + new_count) - 1;
+	view->selection = view->cursor;
+	view->reset_cursor_timer();
+}
+
+bool show_file(Buffer_View* view, const ch::Path& path, usize line) {
+	// A file that's open already gets shown from its buffer
+	const Buffer* buffer = nullptr;
+	for (Buffer_ID id : get_buffer_ids()) {
+		const Buffer* open = find_buffer(id);
+		if (open && is_same_path(open->full_path, path)) buffer = open;
+	}
+	if (buffer) {
+		fault_in_buffer(buffer->id);
+	} else {
+		buffer = open_file(path);
+		if (!buffer) return false;
+	}
+
+	view->the_buffer = buffer->id;
+	view->cursor = -1;
+	view->selection = -1;
+	view->current_scroll_y = 0.f;
+	view->target_scroll_y = 0.f;
+	view->reset_cursor_timer();
+	if (!line) return true;
+
+	// @NOTE: Only text in memory has line sizes. Anything else just scrolls there.
+	if (!buffer->is_read_only() && !buffer->is_binary()) {
+		usize line_start = 0;
+		for (usize i = 0; i < line && i < buffer->eol_table.count; i++) line_start += buffer->eol_table[i];
+		view->cursor = (ssize)line_start - 1;
+		view->selection = view->cursor;
+	}
+	view->target_scroll_y = (f32)(line > 4 ? line - 4 : 0) * the_font.size;
+	return true;
+}
+
 usize push_view(Buffer_ID the_buffer) {
+	fault_in_buffer(the_buffer);
+
 	Buffer_View* view = ch_new Buffer_View;
 	view->the_buffer = the_buffer;
 	if (!focused_view) focused_view = view;
@@ -165,6 +615,8 @@ usize push_view(Buffer_ID the_buffer) {
 }
 
 usize insert_view(Buffer_ID the_buffer, usize index) {
+	fault_in_buffer(the_buffer);
+
 	Buffer_View* view = ch_new Buffer_View;
 	view->the_buffer = the_buffer;
 	views.insert(view, index);
@@ -179,6 +631,10 @@ bool remove_view(usize view_index) {
 	return true;
 }
 
+usize get_view_count() {
+	return views.count;
+}
+
 Buffer_View* get_view(usize index) {
 	return views[index];
 }
@@ -10,6 +10,8 @@ struct Buffer_View {
 
 	ssize cursor = -1;
 	ssize selection = -1;
+	// Binary buffers are edited a hex digit at a time. Set when the next one goes in the low half of the byte.
+	bool hex_low_nibble = false;
 
 	f32 current_scroll_y = 0.f;
 	f32 target_scroll_y = 0.f;
@@ -34,8 +36,26 @@ extern Buffer_View* hovered_view;
 void tick_views(f32 dt);
 void draw_views();
 
+// Pushes the selected text to out. Returns false when nothing is selected or the buffer isn't text in memory.
+bool get_selected_text(const Buffer_View* view, ch::Array<u32>* out);
+
+// Selects the next copy of what's selected, wrapping around the end of the buffer. Backwards goes to the one before.
+void find_selection(Buffer_View* view, bool backwards);
+
+// Replaces the word in front of the cursor with the most used word of the open buffers that starts with it. Going
+// again right after goes through the others and then back to what was typed.
+void complete_word(Buffer_View* view);
+
+// Shows path in view from its buffer, opening it first when it isn't open. The cursor goes to the start of line,
+// scrolled to with a few lines above it. Returns false when the file can't be opened.
+bool show_file(Buffer_View* view, const ch::Path& path, usize line = 0);
+
+// Moves the cursors of every view on the buffer so they stay on the same text after an edit they didn't make
+void shift_view_cursors(Buffer_ID the_buffer, const Text_Edit& edit);
+
 usize push_view(Buffer_ID the_buffer);
 usize insert_view(Buffer_ID the_buffer, usize index);
 bool remove_view(usize view_index);
+usize get_view_count();
 Buffer_View* get_view(usize index);
 ssize get_view_index(Buffer_View* view);
@@ -0,0 +1,230 @@
+#include "diff.h"
+#include "text_scan.h"
+
+#include <ch_stl/math.h>
+
+// Past this many changed lines the whole stretch between the common start and end just gets replaced
+static const usize max_diff_cost = 1024;
+
+bool diff_lines(const u64* old_lines, usize old_count, const u64* new_lines, usize new_count, Same_Line_Proc same_line, void* user, usize max_cost, ch::Array<Diff_Hunk>* out_hunks) {
+	const ssize n = (ssize)old_count;
+	const ssize m = (ssize)new_count;
+
+	// Furthest x reached on every diagonal k in [-d, d] for each step d, kept for walking back. Entry for k is (k + d) / 2.
+	ch::Array<ssize> trace(ch::get_heap_allocator());
+	ch::Array<usize> trace_starts(ch::get_heap_allocator());
+	defer(trace.free());
+	defer(trace_starts.free());
+
+	auto furthest = [&](ssize d, ssize k) { return trace[trace_starts[d] + (k + d) / 2]; };
+	auto goes_down = [&](ssize d, ssize k) { return k == -d || (k != d && furthest(d - 1, k - 1) < furthest(d - 1, k + 1)); };
+
+	const ssize max_d = (ssize)ch::min(max_cost, old_count + new_count);
+	ssize found = -1;
+	for (ssize d = 0; d <= max_d && found < 0; d++) {
+		trace_starts.push(trace.count);
+		for (ssize k = -d; k <= d; k += 2) {
+			ssize x = 0;
+			if (d) x = goes_down(d, k) ? furthest(d - 1, k + 1) : furthest(d - 1, k - 1) + 1;
+
+			ssize y = x - k;
+			while (x < n && y < m && old_lines[x] == new_lines[y] && same_line(user, (usize)x, (usize)y)) {
+				x += 1;
+				y += 1;
+			}
+			trace.push(x);
+
+			if (x >= n && y >= m) {
+				found = d;
+				break;
+			}
+		}
+	}
+	if (found < 0) return false;
+
+	// Walk back from the end. Every step is one line removed or added, runs of them next to each other make a hunk.
+	const usize first_hunk = out_hunks->count;
+	ssize x = n;
+	ssize y = m;
+	for (ssize d = found; d > 0; d--) {
+		const ssize k = x - y;
+		const bool down = goes_down(d, k);
+		const ssize prev_k = down ? k + 1 : k - 1;
+		const ssize prev_x = furthest(d - 1, prev_k);
+		const ssize prev_y = prev_x - prev_k;
+
+		Diff_Hunk* hunk = out_hunks->count > first_hunk ? &out_hunks->data[out_hunks->count - 1] : nullptr;
+		if (down) {
+			// new_lines[prev_y] added before old_lines[prev_x]
+			if (hunk && hunk->old_start == (usize)prev_x && hunk->new_start == (usize)prev_y + 1) {
+				hunk->new_start -= 1;
+				hunk->new_count += 1;
+			} else {
+				Diff_Hunk added = { (usize)prev_x, 0, (usize)prev_y, 1 };
+				out_hunks->push(added);
+			}
+		} else {
+			// old_lines[prev_x] removed
+			if (hunk && hunk->old_start == (usize)prev_x + 1 && hunk->new_start == (usize)prev_y) {
+				hunk->old_start -= 1;
+				hunk->old_count += 1;
+			} else {
+				Diff_Hunk removed = { (usize)prev_x, 1, (usize)prev_y, 0 };
+				out_hunks->push(removed);
+			}
+		}
+
+		x = prev_x;
+		y = prev_y;
+	}
+
+	// Found back to front
+	for (usize i = first_hunk, j = out_hunks->count; i + 1 < j; i++, j--) {
+		const Diff_Hunk temp = (*out_hunks)[i];
+		(*out_hunks)[i] = (*out_hunks)[j - 1];
+		(*out_hunks)[j - 1] = temp;
+	}
+	return true;
+}
+
+static usize common_prefix(const Buffer_Halves& halves, const u32* text, usize count) {
+	const usize front = ch::min(halves.front_count, count);
+	const usize n = find_mismatch(halves.front, text, front);
+	if (n < halves.front_count || n == count) return n;
+
+	return n + find_mismatch(halves.back, text + n, ch::min(halves.back_count, count - n));
+}
+
+// Like common_prefix from the other end, looking at no more than limit codepoints
+static usize common_suffix(const Buffer_Halves& halves, const u32* text, usize count, usize limit) {
+	const usize back = ch::min(halves.back_count, limit);
+	const usize n = find_mismatch_reverse(halves.back + halves.back_count - back, text + count - back, back);
+	if (n < back || n == limit) return n;
+
+	const usize front = ch::min(halves.front_count, limit - n);
+	return n + find_mismatch_reverse(halves.front + halves.front_count - front, text + count - n - front, front);
+}
+
+CH_FORCEINLINE static u32 get_codepoint(const Buffer_Halves& halves, usize index) {
+	return index < halves.front_count ? halves.front[index] : halves.back[index - halves.front_count];
+}
+
+// Pushes a hash and the start of every line in [start, end) of halves, then end itself
+static void hash_lines(const Buffer_Halves& halves, usize start, usize end, ch::Array<u64>* hashes, ch::Array<usize>* starts) {
+	const u64 fnv_offset = 14695981039346656037ull;
+	const u64 fnv_prime = 1099511628211ull;
+
+	const u32* runs[2] = { halves.front, halves.back };
+	const usize run_starts[2] = { 0, halves.front_count };
+	const usize run_ends[2] = { halves.front_count, halves.front_count + halves.back_count };
+
+	u64 hash = fnv_offset;
+	usize line_start = start;
+	for (usize r = 0; r < 2; r++) {
+		const usize from = ch::max(start, run_starts[r]);
+		const usize to = ch::min(end, run_ends[r]);
+		for (usize i = from; i < to; i++) {
+			const u32 c = runs[r][i - run_starts[r]];
+			hash = (hash ^ c) * fnv_prime;
+			if (c == ch::eol) {
+				hashes->push(hash);
+				starts->push(line_start);
+				hash = fnv_offset;
+				line_start = i + 1;
+			}
+		}
+	}
+	if (line_start < end) {
+		hashes->push(hash);
+		starts->push(line_start);
+	}
+	starts->push(end);
+}
+
+struct Diff_Lines {
+	const Buffer_Halves* halves;
+	const usize* old_starts;
+	const u32* text;
+	const usize* new_starts;
+};
+
+// Compares the codepoints of two lines whose hashes matched
+static bool same_line(void* user, usize old_line, usize new_line) {
+	const Diff_Lines* lines = (const Diff_Lines*)user;
+	const Buffer_Halves& halves = *lines->halves;
+
+	const usize start = lines->old_starts[old_line];
+	const usize count = lines->old_starts[old_line + 1] - start;
+	if (lines->new_starts[new_line + 1] - lines->new_starts[new_line] != count) return false;
+	const u32* text = lines->text + lines->new_starts[new_line];
+
+	usize n = 0;
+	if (start < halves.front_count) {
+		n = ch::min(halves.front_count - start, count);
+		if (find_mismatch(halves.front + start, text, n) < n) return false;
+		if (n == count) return true;
+	}
+	return find_mismatch(halves.back + start + n - halves.front_count, text + n, count - n) == count - n;
+}
+
+void apply_line_diff(Buffer* buffer, const u32* text, usize count, ch::Array<Text_Edit>* out_edits) {
+	const Buffer_Halves halves = buffer->get_halves();
+	const usize old_count = halves.front_count + halves.back_count;
+
+	// @NOTE: Everything the two have in common at either end is skipped with a vectorized compare. Only what's
+	//        left in the middle gets looked at line by line, which is tiny when a file only changed in a few spots.
+	usize prefix = common_prefix(halves, text, count);
+	if (prefix == old_count && prefix == count) return;
+	while (prefix && text[prefix - 1] != ch::eol) prefix -= 1;
+
+	usize suffix = common_suffix(halves, text, count, ch::min(old_count, count) - prefix);
+	usize old_end = old_count - suffix;
+	usize new_end = count - suffix;
+	const bool old_aligned = old_end == prefix || get_codepoint(halves, old_end - 1) == ch::eol;
+	const bool new_aligned = new_end == prefix || text[new_end - 1] == ch::eol;
+	if (!old_aligned || !new_aligned) {
+		// Drop the partial line the suffix starts in
+		const usize skip = find_codepoint(text + new_end, suffix, ch::eol);
+		suffix = skip < suffix ? suffix - skip - 1 : 0;
+		old_end = old_count - suffix;
+		new_end = count - suffix;
+	}
+
+	ch::Array<u64> old_hashes(ch::get_heap_allocator());
+	ch::Array<usize> old_starts(ch::get_heap_allocator());
+	ch::Array<u64> new_hashes(ch::get_heap_allocator());
+	ch::Array<usize> new_starts(ch::get_heap_allocator());
+	ch::Array<Diff_Hunk> hunks(ch::get_heap_allocator());
+	defer(old_hashes.free());
+	defer(old_starts.free());
+	defer(new_hashes.free());
+	defer(new_starts.free());
+	defer(hunks.free());
+
+	Buffer_Halves new_halves = {};
+	new_halves.front = text;
+	new_halves.front_count = count;
+	hash_lines(halves, prefix, old_end, &old_hashes, &old_starts);
+	hash_lines(new_halves, prefix, new_end, &new_hashes, &new_starts);
+
+	Diff_Lines lines = { &halves, old_starts.data, text, new_starts.data };
+	if (!diff_lines(old_hashes.data, old_hashes.count, new_hashes.data, new_hashes.count, same_line, &lines, max_diff_cost, &hunks)) {
+		Diff_Hunk everything = { 0, old_hashes.count, 0, new_hashes.count };
+		hunks.push(everything);
+	}
+
+	// Back to front so the hunks still to go keep their positions
+	for (usize i = hunks.count; i > 0; i--) {
+		const Diff_Hunk& hunk = hunks[i - 1];
+
+		Text_Edit edit;
+		edit.index = old_starts[hunk.old_start];
+		edit.removed = old_starts[hunk.old_start + hunk.old_count] - edit.index;
+		const usize new_start = new_starts[hunk.new_start];
+		edit.inserted = new_starts[hunk.new_start + hunk.new_count] - new_start;
+
+		buffer->remove_text(edit.index, edit.removed);
+		buffer->insert_text(edit.index, text + new_start, edit.inserted);
+		out_edits->push(edit);
+	}
+}
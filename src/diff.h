@@ -0,0 +1,23 @@
+#pragma once
+
+#include "buffer.h"
+
+/* Line level diffing, so a new version of a file can go into its buffer as a few edits instead of a reload. */
+
+struct Diff_Hunk {
+	usize old_start;
+	usize old_count;
+	usize new_start;
+	usize new_count;
+};
+
+// Called when the hashes of two lines match, to rule out a collision
+using Same_Line_Proc = bool(*)(void* user, usize old_line, usize new_line);
+
+// Myers diff over one hash per line. Lines only count as equal when same_line agrees too. Gives up and returns false
+// once more than max_cost lines would have to be added or removed.
+bool diff_lines(const u64* old_lines, usize old_count, const u64* new_lines, usize new_count, Same_Line_Proc same_line, void* user, usize max_cost, ch::Array<Diff_Hunk>* out_hunks);
+
+// Edits buffer until it holds text, touching only the lines that differ. Pushes the edits in the order they were
+// applied, last in the buffer first, so each index is valid against the text as it was before the edit.
+void apply_line_diff(Buffer* buffer, const u32* text, usize count, ch::Array<Text_Edit>* out_edits);
@@ -2,6 +2,7 @@
 #include "editor.h"
 #include "gui.h"
 #include "buffer_view.h"
+#include "io.h"
 
 #define STB_RECT_PACK_IMPLEMENTATION
 #include <stb/stb_rect_pack.h>
@@ -16,8 +17,9 @@ struct Bitmap {
 Font* bound_font;
 
 bool load_font_from_path(const ch::Path& path, Font* out_font) {
-	ch::File_Data fd;
-	if (!ch::load_file_into_memory(path, &fd)) return false;
+	// @NOTE: stbtt keeps pointing into the file data so it lives as long as the font
+	IO_Request fd;
+	if (!io_read_file(path, &fd)) return false;
 
 	Font font = {};
 	stbtt_InitFont(&font.info, (const u8*)fd.data, stbtt_GetFontOffsetForIndex((const u8*)fd.data, 0));
@@ -4,6 +4,24 @@
 #include "gui.h"
 #include "input.h"
 #include "buffer_view.h"
+#include "platform.h"
+#include "jobs.h"
+#include "buffer_loader.h"
+#include "save.h"
+#include "io.h"
+#include "file_watch.h"
+#include "journal.h"
+#include "session.h"
+#include "binary_data.h"
+#include "project_loader.h"
+#include "project_search.h"
+#include "trigram_index.h"
+#include "file_finder.h"
+#include "symbol_index.h"
+#include "word_index.h"
+#include "text_scan.h"
+#include "find.h"
+#include "search.h"
 
 #include <ch_stl/opengl.h>
 #include <ch_stl/time.h>
@@ -16,15 +34,26 @@ Font the_font;
 
 ch::Hash_Table<Buffer_ID, Buffer> buffers(ch::get_heap_allocator());
 
+static ch::Array<Buffer_ID> buffer_ids(ch::get_heap_allocator());
+
 static Buffer_ID last_id = 0;
 
 Buffer* create_buffer() {
 	const Buffer_ID id = last_id++;
 	const usize index = buffers.push(id, Buffer(id));
+	buffer_ids.push(id);
 	return &buffers[index];
 }
 
 bool remove_buffer(Buffer_ID id) {
+	Buffer* buffer = buffers.find(id);
+	if (!buffer) return false;
+
+	unwatch_buffer(id);
+	close_journal(id);
+	stop_find(id);
+	buffer->free();
+	buffer_ids.remove(buffer_ids.find(id));
 	return buffers.remove(id);
 }
 
@@ -32,14 +61,245 @@ Buffer* find_buffer(Buffer_ID id) {
 	return buffers.find(id);
 }
 
+const ch::Array<Buffer_ID>& get_buffer_ids() {
+	return buffer_ids;
+}
+
+// Anything bigger than this is opened read only instead of being decoded into memory
+static const usize mapped_file_threshold = 256 * 1024 * 1024;
+// Anything bigger than this loads in the background so the first screen shows up right away
+static const usize async_load_threshold = 4 * 1024 * 1024;
+
+bool load_file(Buffer* buffer, const ch::Path& path, const Known_Lines* known) {
+	File_Stamp stamp;
+	if (!get_file_stamp(path, &stamp)) return false;
+
+	bool opened;
+	if (is_binary_file(path)) {
+		opened = buffer->open_binary(path);
+	} else if (stamp.size > mapped_file_threshold) {
+		// Only UTF-8 can be mapped, other encodings fall back to a background load
+		opened = buffer->open_mapped(path) || buffer->load_from_path_async(path, known);
+	} else if (stamp.size > async_load_threshold) {
+		opened = buffer->load_from_path_async(path, known);
+	} else {
+		opened = buffer->load_from_path(path, known);
+	}
+	if (!opened) return false;
+
+	watch_buffer(buffer);
+	recover_buffer(buffer);
+	return true;
+}
+
+Buffer* open_file(const ch::Path& path) {
+	Buffer* buffer = create_buffer();
+	if (!load_file(buffer, path)) {
+		remove_buffer(buffer->id);
+		return nullptr;
+	}
+	return buffer;
+}
+
+void open_files(const ch::Path* paths, usize count, ch::Array<Buffer_ID>* out_ids) {
+	ch::Array<IO_Request> requests(ch::get_heap_allocator());
+	ch::Array<File_Stamp> stamps(ch::get_heap_allocator());
+	defer(requests.free());
+	defer(stamps.free());
+
+	for (usize i = 0; i < count; i++) {
+		File_Stamp stamp;
+		if (!get_file_stamp(paths[i], &stamp)) continue;
+
+		if (stamp.size > async_load_threshold) {
+			Buffer* buffer = open_file(paths[i]);
+			if (buffer) out_ids->push(buffer->id);
+			continue;
+		}
+
+		IO_Request request;
+		request.path = paths[i];
+		requests.push(request);
+		stamps.push(stamp);
+	}
+
+	io_read_files(requests.data, requests.count);
+
+	ch::Array<Buffer_ID> opened(ch::get_heap_allocator());
+	defer(opened.free());
+	for (IO_Request& request : requests) {
+		if (!request.succeeded) continue;
+
+		Buffer* buffer = create_buffer();
+		if (looks_binary(request.data, request.size)) {
+			io_free(&request);
+			if (!buffer->open_binary(request.path)) {
+				remove_buffer(buffer->id);
+				continue;
+			}
+		} else {
+			buffer->load_from_memory(request.data, request.size);
+			buffer->full_path = request.path;
+			buffer->disk_stamp = stamps[&request - requests.data];
+			io_free(&request);
+		}
+		watch_buffer(buffer);
+		opened.push(buffer->id);
+		out_ids->push(buffer->id);
+	}
+	recover_buffers(opened.data, opened.count);
+}
+
+// The last directory given on the command line
+static ch::Path project_root;
+static bool has_project_root = false;
+
+// The project's root, or the directory of the view's file without a project
+static bool get_project_root(const Buffer_View* view, ch::Path* out) {
+	if (has_project_root) {
+		*out = project_root;
+		return true;
+	}
+
+	const Buffer* buffer = find_buffer(view->the_buffer);
+	if (!buffer || !buffer->full_path.count) return false;
+
+	ch::Path root = buffer->full_path;
+	while (root.count && root.data[root.count - 1] != '/' && root.data[root.count - 1] != '\\') root.count -= 1;
+	if (root.count > 1) root.count -= 1;
+	root.data[root.count] = 0;
+	if (!root.count) return false;
+	*out = root;
+	return true;
+}
+
+// Searches every file under the project for what's selected
+static void search_project_for_selection(Buffer_View* view) {
+	ch::Array<u32> text(ch::get_heap_allocator());
+	defer(text.free());
+	if (!get_selected_text(view, &text)) return;
+
+	ch::Path root;
+	if (!get_project_root(view, &root)) return;
+	start_project_search(root, text.data, text.count, 0);
+}
+
+// Most definitions going to a name cycles through
+static const usize max_definitions = 64;
+
+// The name go_to_definition went to last and which of its definitions that was
+static ch::Array<u32> definition_name(ch::get_heap_allocator());
+static usize definition_index = 0;
+
+// What's selected, or else the name the cursor is in or right after
+static bool get_name_at_cursor(const Buffer_View* view, ch::Array<u32>* out) {
+	if (get_selected_text(view, out)) return true;
+	const Buffer* buffer = find_buffer(view->the_buffer);
+	if (!buffer || buffer->is_read_only() || buffer->is_binary()) return false;
+
+	const usize total = buffer->gap_buffer.count();
+	usize start = (usize)(view->cursor + 1);
+	usize end = start;
+	while (start > 0 && is_name_codepoint(buffer->gap_buffer[start - 1])) start -= 1;
+	while (end < total && is_name_codepoint(buffer->gap_buffer[end])) end += 1;
+	if (start == end) return false;
+
+	out->reserve(end - start);
+	copy_codepoints(buffer->get_halves(), start, end, out->data + out->count);
+	out->count += end - start;
+	return true;
+}
+
+// Shows where the name at the cursor is defined. Going again from there shows its next definition.
+static void go_to_definition(Buffer_View* view) {
+	ch::Array<u32> name(ch::get_heap_allocator());
+	defer(name.free());
+	if (!get_name_at_cursor(view, &name)) return;
+
+	ch::Path root;
+	if (!get_project_root(view, &root)) return;
+	ch::Array<Symbol_Location> locations(ch::get_heap_allocator());
+	defer(locations.free());
+	if (!find_symbols(root, name.data, name.count, false, max_definitions, &locations) || !locations.count) return;
+
+	bool is_same_name = name.count == definition_name.count;
+	for (usize i = 0; is_same_name && i < name.count; i++) is_same_name = name[i] == definition_name[i];
+	definition_index = is_same_name ? (definition_index + 1) % locations.count : 0;
+	definition_name.count = 0;
+	definition_name.reserve(name.count);
+	for (u32 c : name) definition_name.push(c);
+
+	const Symbol_Location& location = locations[definition_index];
+	if (!show_file(view, location.path, location.line)) return;
+
+	// Selecting the name on its line has going again pick up the same name
+	const Buffer* buffer = find_buffer(view->the_buffer);
+	if (!buffer || buffer->is_read_only() || buffer->is_binary() || location.line >= buffer->eol_table.count) return;
+	const usize line_start = (usize)(view->cursor + 1);
+	const usize line_end = line_start + buffer->eol_table[location.line];
+	for (usize i = line_start; i + name.count <= line_end; i++) {
+		usize matched = 0;
+		while (matched < name.count && buffer->gap_buffer[i + matched] == name[matched]) matched += 1;
+		if (matched < name.count) continue;
+
+		view->selection = (ssize)i - 1;
+		view->cursor = (ssize)(i + name.count) - 1;
+		break;
+	}
+}
+
 static void tick_editor(f32 dt) {
+	tick_buffer_loads();
+	tick_saves();
+	tick_file_watch(dt);
+	tick_journals(dt);
+	tick_project_loads();
+	tick_finds(dt);
+	tick_trigram_index();
+	tick_symbol_index();
+	tick_project_search();
+	tick_file_finder();
+	tick_word_index();
+
+	if (is_key_down(CH_KEY_CONTROL) && is_key_down(CH_KEY_SHIFT) && did_key_go_down('S')) {
+		save_all_buffers();
+	} else if (focused_view && is_key_down(CH_KEY_CONTROL) && did_key_go_down('S')) {
+		Buffer* buffer = find_buffer(focused_view->the_buffer);
+		if (buffer && buffer->full_path.count && !buffer->is_read_only() && !buffer->is_loading()) {
+			save_buffer_async(buffer);
+		}
+	}
+
+	if (focused_view && is_key_down(CH_KEY_CONTROL) && did_key_go_down('F')) {
+		find_selection(focused_view, is_key_down(CH_KEY_SHIFT));
+	}
+
+	if (focused_view && is_key_down(CH_KEY_CONTROL) && is_key_down(CH_KEY_SHIFT) && did_key_go_down('G')) {
+		search_project_for_selection(focused_view);
+	}
+
+	if (focused_view && is_key_down(CH_KEY_CONTROL) && did_key_go_down('P')) {
+		ch::Path root;
+		if (get_project_root(focused_view, &root)) open_file_finder(root);
+	}
+
+	if (focused_view && is_key_down(CH_KEY_CONTROL) && did_key_go_down('D')) {
+		go_to_definition(focused_view);
+	}
+
+	if (focused_view && is_key_down(CH_KEY_CONTROL) && did_key_go_down('N')) {
+		complete_word(focused_view);
+	}
+
 	tick_views(dt);
 }
 
 #if CH_PLATFORM_WINDOWS && !CH_BUILD_DEBUG
 int WinMain(HINSTANCE, HINSTANCE, LPSTR, int) {
+	const int argc = __argc;
+	char** const argv = __argv;
 #else
-int main() {
+int main(int argc, char** argv) {
 #endif
 	const bool gl_loaded = ch::load_gl();
 	assert(gl_loaded);
@@ -54,9 +314,44 @@ int main() {
 
 	init_draw();
 	init_input();
+	init_jobs();
+	init_journals();
+	init_finds();
+	init_word_index();
 
-	Buffer* buffer = create_buffer();
-	push_view(buffer->id);
+	// @NOTE: Files on the command line replace the last session instead of adding to it
+	if (argc > 1) {
+		ch::Array<ch::Path> paths(ch::get_heap_allocator());
+		defer(paths.free());
+		for (int i = 1; i < argc; i++) {
+			const ch::Path path = argv[i];
+			if (is_directory(path)) {
+				start_project_load(path);
+				open_trigram_index(path);
+				open_symbol_index(path);
+				open_path_index(path);
+				watch_project(path);
+				project_root = path;
+				has_project_root = true;
+			} else {
+				paths.push(path);
+			}
+		}
+
+		ch::Array<Buffer_ID> opened(ch::get_heap_allocator());
+		defer(opened.free());
+		open_files(paths.data, paths.count, &opened);
+		for (Buffer_ID id : opened) {
+			push_view(id);
+		}
+	} else {
+		restore_session();
+	}
+
+	if (!focused_view) {
+		Buffer* buffer = create_buffer();
+		push_view(buffer->id);
+	}
 
 	// @TEMP(CHall): Load font and get size
 	{
@@ -80,4 +375,15 @@ int main() {
 		tick_editor(dt);
 		draw_editor();
 	}
+
+	shutdown_project_loads();
+	shutdown_project_search();
+	shutdown_trigram_index();
+	shutdown_symbol_index();
+	shutdown_file_finder();
+	shutdown_finds();
+	shutdown_word_index();
+	shutdown_session();
+	shutdown_journals();
+	shutdown_jobs();
 }
\ No newline at end of file
@@ -8,4 +8,13 @@ extern struct Font the_font;
 
 Buffer* create_buffer();
 bool remove_buffer(Buffer_ID id);
-Buffer* find_buffer(Buffer_ID id);
\ No newline at end of file
+Buffer* find_buffer(Buffer_ID id);
+const ch::Array<Buffer_ID>& get_buffer_ids();
+
+// Loads path into an empty buffer and starts watching it. Big files load in the background and huge ones open as
+// read only mapped views. known is the file's line index from an earlier load, if there is one.
+bool load_file(Buffer* buffer, const ch::Path& path, const Known_Lines* known = nullptr);
+// Same as load_file into a new buffer, which goes away again if loading fails
+Buffer* open_file(const ch::Path& path);
+// Opens many files at once. Small ones are read as one batch instead of a blocking read each. Appends the new buffers to out_ids.
+void open_files(const ch::Path* paths, usize count, ch::Array<Buffer_ID>* out_ids);
\ No newline at end of file
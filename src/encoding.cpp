@@ -0,0 +1,490 @@
+#include "encoding.h"
+#include "simd.h"
+
+// Decodes the sequence at src[i]. Always consumes at least one byte; invalid input yields replacement_char.
+CH_FORCEINLINE static usize decode_utf8_sequence(const u8* src, usize size, usize i, u32* out_c) {
+	const u8 b = src[i];
+	if (b < 0x80) {
+		*out_c = b;
+		return 1;
+	}
+
+	usize len;
+	u32 c;
+	u32 min;
+	if ((b & 0xE0) == 0xC0) {
+		len = 2;
+		c = b & 0x1F;
+		min = 0x80;
+	} else if ((b & 0xF0) == 0xE0) {
+		len = 3;
+		c = b & 0x0F;
+		min = 0x800;
+	} else if ((b & 0xF8) == 0xF0) {
+		len = 4;
+		c = b & 0x07;
+		min = 0x10000;
+	} else {
+		*out_c = replacement_char;
+		return 1;
+	}
+
+	bool valid = i + len <= size;
+	for (usize j = 1; valid && j < len; j++) {
+		const u8 cont = src[i + j];
+		if (!is_utf8_continuation(cont)) valid = false;
+		c = (c << 6) | (cont & 0x3F);
+	}
+	if (!valid || c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+		*out_c = replacement_char;
+		return 1;
+	}
+
+	*out_c = c;
+	return len;
+}
+
+template <bool write>
+static usize decode_utf8(const u8* src, usize size, u32* dst) {
+	usize i = 0;
+	usize n = 0;
+	while (i < size) {
+		// @NOTE: ASCII fast path. Whole blocks of 16 get widened at once, a mixed block copies its ASCII prefix
+		//        and then decodes the rest of the block a sequence at a time.
+		if (i + 16 <= size) {
+			const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+			const u32 high_bits = (u32)_mm_movemask_epi8(v);
+			if (!high_bits) {
+				if (write) widen_bytes_16(v, dst + n);
+				i += 16;
+				n += 16;
+				continue;
+			}
+
+			const usize block_end = i + 16;
+			const usize ascii = count_trailing_zeros(high_bits);
+			for (usize j = 0; j < ascii; j++) {
+				if (write) dst[n] = src[i];
+				n += 1;
+				i += 1;
+			}
+
+			while (i < block_end) {
+				u32 c;
+				i += decode_utf8_sequence(src, size, i, &c);
+				if (write) dst[n] = c;
+				n += 1;
+			}
+			continue;
+		}
+
+		u32 c;
+		i += decode_utf8_sequence(src, size, i, &c);
+		if (write) dst[n] = c;
+		n += 1;
+	}
+
+	return n;
+}
+
+usize utf8_decode(const u8* src, usize size, u32* dst) {
+	return decode_utf8<true>(src, size, dst);
+}
+
+usize utf8_decoded_length(const u8* src, usize size) {
+	return decode_utf8<false>(src, size, nullptr);
+}
+
+usize utf8_complete_prefix(const u8* src, usize size) {
+	// Look at most 3 bytes back for a lead byte whose sequence runs past the end
+	for (usize back = 1; back <= 3 && back <= size; back++) {
+		const u8 b = src[size - back];
+		if (is_utf8_continuation(b)) continue;
+
+		usize len = 1;
+		if ((b & 0xE0) == 0xC0) len = 2;
+		else if ((b & 0xF0) == 0xE0) len = 3;
+		else if ((b & 0xF8) == 0xF0) len = 4;
+
+		if (len > back) return size - back;
+		break;
+	}
+	return size;
+}
+
+usize utf8_align_forward(const u8* src, usize size, usize offset) {
+	for (usize i = 0; i < 3 && offset < size && is_utf8_continuation(src[offset]); i++) {
+		offset += 1;
+	}
+	return offset;
+}
+
+CH_FORCEINLINE static usize encode_utf8_sequence(u32 c, u8* dst) {
+	if (c < 0x80) {
+		dst[0] = (u8)c;
+		return 1;
+	}
+	if (c < 0x800) {
+		dst[0] = (u8)(0xC0 | (c >> 6));
+		dst[1] = (u8)(0x80 | (c & 0x3F));
+		return 2;
+	}
+	if (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) c = replacement_char;
+	if (c < 0x10000) {
+		dst[0] = (u8)(0xE0 | (c >> 12));
+		dst[1] = (u8)(0x80 | ((c >> 6) & 0x3F));
+		dst[2] = (u8)(0x80 | (c & 0x3F));
+		return 3;
+	}
+	dst[0] = (u8)(0xF0 | (c >> 18));
+	dst[1] = (u8)(0x80 | ((c >> 12) & 0x3F));
+	dst[2] = (u8)(0x80 | ((c >> 6) & 0x3F));
+	dst[3] = (u8)(0x80 | (c & 0x3F));
+	return 4;
+}
+
+usize utf8_encode(const u32* src, usize count, u8* dst, usize dst_size, usize* consumed) {
+	const __m128i high_mask = _mm_set1_epi32(~0x7F);
+	const __m128i zero = _mm_setzero_si128();
+
+	usize i = 0;
+	usize n = 0;
+	while (i < count) {
+		// @NOTE: ASCII fast path. Narrow 16 codepoints at once when none of them need more than 7 bits.
+		if (i + 16 <= count && n + 16 <= dst_size) {
+			const __m128i v0 = _mm_loadu_si128((const __m128i*)(src + i + 0));
+			const __m128i v1 = _mm_loadu_si128((const __m128i*)(src + i + 4));
+			const __m128i v2 = _mm_loadu_si128((const __m128i*)(src + i + 8));
+			const __m128i v3 = _mm_loadu_si128((const __m128i*)(src + i + 12));
+			const __m128i any = _mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(any, high_mask), zero)) == 0xFFFF) {
+				const __m128i lo = _mm_packs_epi32(v0, v1);
+				const __m128i hi = _mm_packs_epi32(v2, v3);
+				_mm_storeu_si128((__m128i*)(dst + n), _mm_packus_epi16(lo, hi));
+				i += 16;
+				n += 16;
+				continue;
+			}
+		}
+
+		if (n + max_utf8_sequence > dst_size) {
+			// Might still fit if it's short
+			u8 scratch[max_utf8_sequence];
+			const usize len = encode_utf8_sequence(src[i], scratch);
+			if (n + len > dst_size) break;
+			for (usize j = 0; j < len; j++) dst[n + j] = scratch[j];
+			n += len;
+			i += 1;
+			continue;
+		}
+
+		n += encode_utf8_sequence(src[i], dst + n);
+		i += 1;
+	}
+
+	*consumed = i;
+	return n;
+}
+
+// Looks for invalid sequences. A sequence cut off by the end of src counts as invalid, trim it off first.
+static bool is_valid_utf8(const u8* src, usize size) {
+	usize i = 0;
+	while (i < size) {
+		if (i + 16 <= size && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(src + i)))) {
+			i += 16;
+			continue;
+		}
+
+		u32 c;
+		const usize len = decode_utf8_sequence(src, size, i, &c);
+		// A real U+FFFD is three bytes, a one byte replacement_char means the input was bad
+		if (c == replacement_char && len == 1) return false;
+		i += len;
+	}
+	return true;
+}
+
+// Bytes looked at to guess the encoding when there's no BOM
+static const usize detect_sample_size = 64 * 1024;
+
+Text_Format detect_text_format(const u8* data, usize size, usize* bom_size) {
+	Text_Format result;
+	*bom_size = 0;
+
+	if (size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) {
+		result.bom = true;
+		*bom_size = 3;
+		return result;
+	}
+	if (size >= 2 && ((data[0] == 0xFF && data[1] == 0xFE) || (data[0] == 0xFE && data[1] == 0xFF))) {
+		result.encoding = data[0] == 0xFF ? TE_UTF16LE : TE_UTF16BE;
+		result.bom = true;
+		*bom_size = 2;
+		return result;
+	}
+
+	const usize sample = size < detect_sample_size ? size : detect_sample_size;
+
+	// UTF-16 that is mostly ASCII has a zero in every other byte. Which half they're in gives the byte order.
+	usize even_zeros = 0;
+	usize odd_zeros = 0;
+	usize i = 0;
+	for (; i + 16 <= sample; i += 16) {
+		const u32 zeros = match_bytes_16(data + i, 0);
+		even_zeros += count_bits(zeros & 0x5555);
+		odd_zeros += count_bits(zeros & 0xAAAA);
+	}
+	for (; i < sample; i++) {
+		if (data[i]) continue;
+		if (i & 1) {
+			odd_zeros += 1;
+		} else {
+			even_zeros += 1;
+		}
+	}
+
+	// @NOTE: UTF-16 without a BOM and without much ASCII in it (CJK mostly) isn't caught here
+	const usize units = sample / 2;
+	if (units && odd_zeros * 4 >= units && even_zeros * 8 < odd_zeros) {
+		result.encoding = TE_UTF16LE;
+		return result;
+	}
+	if (units && even_zeros * 4 >= units && odd_zeros * 8 < even_zeros) {
+		result.encoding = TE_UTF16BE;
+		return result;
+	}
+
+	const usize checked = sample < size ? utf8_complete_prefix(data, sample) : sample;
+	if (!is_valid_utf8(data, checked)) result.encoding = TE_Latin1;
+	return result;
+}
+
+bool looks_binary(const u8* data, usize size) {
+	usize bom_size;
+	const Text_Encoding encoding = detect_text_format(data, size, &bom_size).encoding;
+	if (encoding == TE_UTF16LE || encoding == TE_UTF16BE) return false;
+
+	const usize sample = size < detect_sample_size ? size : detect_sample_size;
+	usize i = 0;
+	for (; i + 16 <= sample; i += 16) {
+		if (match_bytes_16(data + i, 0)) return true;
+	}
+	for (; i < sample; i++) {
+		if (!data[i]) return true;
+	}
+	return false;
+}
+
+usize get_code_unit_size(Text_Encoding encoding) {
+	return encoding == TE_UTF16LE || encoding == TE_UTF16BE ? 2 : 1;
+}
+
+CH_FORCEINLINE static u32 load_utf16_unit(const u8* p, bool big_endian) {
+	return big_endian ? ((u32)p[0] << 8) | p[1] : p[0] | ((u32)p[1] << 8);
+}
+
+CH_FORCEINLINE static void store_utf16_unit(u8* p, u32 unit, bool big_endian) {
+	if (big_endian) {
+		p[0] = (u8)(unit >> 8);
+		p[1] = (u8)unit;
+	} else {
+		p[0] = (u8)unit;
+		p[1] = (u8)(unit >> 8);
+	}
+}
+
+CH_FORCEINLINE static __m128i swap_utf16_bytes(__m128i v) {
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+template <bool big_endian>
+static usize decode_utf16(const u8* src, usize size, u32* dst) {
+	const __m128i surrogate_mask = _mm_set1_epi16((s16)0xF800);
+	const __m128i surrogate_bits = _mm_set1_epi16((s16)0xD800);
+	const __m128i zero = _mm_setzero_si128();
+
+	const usize units = size / 2;
+	usize i = 0;
+	usize n = 0;
+	while (i < units) {
+		// @NOTE: Fast path. 8 units without surrogates are 8 codepoints, they only need zero extending.
+		if (i + 8 <= units) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+			if (big_endian) v = swap_utf16_bytes(v);
+
+			const __m128i surrogates = _mm_cmpeq_epi16(_mm_and_si128(v, surrogate_mask), surrogate_bits);
+			if (!_mm_movemask_epi8(surrogates)) {
+				_mm_storeu_si128((__m128i*)(dst + n + 0), _mm_unpacklo_epi16(v, zero));
+				_mm_storeu_si128((__m128i*)(dst + n + 4), _mm_unpackhi_epi16(v, zero));
+				i += 8;
+				n += 8;
+				continue;
+			}
+		}
+
+		const u32 unit = load_utf16_unit(src + i * 2, big_endian);
+		i += 1;
+		if (unit >= 0xD800 && unit <= 0xDBFF && i < units) {
+			const u32 low = load_utf16_unit(src + i * 2, big_endian);
+			if (low >= 0xDC00 && low <= 0xDFFF) {
+				dst[n++] = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+				i += 1;
+				continue;
+			}
+		}
+		dst[n++] = unit >= 0xD800 && unit <= 0xDFFF ? replacement_char : unit;
+	}
+
+	// Odd byte left over
+	if (size & 1) dst[n++] = replacement_char;
+	return n;
+}
+
+template <bool big_endian>
+static usize encode_utf16(const u32* src, usize count, u8* dst, usize dst_size, usize* consumed) {
+	const __m128i limit = _mm_set1_epi32(0xD800);
+	const __m128i minus_one = _mm_set1_epi32(-1);
+	const __m128i bias32 = _mm_set1_epi32(0x8000);
+	const __m128i bias16 = _mm_set1_epi16((s16)0x8000);
+
+	usize i = 0;
+	usize n = 0;
+	while (i < count) {
+		// @NOTE: Fast path. Everything below the surrogates is one unit. The compares are signed so the top bit
+		//        gets ruled out separately.
+		if (i + 8 <= count && n + 16 <= dst_size) {
+			const __m128i v0 = _mm_loadu_si128((const __m128i*)(src + i + 0));
+			const __m128i v1 = _mm_loadu_si128((const __m128i*)(src + i + 4));
+			const __m128i ok0 = _mm_and_si128(_mm_cmplt_epi32(v0, limit), _mm_cmpgt_epi32(v0, minus_one));
+			const __m128i ok1 = _mm_and_si128(_mm_cmplt_epi32(v1, limit), _mm_cmpgt_epi32(v1, minus_one));
+			if (_mm_movemask_epi8(_mm_and_si128(ok0, ok1)) == 0xFFFF) {
+				// SSE2 only packs signed, so shift into signed range, pack, and shift back
+				__m128i packed = _mm_packs_epi32(_mm_sub_epi32(v0, bias32), _mm_sub_epi32(v1, bias32));
+				packed = _mm_add_epi16(packed, bias16);
+				if (big_endian) packed = swap_utf16_bytes(packed);
+				_mm_storeu_si128((__m128i*)(dst + n), packed);
+				i += 8;
+				n += 16;
+				continue;
+			}
+		}
+
+		u32 c = src[i];
+		if (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) c = replacement_char;
+
+		const usize len = c >= 0x10000 ? 4 : 2;
+		if (n + len > dst_size) break;
+		if (c >= 0x10000) {
+			c -= 0x10000;
+			store_utf16_unit(dst + n + 0, 0xD800 + (c >> 10), big_endian);
+			store_utf16_unit(dst + n + 2, 0xDC00 + (c & 0x3FF), big_endian);
+		} else {
+			store_utf16_unit(dst + n, c, big_endian);
+		}
+		n += len;
+		i += 1;
+	}
+
+	*consumed = i;
+	return n;
+}
+
+static usize decode_latin1(const u8* src, usize size, u32* dst) {
+	usize i = 0;
+	for (; i + 16 <= size; i += 16) {
+		widen_bytes_16(_mm_loadu_si128((const __m128i*)(src + i)), dst + i);
+	}
+	for (; i < size; i++) {
+		dst[i] = src[i];
+	}
+	return size;
+}
+
+static usize encode_latin1(const u32* src, usize count, u8* dst, usize dst_size, usize* consumed) {
+	const __m128i high_mask = _mm_set1_epi32(~0xFF);
+	const __m128i zero = _mm_setzero_si128();
+
+	usize i = 0;
+	while (i < count && i < dst_size) {
+		if (i + 16 <= count && i + 16 <= dst_size) {
+			const __m128i v0 = _mm_loadu_si128((const __m128i*)(src + i + 0));
+			const __m128i v1 = _mm_loadu_si128((const __m128i*)(src + i + 4));
+			const __m128i v2 = _mm_loadu_si128((const __m128i*)(src + i + 8));
+			const __m128i v3 = _mm_loadu_si128((const __m128i*)(src + i + 12));
+			const __m128i any = _mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(any, high_mask), zero)) == 0xFFFF) {
+				const __m128i lo = _mm_packs_epi32(v0, v1);
+				const __m128i hi = _mm_packs_epi32(v2, v3);
+				_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+				i += 16;
+				continue;
+			}
+		}
+
+		dst[i] = src[i] < 0x100 ? (u8)src[i] : '?';
+		i += 1;
+	}
+
+	*consumed = i;
+	return i;
+}
+
+usize decode_text(Text_Encoding encoding, const u8* src, usize size, u32* dst) {
+	switch (encoding) {
+	case TE_UTF8: return utf8_decode(src, size, dst);
+	case TE_UTF16LE: return decode_utf16<false>(src, size, dst);
+	case TE_UTF16BE: return decode_utf16<true>(src, size, dst);
+	case TE_Latin1: return decode_latin1(src, size, dst);
+	}
+	return 0;
+}
+
+usize complete_text_prefix(Text_Encoding encoding, const u8* src, usize size) {
+	switch (encoding) {
+	case TE_UTF8: return utf8_complete_prefix(src, size);
+	case TE_UTF16LE:
+	case TE_UTF16BE: {
+		size &= ~(usize)1;
+		// Don't split a surrogate pair
+		if (size >= 2) {
+			const u32 last = load_utf16_unit(src + size - 2, encoding == TE_UTF16BE);
+			if (last >= 0xD800 && last <= 0xDBFF) size -= 2;
+		}
+		return size;
+	}
+	case TE_Latin1: return size;
+	}
+	return size;
+}
+
+usize encode_text(Text_Encoding encoding, const u32* src, usize count, u8* dst, usize dst_size, usize* consumed) {
+	switch (encoding) {
+	case TE_UTF8: return utf8_encode(src, count, dst, dst_size, consumed);
+	case TE_UTF16LE: return encode_utf16<false>(src, count, dst, dst_size, consumed);
+	case TE_UTF16BE: return encode_utf16<true>(src, count, dst, dst_size, consumed);
+	case TE_Latin1: return encode_latin1(src, count, dst, dst_size, consumed);
+	}
+	*consumed = 0;
+	return 0;
+}
+
+usize write_bom(Text_Encoding encoding, u8* dst) {
+	switch (encoding) {
+	case TE_UTF8:
+		dst[0] = 0xEF;
+		dst[1] = 0xBB;
+		dst[2] = 0xBF;
+		return 3;
+	case TE_UTF16LE:
+		dst[0] = 0xFF;
+		dst[1] = 0xFE;
+		return 2;
+	case TE_UTF16BE:
+		dst[0] = 0xFE;
+		dst[1] = 0xFF;
+		return 2;
+	case TE_Latin1:
+		return 0;
+	}
+	return 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <ch_stl/types.h>
+
+const u32 replacement_char = 0xFFFD;
+
+CH_FORCEINLINE bool is_utf8_continuation(u8 b) {
+	return (b & 0xC0) == 0x80;
+}
+
+// Decodes UTF-8 into codepoints. Each invalid byte becomes one replacement_char, so dst must hold at least size codepoints.
+// Returns the amount of codepoints written.
+usize utf8_decode(const u8* src, usize size, u32* dst);
+// Amount of codepoints utf8_decode would produce.
+usize utf8_decoded_length(const u8* src, usize size);
+
+// Length of src without a trailing sequence that got cut off. Used to decode a stream in chunks.
+usize utf8_complete_prefix(const u8* src, usize size);
+
+// Moves offset forward past continuation bytes so it lands on the start of a sequence.
+usize utf8_align_forward(const u8* src, usize size, usize offset);
+
+// Longest UTF-8 sequence a single codepoint can need
+const usize max_utf8_sequence = 4;
+
+// Encodes as much of src as fits in dst_size bytes. Codepoints that can't be encoded become replacement_char.
+// Returns bytes written and sets consumed to the amount of codepoints used up.
+usize utf8_encode(const u32* src, usize count, u8* dst, usize dst_size, usize* consumed);
+
+enum Text_Encoding : u8 {
+	TE_UTF8,
+	TE_UTF16LE,
+	TE_UTF16BE,
+	TE_Latin1,
+};
+
+// How text is stored on disk. Buffers keep it so saving writes the file back the way it came.
+struct Text_Format {
+	Text_Encoding encoding = TE_UTF8;
+	bool bom = false;
+};
+
+// Most bytes a single codepoint takes in any encoding we write
+const usize max_encoded_size = 4;
+const usize max_bom_size = 3;
+
+// Goes by the BOM when there is one, otherwise looks at a sample from the start: UTF-16 if every other byte is
+// mostly zero, UTF-8 if the sample is valid UTF-8, Latin-1 if not. Sets bom_size to the bytes the BOM takes up.
+Text_Format detect_text_format(const u8* data, usize size, usize* bom_size);
+
+// True when the same sample has a NUL byte in it and isn't UTF-16. Text files practically never do.
+bool looks_binary(const u8* data, usize size);
+
+// Bytes of one code unit, which is also how many an ASCII character takes
+usize get_code_unit_size(Text_Encoding encoding);
+
+// Decodes into codepoints. dst must hold at least size codepoints. Returns the amount written.
+usize decode_text(Text_Encoding encoding, const u8* src, usize size, u32* dst);
+// Length of src without a trailing character that got cut off
+usize complete_text_prefix(Text_Encoding encoding, const u8* src, usize size);
+
+// Same contract as utf8_encode. Codepoints Latin-1 can't hold become '?'.
+usize encode_text(Text_Encoding encoding, const u32* src, usize count, u8* dst, usize dst_size, usize* consumed);
+// Writes the BOM for encoding into dst and returns its size. Latin-1 has none.
+usize write_bom(Text_Encoding encoding, u8* dst);
@@ -0,0 +1,632 @@
+#include "file_finder.h"
+#include "editor.h"
+#include "buffer_view.h"
+#include "encoding.h"
+#include "text_scan.h"
+#include "simd.h"
+#include "jobs.h"
+#include "project_walk.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/memory.h>
+
+#include <thread>
+
+// Result lines shown under the query
+static const usize max_finder_results = 100;
+// Paths one job scores before taking the next chunk
+static const usize score_chunk_size = 16 * 1024;
+
+static const s32 score_match = 16;
+static const s32 score_gap_start = -3;
+static const s32 score_gap_extension = -1;
+// Added to every match after the one before it
+static const s32 bonus_consecutive = 4;
+// Added to matches in the file name rather than the directories
+static const s32 bonus_file_name = 2;
+// The first character of the query counts its bonus this many times
+static const s32 first_char_multiplier = 2;
+
+// Bonuses of matching the first byte of a path component, a word or a camel case hump
+static const u8 bonus_component = 8;
+static const u8 bonus_word = 7;
+static const u8 bonus_camel = 6;
+
+struct Path_Entry {
+	u32 text_offset;
+	u32 key_offset;
+	u32 key_count;
+	// Where the file name starts in the key
+	u32 name_start;
+};
+
+struct Path_List {
+	// Relative paths, each followed by a 0
+	ch::Array<tchar> text;
+	// UTF-8 of every path with ASCII folded to lower case. Queries are matched against these.
+	ch::Array<u8> keys;
+	// Bonus of matching each byte of keys
+	ch::Array<u8> bonuses;
+	ch::Array<Path_Entry> entries;
+
+	void init() {
+		text.allocator = ch::get_heap_allocator();
+		keys.allocator = ch::get_heap_allocator();
+		bonuses.allocator = ch::get_heap_allocator();
+		entries.allocator = ch::get_heap_allocator();
+	}
+
+	void free() {
+		text.free();
+		keys.free();
+		bonuses.free();
+		entries.free();
+	}
+
+	void clear() {
+		text.count = 0;
+		keys.count = 0;
+		bonuses.count = 0;
+		entries.count = 0;
+	}
+};
+
+struct Path_Index {
+	Project_Walk walk;
+
+	std::mutex mutex;
+	// Paths walk jobs found that the main thread hasn't taken yet
+	Path_List pending;
+
+	// Main thread only
+	Path_List list;
+};
+
+struct Scored_Path {
+	u32 entry;
+	s32 score;
+	u32 key_count;
+};
+
+static Path_Index* the_paths = nullptr;
+// Walk of the same root started when the finder opens again, replacing the_paths once it's done
+static Path_Index* next_paths = nullptr;
+// Cancelled indexes whose walk jobs haven't all returned yet
+static ch::Array<Path_Index*> dropped_paths;
+
+static Buffer_ID finder_buffer;
+static bool has_finder_buffer = false;
+// Version of the finder buffer the results were made for
+static u64 finder_version = 0;
+
+// Key of the query the results are for
+static ch::Array<u8> query_key;
+// Paths of the_paths that match query_key, in order. Only the first scored_count paths have been looked at.
+static ch::Array<u32> candidates;
+static usize scored_count = 0;
+// Best max_finder_results candidates as a heap with the worst on top
+static ch::Array<Scored_Path> top;
+// Entry of each result line, best first
+static ch::Array<u32> shown;
+
+CH_FORCEINLINE static u8 fold_byte(u8 c) {
+	return c >= 'A' && c <= 'Z' ? (u8)(c + ('a' - 'A')) : c;
+}
+
+CH_FORCEINLINE static bool is_separator(u32 c) {
+	return c == '/' || c == '\\';
+}
+
+CH_FORCEINLINE static bool is_word_break(u32 c) {
+	return c == '_' || c == '-' || c == '.' || c == ' ';
+}
+
+CH_FORCEINLINE static bool is_lower(u32 c) { return c >= 'a' && c <= 'z'; }
+CH_FORCEINLINE static bool is_upper(u32 c) { return c >= 'A' && c <= 'Z'; }
+CH_FORCEINLINE static bool is_digit(u32 c) { return c >= '0' && c <= '9'; }
+
+static u8 get_bonus(u32 prev, u32 c) {
+	if (is_separator(prev)) return bonus_component;
+	if (is_word_break(prev)) return bonus_word;
+	if ((is_lower(prev) && is_upper(c)) || (!is_digit(prev) && is_digit(c))) return bonus_camel;
+	return 0;
+}
+
+// Appends path to list with its key and bonuses
+static void push_path(Path_List* list, const tchar* path, usize count) {
+	Path_Entry entry;
+	entry.text_offset = (u32)list->text.count;
+	entry.key_offset = (u32)list->keys.count;
+	entry.name_start = 0;
+
+	list->text.reserve(count + 1);
+	for (usize i = 0; i < count; i++) list->text.push(path[i]);
+	list->text.push(0);
+
+	list->keys.reserve(count * max_utf8_sequence);
+	list->bonuses.reserve(count * max_utf8_sequence);
+	u32 prev = '/';
+	for (usize i = 0; i < count; i++) {
+		const u32 c = (u32)path[i];
+		u8 bytes[max_utf8_sequence];
+		usize size = 1;
+		// @NOTE: Paths are UTF-8 already where tchar is a byte
+		if (sizeof(tchar) == 1) {
+			bytes[0] = (u8)c;
+		} else {
+			usize consumed;
+			size = utf8_encode(&c, 1, bytes, max_utf8_sequence, &consumed);
+		}
+
+		const usize key_index = list->keys.count - entry.key_offset;
+		if (is_separator(c)) entry.name_start = (u32)key_index + 1;
+		for (usize j = 0; j < size; j++) {
+			list->keys.push(fold_byte(bytes[j]));
+			list->bonuses.push(j ? 0 : get_bonus(prev, c));
+		}
+		prev = c;
+	}
+	entry.key_count = (u32)(list->keys.count - entry.key_offset);
+
+	// @NOTE: Matching loads 16 bytes at a time, so the end of the last key has to be readable that far
+	list->keys.reserve(16);
+	list->entries.push(entry);
+}
+
+// Appends every path of from to list
+static void append_paths(Path_List* list, const Path_List& from) {
+	const u32 text_base = (u32)list->text.count;
+	const u32 key_base = (u32)list->keys.count;
+
+	list->text.reserve(from.text.count);
+	ch::mem_copy(list->text.data + list->text.count, from.text.data, from.text.count * sizeof(tchar));
+	list->text.count += from.text.count;
+
+	list->keys.reserve(from.keys.count + 16);
+	ch::mem_copy(list->keys.data + list->keys.count, from.keys.data, from.keys.count);
+	list->keys.count += from.keys.count;
+
+	list->bonuses.reserve(from.bonuses.count);
+	ch::mem_copy(list->bonuses.data + list->bonuses.count, from.bonuses.data, from.bonuses.count);
+	list->bonuses.count += from.bonuses.count;
+
+	list->entries.reserve(from.entries.count);
+	for (Path_Entry entry : from.entries) {
+		entry.text_offset += text_base;
+		entry.key_offset += key_base;
+		list->entries.push(entry);
+	}
+}
+
+static void add_walked_paths(Project_Walk* walk, const ch::Path* paths, usize count) {
+	Path_Index* index = (Path_Index*)walk->user;
+
+	Path_List batch;
+	batch.init();
+	defer(batch.free());
+	for (usize i = 0; i < count; i++) {
+		usize path_count;
+		const tchar* relative_path = get_relative_path(walk->root, paths[i], &path_count);
+		push_path(&batch, relative_path, path_count);
+	}
+
+	std::lock_guard<std::mutex> lock(index->mutex);
+	append_paths(&index->pending, batch);
+}
+
+static Path_Index* start_path_walk(const ch::Path& root) {
+	Path_Index* index = ch_new Path_Index;
+	init_project_walk(&index->walk, root, (u64)-1, add_walked_paths, index);
+	index->pending.init();
+	index->list.init();
+	push_walk_root(&index->walk);
+	return index;
+}
+
+static void free_path_index(Path_Index* index) {
+	free_project_walk(&index->walk);
+	index->pending.free();
+	index->list.free();
+	ch_delete index;
+}
+
+static void drop_path_index(Path_Index* index) {
+	if (!index) return;
+	index->walk.cancel.store(true);
+	dropped_paths.allocator = ch::get_heap_allocator();
+	dropped_paths.push(index);
+}
+
+// Moves whatever the walk found so far into list
+static void take_pending_paths(Path_Index* index) {
+	std::lock_guard<std::mutex> lock(index->mutex);
+	if (!index->pending.entries.count) return;
+	append_paths(&index->list, index->pending);
+	index->pending.clear();
+}
+
+// Forgets every score so the next tick matches every path again
+static void reset_scores() {
+	candidates.count = 0;
+	scored_count = 0;
+	top.count = 0;
+	shown.count = 0;
+	finder_version = (u64)-1;
+}
+
+// Index of the first byte at or after from that is c, or count when there's none
+CH_FORCEINLINE static usize find_key_byte(const u8* key, usize from, usize count, u8 c) {
+	for (usize i = from; i < count; i += 16) {
+		u32 mask = match_bytes_16(key + i, c);
+		if (count - i < 16) mask &= (1u << (count - i)) - 1;
+		if (mask) return i + count_trailing_zeros(mask);
+	}
+	return count;
+}
+
+// Scores a path that has query in it in order. The shortest run that ends where the first one found does gets scored.
+static bool score_path(const Path_List& list, const Path_Entry& entry, const u8* query, usize count, s32* out_score) {
+	*out_score = 0;
+	if (!count) return true;
+
+	const u8* key = list.keys.data + entry.key_offset;
+	const u8* bonuses = list.bonuses.data + entry.key_offset;
+	usize end = 0;
+	for (usize i = 0; i < count; i++) {
+		end = find_key_byte(key, end, entry.key_count, query[i]);
+		if (end == entry.key_count) return false;
+		end += 1;
+	}
+
+	usize start = end;
+	for (usize i = count; i > 0; i--) {
+		start -= 1;
+		while (key[start] != query[i - 1]) start -= 1;
+	}
+
+	s32 score = 0;
+	usize next = 0;
+	bool in_gap = false;
+	bool after_match = false;
+	for (usize i = start; i < end; i++) {
+		if (key[i] != query[next]) {
+			score += in_gap ? score_gap_extension : score_gap_start;
+			in_gap = true;
+			after_match = false;
+			continue;
+		}
+
+		score += score_match + bonuses[i] * (next ? 1 : first_char_multiplier);
+		if (after_match) score += bonus_consecutive;
+		if (i >= entry.name_start) score += bonus_file_name;
+		in_gap = false;
+		after_match = true;
+		next += 1;
+	}
+	*out_score = score;
+	return true;
+}
+
+// Higher scores first, then shorter paths, then walk order
+CH_FORCEINLINE static bool is_better(const Scored_Path& a, const Scored_Path& b) {
+	if (a.score != b.score) return a.score > b.score;
+	if (a.key_count != b.key_count) return a.key_count < b.key_count;
+	return a.entry < b.entry;
+}
+
+// Puts path in the heap if it's one of the best max_finder_results. Returns whether it went in.
+static bool push_top(ch::Array<Scored_Path>* heap, const Scored_Path& path) {
+	if (heap->count < max_finder_results) {
+		usize i = heap->push(path);
+		while (i > 0) {
+			const usize parent = (i - 1) / 2;
+			if (!is_better((*heap)[parent], (*heap)[i])) break;
+			const Scored_Path temp = (*heap)[parent];
+			(*heap)[parent] = (*heap)[i];
+			(*heap)[i] = temp;
+			i = parent;
+		}
+		return true;
+	}
+
+	if (!is_better(path, (*heap)[0])) return false;
+	(*heap)[0] = path;
+	usize i = 0;
+	for (;;) {
+		const usize left = i * 2 + 1;
+		const usize right = left + 1;
+		usize worst = i;
+		if (left < heap->count && is_better((*heap)[worst], (*heap)[left])) worst = left;
+		if (right < heap->count && is_better((*heap)[worst], (*heap)[right])) worst = right;
+		if (worst == i) break;
+		const Scored_Path temp = (*heap)[worst];
+		(*heap)[worst] = (*heap)[i];
+		(*heap)[i] = temp;
+		i = worst;
+	}
+	return true;
+}
+
+// Paths one job scores. Either the ones indices points at or the range of entries.
+struct Score_Chunk {
+	const u32* indices;
+	usize begin;
+	usize end;
+
+	ch::Array<u32> matched;
+	ch::Array<Scored_Path> top;
+};
+
+static void push_chunks(ch::Array<Score_Chunk>* chunks, const u32* indices, usize begin, usize end) {
+	for (usize i = begin; i < end; i += score_chunk_size) {
+		Score_Chunk chunk;
+		chunk.indices = indices;
+		chunk.begin = i;
+		chunk.end = ch::min(end, i + score_chunk_size);
+		chunk.matched.allocator = ch::get_heap_allocator();
+		chunk.top.allocator = ch::get_heap_allocator();
+		chunks->push(chunk);
+	}
+}
+
+// Scores the paths of query that aren't scored yet. Paths that matched old_key are all that can match a query that
+// has old_key in it in order, so only those are looked at again.
+static bool update_scores(const Path_List& list, const u8* old_key, usize old_count, bool query_changed) {
+	ch::Array<Score_Chunk> chunks(ch::get_heap_allocator());
+	defer(chunks.free());
+
+	ch::Array<u32> old_candidates(ch::get_heap_allocator());
+	defer(old_candidates.free());
+	if (query_changed) {
+		bool narrows = old_count <= query_key.count;
+		for (usize i = 0, j = 0; narrows && i < old_count; i++, j++) {
+			while (j < query_key.count && query_key[j] != old_key[i]) j += 1;
+			narrows = j < query_key.count;
+		}
+
+		if (narrows) {
+			old_candidates = candidates;
+			candidates.data = nullptr;
+			candidates.count = 0;
+			candidates.allocated = 0;
+			candidates.allocator = ch::get_heap_allocator();
+			push_chunks(&chunks, old_candidates.data, 0, old_candidates.count);
+		} else {
+			candidates.count = 0;
+			push_chunks(&chunks, nullptr, 0, scored_count);
+		}
+		top.count = 0;
+	}
+	push_chunks(&chunks, nullptr, scored_count, list.entries.count);
+	scored_count = list.entries.count;
+	if (!chunks.count) return query_changed;
+
+	auto score_chunk = [&](usize index) {
+		Score_Chunk* chunk = &chunks[index];
+		for (usize i = chunk->begin; i < chunk->end; i++) {
+			const u32 entry_index = chunk->indices ? chunk->indices[i] : (u32)i;
+			const Path_Entry& entry = list.entries[entry_index];
+			Scored_Path path;
+			if (!score_path(list, entry, query_key.data, query_key.count, &path.score)) continue;
+			path.entry = entry_index;
+			path.key_count = entry.key_count;
+			chunk->matched.push(entry_index);
+			push_top(&chunk->top, path);
+		}
+	};
+	parallel_for(chunks.count, score_chunk);
+
+	// @NOTE: Chunks are in path order, so candidates stay sorted
+	bool top_changed = query_changed;
+	for (Score_Chunk& chunk : chunks) {
+		for (u32 entry : chunk.matched) candidates.push(entry);
+		for (const Scored_Path& path : chunk.top) {
+			if (push_top(&top, path)) top_changed = true;
+		}
+		chunk.matched.free();
+		chunk.top.free();
+	}
+	return top_changed;
+}
+
+// End of the first line, which is the query
+static usize get_query_end(const Buffer* buffer) {
+	return buffer->eol_table.count > 1 ? buffer->eol_table[0] - 1 : buffer->eol_table[0];
+}
+
+// Replaces everything under the query line with the best results
+static void show_results(Buffer* buffer, const Path_List& list) {
+	ch::Array<Scored_Path> sorted(ch::get_heap_allocator());
+	defer(sorted.free());
+	sorted.reserve(top.count);
+	for (const Scored_Path& path : top) {
+		usize i = sorted.count;
+		sorted.push(path);
+		for (; i > 0 && is_better(sorted[i], sorted[i - 1]); i--) {
+			const Scored_Path temp = sorted[i - 1];
+			sorted[i - 1] = sorted[i];
+			sorted[i] = temp;
+		}
+	}
+
+	ch::Array<u32> text(ch::get_heap_allocator());
+	defer(text.free());
+	shown.count = 0;
+	for (const Scored_Path& path : sorted) {
+		text.push(ch::eol);
+		for (const tchar* c = list.text.data + list.entries[path.entry].text_offset; *c; c++) text.push((u32)*c);
+		shown.push(path.entry);
+	}
+
+	const usize query_end = get_query_end(buffer);
+	buffer->remove_text(query_end, buffer->gap_buffer.count() - query_end);
+	buffer->insert_text(query_end, text.data, text.count);
+
+	// A cursor down in the results stays where it was unless they got shorter than that
+	const ssize last = (ssize)buffer->gap_buffer.count() - 1;
+	for (usize i = 0; i < get_view_count(); i++) {
+		Buffer_View* view = get_view(i);
+		if (view->the_buffer != buffer->id) continue;
+		view->cursor = ch::min(view->cursor, last);
+		view->selection = ch::min(view->selection, last);
+	}
+}
+
+static bool is_same_key(const ch::Array<u8>& a, const ch::Array<u8>& b) {
+	if (a.count != b.count) return false;
+	for (usize i = 0; i < a.count; i++) {
+		if (a[i] != b[i]) return false;
+	}
+	return true;
+}
+
+// UTF-8 of the finder's first line with ASCII folded, the way paths are keyed
+static ch::Array<u8> get_query_key(const Buffer* buffer) {
+	const usize query_end = get_query_end(buffer);
+	ch::Array<u32> query(ch::get_heap_allocator());
+	defer(query.free());
+	query.reserve(query_end);
+	copy_codepoints(buffer->get_halves(), 0, query_end, query.data);
+	query.count = query_end;
+
+	ch::Array<u8> key(ch::get_heap_allocator());
+	key.reserve(query.count * max_utf8_sequence);
+	usize consumed;
+	key.count = utf8_encode(query.data, query.count, key.data, query.count * max_utf8_sequence, &consumed);
+	for (u8& c : key) c = fold_byte(c);
+	return key;
+}
+
+void open_path_index(const ch::Path& root) {
+	if (the_paths && is_same_path(the_paths->walk.root, root)) {
+		// Walking again picks up files made since, the old paths get used until it's done
+		if (the_paths->walk.is_done() && !next_paths) next_paths = start_path_walk(root);
+		return;
+	}
+
+	drop_path_index(the_paths);
+	drop_path_index(next_paths);
+	next_paths = nullptr;
+	the_paths = start_path_walk(root);
+	query_key.allocator = ch::get_heap_allocator();
+	candidates.allocator = ch::get_heap_allocator();
+	top.allocator = ch::get_heap_allocator();
+	shown.allocator = ch::get_heap_allocator();
+	query_key.count = 0;
+	reset_scores();
+}
+
+void open_file_finder(const ch::Path& root) {
+	open_path_index(root);
+
+	Buffer* buffer = has_finder_buffer ? find_buffer(finder_buffer) : nullptr;
+	if (buffer) {
+		buffer->remove_text(0, buffer->gap_buffer.count());
+	} else {
+		buffer = create_buffer();
+		finder_buffer = buffer->id;
+		has_finder_buffer = true;
+	}
+
+	// Every view of the finder starts over on the empty query, the last one gets focus
+	Buffer_View* view = nullptr;
+	for (usize i = 0; i < get_view_count(); i++) {
+		Buffer_View* finder_view = get_view(i);
+		if (finder_view->the_buffer != finder_buffer) continue;
+		finder_view->cursor = -1;
+		finder_view->selection = -1;
+		view = finder_view;
+	}
+	if (!view) view = get_view(push_view(finder_buffer));
+	view->cursor = -1;
+	view->selection = -1;
+	view->reset_cursor_timer();
+	focused_view = view;
+	finder_version = (u64)-1;
+}
+
+bool is_finder_buffer(Buffer_ID id) {
+	return has_finder_buffer && finder_buffer == id;
+}
+
+bool open_finder_selection(Buffer_View* view) {
+	if (!has_finder_buffer || view->the_buffer != finder_buffer || !the_paths) return false;
+	const Buffer* buffer = find_buffer(finder_buffer);
+	if (!buffer) return false;
+
+	const usize line = buffer->get_line_index((usize)(view->cursor + 1));
+	const usize result = line ? line - 1 : 0;
+	if (result >= shown.count) return true;
+
+	const Path_List& list = the_paths->list;
+	ch::Path path = the_paths->walk.root;
+	path.append(list.text.data + list.entries[shown[result]].text_offset);
+
+	show_file(view, path);
+	return true;
+}
+
+void tick_file_finder() {
+	for (usize i = 0; i < dropped_paths.count;) {
+		if (dropped_paths[i]->walk.is_done()) {
+			free_path_index(dropped_paths[i]);
+			dropped_paths.remove(i);
+			continue;
+		}
+		i += 1;
+	}
+
+	if (next_paths && next_paths->walk.is_done()) {
+		take_pending_paths(next_paths);
+		free_path_index(the_paths);
+		the_paths = next_paths;
+		next_paths = nullptr;
+		reset_scores();
+	}
+
+	Path_Index* index = the_paths;
+	if (!index) return;
+	take_pending_paths(index);
+
+	Buffer* buffer = has_finder_buffer ? find_buffer(finder_buffer) : nullptr;
+	if (!buffer) {
+		has_finder_buffer = false;
+		return;
+	}
+	const bool query_changed = buffer->version != finder_version;
+	if (!query_changed && scored_count == index->list.entries.count) return;
+
+	// The query's key only changes when the first line does, edits under it just get the results put back
+	bool key_changed = false;
+	ch::Array<u8> old_key(ch::get_heap_allocator());
+	defer(old_key.free());
+	if (query_changed) {
+		ch::Array<u8> key = get_query_key(buffer);
+		if (!is_same_key(key, query_key)) {
+			old_key = query_key;
+			query_key = key;
+			key_changed = true;
+		} else {
+			key.free();
+		}
+	}
+
+	if (update_scores(index->list, old_key.data, old_key.count, key_changed) || query_changed) show_results(buffer, index->list);
+	finder_version = buffer->version;
+}
+
+void shutdown_file_finder() {
+	drop_path_index(the_paths);
+	drop_path_index(next_paths);
+	the_paths = nullptr;
+	next_paths = nullptr;
+	while (dropped_paths.count) {
+		tick_file_finder();
+		std::this_thread::yield();
+	}
+	dropped_paths.free();
+	query_key.free();
+	candidates.free();
+	top.free();
+	shown.free();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "buffer.h"
+
+#include <ch_stl/filesystem.h>
+
+/* Opening files by typing part of their path. Every path under the project is collected by a walk on the job pool
+   and kept with a lower case copy to match against. A query matches a path when its characters show up in it in
+   order, and matches that start path components, words or camel case humps or that run together score higher.
+
+   The finder is a buffer whose first line is the query and whose other lines are the best matching paths. Every
+   edit of the query scores paths across the pool before the frame is drawn. A query that only adds characters to
+   the last one only looks at the paths the last one matched. */
+
+// Starts collecting the paths under root in the background. Drops the paths of any other root.
+void open_path_index(const ch::Path& root);
+
+// Shows the finder with an empty query and focuses it
+void open_file_finder(const ch::Path& root);
+
+// Opens the result the view's cursor is on in the view, or the best one when the cursor is on the query. Returns
+// false when the view isn't showing the finder.
+bool open_finder_selection(struct Buffer_View* view);
+
+// Whether the buffer is the finder's, which has a query and paths rather than text of its own
+bool is_finder_buffer(Buffer_ID id);
+
+// Takes in walked paths and scores them against the query when it changed. Called once a tick on the main thread.
+void tick_file_finder();
+
+// Stops the walks and waits for them. Called before the job pool goes away.
+void shutdown_file_finder();
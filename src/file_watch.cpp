@@ -0,0 +1,117 @@
+#include "file_watch.h"
+#include "editor.h"
+#include "buffer_view.h"
+#include "save.h"
+#include "trigram_index.h"
+#include "symbol_index.h"
+
+// How long a file has to go without activity before it's reloaded. Build tools tend to write in several goes.
+static const f32 reload_settle_time = 0.1f;
+
+struct Watched_Buffer {
+	Buffer_ID buffer_id;
+	Watch_ID watch_id;
+
+	bool changed;
+	f32 quiet_time;
+	bool conflict;
+};
+
+static ch::Array<Watched_Buffer> watched_buffers;
+
+void watch_buffer(Buffer* buffer) {
+	if (!buffer->full_path.count) return;
+
+	const Watch_ID watch_id = watch_file(buffer->full_path);
+	if (watch_id == invalid_watch_id) return;
+
+	Watched_Buffer watched = {};
+	watched.buffer_id = buffer->id;
+	watched.watch_id = watch_id;
+	watched_buffers.allocator = ch::get_heap_allocator();
+	watched_buffers.push(watched);
+}
+
+void unwatch_buffer(Buffer_ID id) {
+	for (usize i = 0; i < watched_buffers.count; i++) {
+		if (watched_buffers[i].buffer_id != id) continue;
+
+		unwatch_file(watched_buffers[i].watch_id);
+		watched_buffers.remove(i);
+		return;
+	}
+}
+
+void watch_project(const ch::Path& root) {
+	// An index nothing keeps current can't narrow searches down, they walk the tree instead
+	if (!watch_directory_tree(root)) shutdown_trigram_index();
+}
+
+bool has_disk_conflict(Buffer_ID id) {
+	for (const Watched_Buffer& watched : watched_buffers) {
+		if (watched.buffer_id == id) return watched.conflict;
+	}
+	return false;
+}
+
+void tick_file_watch(f32 dt) {
+	ch::Array<ch::Path> tree_changed(ch::get_heap_allocator());
+	defer(tree_changed.free());
+	if (!poll_tree_changes(&tree_changed)) {
+		check_trigram_index();
+		check_symbol_index();
+	}
+	for (const ch::Path& path : tree_changed) {
+		note_file_changed(path);
+		note_symbol_file_changed(path);
+	}
+
+	ch::Array<Watch_ID> changed(ch::get_heap_allocator());
+	defer(changed.free());
+	poll_file_changes(&changed);
+
+	ch::Array<Text_Edit> edits(ch::get_heap_allocator());
+	defer(edits.free());
+
+	for (Watched_Buffer& watched : watched_buffers) {
+		if (changed.find(watched.watch_id) != -1) {
+			watched.changed = true;
+			watched.quiet_time = 0.f;
+			if (const Buffer* buffer = find_buffer(watched.buffer_id)) {
+				note_file_changed(buffer->full_path);
+				note_symbol_file_changed(buffer->full_path);
+			}
+			continue;
+		}
+		if (!watched.changed) continue;
+
+		watched.quiet_time += dt;
+		if (watched.quiet_time < reload_settle_time) continue;
+
+		// Loads and our own saves have to land first, the stamp doesn't mean anything until they do
+		Buffer* buffer = find_buffer(watched.buffer_id);
+		if (!buffer || buffer->is_loading() || get_save_state(buffer->id) == SS_Saving) continue;
+		watched.changed = false;
+
+		// Deleted files keep their buffer as it is
+		File_Stamp stamp;
+		if (!get_file_stamp(buffer->full_path, &stamp)) continue;
+		// Nothing new, like after one of our own saves
+		if (stamp == buffer->disk_stamp) {
+			watched.conflict = false;
+			continue;
+		}
+
+		if (buffer->is_dirty()) {
+			watched.conflict = true;
+			continue;
+		}
+		watched.conflict = false;
+
+		edits.count = 0;
+		if (!buffer->reload_from_path(&edits)) continue;
+		for (const Text_Edit& edit : edits) {
+			shift_view_cursors(buffer->id, edit);
+		}
+	}
+}
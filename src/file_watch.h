@@ -0,0 +1,19 @@
+#pragma once
+
+#include "buffer.h"
+
+/* Keeps buffers in step with their files when something else writes them. Bursts of changes get coalesced until the
+   file has been quiet for a moment, then only the lines that changed are applied to the buffer as edits. The whole
+   tree of the project is watched as well, which keeps its indexes current. */
+
+void watch_buffer(Buffer* buffer);
+void unwatch_buffer(Buffer_ID id);
+
+// Feeds every change under root to the indexes. Called once they're open for root.
+void watch_project(const ch::Path& root);
+
+// True when the file changed while the buffer had unsaved edits, so it was left alone
+bool has_disk_conflict(Buffer_ID id);
+
+// Called once a tick on the main thread
+void tick_file_watch(f32 dt);
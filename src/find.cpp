@@ -0,0 +1,554 @@
+#include "find.h"
+#include "editor.h"
+#include "jobs.h"
+#include "text_scan.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/memory.h>
+
+#include <atomic>
+#include <thread>
+
+// Codepoints each chunk job looks for match starts in
+static const usize find_chunk_size = 1024 * 1024;
+// Seconds a buffer has to go without an edit before a search that fell behind it starts over. Longer than the
+// gap between keystrokes, so typing doesn't pay for a restart on every one.
+static const f32 restart_idle_time = 0.2f;
+
+struct Find_Search;
+
+struct Find_Chunk {
+	Find_Search* search;
+	// Matches that start in [start, end) belong to this chunk
+	usize start;
+	usize end;
+
+	ch::Array<Text_Span> matches;
+	std::atomic<bool> done;
+};
+
+struct Find_Search {
+	Buffer_ID buffer_id;
+	u64 version;
+
+	ch::Array<u32> query_text;
+	Find_Query query;
+
+	// Flat copy of the buffer the jobs read from. Freed once they're all merged.
+	u32* text;
+	usize count;
+
+	ch::Array<Find_Chunk*> chunks;
+	std::atomic<usize> jobs_left;
+	std::atomic<bool> cancel;
+
+	// Main thread only
+	usize next_chunk = 0;
+	bool done = false;
+	// Last version of the buffer seen while this search is behind it, and how long that's held still
+	u64 seen_version = 0;
+	f32 idle_time = 0.f;
+	Find_Matches matches;
+	// Where a search carrying on from the last match taken would look next, and where that match ended
+	usize next_index = 0;
+	usize last_end = no_match;
+	Regex_Cache repair_cache;
+};
+
+static ch::Array<Find_Search*> searches;
+// Searches that were dropped while chunk jobs still had them
+static ch::Array<Find_Search*> dropped_searches;
+
+CH_FORCEINLINE static Buffer_Halves get_snapshot_halves(const Find_Search* search) {
+	Buffer_Halves result = {};
+	result.front = search->text;
+	result.front_count = search->count;
+	return result;
+}
+
+bool Find_Query::compile(const u32* query, usize count, u32 _flags) {
+	flags = _flags;
+	if (!is_regex()) {
+		literal.set(query, count, flags);
+		return true;
+	}
+
+	ch::Array<u32> pattern(ch::get_heap_allocator());
+	defer(pattern.free());
+	const bool whole_word = (flags & SF_Whole_Word) != 0;
+	if (whole_word) {
+		for (const char* p = "\\b(?:"; *p; p++) pattern.push((u32)*p);
+	}
+	for (usize i = 0; i < count; i++) pattern.push(query[i]);
+	if (whole_word) {
+		for (const char* p = ")\\b"; *p; p++) pattern.push((u32)*p);
+	}
+
+	const u32 regex_flags = (flags & SF_Ignore_Case) ? RF_Ignore_Case : 0;
+	return regex.compile(pattern.data, pattern.count, regex_flags);
+}
+
+void Find_Query::free() {
+	if (is_regex()) {
+		regex.free();
+	} else {
+		literal.free();
+	}
+}
+
+// How far past limit a match that starts before it can reach
+static usize get_range_end(const Find_Query& query, const Buffer_Halves& halves, usize limit) {
+	const usize total = halves.front_count + halves.back_count;
+	if (!query.is_regex()) return ch::min(total, limit + query.literal.text.count - 1);
+
+	if (query.regex.line_bounded) {
+		if (limit >= total) return total;
+		return find_codepoint(halves, limit, total, ch::eol);
+	}
+	if (query.regex.max_length != no_match) return ch::min(total, limit + query.regex.max_length);
+	return total;
+}
+
+bool find_next(const Find_Query& query, const Buffer_Halves& halves, Regex_Cache* cache, usize index, usize last_end, usize limit, Regex_Match* out, bool with_groups) {
+	const usize range_end = get_range_end(query, halves, limit);
+
+	if (!query.is_regex()) {
+		const usize at = find_literal(halves, query.literal, index, range_end);
+		if (at == no_match || at >= limit) return false;
+		out->start = at;
+		out->end = at + query.literal.text.count;
+		return true;
+	}
+
+	while (index <= range_end && find_regex(cache, halves, index, range_end, out, with_groups)) {
+		if (out->start >= limit) return false;
+		if (out->start == out->end && out->start == last_end) {
+			index = out->start + 1;
+			continue;
+		}
+		return true;
+	}
+	return false;
+}
+
+CH_FORCEINLINE static usize get_next_index(const Text_Span& match) {
+	return match.end > match.start ? match.end : match.end + 1;
+}
+
+static void run_find_chunk(void* user) {
+	Find_Chunk* chunk = (Find_Chunk*)user;
+	Find_Search* search = chunk->search;
+
+	if (!search->cancel.load(std::memory_order_relaxed)) {
+		Regex_Cache cache;
+		if (search->query.is_regex()) cache.init(&search->query.regex);
+
+		const Buffer_Halves halves = get_snapshot_halves(search);
+		usize index = chunk->start;
+		usize last_end = no_match;
+		Regex_Match match;
+		while (!search->cancel.load(std::memory_order_relaxed) && find_next(search->query, halves, &cache, index, last_end, chunk->end, &match)) {
+			chunk->matches.push({ match.start, match.end });
+			last_end = match.end;
+			index = get_next_index({ match.start, match.end });
+		}
+
+		if (search->query.is_regex()) cache.free();
+	}
+
+	chunk->done.store(true, std::memory_order_release);
+	search->jobs_left.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+static void take_match(Find_Search* search, const Text_Span& match) {
+	search->matches.insert(match);
+	search->last_end = match.end;
+	search->next_index = get_next_index(match);
+}
+
+// Appends a chunk's matches. When the last match taken ran past where the chunk started looking, the chunk's first
+// matches can be out of step with what a search in order would find, so those get found again from where it ended
+// until one lines up with the chunk's.
+static void merge_chunk(Find_Search* search, Find_Chunk* chunk) {
+	usize k = 0;
+	usize chunk_index = chunk->start;
+	while (true) {
+		if (search->next_index <= chunk_index) {
+			for (; k < chunk->matches.count; k++) {
+				const Text_Span& match = chunk->matches[k];
+				if (match.start == match.end && match.start == search->last_end) continue;
+				take_match(search, match);
+			}
+			return;
+		}
+
+		Regex_Match found;
+		if (!find_next(search->query, get_snapshot_halves(search), &search->repair_cache, search->next_index, search->last_end, chunk->end, &found)) return;
+		const Text_Span match = { found.start, found.end };
+		take_match(search, match);
+
+		while (k < chunk->matches.count && chunk->matches[k].start < match.start) k += 1;
+		if (k < chunk->matches.count && chunk->matches[k].start == match.start && chunk->matches[k].end == match.end) {
+			k += 1;
+			chunk_index = search->next_index;
+		}
+	}
+}
+
+static void free_chunks(Find_Search* search) {
+	for (Find_Chunk* chunk : search->chunks) {
+		chunk->matches.free();
+		ch_delete chunk;
+	}
+	search->chunks.free();
+	ch_delete[] search->text;
+	search->text = nullptr;
+}
+
+usize Find_Matches::find_first_ending_after(usize index) const {
+	usize result = 0;
+	usize n = count();
+	while (n > 0) {
+		const usize half = n / 2;
+		if ((*this)[result + half].end <= index) {
+			result += half + 1;
+			n -= half + 1;
+		} else {
+			n = half;
+		}
+	}
+	return result;
+}
+
+void Find_Matches::move_gap(usize index) {
+	assert(index <= count());
+	while (gap > index) {
+		gap -= 1;
+		const Text_Span span = data[gap];
+		data[gap + gap_size] = { text_count - span.start, text_count - span.end };
+	}
+	while (gap < index) {
+		const Text_Span span = data[gap + gap_size];
+		data[gap] = { text_count - span.start, text_count - span.end };
+		gap += 1;
+	}
+}
+
+void Find_Matches::insert(const Text_Span& span) {
+	if (!gap_size) {
+		const usize back = allocated - gap;
+		const usize new_gap_size = ch::max(allocated / 2, (usize)64);
+		const usize new_allocated = allocated + new_gap_size;
+
+		Text_Span* new_data = (Text_Span*)ch::get_heap_allocator().alloc(new_allocated * sizeof(Text_Span));
+		if (data) {
+			ch::mem_copy(new_data, data, gap * sizeof(Text_Span));
+			ch::mem_copy(new_data + gap + new_gap_size, data + gap, back * sizeof(Text_Span));
+			ch::get_heap_allocator().free(data);
+		}
+		data = new_data;
+		allocated = new_allocated;
+		gap_size = new_gap_size;
+	}
+
+	data[gap] = span;
+	gap += 1;
+	gap_size -= 1;
+}
+
+void Find_Matches::remove_after_gap() {
+	assert(gap < count());
+	gap_size += 1;
+}
+
+void Find_Matches::free() {
+	if (data) ch::get_heap_allocator().free(data);
+	data = nullptr;
+	allocated = 0;
+	gap = 0;
+	gap_size = 0;
+}
+
+// Index of the first match that starts at or after index, or count() when there isn't one
+static usize find_first_starting_at(const Find_Matches& matches, usize index) {
+	usize result = 0;
+	usize count = matches.count();
+	while (count > 0) {
+		const usize half = count / 2;
+		if (matches[result + half].start < index) {
+			result += half + 1;
+			count -= half + 1;
+		} else {
+			count = half;
+		}
+	}
+	return result;
+}
+
+// Updates a done search's matches for an edit the buffer already has. Returns false when a match can be any length,
+// then nothing short of searching everything again says which ones changed.
+static bool follow_edit(Find_Search* search, Buffer* buffer, const Text_Edit& edit) {
+	const usize max_length = search->query.get_max_length();
+	if (max_length == no_match && !search->query.regex.line_bounded) return false;
+
+	const Buffer_Halves halves = buffer->get_halves();
+	const usize total = halves.front_count + halves.back_count;
+	const usize edit_end = edit.index + edit.inserted;
+
+	// A match that starts before from can't reach the edit. Past region_end the only matches are ones there were
+	// before, unless a new match runs over them.
+	usize from;
+	usize region_end;
+	if (max_length != no_match) {
+		from = edit.index > max_length ? edit.index - max_length : 0;
+		region_end = ch::min(total, edit_end + max_length);
+	} else {
+		buffer->get_line_index(edit.index, &from);
+		region_end = find_codepoint(halves, edit_end, total, ch::eol);
+	}
+
+	// @NOTE: Matches after the gap are stored from the end of the text, so the ones past the edit are already where
+	//        they need to be once text_count changes. Everything the edit could have changed gets dropped first.
+	Find_Matches& matches = search->matches;
+	matches.move_gap(find_first_starting_at(matches, from));
+	while (matches.gap < matches.count() && matches[matches.gap].start <= edit.index + edit.removed) matches.remove_after_gap();
+	matches.text_count = total;
+
+	usize index = from;
+	usize last_end = no_match;
+	if (matches.gap > 0) {
+		const Text_Span& before = matches.data[matches.gap - 1];
+		index = ch::max(index, get_next_index(before));
+		last_end = before.end;
+	}
+
+	while (true) {
+		// @NOTE: Spots an old match that got run over was covering can hold new matches too
+		while (matches.gap < matches.count() && matches[matches.gap].start < index) {
+			region_end = ch::max(region_end, matches[matches.gap].end);
+			matches.remove_after_gap();
+		}
+		const bool has_next = matches.gap < matches.count();
+		const Text_Span next = has_next ? matches[matches.gap] : Text_Span{ 0, 0 };
+
+		usize limit;
+		if (index <= region_end) {
+			limit = region_end + 1;
+			if (has_next) limit = ch::min(limit, next.start + 1);
+		} else if (has_next) {
+			limit = next.start + 1;
+		} else {
+			break;
+		}
+
+		Regex_Match found;
+		if (!find_next(search->query, halves, &search->repair_cache, index, last_end, limit, &found)) {
+			if (!has_next || limit != next.start + 1) break;
+			region_end = ch::max(region_end, next.end);
+			matches.remove_after_gap();
+			index = limit;
+			continue;
+		}
+		// From a match both agree on everything after it is the same as before
+		const Text_Span match = { found.start, found.end };
+		if (has_next && match.start == next.start && match.end == next.end) break;
+
+		matches.insert(match);
+		last_end = match.end;
+		index = get_next_index(match);
+	}
+	return true;
+}
+
+static void free_search(Find_Search* search) {
+	free_chunks(search);
+	search->matches.free();
+	search->query_text.free();
+	if (search->query.is_regex()) search->repair_cache.free();
+	search->query.free();
+	ch_delete search;
+}
+
+static void drop_search(usize index) {
+	Find_Search* search = searches[index];
+	searches.remove(index);
+	search->cancel.store(true);
+
+	dropped_searches.push(search);
+}
+
+static ssize find_search(Buffer_ID id) {
+	for (usize i = 0; i < searches.count; i++) {
+		if (searches[i]->buffer_id == id) return (ssize)i;
+	}
+	return -1;
+}
+
+static void on_buffer_edit(Buffer* buffer, const Text_Edit& edit, const u32* inserted) {
+	const ssize index = find_search(buffer->id);
+	if (index < 0) return;
+
+	// @NOTE: Searches still running, or that already missed an edit, start over in tick_finds instead
+	Find_Search* search = searches[index];
+	if (!search->done || search->version + 1 != buffer->version) return;
+	if (follow_edit(search, buffer, edit)) search->version = buffer->version;
+}
+
+static bool is_same_query(const Find_Search* search, const u32* query, usize count, u32 flags) {
+	if (search->query.flags != flags || search->query_text.count != count) return false;
+	for (usize i = 0; i < count; i++) {
+		if (search->query_text[i] != query[i]) return false;
+	}
+	return true;
+}
+
+static void start_chunks(Find_Search* search) {
+	// @NOTE: Without a bound on how long a match is, no overlap is enough and the whole text is one chunk
+	const bool unbounded = search->query.get_max_length() == no_match && !search->query.regex.line_bounded;
+	const usize chunk_size = unbounded ? search->count + 1 : find_chunk_size;
+
+	usize start = 0;
+	do {
+		Find_Chunk* chunk = ch_new Find_Chunk;
+		chunk->search = search;
+		chunk->start = start;
+		// The last chunk takes an empty match right at the end of the text too
+		chunk->end = search->count - start <= chunk_size ? search->count + 1 : start + chunk_size;
+		chunk->matches.allocator = ch::get_heap_allocator();
+		chunk->done.store(false);
+		search->chunks.push(chunk);
+		start = chunk->end;
+	} while (start <= search->count);
+
+	search->jobs_left.store(search->chunks.count);
+	for (Find_Chunk* chunk : search->chunks) push_job(run_find_chunk, chunk);
+}
+
+static Find_Search* begin_search(Buffer* buffer, const u32* query, usize count, u32 flags) {
+	Find_Search* search = ch_new Find_Search;
+	search->buffer_id = buffer->id;
+	search->version = buffer->version;
+	search->query_text.allocator = ch::get_heap_allocator();
+	for (usize i = 0; i < count; i++) search->query_text.push(query[i]);
+	search->chunks.allocator = ch::get_heap_allocator();
+	search->cancel.store(false);
+	search->jobs_left.store(0);
+	search->text = nullptr;
+	search->count = 0;
+
+	if (!search->query.compile(query, count, flags)) {
+		search->query_text.free();
+		ch_delete search;
+		return nullptr;
+	}
+	if (search->query.is_regex()) search->repair_cache.init(&search->query.regex);
+
+	// @NOTE: Snapshot is a flat copy of both halves, the same as saving takes
+	const Buffer_Halves halves = buffer->get_halves();
+	search->count = halves.front_count + halves.back_count;
+	search->text = ch_new u32[search->count + 1];
+	ch::mem_copy(search->text, halves.front, halves.front_count * sizeof(u32));
+	ch::mem_copy(search->text + halves.front_count, halves.back, halves.back_count * sizeof(u32));
+	search->matches.text_count = search->count;
+
+	start_chunks(search);
+	return search;
+}
+
+void init_finds() {
+	searches.allocator = ch::get_heap_allocator();
+	dropped_searches.allocator = ch::get_heap_allocator();
+	add_buffer_edit_hook(on_buffer_edit);
+}
+
+bool start_find(Buffer* buffer, const u32* query, usize count, u32 flags) {
+	if (buffer->is_read_only() || buffer->is_binary() || buffer->is_loading()) return false;
+
+	const ssize existing = find_search(buffer->id);
+	if (existing > -1) {
+		const Find_Search* search = searches[existing];
+		if (search->version == buffer->version && is_same_query(search, query, count, flags)) return true;
+		drop_search((usize)existing);
+	}
+	if (!count) return true;
+
+	Find_Search* search = begin_search(buffer, query, count, flags);
+	if (!search) return false;
+
+	searches.push(search);
+	return true;
+}
+
+void stop_find(Buffer_ID id) {
+	const ssize index = find_search(id);
+	if (index > -1) drop_search((usize)index);
+}
+
+const Find_Matches* get_find_matches(Buffer_ID id) {
+	const ssize index = find_search(id);
+	return index > -1 ? &searches[index]->matches : nullptr;
+}
+
+bool is_find_done(Buffer_ID id) {
+	const ssize index = find_search(id);
+	return index > -1 && searches[index]->done;
+}
+
+void tick_finds(f32 dt) {
+	for (usize i = 0; i < dropped_searches.count;) {
+		if (dropped_searches[i]->jobs_left.load(std::memory_order_acquire)) {
+			i += 1;
+			continue;
+		}
+		free_search(dropped_searches[i]);
+		dropped_searches.remove(i);
+	}
+
+	for (usize i = 0; i < searches.count; i++) {
+		Find_Search* search = searches[i];
+
+		// @NOTE: An edit that couldn't be followed makes every offset stale, the search starts over against the buffer
+		//        as it is now. Starting over copies the whole buffer, so it waits until the edits stop coming, or
+		//        typing into a big buffer would pay for a copy every keystroke.
+		Buffer* buffer = find_buffer(search->buffer_id);
+		if (buffer && buffer->version != search->version) {
+			if (buffer->version != search->seen_version) {
+				search->seen_version = buffer->version;
+				search->idle_time = 0.f;
+			} else {
+				search->idle_time += dt;
+			}
+
+			if (search->idle_time >= restart_idle_time) {
+				Find_Search* restarted = begin_search(buffer, search->query_text.data, search->query_text.count, search->query.flags);
+				drop_search(i);
+				searches.insert(restarted, i);
+				continue;
+			}
+		}
+
+		while (search->next_chunk < search->chunks.count) {
+			Find_Chunk* chunk = search->chunks[search->next_chunk];
+			if (!chunk->done.load(std::memory_order_acquire)) break;
+
+			merge_chunk(search, chunk);
+			chunk->matches.free();
+			search->next_chunk += 1;
+		}
+
+		if (!search->done && search->next_chunk == search->chunks.count) {
+			search->done = true;
+			free_chunks(search);
+		}
+	}
+}
+
+void shutdown_finds() {
+	while (searches.count) drop_search(searches.count - 1);
+	while (dropped_searches.count) {
+		tick_finds(0.f);
+		std::this_thread::yield();
+	}
+	searches.free();
+	dropped_searches.free();
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "regex.h"
+
+/* Finding every match of a query in a buffer. The search runs on the job pool against a snapshot of the buffer,
+   split into chunks that overlap by the longest a match can be so none gets cut in two. Each chunk is a job of its
+   own. Finished chunks are merged on the main thread in buffer order as soon as every chunk before them is in, so
+   the first matches show up long before the last chunk is done. Starting a new search of a buffer drops the old one.
+
+   Once a search is done it follows edits to the buffer. Matches after the edit get shifted and only the stretch
+   around it gets searched again, up to where the new matches line back up with the old ones. */
+
+// Matches in buffer order, kept like a gap buffer split where the last edit was. The ones after the gap are stored as
+// distances back from the end of the text, so shifting them for an edit is free.
+struct Find_Matches {
+	Text_Span* data = nullptr;
+	usize allocated = 0;
+	usize gap = 0;
+	usize gap_size = 0;
+	// Length of the text the matches are in
+	usize text_count = 0;
+
+	CH_FORCEINLINE usize count() const { return allocated - gap_size; }
+	CH_FORCEINLINE Text_Span operator[](usize index) const {
+		if (index < gap) return data[index];
+		const Text_Span& span = data[index + gap_size];
+		return { text_count - span.start, text_count - span.end };
+	}
+
+	// Index of the first match that ends after index, or count() when there isn't one
+	usize find_first_ending_after(usize index) const;
+
+	void move_gap(usize index);
+	// Puts span in front of the gap
+	void insert(const Text_Span& span);
+	// Drops the match right after the gap
+	void remove_after_gap();
+	void free();
+};
+
+// A query compiled the way its Search_Flags say. Whole word regexes get wrapped in word boundaries.
+struct Find_Query {
+	u32 flags = 0;
+	Literal_Pattern literal;
+	Regex regex;
+
+	// Returns false when a regex doesn't compile
+	bool compile(const u32* query, usize count, u32 flags);
+	void free();
+
+	CH_FORCEINLINE bool is_regex() const { return (flags & SF_Regex) != 0; }
+	// Most codepoints a match can take, or no_match when there's no limit
+	CH_FORCEINLINE usize get_max_length() const { return is_regex() ? regex.max_length : literal.text.count; }
+};
+
+// The match a search going through the whole text in order finds next from index, as long as it starts before limit.
+// last_end is where the match before it ended, an empty match right there doesn't count. cache is only used by
+// regexes and so are groups.
+bool find_next(const Find_Query& query, const Buffer_Halves& halves, Regex_Cache* cache, usize index, usize last_end, usize limit, Regex_Match* out, bool with_groups = false);
+
+// Hooks buffer edits so done searches follow them
+void init_finds();
+
+// Starts finding every match of query in buffer with Search_Flags. Does nothing when that search is already running
+// or done for the buffer as it is. Returns false when query is a regex that doesn't compile or the buffer isn't text
+// in memory.
+bool start_find(Buffer* buffer, const u32* query, usize count, u32 flags);
+void stop_find(Buffer_ID id);
+
+// Matches merged so far in buffer order, or nullptr when the buffer isn't being searched
+const Find_Matches* get_find_matches(Buffer_ID id);
+// True once every chunk of the buffer's search has been merged
+bool is_find_done(Buffer_ID id);
+
+// Merges finished chunks and restarts searches of buffers that changed in a way edits couldn't be followed, once
+// the edits stop for a moment. Called once a tick on the main thread.
+void tick_finds(f32 dt);
+
+// Stops every search and waits for its jobs. Called before the job pool goes away.
+void shutdown_finds();
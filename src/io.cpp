@@ -0,0 +1,63 @@
+#include "io.h"
+#include "jobs.h"
+#include "platform.h"
+
+static void read_file_blocking(IO_Request* request) {
+	request->succeeded = false;
+
+	Mapped_File file;
+	if (!map_file(request->path, &file)) return;
+
+	request->size = file.size;
+	request->data = ch_new u8[file.size + 1];
+	ch::mem_copy(request->data, file.data, file.size);
+	request->data[file.size] = 0;
+	unmap_file(&file);
+
+	request->succeeded = true;
+}
+
+static void write_file_blocking(IO_Request* request) {
+	request->succeeded = false;
+
+	const OS_File file = create_write_file(request->path);
+	if (file == invalid_os_file) return;
+
+	IO_Slice slice;
+	slice.data = request->data;
+	slice.size = request->size;
+	request->succeeded = write_file_gather(file, &slice, 1) && (!request->sync || sync_os_file(file));
+	close_os_file(file);
+}
+
+void io_read_files(IO_Request* requests, usize count) {
+#if !CH_PLATFORM_WINDOWS
+	if (platform_io_batch(requests, count, false)) return;
+#endif
+
+	run_parallel(count, [](void* user, usize index) {
+		read_file_blocking((IO_Request*)user + index);
+	}, requests);
+}
+
+void io_write_files(IO_Request* requests, usize count) {
+#if !CH_PLATFORM_WINDOWS
+	if (platform_io_batch(requests, count, true)) return;
+#endif
+
+	run_parallel(count, [](void* user, usize index) {
+		write_file_blocking((IO_Request*)user + index);
+	}, requests);
+}
+
+bool io_read_file(const ch::Path& path, IO_Request* out_request) {
+	out_request->path = path;
+	io_read_files(out_request, 1);
+	return out_request->succeeded;
+}
+
+void io_free(IO_Request* request) {
+	if (request->data) ch_delete[] request->data;
+	request->data = nullptr;
+	request->size = 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <ch_stl/filesystem.h>
+
+/* Batched whole file reads and writes. Linux goes through io_uring with a bounded queue depth. Windows, and Linux
+   kernels without io_uring, run blocking I/O on the job pool. */
+
+// Most requests we keep in flight at once
+const usize io_queue_depth = 64;
+
+struct IO_Request {
+	ch::Path path;
+
+	// Reads fill these in, the caller frees data with io_free. Writes read them.
+	u8* data = nullptr;
+	usize size = 0;
+
+	// Writes only. fsync before closing.
+	bool sync = false;
+
+	bool succeeded = false;
+};
+
+void io_read_files(IO_Request* requests, usize count);
+void io_write_files(IO_Request* requests, usize count);
+
+bool io_read_file(const ch::Path& path, IO_Request* out_request);
+void io_free(IO_Request* request);
+
+#if !CH_PLATFORM_WINDOWS
+// Implemented by the posix layer. Returns false if batched I/O isn't available, then the requests are untouched.
+bool platform_io_batch(IO_Request* requests, usize count, bool write);
+#endif
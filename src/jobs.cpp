@@ -0,0 +1,149 @@
+#include "jobs.h"
+
+#include <ch_stl/array.h>
+#include <ch_stl/math.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct Job {
+	Job_Proc proc;
+	void* user;
+};
+
+static std::mutex queue_mutex;
+static std::condition_variable queue_cv;
+static ch::Array<Job> queue;
+static usize queue_head = 0;
+static bool shutting_down = false;
+
+static ch::Array<std::thread*> workers;
+
+static void worker_loop() {
+	for (;;) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			queue_cv.wait(lock, [] { return shutting_down || queue_head < queue.count; });
+			if (queue_head == queue.count) return;
+
+			job = queue[queue_head];
+			queue_head += 1;
+			if (queue_head == queue.count) {
+				queue.count = 0;
+				queue_head = 0;
+			}
+		}
+
+		job.proc(job.user);
+	}
+}
+
+void init_jobs() {
+	queue.allocator = ch::get_heap_allocator();
+	workers.allocator = ch::get_heap_allocator();
+
+	// @NOTE: leave a core for the main thread, it helps out in run_parallel anyway
+	const u32 cores = std::thread::hardware_concurrency();
+	const usize worker_count = cores > 1 ? cores - 1 : 1;
+	for (usize i = 0; i < worker_count; i++) {
+		workers.push(ch_new std::thread(worker_loop));
+	}
+}
+
+void shutdown_jobs() {
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		shutting_down = true;
+	}
+	queue_cv.notify_all();
+
+	for (std::thread* worker : workers) {
+		worker->join();
+		ch_delete worker;
+	}
+	workers.free();
+	queue.free();
+}
+
+usize get_worker_count() {
+	return workers.count;
+}
+
+void push_job(Job_Proc proc, void* user) {
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		Job job;
+		job.proc = proc;
+		job.user = user;
+		queue.push(job);
+	}
+	queue_cv.notify_one();
+}
+
+// Lives on the heap and is refcounted because helpers can get picked up after the caller already returned
+struct Parallel_Batch {
+	Parallel_Proc proc;
+	void* user;
+	usize count;
+
+	std::atomic<usize> next;
+	std::atomic<usize> done;
+	std::atomic<usize> refs;
+
+	std::mutex done_mutex;
+	std::condition_variable done_cv;
+};
+
+static void release_batch(Parallel_Batch* batch) {
+	if (batch->refs.fetch_sub(1) == 1) ch_delete batch;
+}
+
+static void work_on_batch(Parallel_Batch* batch) {
+	for (;;) {
+		const usize index = batch->next.fetch_add(1);
+		if (index >= batch->count) break;
+
+		batch->proc(batch->user, index);
+
+		if (batch->done.fetch_add(1) + 1 == batch->count) {
+			std::lock_guard<std::mutex> lock(batch->done_mutex);
+			batch->done_cv.notify_all();
+		}
+	}
+}
+
+void run_parallel(usize count, Parallel_Proc proc, void* user) {
+	if (!count) return;
+
+	const usize helpers = ch::min(workers.count, count - 1);
+	if (!helpers) {
+		for (usize i = 0; i < count; i++) proc(user, i);
+		return;
+	}
+
+	Parallel_Batch* batch = ch_new Parallel_Batch;
+	batch->proc = proc;
+	batch->user = user;
+	batch->count = count;
+	batch->next.store(0);
+	batch->done.store(0);
+	batch->refs.store(helpers + 1);
+
+	for (usize i = 0; i < helpers; i++) {
+		push_job([](void* user) {
+			Parallel_Batch* batch = (Parallel_Batch*)user;
+			work_on_batch(batch);
+			release_batch(batch);
+		}, batch);
+	}
+
+	work_on_batch(batch);
+	{
+		std::unique_lock<std::mutex> lock(batch->done_mutex);
+		batch->done_cv.wait(lock, [batch] { return batch->done.load() == batch->count; });
+	}
+	release_batch(batch);
+}
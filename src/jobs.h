@@ -0,0 +1,26 @@
+#pragma once
+
+#include <ch_stl/types.h>
+
+/* Worker pool shared by everything that wants to get off the main thread. */
+
+using Job_Proc = void(*)(void* user);
+using Parallel_Proc = void(*)(void* user, usize index);
+
+void init_jobs();
+void shutdown_jobs();
+
+usize get_worker_count();
+
+// Queues proc to run on a worker. Fire and forget, the job owns user.
+void push_job(Job_Proc proc, void* user);
+
+// Runs proc for every index in [0, count) across the pool and returns once all of them are done. The calling thread helps out.
+void run_parallel(usize count, Parallel_Proc proc, void* user);
+
+template <typename F>
+void parallel_for(usize count, F& f) {
+	run_parallel(count, [](void* user, usize index) {
+		(*(F*)user)(index);
+	}, &f);
+}
@@ -0,0 +1,467 @@
+#include "journal.h"
+#include "editor.h"
+#include "buffer_view.h"
+#include "jobs.h"
+#include "encoding.h"
+#include "io.h"
+
+#include <ch_stl/memory.h>
+#include <ch_stl/string.h>
+
+#include <atomic>
+#include <thread>
+
+// How often new edits get written and synced. Edits newer than this are what a crash can cost.
+static const f32 journal_flush_interval = 0.5f;
+
+static const u8 journal_magic[8] = { 'Y', 'E', 'E', 'T', 'J', 'R', 'N', '1' };
+// Magic followed by the stamp of the file the edits apply to
+static const usize journal_header_size = sizeof(journal_magic) + 2 * sizeof(u64);
+
+enum Journal_Record_Kind : u8 {
+	JR_Insert = 1,
+	JR_Remove,
+};
+
+enum Journal_Task {
+	JT_Append,
+	JT_Rewrite,
+	JT_Delete,
+};
+
+// Where the records for a version end in the log, so a save can cut off everything it covered
+struct Journal_Mark {
+	u64 version;
+	usize end;
+};
+
+struct Journal {
+	Buffer_ID buffer_id;
+	ch::Path path;
+	ch::Path temp_path;
+
+	// Main thread only. log holds every record since base_version, which is what the file is supposed to hold
+	// after its header.
+	u64 base_version;
+	File_Stamp base_stamp;
+	ch::Array<u8> log;
+	ch::Array<Journal_Mark> marks;
+	usize written = 0;
+	bool needs_rewrite = true;
+	bool on_disk = false;
+	f32 since_flush = 0.f;
+
+	// A journal from last time that gets applied once the buffer is done loading. Nothing is written until then.
+	IO_Request replay;
+	bool replay_pending = false;
+
+	// Owned by the job while busy is set
+	std::atomic<bool> busy;
+	Journal_Task task;
+	ch::Array<u8> task_bytes;
+	OS_File file = invalid_os_file;
+	bool task_failed = false;
+};
+
+static ch::Array<Journal*> journals;
+static ch::Array<u8> record_scratch;
+
+static Journal* find_journal(Buffer_ID id) {
+	for (Journal* journal : journals) {
+		if (journal->buffer_id == id) return journal;
+	}
+	return nullptr;
+}
+
+// Journals are named after a hash of the full path of the file they're for, in the cache directory
+static bool get_journal_path(const ch::Path& cache_directory, const ch::Path& path, ch::Path* out_path) {
+	tchar name[32];
+	ch::sprintf(name, CH_TEXT("%016llx.recovery"), (unsigned long long)ch::fnv1_hash(path.data, path.count * sizeof(tchar)));
+	*out_path = cache_directory;
+	return append_path_name(out_path, name);
+}
+
+// Null when there's nowhere to put the journal, which leaves the buffer without one
+static Journal* create_journal(Buffer* buffer) {
+	ch::Path cache_directory;
+	if (!get_cache_directory(&cache_directory)) return nullptr;
+
+	ch::Path path;
+	if (!get_journal_path(cache_directory, buffer->full_path, &path)) return nullptr;
+	ch::Path temp_path = path;
+	if (!append_path_suffix(&temp_path, CH_TEXT(".tmp"))) return nullptr;
+
+	Journal* journal = ch_new Journal;
+	journal->buffer_id = buffer->id;
+	journal->base_version = buffer->saved_version;
+	journal->base_stamp = buffer->disk_stamp;
+	journal->log.allocator = ch::get_heap_allocator();
+	journal->marks.allocator = ch::get_heap_allocator();
+	journal->task_bytes.allocator = ch::get_heap_allocator();
+	journal->busy.store(false);
+
+	journal->path = path;
+	journal->temp_path = temp_path;
+
+	journals.push(journal);
+	return journal;
+}
+
+static void put_varint(ch::Array<u8>* out, u64 value) {
+	while (value >= 0x80) {
+		out->push((u8)(value | 0x80));
+		value >>= 7;
+	}
+	out->push((u8)value);
+}
+
+static bool get_varint(const u8* data, usize size, usize* pos, u64* out_value) {
+	u64 value = 0;
+	for (u32 shift = 0; shift < 64; shift += 7) {
+		if (*pos >= size) return false;
+		const u8 b = data[(*pos)++];
+		value |= (u64)(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			*out_value = value;
+			return true;
+		}
+	}
+	return false;
+}
+
+static u32 checksum(const u8* data, usize size) {
+	u32 hash = 2166136261u;
+	for (usize i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static void put_u64(ch::Array<u8>* out, u64 value) {
+	for (usize i = 0; i < sizeof(u64); i++) out->push((u8)(value >> (i * 8)));
+}
+
+static u64 get_u64(const u8* data) {
+	u64 value = 0;
+	for (usize i = 0; i < sizeof(u64); i++) value |= (u64)data[i] << (i * 8);
+	return value;
+}
+
+// Records are framed as payload size, payload, checksum so a write torn by a crash is recognizable on replay
+static void append_record(Journal* journal, Journal_Record_Kind kind, usize index, usize count, const u32* text) {
+	record_scratch.allocator = ch::get_heap_allocator();
+	record_scratch.count = 0;
+	record_scratch.push(kind);
+	put_varint(&record_scratch, index);
+	put_varint(&record_scratch, count);
+	if (kind == JR_Insert) {
+		const usize start = record_scratch.count;
+		for (usize i = 0; i < count * max_utf8_sequence; i++) record_scratch.push(0);
+
+		usize consumed;
+		const usize size = utf8_encode(text, count, record_scratch.data + start, count * max_utf8_sequence, &consumed);
+		record_scratch.count = start + size;
+	}
+
+	ch::Array<u8>& log = journal->log;
+	put_varint(&log, record_scratch.count);
+	for (u8 b : record_scratch) log.push(b);
+
+	const u32 sum = checksum(record_scratch.data, record_scratch.count);
+	for (usize i = 0; i < sizeof(u32); i++) log.push((u8)(sum >> (i * 8)));
+}
+
+static void on_buffer_edit(Buffer* buffer, const Text_Edit& edit, const u32* inserted) {
+	if (!buffer->full_path.count) return;
+
+	Journal* journal = find_journal(buffer->id);
+	if (!journal) journal = create_journal(buffer);
+	if (!journal) return;
+
+	if (edit.removed) append_record(journal, JR_Remove, edit.index, edit.removed, nullptr);
+	if (edit.inserted) append_record(journal, JR_Insert, edit.index, edit.inserted, inserted);
+
+	Journal_Mark mark;
+	mark.version = buffer->version;
+	mark.end = journal->log.count;
+	journal->marks.push(mark);
+}
+
+void init_journals() {
+	journals.allocator = ch::get_heap_allocator();
+	add_buffer_edit_hook(on_buffer_edit);
+}
+
+static void run_journal_task(void* user) {
+	Journal* journal = (Journal*)user;
+
+	IO_Slice slice;
+	slice.data = journal->task_bytes.data;
+	slice.size = journal->task_bytes.count;
+
+	bool succeeded = true;
+	switch (journal->task) {
+	case JT_Append:
+		succeeded = write_file_gather(journal->file, &slice, 1) && sync_os_file(journal->file);
+		break;
+	case JT_Rewrite: {
+		close_os_file(journal->file);
+		journal->file = invalid_os_file;
+
+		// A fresh file renamed into place, so a crash halfway leaves the old journal rather than half of the new one
+		const OS_File temp = create_write_file(journal->temp_path);
+		succeeded = temp != invalid_os_file;
+		if (succeeded) {
+			succeeded = write_file_gather(temp, &slice, 1) && sync_os_file(temp);
+			close_os_file(temp);
+		}
+		succeeded = succeeded && replace_file(journal->temp_path, journal->path);
+		if (succeeded) {
+			journal->file = open_append_file(journal->path);
+			succeeded = journal->file != invalid_os_file;
+		}
+		break;
+	}
+	case JT_Delete:
+		close_os_file(journal->file);
+		journal->file = invalid_os_file;
+		delete_file(journal->path);
+		break;
+	}
+
+	journal->task_failed = !succeeded;
+	journal->busy.store(false, std::memory_order_release);
+}
+
+static void wait_for_task(Journal* journal) {
+	while (journal->busy.load(std::memory_order_acquire)) std::this_thread::yield();
+}
+
+// Hands the next write to the job pool, or runs it right here when inline is set. Returns false if there's nothing to do.
+static bool start_task(Journal* journal, bool inline_task) {
+	ch::Array<u8>& bytes = journal->task_bytes;
+	bytes.count = 0;
+
+	if (!journal->log.count) {
+		if (!journal->on_disk) return false;
+		journal->task = JT_Delete;
+		journal->on_disk = false;
+	} else if (journal->needs_rewrite) {
+		journal->task = JT_Rewrite;
+		for (u8 b : journal_magic) bytes.push(b);
+		put_u64(&bytes, journal->base_stamp.size);
+		put_u64(&bytes, journal->base_stamp.mtime);
+		for (u8 b : journal->log) bytes.push(b);
+		journal->needs_rewrite = false;
+		journal->on_disk = true;
+	} else if (journal->written < journal->log.count) {
+		journal->task = JT_Append;
+		for (usize i = journal->written; i < journal->log.count; i++) bytes.push(journal->log[i]);
+	} else {
+		return false;
+	}
+
+	journal->written = journal->log.count;
+	journal->since_flush = 0.f;
+	journal->busy.store(true);
+	if (inline_task) {
+		run_journal_task(journal);
+	} else {
+		push_job(run_journal_task, journal);
+	}
+	return true;
+}
+
+static void free_journal(Journal* journal) {
+	wait_for_task(journal);
+	close_os_file(journal->file);
+	if (journal->replay_pending) io_free(&journal->replay);
+	journal->log.free();
+	journal->marks.free();
+	journal->task_bytes.free();
+	journals.remove(journals.find(journal));
+	ch_delete journal;
+}
+
+void close_journal(Buffer_ID id) {
+	Journal* journal = find_journal(id);
+	if (!journal) return;
+
+	wait_for_task(journal);
+	if (journal->on_disk) delete_file(journal->path);
+	free_journal(journal);
+}
+
+void shutdown_journals() {
+	// @NOTE: Unsaved edits stay journaled on the way out too, they come back the next time the file is opened
+	while (journals.count) {
+		Journal* journal = journals[0];
+		wait_for_task(journal);
+		if (!journal->replay_pending) start_task(journal, true);
+		free_journal(journal);
+	}
+	journals.free();
+	record_scratch.free();
+}
+
+static void replay_journal(Buffer* buffer, Journal* journal) {
+	journal->replay_pending = false;
+	IO_Request request = journal->replay;
+	defer(io_free(&request));
+
+	const u8* data = request.data;
+	const usize size = request.size;
+	if (size < journal_header_size) return;
+	for (usize i = 0; i < sizeof(journal_magic); i++) {
+		if (data[i] != journal_magic[i]) return;
+	}
+
+	// Edits only make sense against the file they were made to. If it moved on, the journal is set aside in the
+	// cache directory for digging out by hand.
+	File_Stamp base;
+	base.size = get_u64(data + sizeof(journal_magic));
+	base.mtime = get_u64(data + sizeof(journal_magic) + sizeof(u64));
+	if (base != buffer->disk_stamp) {
+		ch::Path stale_path = journal->path;
+		if (append_path_suffix(&stale_path, CH_TEXT(".stale"))) replace_file(journal->path, stale_path);
+		return;
+	}
+
+	ch::Array<u32> text(ch::get_heap_allocator());
+	defer(text.free());
+
+	usize pos = journal_header_size;
+	for (;;) {
+		u64 payload_size;
+		if (!get_varint(data, size, &pos, &payload_size)) break;
+		if (payload_size > size - pos || size - pos - payload_size < sizeof(u32)) break;
+
+		const u8* payload = data + pos;
+		u32 sum = 0;
+		for (usize i = 0; i < sizeof(u32); i++) sum |= (u32)payload[payload_size + i] << (i * 8);
+		if (sum != checksum(payload, payload_size)) break;
+		pos += payload_size + sizeof(u32);
+
+		usize at = 1;
+		u64 index, count;
+		if (!payload_size || !get_varint(payload, payload_size, &at, &index) || !get_varint(payload, payload_size, &at, &count)) break;
+
+		// Views may have had their cursors put back already, they follow the edits like they do a reload's
+		Text_Edit edit = {};
+		edit.index = (usize)index;
+		const usize buffer_count = buffer->gap_buffer.count();
+		if (payload[0] == JR_Remove) {
+			if (index > buffer_count || count > buffer_count - index) break;
+			buffer->remove_text(index, count);
+			edit.removed = (usize)count;
+		} else if (payload[0] == JR_Insert) {
+			if (index > buffer_count) break;
+			text.count = 0;
+			for (usize i = at; i < payload_size; i++) text.push(0);
+			text.count = utf8_decode(payload + at, payload_size - at, text.data);
+			if (text.count != count) break;
+			buffer->insert_text(index, text.data, text.count);
+			edit.inserted = text.count;
+		} else {
+			break;
+		}
+		shift_view_cursors(buffer->id, edit);
+	}
+}
+
+void recover_buffer(Buffer* buffer) {
+	recover_buffers(&buffer->id, 1);
+}
+
+void recover_buffers(const Buffer_ID* ids, usize count) {
+	ch::Path cache_directory;
+	if (!get_cache_directory(&cache_directory)) return;
+
+	ch::Array<IO_Request> requests(ch::get_heap_allocator());
+	ch::Array<Buffer*> recovering(ch::get_heap_allocator());
+	defer(requests.free());
+	defer(recovering.free());
+
+	for (usize i = 0; i < count; i++) {
+		Buffer* buffer = find_buffer(ids[i]);
+		if (!buffer || !buffer->full_path.count || buffer->is_read_only()) continue;
+
+		IO_Request request;
+		if (!get_journal_path(cache_directory, buffer->full_path, &request.path)) continue;
+		requests.push(request);
+		recovering.push(buffer);
+	}
+	if (!requests.count) return;
+
+	// @NOTE: Hardly any file has a journal, finding that out a read at a time would pay for setting up I/O every time
+	io_read_files(requests.data, requests.count);
+
+	for (usize i = 0; i < requests.count; i++) {
+		if (!requests[i].succeeded) continue;
+
+		Buffer* buffer = recovering[i];
+		Journal* journal = find_journal(buffer->id);
+		if (!journal) journal = create_journal(buffer);
+		if (!journal) {
+			io_free(&requests[i]);
+			continue;
+		}
+		journal->replay = requests[i];
+		journal->replay_pending = true;
+		// The file on disk stays until replaying puts the same edits back into log
+		journal->on_disk = true;
+
+		if (!buffer->is_loading()) replay_journal(buffer, journal);
+	}
+}
+
+// After a save or reload only edits newer than saved_version are still worth keeping
+static void rebase_journal(Buffer* buffer, Journal* journal) {
+	usize kept_marks = 0;
+	usize cut = 0;
+	while (kept_marks < journal->marks.count && journal->marks[kept_marks].version <= buffer->saved_version) {
+		cut = journal->marks[kept_marks].end;
+		kept_marks += 1;
+	}
+
+	ch::Array<u8>& log = journal->log;
+	ch::mem_move(log.data, log.data + cut, log.count - cut);
+	log.count -= cut;
+
+	ch::Array<Journal_Mark>& marks = journal->marks;
+	for (usize i = kept_marks; i < marks.count; i++) {
+		marks[i - kept_marks] = marks[i];
+		marks[i - kept_marks].end -= cut;
+	}
+	marks.count -= kept_marks;
+
+	journal->base_version = buffer->saved_version;
+	journal->base_stamp = buffer->disk_stamp;
+	journal->needs_rewrite = true;
+	journal->written = 0;
+}
+
+void tick_journals(f32 dt) {
+	for (Journal* journal : journals) {
+		if (journal->busy.load(std::memory_order_acquire)) continue;
+
+		Buffer* buffer = find_buffer(journal->buffer_id);
+		if (!buffer) continue;
+
+		if (journal->replay_pending) {
+			if (buffer->is_loading()) continue;
+			replay_journal(buffer, journal);
+		}
+
+		if (journal->task_failed) {
+			journal->task_failed = false;
+			journal->needs_rewrite = true;
+		}
+		if (buffer->saved_version != journal->base_version) rebase_journal(buffer, journal);
+
+		// Rewrites are rare and trim the file, so they don't wait for the timer
+		journal->since_flush += dt;
+		const bool due = journal->since_flush >= journal_flush_interval;
+		if (due || journal->needs_rewrite || !journal->log.count) start_task(journal, false);
+	}
+}
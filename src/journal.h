@@ -0,0 +1,22 @@
+#pragma once
+
+#include "buffer.h"
+
+/* Crash recovery. Every edit to a buffer with a file gets appended as a small delta to a journal in the cache
+   directory, named after a hash of the file's path. Appends are grouped and synced on the job pool every so often,
+   so typing never waits on the disk.
+   Once the buffer is saved the journal is cut back to whatever is still unsaved, and removed when that's nothing. */
+
+void init_journals();
+// Writes out whatever hasn't been yet and waits for it. Called before the job pool goes away.
+void shutdown_journals();
+
+// Replays the journal left behind for buffer's file, if there is one. Buffers still loading get it once they're done.
+void recover_buffer(Buffer* buffer);
+// recover_buffer for many buffers at once, looking for their journals in one batch of reads
+void recover_buffers(const Buffer_ID* ids, usize count);
+// Drops the buffer's journal along with its unsaved edits
+void close_journal(Buffer_ID id);
+
+// Called once a tick on the main thread
+void tick_journals(f32 dt);
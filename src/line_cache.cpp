@@ -0,0 +1,133 @@
+#include "line_cache.h"
+#include "mapped_text.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/string.h>
+
+static const u8 line_cache_magic[8] = { 'Y', 'E', 'E', 'T', 'L', 'I', 'X', '1' };
+
+// Pieces hash_file_sample looks at, spread evenly from the first byte to the last
+static const usize sample_count = 8;
+static const usize sample_size = 4096;
+
+struct Line_Cache_Header {
+	u8 magic[8];
+	u64 file_size;
+	u64 file_mtime;
+	u64 sample_hash;
+	u64 line_count;
+	u64 coarse_count;
+	u64 coarse_stride;
+	u64 reserved;
+};
+
+static const u64 fnv_offset = 14695981039346656037ull;
+static const u64 fnv_prime = 1099511628211ull;
+
+static u64 hash_bytes(u64 hash, const u8* data, usize size) {
+	for (usize i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * fnv_prime;
+	}
+	return hash;
+}
+
+u64 hash_file_sample(const Mapped_File& file) {
+	u64 hash = fnv_offset;
+	if (file.size <= sample_count * sample_size) return hash_bytes(hash, file.data, file.size);
+
+	const usize last = file.size - sample_size;
+	for (usize i = 0; i < sample_count; i++) {
+		const usize offset = (usize)((u64)last * i / (sample_count - 1));
+		hash = hash_bytes(hash, file.data + offset, sample_size);
+	}
+	return hash;
+}
+
+// Cache files are named after a hash of the full path of the file they index
+static bool get_line_cache_path(const ch::Path& path, ch::Path* out_path) {
+	if (!get_cache_directory(out_path)) return false;
+
+	const u64 hash = hash_bytes(fnv_offset, (const u8*)path.data, path.count * sizeof(tchar));
+	tchar name[32];
+	ch::sprintf(name, CH_TEXT("%016llx.lines"), (unsigned long long)hash);
+	return append_path_name(out_path, name);
+}
+
+bool open_line_cache(const ch::Path& path, const File_Stamp& stamp, u64 sample_hash, Line_Cache* out_cache) {
+	ch::Path cache_path;
+	if (!get_line_cache_path(path, &cache_path)) return false;
+
+	Mapped_File file;
+	if (!map_file(cache_path, &file)) return false;
+
+	const Line_Cache_Header* header = (const Line_Cache_Header*)file.data;
+	bool valid = file.size >= sizeof(Line_Cache_Header);
+	for (usize i = 0; valid && i < sizeof(line_cache_magic); i++) {
+		valid = header->magic[i] == line_cache_magic[i];
+	}
+	valid = valid && header->file_size == stamp.size && header->file_mtime == stamp.mtime && header->sample_hash == sample_hash;
+	valid = valid && header->coarse_stride == coarse_line_stride && header->line_count > 0;
+	// The first line of every stride gets an offset, starting with line 0
+	valid = valid && header->coarse_count == (header->line_count - 1) / coarse_line_stride + 1;
+	valid = valid && header->coarse_count <= (file.size - sizeof(Line_Cache_Header)) / sizeof(u64);
+	valid = valid && file.size == sizeof(Line_Cache_Header) + header->coarse_count * sizeof(u64);
+
+	const u64* offsets = (const u64*)(file.data + sizeof(Line_Cache_Header));
+	valid = valid && offsets[0] == 0 && offsets[header->coarse_count - 1] <= stamp.size;
+	if (!valid) {
+		unmap_file(&file);
+		return false;
+	}
+
+	out_cache->file = file;
+	out_cache->offsets = offsets;
+	out_cache->coarse_count = (usize)header->coarse_count;
+	out_cache->line_count = (usize)header->line_count;
+	return true;
+}
+
+void close_line_cache(Line_Cache* cache) {
+	unmap_file(&cache->file);
+	*cache = Line_Cache();
+}
+
+bool save_line_cache(const ch::Path& path, const File_Stamp& stamp, u64 sample_hash, usize line_count, const usize* const* blocks, usize coarse_count) {
+	static_assert(sizeof(usize) == sizeof(u64), "Offsets are written straight out of the coarse blocks");
+
+	ch::Path cache_path;
+	if (!get_line_cache_path(path, &cache_path)) return false;
+
+	Line_Cache_Header header = {};
+	ch::mem_copy(header.magic, line_cache_magic, sizeof(line_cache_magic));
+	header.file_size = stamp.size;
+	header.file_mtime = stamp.mtime;
+	header.sample_hash = sample_hash;
+	header.line_count = line_count;
+	header.coarse_count = coarse_count;
+	header.coarse_stride = coarse_line_stride;
+
+	ch::Array<IO_Slice> slices(ch::get_heap_allocator());
+	defer(slices.free());
+
+	IO_Slice header_slice = { &header, sizeof(header) };
+	slices.push(header_slice);
+	for (usize i = 0; i < coarse_count; i += coarse_block_size) {
+		IO_Slice block = { blocks[i / coarse_block_size], ch::min(coarse_count - i, coarse_block_size) * sizeof(usize) };
+		slices.push(block);
+	}
+
+	// Written aside and renamed into place so a reader never maps half a cache
+	ch::Path temp_path = cache_path;
+	if (!append_path_suffix(&temp_path, CH_TEXT(".tmp"))) return false;
+
+	const OS_File file = create_write_file(temp_path);
+	if (file == invalid_os_file) return false;
+	const bool written = write_file_gather(file, slices.data, slices.count);
+	close_os_file(file);
+
+	if (!written || !replace_file(temp_path, cache_path)) {
+		delete_file(temp_path);
+		return false;
+	}
+	return true;
+}
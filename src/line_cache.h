@@ -0,0 +1,24 @@
+#pragma once
+
+#include "platform.h"
+
+/* The coarse line index of a mapped file, saved in the cache directory so opening the same file again doesn't
+   have to scan all of it. A cache file is a fixed header followed by the coarse offsets exactly as they sit in
+   memory, so it's mapped and used in place. Anything that doesn't check out is ignored and the file gets rescanned. */
+
+struct Line_Cache {
+	Mapped_File file;
+
+	const u64* offsets = nullptr;
+	usize coarse_count = 0;
+	usize line_count = 0;
+};
+
+// Hashes a few spread out pieces of file. Together with the stamp it tells whether a cache still describes it.
+u64 hash_file_sample(const Mapped_File& file);
+
+bool open_line_cache(const ch::Path& path, const File_Stamp& stamp, u64 sample_hash, Line_Cache* out_cache);
+void close_line_cache(Line_Cache* cache);
+
+// Writes the index of path. Offsets are in blocks of coarse_block_size.
+bool save_line_cache(const ch::Path& path, const File_Stamp& stamp, u64 sample_hash, usize line_count, const usize* const* blocks, usize coarse_count);
@@ -0,0 +1,161 @@
+#include "line_endings.h"
+#include "text_scan.h"
+#include "simd.h"
+
+#include <ch_stl/memory.h>
+
+Line_Endings::Line_Endings() {
+	exceptions.allocator = ch::get_heap_allocator();
+}
+
+void Line_Endings::free() {
+	exceptions.free();
+	ending = LE_LF;
+}
+
+Line_Endings Line_Endings::copy() const {
+	Line_Endings result;
+	result.ending = ending;
+	result.exceptions.reserve(exceptions.count);
+	result.exceptions.count = exceptions.count;
+	ch::mem_copy(result.exceptions.data, exceptions.data, exceptions.count * sizeof(Line_Ending_Exception));
+	return result;
+}
+
+// Index of the first exception at or after line
+static usize lower_bound(const ch::Array<Line_Ending_Exception>& exceptions, usize line) {
+	usize lo = 0;
+	usize hi = exceptions.count;
+	while (lo < hi) {
+		const usize mid = lo + (hi - lo) / 2;
+		if (exceptions[mid].line < line) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+Line_Ending Line_Endings::get(usize line) const {
+	const usize index = lower_bound(exceptions, line);
+	if (index < exceptions.count && exceptions[index].line == line) return exceptions[index].ending;
+	return ending;
+}
+
+void Line_Endings::on_lines_inserted(usize line, usize count) {
+	// The old ending now belongs to the last of the new lines
+	for (usize i = lower_bound(exceptions, line); i < exceptions.count; i++) {
+		exceptions[i].line += count;
+	}
+}
+
+void Line_Endings::on_lines_removed(usize line, usize count) {
+	// What's left of the lines keeps the ending of the one that got pulled up
+	const usize first = lower_bound(exceptions, line);
+	const usize last = lower_bound(exceptions, line + count);
+	const usize removed = last - first;
+	for (usize i = last; i < exceptions.count; i++) {
+		exceptions[i - removed] = exceptions[i];
+		exceptions[i - removed].line -= count;
+	}
+	exceptions.count -= removed;
+}
+
+void Line_Endings::choose_main_ending(usize eol_count) {
+	usize counts[3] = {};
+	for (const Line_Ending_Exception& it : exceptions) counts[it.ending] += 1;
+	counts[ending] = eol_count - exceptions.count;
+
+	Line_Ending best = ending;
+	for (u8 i = 0; i < 3; i++) {
+		if (counts[i] > counts[best]) best = (Line_Ending)i;
+	}
+	if (best == ending) return;
+
+	// @NOTE: Only mixed files where the first line lied about the style get here
+	ch::Array<Line_Ending_Exception> rebuilt(ch::get_heap_allocator());
+	rebuilt.reserve(eol_count - counts[best]);
+	usize next = 0;
+	for (usize line = 0; line < eol_count; line++) {
+		Line_Ending line_ending = ending;
+		if (next < exceptions.count && exceptions[next].line == line) {
+			line_ending = exceptions[next].ending;
+			next += 1;
+		}
+		if (line_ending == best) continue;
+
+		Line_Ending_Exception exception;
+		exception.line = line;
+		exception.ending = line_ending;
+		rebuilt.push(exception);
+	}
+
+	exceptions.free();
+	exceptions = rebuilt;
+	ending = best;
+}
+
+// Index of the first '\n' or '\r' in p, or count
+static usize find_line_break(const u32* p, usize count) {
+	usize i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const u32 mask = match_codepoints_16(p + i, '\n') | match_codepoints_16(p + i, '\r');
+		if (mask) return i + count_trailing_zeros(mask);
+	}
+	for (; i < count; i++) {
+		if (p[i] == '\n' || p[i] == '\r') return i;
+	}
+	return count;
+}
+
+Line_Ending detect_line_ending(const u32* text, usize count) {
+	const usize at = find_line_break(text, count);
+	if (at == count || text[at] == '\n') return LE_LF;
+	if (at + 1 < count && text[at + 1] == '\n') return LE_CRLF;
+	return LE_CR;
+}
+
+usize normalize_line_endings(u32* text, usize count, Line_Ending main, usize first_line, ch::Array<Line_Ending_Exception>* exceptions) {
+	usize line = first_line;
+	usize read = 0;
+	usize write = 0;
+	for (;;) {
+		// With LF as the main style plain '\n' needs nothing, so only stop for '\r' and count the lines skipped
+		usize next;
+		if (main == LE_LF) {
+			next = read + find_codepoint(text + read, count - read, '\r');
+			line += count_codepoint(text + read, next - read, '\n');
+		} else {
+			next = read + find_line_break(text + read, count - read);
+		}
+
+		if (write != read) ch::mem_move(text + write, text + read, (next - read) * sizeof(u32));
+		write += next - read;
+		read = next;
+		if (read == count) break;
+
+		Line_Ending line_ending;
+		if (text[read] == '\n') {
+			line_ending = LE_LF;
+			read += 1;
+		} else if (read + 1 < count && text[read + 1] == '\n') {
+			line_ending = LE_CRLF;
+			read += 2;
+		} else {
+			line_ending = LE_CR;
+			read += 1;
+		}
+		text[write++] = '\n';
+
+		if (line_ending != main) {
+			Line_Ending_Exception exception;
+			exception.line = line;
+			exception.ending = line_ending;
+			exceptions->push(exception);
+		}
+		line += 1;
+	}
+
+	return write;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <ch_stl/array.h>
+
+/* Buffers only ever hold '\n'. The style a file was written with is kept next to its text so saving can put it
+   back. Files that mix styles keep a sorted list of just the lines that differ from the main style. */
+
+enum Line_Ending : u8 {
+	LE_LF,
+	LE_CRLF,
+	LE_CR,
+};
+
+struct Line_Ending_Exception {
+	usize line;
+	Line_Ending ending;
+};
+
+struct Line_Endings {
+	Line_Ending ending = LE_LF;
+	// Sorted by line. Line n is the one ended by the nth eol.
+	ch::Array<Line_Ending_Exception> exceptions;
+
+	Line_Endings();
+
+	void free();
+	Line_Endings copy() const;
+
+	Line_Ending get(usize line) const;
+
+	// Keeps exceptions on the right lines as eols get added and removed. count eols went in on line, or the eols
+	// of count lines starting at line came out. New lines always get the main ending.
+	void on_lines_inserted(usize line, usize count);
+	void on_lines_removed(usize line, usize count);
+
+	// Makes whatever ending most of the eol_count lines use the main one. Cheap when it already is.
+	void choose_main_ending(usize eol_count);
+};
+
+// Ending of the first line break in text, or LE_LF when there isn't one
+Line_Ending detect_line_ending(const u32* text, usize count);
+
+// Turns CRLF and lone CR into '\n' in place and returns the new count. Lines whose ending isn't main get
+// pushed onto exceptions, numbered from first_line. Text without a '\r' in it is only read, never moved.
+usize normalize_line_endings(u32* text, usize count, Line_Ending main, usize first_line, ch::Array<Line_Ending_Exception>* exceptions);
@@ -0,0 +1,226 @@
+#include "mapped_text.h"
+#include "encoding.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/memory.h>
+
+#include <string.h>
+
+// How far the indexer scans before publishing what it found
+static const usize index_chunk_size = 4 * 1024 * 1024;
+
+static void push_coarse_offset(Mapped_Text* text, usize offset) {
+	const usize n = text->coarse_count.load(std::memory_order_relaxed);
+	const usize block = n / coarse_block_size;
+	assert(block < text->line_block_count);
+
+	if (!text->line_blocks[block]) text->line_blocks[block] = ch_new usize[coarse_block_size];
+	text->line_blocks[block][n % coarse_block_size] = offset;
+
+	text->coarse_count.store(n + 1, std::memory_order_release);
+}
+
+static void build_coarse_index(Mapped_Text* text) {
+	const u8* data = text->file.data;
+	const usize size = text->file.size;
+
+	usize lines = 1;
+	usize pos = 0;
+	while (pos < size && !text->cancel_index.load(std::memory_order_relaxed)) {
+		const usize chunk_start = pos;
+		const usize chunk_end = ch::min(pos + index_chunk_size, size);
+
+		for (;;) {
+			const u8* nl = (const u8*)memchr(data + pos, '\n', chunk_end - pos);
+			if (!nl) {
+				pos = chunk_end;
+				break;
+			}
+			pos = (usize)(nl - data) + 1;
+
+			if (lines % coarse_line_stride == 0) push_coarse_offset(text, pos);
+			lines += 1;
+		}
+
+		text->line_count.store(lines, std::memory_order_release);
+		text->indexed_bytes.store(pos, std::memory_order_relaxed);
+
+		// @NOTE: We touched every page of the file to get here. Give them back so resident memory stays bounded by what's on screen.
+		discard_mapped_range(text->file, chunk_start, chunk_end - chunk_start);
+	}
+
+	if (!text->cancel_index.load(std::memory_order_relaxed)) {
+		save_line_cache(text->path, text->stamp, text->sample_hash, lines, text->line_blocks, text->coarse_count.load(std::memory_order_relaxed));
+	}
+	text->index_done.store(true, std::memory_order_release);
+}
+
+// Points the coarse index at a cache from an earlier open. No scanning, the blocks are views into the mapping.
+static bool use_line_cache(Mapped_Text* text) {
+	if (!open_line_cache(text->path, text->stamp, text->sample_hash, &text->line_cache)) return false;
+
+	const Line_Cache& cache = text->line_cache;
+	text->line_block_count = (cache.coarse_count + coarse_block_size - 1) / coarse_block_size;
+	text->line_blocks = ch_new usize*[text->line_block_count];
+	for (usize i = 0; i < text->line_block_count; i++) {
+		text->line_blocks[i] = (usize*)(cache.offsets + i * coarse_block_size);
+	}
+
+	text->coarse_count.store(cache.coarse_count);
+	text->line_count.store(cache.line_count);
+	text->indexed_bytes.store(text->file.size);
+	text->index_done.store(true);
+	return true;
+}
+
+bool Mapped_Text::open(const ch::Path& path) {
+	if (!map_file(path, &file)) return false;
+
+	// @NOTE: Pages and the line index work on UTF-8 bytes. Anything else has to be loaded.
+	usize bom_size;
+	if (detect_text_format(file.data, file.size, &bom_size).encoding != TE_UTF8) {
+		unmap_file(&file);
+		return false;
+	}
+
+	for (usize i = 0; i < max_resident_pages; i++) {
+		pages[i] = Mapped_Page();
+	}
+	use_clock = 0;
+
+	this->path = path;
+	if (!get_file_stamp(path, &stamp)) stamp = File_Stamp();
+	sample_hash = hash_file_sample(file);
+	cancel_index.store(false);
+	if (use_line_cache(this)) return true;
+
+	// Worst case every byte is a newline
+	const usize max_coarse = file.size / coarse_line_stride + 2;
+	line_block_count = max_coarse / coarse_block_size + 1;
+	line_blocks = ch_new usize*[line_block_count];
+	ch::mem_zero(line_blocks, line_block_count * sizeof(usize*));
+
+	coarse_count.store(0);
+	push_coarse_offset(this, 0);
+
+	line_count.store(1);
+	indexed_bytes.store(0);
+	index_done.store(false);
+
+	indexer = std::thread(build_coarse_index, this);
+	return true;
+}
+
+void Mapped_Text::close() {
+	cancel_index.store(true);
+	if (indexer.joinable()) indexer.join();
+
+	for (usize i = 0; i < max_resident_pages; i++) {
+		if (pages[i].codepoints) ch_delete[] pages[i].codepoints;
+		pages[i] = Mapped_Page();
+	}
+
+	if (line_cache.file.data) {
+		close_line_cache(&line_cache);
+	} else {
+		for (usize i = 0; i < line_block_count; i++) {
+			if (line_blocks[i]) ch_delete[] line_blocks[i];
+		}
+	}
+	ch_delete[] line_blocks;
+	line_blocks = nullptr;
+	line_block_count = 0;
+
+	unmap_file(&file);
+}
+
+usize Mapped_Text::get_line_offset(usize line) const {
+	const usize known = get_known_line_count();
+	if (line >= known) line = known - 1;
+
+	usize k = line / coarse_line_stride;
+	const usize published = coarse_count.load(std::memory_order_acquire);
+	if (k >= published) k = published - 1;
+
+	usize offset = line_blocks[k / coarse_block_size][k % coarse_block_size];
+	for (usize i = k * coarse_line_stride; i < line; i++) {
+		offset = get_next_line_offset(offset);
+	}
+	return offset;
+}
+
+usize Mapped_Text::get_next_line_offset(usize offset) const {
+	if (offset >= file.size) return file.size;
+
+	const u8* nl = (const u8*)memchr(file.data + offset, '\n', file.size - offset);
+	if (!nl) return file.size;
+	return (usize)(nl - file.data) + 1;
+}
+
+usize Mapped_Text::get_page_index(usize byte_offset) {
+	usize page_index = byte_offset / mapped_page_size;
+	// Pages start on the first lead byte at or after their boundary so a stray continuation byte can push the start past us
+	if (page_index > 0 && byte_offset < utf8_align_forward(file.data, file.size, page_index * mapped_page_size)) {
+		page_index -= 1;
+	}
+	return page_index;
+}
+
+const Mapped_Page* Mapped_Text::get_page(usize page_index) {
+	const usize first_byte = page_index * mapped_page_size;
+	if (first_byte >= file.size) return nullptr;
+
+	use_clock += 1;
+
+	Mapped_Page* lru = &pages[0];
+	for (usize i = 0; i < max_resident_pages; i++) {
+		Mapped_Page* page = &pages[i];
+		if (page->page_index == page_index) {
+			page->last_used = use_clock;
+			return page;
+		}
+		if (page->last_used < lru->last_used) lru = page;
+	}
+
+	if (lru->page_index != (usize)-1) {
+		discard_mapped_range(file, lru->byte_offset, lru->byte_end - lru->byte_offset);
+	}
+
+	// Page boundaries are aligned forward to a lead byte so every sequence lands entirely in one page
+	const usize start = utf8_align_forward(file.data, file.size, first_byte);
+	const usize end = utf8_align_forward(file.data, file.size, ch::min(first_byte + mapped_page_size, file.size));
+
+	if (!lru->codepoints) lru->codepoints = ch_new u32[mapped_page_size + 4];
+	lru->page_index = page_index;
+	lru->byte_offset = start;
+	lru->byte_end = end;
+	lru->count = utf8_decode(file.data + start, end - start, lru->codepoints);
+	lru->last_used = use_clock;
+
+	return lru;
+}
+
+usize Mapped_Text::get_codepoint_index(const Mapped_Page& page, usize byte_offset) const {
+	assert(byte_offset >= page.byte_offset && byte_offset <= page.byte_end);
+	return utf8_decoded_length(file.data + page.byte_offset, byte_offset - page.byte_offset);
+}
+
+void Mapped_Text::trim(usize keep) {
+	for (;;) {
+		usize resident = 0;
+		Mapped_Page* lru = nullptr;
+		for (usize i = 0; i < max_resident_pages; i++) {
+			Mapped_Page* page = &pages[i];
+			if (!page->codepoints) continue;
+			resident += 1;
+			if (!lru || page->last_used < lru->last_used) lru = page;
+		}
+		if (resident <= keep) break;
+
+		if (lru->page_index != (usize)-1) {
+			discard_mapped_range(file, lru->byte_offset, lru->byte_end - lru->byte_offset);
+		}
+		ch_delete[] lru->codepoints;
+		*lru = Mapped_Page();
+	}
+}
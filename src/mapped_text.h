@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "platform.h"
+#include "line_cache.h"
+
+// Bytes of source that get decoded together
+const usize mapped_page_size = 64 * 1024;
+// Decoded pages we keep around. This is what bounds memory, not the size of the file.
+const usize max_resident_pages = 32;
+// Only every Nth line start is stored in the coarse index. The rest are found by scanning forward.
+const usize coarse_line_stride = 1024;
+const usize coarse_block_size = 4096;
+
+struct Mapped_Page {
+	usize page_index = (usize)-1;
+	usize byte_offset = 0;
+	usize byte_end = 0;
+
+	u32* codepoints = nullptr;
+	usize count = 0;
+
+	u64 last_used = 0;
+};
+
+/* Read only view of a file that is too big to decode up front. The bytes stay mapped, pages only get decoded
+   into codepoints when something looks at them and the coarse line index is built on a background thread. */
+struct Mapped_Text {
+	Mapped_File file;
+	ch::Path path;
+	File_Stamp stamp;
+	u64 sample_hash = 0;
+
+	Mapped_Page pages[max_resident_pages];
+	u64 use_clock = 0;
+
+	usize** line_blocks = nullptr;
+	usize line_block_count = 0;
+	// When set, line_blocks point into the index saved by an earlier open instead of owning their memory
+	Line_Cache line_cache;
+
+	std::atomic<usize> coarse_count;
+	std::atomic<usize> line_count;
+	std::atomic<usize> indexed_bytes;
+	std::atomic<bool> index_done;
+	std::atomic<bool> cancel_index;
+	std::thread indexer;
+
+	bool open(const ch::Path& path);
+	void close();
+
+	// Lines that are known so far. Only final once index_done is set.
+	CH_FORCEINLINE usize get_known_line_count() const { return line_count.load(std::memory_order_acquire); }
+	CH_FORCEINLINE f32 get_index_progress() const {
+		if (index_done.load(std::memory_order_acquire) || !file.size) return 1.f;
+		return (f32)indexed_bytes.load(std::memory_order_relaxed) / (f32)file.size;
+	}
+
+	// Byte offset of the start of line. Lines that haven't been indexed yet clamp to the last known line.
+	usize get_line_offset(usize line) const;
+	// Byte offset of the line after the one containing offset, or the file size.
+	usize get_next_line_offset(usize offset) const;
+
+	usize get_page_index(usize byte_offset);
+	const Mapped_Page* get_page(usize page_index);
+	// Codepoint index within page of the codepoint that starts at byte_offset
+	usize get_codepoint_index(const Mapped_Page& page, usize byte_offset) const;
+
+	// Drops every decoded page except the keep most recently used.
+	void trim(usize keep);
+};
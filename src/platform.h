@@ -0,0 +1,120 @@
+#pragma once
+
+#include <ch_stl/array.h>
+#include <ch_stl/filesystem.h>
+#include <ch_stl/memory.h>
+#include <ch_stl/string.h>
+
+/* OS services that ch_stl doesn't cover. Implementations live in src/win32 and src/posix. */
+
+struct Mapped_File {
+	const u8* data = nullptr;
+	usize size = 0;
+
+	void* os_file = nullptr;
+	void* os_mapping = nullptr;
+};
+
+struct File_Stamp {
+	u64 size = 0;
+	u64 mtime = 0;
+
+	CH_FORCEINLINE bool operator==(const File_Stamp& other) const { return size == other.size && mtime == other.mtime; }
+	CH_FORCEINLINE bool operator!=(const File_Stamp& other) const { return !(*this == other); }
+};
+
+// How many tchars fit in a path, with its 0
+const usize path_capacity = sizeof(ch::Path::data) / sizeof(tchar);
+
+// Puts suffix right after the last name of path, like an extension. Returns false and leaves path alone when it
+// doesn't fit.
+CH_FORCEINLINE bool append_path_suffix(ch::Path* path, const tchar* suffix) {
+	const usize count = ch::strlen(suffix);
+	if (path->count + count >= path_capacity) return false;
+	ch::mem_copy(path->data + path->count, suffix, (count + 1) * sizeof(tchar));
+	path->count += count;
+	return true;
+}
+
+// Path::append with a length check, for a name that goes in the directory path is
+CH_FORCEINLINE bool append_path_name(ch::Path* path, const tchar* name) {
+	if (path->count + 1 + ch::strlen(name) >= path_capacity) return false;
+	path->append(name);
+	return true;
+}
+
+bool get_file_stamp(const ch::Path& path, File_Stamp* out_stamp);
+
+// Maps the whole file read only. Empty files succeed with a null data pointer.
+bool map_file(const ch::Path& path, Mapped_File* out_file);
+void unmap_file(Mapped_File* file);
+
+// Hints that the pages in [offset, offset + size) won't be touched again soon so the OS can drop them from our working set.
+void discard_mapped_range(const Mapped_File& file, usize offset, usize size);
+
+// True when the system is close to running out of physical memory and caches should be dropped.
+bool is_memory_low();
+
+// Raw OS file handle for the places that need more control than ch::File gives, like gathered writes
+using OS_File = u64;
+const OS_File invalid_os_file = (OS_File)-1;
+
+struct IO_Slice {
+	const void* data;
+	usize size;
+};
+
+// Creates or truncates path for writing
+OS_File create_write_file(const ch::Path& path);
+// Opens path for writing at the end, creating it if it isn't there
+OS_File open_append_file(const ch::Path& path);
+// Opens an existing file for writing anywhere in it, without truncating. Works while the file is mapped and the
+// mapping sees what gets written.
+OS_File open_write_file(const ch::Path& path);
+// Writes every slice in order. Short writes are retried until everything is out or an error happens.
+bool write_file_gather(OS_File file, const IO_Slice* slices, usize count);
+// Writes size bytes at offset without moving anything else in the file
+bool write_file_at(OS_File file, u64 offset, const void* data, usize size);
+void close_os_file(OS_File file);
+// Flushes the file's data to disk
+bool sync_os_file(OS_File file);
+
+// Atomically puts from in place of to, replacing it if it exists
+bool replace_file(const ch::Path& from, const ch::Path& to);
+bool delete_file(const ch::Path& path);
+
+// Per user directory for data the editor can always rebuild, created if it doesn't exist yet
+bool get_cache_directory(ch::Path* out_path);
+
+bool is_directory(const ch::Path& path);
+
+struct Directory_Entry {
+	const tchar* name;
+	u64 size;
+	bool is_directory;
+};
+using Directory_Proc = void(*)(void* user, const Directory_Entry& entry);
+
+// Calls proc for everything directly inside path except . and .. Links to directories are left out so walking a
+// tree can't loop.
+bool list_directory(const ch::Path& path, Directory_Proc proc, void* user);
+
+// Files are watched through their directory, so tools that save by writing a new file and renaming it over
+// the old one still show up.
+using Watch_ID = u64;
+const Watch_ID invalid_watch_id = (Watch_ID)-1;
+
+Watch_ID watch_file(const ch::Path& path);
+void unwatch_file(Watch_ID id);
+// Pushes every watch that saw activity since the last poll, once each. Never blocks. Activity doesn't always
+// mean the contents changed, callers compare stamps.
+void poll_file_changes(ch::Array<Watch_ID>* out_changed);
+
+// Watches every directory under root but hidden ones, including the ones made later. There's one tree at a time,
+// watching another drops the last. Returns false when not all of it could be watched.
+bool watch_directory_tree(const ch::Path& root);
+void unwatch_directory_tree();
+// Pushes the full path of every file that saw activity since the last poll, of every file in directories that showed
+// up and of every directory that went away. Never blocks. Returns false when events got lost, so anything under the
+// root could have changed.
+bool poll_tree_changes(ch::Array<ch::Path>* out_changed);
@@ -0,0 +1,322 @@
+#include "../io.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Biggest single read or write we hand the kernel. Bigger files just take a few round trips.
+static const usize max_uring_transfer = 1 << 30;
+
+struct Uring {
+	int fd = -1;
+
+	u32* sq_head;
+	u32* sq_tail;
+	u32* sq_mask;
+	u32* sq_array;
+	io_uring_sqe* sqes;
+	u32 sq_pending = 0;
+
+	u32* cq_head;
+	u32* cq_tail;
+	u32* cq_mask;
+	io_uring_cqe* cqes;
+
+	void* sq_ring = nullptr;
+	usize sq_ring_size = 0;
+	void* cq_ring = nullptr;
+	usize cq_ring_size = 0;
+	usize sqes_size = 0;
+};
+
+static bool uring_supports_ops(int fd) {
+	const usize probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+	u8 storage[probe_size] = {};
+	io_uring_probe* probe = (io_uring_probe*)storage;
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+
+	const u8 needed[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC, IORING_OP_CLOSE };
+	for (u8 op : needed) {
+		if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+	}
+	return true;
+}
+
+static void destroy_uring(Uring* ring) {
+	if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+	if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+	if (ring->fd >= 0) close(ring->fd);
+	*ring = Uring();
+}
+
+static bool create_uring(u32 entries, Uring* ring) {
+	io_uring_params params = {};
+	ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0) return false;
+
+	if (!uring_supports_ops(ring->fd)) {
+		destroy_uring(ring);
+		return false;
+	}
+
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mmap) {
+		if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	ring->sq_ring = mmap(nullptr, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) {
+		ring->sq_ring = nullptr;
+		destroy_uring(ring);
+		return false;
+	}
+
+	if (single_mmap) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = mmap(nullptr, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) {
+			ring->cq_ring = nullptr;
+			destroy_uring(ring);
+			return false;
+		}
+	}
+
+	ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	ring->sqes = (io_uring_sqe*)mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = nullptr;
+		destroy_uring(ring);
+		return false;
+	}
+
+	u8* sq = (u8*)ring->sq_ring;
+	ring->sq_head = (u32*)(sq + params.sq_off.head);
+	ring->sq_tail = (u32*)(sq + params.sq_off.tail);
+	ring->sq_mask = (u32*)(sq + params.sq_off.ring_mask);
+	ring->sq_array = (u32*)(sq + params.sq_off.array);
+
+	u8* cq = (u8*)ring->cq_ring;
+	ring->cq_head = (u32*)(cq + params.cq_off.head);
+	ring->cq_tail = (u32*)(cq + params.cq_off.tail);
+	ring->cq_mask = (u32*)(cq + params.cq_off.ring_mask);
+	ring->cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	return true;
+}
+
+static io_uring_sqe* get_sqe(Uring* ring) {
+	const u32 tail = *ring->sq_tail;
+	const u32 index = tail & *ring->sq_mask;
+	io_uring_sqe* sqe = &ring->sqes[index];
+	*sqe = {};
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->sq_pending += 1;
+	return sqe;
+}
+
+enum Uring_Stage {
+	US_Open,
+	US_Transfer,
+	US_Sync,
+	US_Close,
+};
+
+struct Uring_Task {
+	IO_Request* request;
+	int fd;
+	usize offset;
+	Uring_Stage stage;
+	bool failed;
+	bool finished;
+};
+
+static void submit_open(Uring* ring, Uring_Task* task, u64 user_data, bool write) {
+	io_uring_sqe* sqe = get_sqe(ring);
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (u64)task->request->path.data;
+	sqe->open_flags = write ? (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC);
+	sqe->len = write ? 0644 : 0;
+	sqe->user_data = user_data;
+	task->stage = US_Open;
+}
+
+static void submit_transfer(Uring* ring, Uring_Task* task, u64 user_data, bool write) {
+	const usize remaining = task->request->size - task->offset;
+
+	io_uring_sqe* sqe = get_sqe(ring);
+	sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = task->fd;
+	sqe->addr = (u64)(task->request->data + task->offset);
+	sqe->len = (u32)(remaining < max_uring_transfer ? remaining : max_uring_transfer);
+	sqe->off = task->offset;
+	sqe->user_data = user_data;
+	task->stage = US_Transfer;
+}
+
+static void submit_sync(Uring* ring, Uring_Task* task, u64 user_data) {
+	io_uring_sqe* sqe = get_sqe(ring);
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->fd = task->fd;
+	sqe->user_data = user_data;
+	task->stage = US_Sync;
+}
+
+static void submit_close(Uring* ring, Uring_Task* task, u64 user_data) {
+	io_uring_sqe* sqe = get_sqe(ring);
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = task->fd;
+	sqe->user_data = user_data;
+	task->stage = US_Close;
+}
+
+// Moves task to its next stage given the result of the last one. Returns true when the task is finished.
+static bool advance_task(Uring* ring, Uring_Task* task, u64 user_data, s32 result, bool write) {
+	IO_Request* request = task->request;
+
+	switch (task->stage) {
+	case US_Open: {
+		if (result < 0) {
+			task->failed = true;
+			return true;
+		}
+		task->fd = result;
+
+		if (!write) {
+			struct stat st;
+			if (fstat(task->fd, &st) != 0) {
+				task->failed = true;
+				submit_close(ring, task, user_data);
+				return false;
+			}
+			request->size = (usize)st.st_size;
+			request->data = ch_new u8[request->size + 1];
+			request->data[request->size] = 0;
+		}
+
+		if (request->size) {
+			submit_transfer(ring, task, user_data, write);
+		} else if (write && request->sync) {
+			submit_sync(ring, task, user_data);
+		} else {
+			submit_close(ring, task, user_data);
+		}
+		return false;
+	}
+	case US_Transfer: {
+		if (result < 0 || (write && result == 0)) {
+			task->failed = true;
+			submit_close(ring, task, user_data);
+			return false;
+		}
+
+		// A read that comes back empty means the file shrank under us
+		if (!write && result == 0) {
+			request->size = task->offset;
+			request->data[request->size] = 0;
+			submit_close(ring, task, user_data);
+			return false;
+		}
+
+		task->offset += (usize)result;
+		if (task->offset < request->size) {
+			submit_transfer(ring, task, user_data, write);
+		} else if (write && request->sync) {
+			submit_sync(ring, task, user_data);
+		} else {
+			submit_close(ring, task, user_data);
+		}
+		return false;
+	}
+	case US_Sync: {
+		if (result < 0) task->failed = true;
+		submit_close(ring, task, user_data);
+		return false;
+	}
+	case US_Close:
+		if (result < 0 && write) task->failed = true;
+		return true;
+	}
+
+	return true;
+}
+
+bool platform_io_batch(IO_Request* requests, usize count, bool write) {
+	if (!count) return true;
+
+	Uring ring;
+	if (!create_uring((u32)io_queue_depth, &ring)) return false;
+	defer(destroy_uring(&ring));
+
+	Uring_Task* tasks = ch_new Uring_Task[count];
+	defer(ch_delete[] tasks);
+
+	usize next = 0;
+	usize in_flight = 0;
+	usize completed = 0;
+	while (completed < count) {
+		// Every task has at most one op in flight so this also bounds the submission queue
+		while (next < count && in_flight < io_queue_depth) {
+			Uring_Task* task = &tasks[next];
+			task->request = &requests[next];
+			task->fd = -1;
+			task->offset = 0;
+			task->failed = false;
+			task->finished = false;
+			if (!write) {
+				task->request->data = nullptr;
+				task->request->size = 0;
+			}
+			submit_open(&ring, task, next, write);
+			next += 1;
+			in_flight += 1;
+		}
+
+		const int entered = (int)syscall(__NR_io_uring_enter, ring.fd, ring.sq_pending, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+		if (entered < 0) {
+			if (errno == EINTR) continue;
+
+			// @NOTE: Tearing the ring down waits out whatever the kernel still owns. Everything not done yet fails.
+			destroy_uring(&ring);
+			for (usize i = 0; i < count; i++) {
+				Uring_Task* task = &tasks[i];
+				if (i < next && task->finished) continue;
+				if (i < next && task->fd >= 0 && task->stage != US_Close) close(task->fd);
+
+				requests[i].succeeded = false;
+				if (!write) io_free(&requests[i]);
+			}
+			return true;
+		}
+		ring.sq_pending -= (u32)entered;
+
+		u32 head = *ring.cq_head;
+		const u32 tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			const io_uring_cqe* cqe = &ring.cqes[head & *ring.cq_mask];
+			const u64 user_data = cqe->user_data;
+			Uring_Task* task = &tasks[user_data];
+
+			if (advance_task(&ring, task, user_data, cqe->res, write)) {
+				task->finished = true;
+				task->request->succeeded = !task->failed;
+				if (task->failed && !write) io_free(task->request);
+				in_flight -= 1;
+				completed += 1;
+			}
+		}
+		__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	return true;
+}
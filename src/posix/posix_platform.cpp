@@ -0,0 +1,494 @@
+#include "../platform.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/memory.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/inotify.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static usize get_page_size() {
+	static usize page_size = (usize)sysconf(_SC_PAGESIZE);
+	return page_size;
+}
+
+bool get_file_stamp(const ch::Path& path, File_Stamp* out_stamp) {
+	struct stat st;
+	if (stat(path.data, &st) != 0) return false;
+
+	out_stamp->size = (u64)st.st_size;
+	out_stamp->mtime = (u64)st.st_mtim.tv_sec * 1000000000ull + (u64)st.st_mtim.tv_nsec;
+	return true;
+}
+
+bool map_file(const ch::Path& path, Mapped_File* out_file) {
+	const int fd = open(path.data, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+
+	Mapped_File result;
+	result.size = (usize)st.st_size;
+	if (result.size) {
+		void* data = mmap(nullptr, result.size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+		result.data = (const u8*)data;
+	}
+	// @NOTE: the mapping keeps its own reference to the file
+	close(fd);
+
+	*out_file = result;
+	return true;
+}
+
+void unmap_file(Mapped_File* file) {
+	if (file->data) munmap((void*)file->data, file->size);
+	*file = Mapped_File();
+}
+
+void discard_mapped_range(const Mapped_File& file, usize offset, usize size) {
+	if (!file.data || offset >= file.size) return;
+	if (offset + size > file.size) size = file.size - offset;
+
+	// madvise wants page aligned ranges. Only drop pages that are fully inside the range.
+	const usize page_size = get_page_size();
+	const usize first = (offset + page_size - 1) & ~(page_size - 1);
+	const usize last = (offset + size) & ~(page_size - 1);
+	if (last <= first) return;
+
+	madvise((void*)(file.data + first), last - first, MADV_DONTNEED);
+}
+
+bool is_memory_low() {
+	const long total_pages = sysconf(_SC_PHYS_PAGES);
+	const long available_pages = sysconf(_SC_AVPHYS_PAGES);
+	if (total_pages <= 0 || available_pages < 0) return false;
+
+	return available_pages < total_pages / 20;
+}
+
+OS_File create_write_file(const ch::Path& path) {
+	const int fd = open(path.data, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) return invalid_os_file;
+	return (OS_File)fd;
+}
+
+OS_File open_append_file(const ch::Path& path) {
+	const int fd = open(path.data, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0) return invalid_os_file;
+	return (OS_File)fd;
+}
+
+OS_File open_write_file(const ch::Path& path) {
+	const int fd = open(path.data, O_WRONLY | O_CLOEXEC);
+	if (fd < 0) return invalid_os_file;
+	return (OS_File)fd;
+}
+
+bool write_file_gather(OS_File file, const IO_Slice* slices, usize count) {
+	const int fd = (int)file;
+
+	struct iovec iov[IOV_MAX];
+	while (count) {
+		const usize batch = count < IOV_MAX ? count : IOV_MAX;
+		usize remaining = 0;
+		for (usize i = 0; i < batch; i++) {
+			iov[i].iov_base = (void*)slices[i].data;
+			iov[i].iov_len = slices[i].size;
+			remaining += slices[i].size;
+		}
+
+		struct iovec* current = iov;
+		usize current_count = batch;
+		while (remaining) {
+			const ssize_t written = writev(fd, current, (int)current_count);
+			if (written < 0) {
+				if (errno == EINTR) continue;
+				return false;
+			}
+			remaining -= (usize)written;
+
+			// Skip what got written and retry the rest
+			usize left = (usize)written;
+			while (current_count && left >= current->iov_len) {
+				left -= current->iov_len;
+				current += 1;
+				current_count -= 1;
+			}
+			if (current_count) {
+				current->iov_base = (u8*)current->iov_base + left;
+				current->iov_len -= left;
+			}
+		}
+
+		slices += batch;
+		count -= batch;
+	}
+	return true;
+}
+
+bool write_file_at(OS_File file, u64 offset, const void* data, usize size) {
+	const u8* bytes = (const u8*)data;
+	while (size) {
+		const ssize_t written = pwrite((int)file, bytes, size, (off_t)offset);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		bytes += written;
+		offset += (u64)written;
+		size -= (usize)written;
+	}
+	return true;
+}
+
+void close_os_file(OS_File file) {
+	if (file != invalid_os_file) close((int)file);
+}
+
+bool sync_os_file(OS_File file) {
+	return fsync((int)file) == 0;
+}
+
+// Copies the directory part of path into dir. Returns where the file name starts in path.
+static usize get_parent_directory(const ch::Path& path, tchar (&dir)[PATH_MAX]) {
+	ch::mem_copy(dir, path.data, ch::min(path.count + 1, (usize)PATH_MAX));
+	dir[PATH_MAX - 1] = 0;
+	tchar* slash = strrchr(dir, '/');
+	if (!slash) {
+		dir[0] = '.';
+		dir[1] = 0;
+		return 0;
+	}
+
+	const usize name_offset = slash - dir + 1;
+	if (slash == dir) slash += 1;
+	*slash = 0;
+	return name_offset;
+}
+
+bool replace_file(const ch::Path& from, const ch::Path& to) {
+	if (rename(from.data, to.data) != 0) return false;
+
+	// Make the rename itself durable by syncing the directory it happened in
+	tchar dir[PATH_MAX];
+	get_parent_directory(to, dir);
+
+	const int dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir_fd >= 0) {
+		fsync(dir_fd);
+		close(dir_fd);
+	}
+	return true;
+}
+
+bool delete_file(const ch::Path& path) {
+	return unlink(path.data) == 0;
+}
+
+bool get_cache_directory(ch::Path* out_path) {
+	const char* xdg_cache = getenv("XDG_CACHE_HOME");
+	if (xdg_cache && xdg_cache[0]) {
+		*out_path = xdg_cache;
+	} else {
+		const char* home = getenv("HOME");
+		if (!home || !home[0]) return false;
+		*out_path = home;
+		out_path->append(".cache");
+		mkdir(out_path->data, 0755);
+	}
+	out_path->append("yeet");
+
+	return mkdir(out_path->data, 0755) == 0 || errno == EEXIST;
+}
+
+bool is_directory(const ch::Path& path) {
+	struct stat st;
+	return stat(path.data, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool list_directory(const ch::Path& path, Directory_Proc proc, void* user) {
+	DIR* dir = opendir(path.data);
+	if (!dir) return false;
+	defer(closedir(dir));
+
+	const int dir_fd = dirfd(dir);
+	while (const struct dirent* ent = readdir(dir)) {
+		const char* name = ent->d_name;
+		if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) continue;
+
+		// Links to files count as the file, links to directories get skipped
+		struct stat st;
+		if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+		if (S_ISLNK(st.st_mode) && (fstatat(dir_fd, name, &st, 0) != 0 || !S_ISREG(st.st_mode))) continue;
+		if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)) continue;
+
+		Directory_Entry entry;
+		entry.name = name;
+		entry.size = (u64)st.st_size;
+		entry.is_directory = S_ISDIR(st.st_mode);
+		proc(user, entry);
+	}
+	return true;
+}
+
+struct File_Watch {
+	Watch_ID id;
+	int wd;
+	ch::Path path;
+	usize name_offset;
+};
+
+static int inotify_fd = -1;
+static ch::Array<File_Watch> file_watches;
+static Watch_ID next_watch_id = 0;
+
+Watch_ID watch_file(const ch::Path& path) {
+	if (inotify_fd < 0) {
+		inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotify_fd < 0) return invalid_watch_id;
+		file_watches.allocator = ch::get_heap_allocator();
+	}
+
+	tchar dir[PATH_MAX];
+	const usize name_offset = get_parent_directory(path, dir);
+
+	// @NOTE: Watching the same directory twice hands back the same wd, so watches just share it
+	const u32 mask = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+	const int wd = inotify_add_watch(inotify_fd, dir, mask);
+	if (wd < 0) return invalid_watch_id;
+
+	File_Watch watch;
+	watch.id = next_watch_id++;
+	watch.wd = wd;
+	watch.path = path;
+	watch.name_offset = name_offset;
+	file_watches.push(watch);
+	return watch.id;
+}
+
+void unwatch_file(Watch_ID id) {
+	for (usize i = 0; i < file_watches.count; i++) {
+		if (file_watches[i].id != id) continue;
+
+		const int wd = file_watches[i].wd;
+		file_watches.remove(i);
+
+		for (const File_Watch& watch : file_watches) {
+			if (watch.wd == wd) return;
+		}
+		inotify_rm_watch(inotify_fd, wd);
+		return;
+	}
+}
+
+static void push_changed_watch(ch::Array<Watch_ID>* out_changed, Watch_ID id) {
+	if (out_changed->find(id) == -1) out_changed->push(id);
+}
+
+void poll_file_changes(ch::Array<Watch_ID>* out_changed) {
+	if (inotify_fd < 0) return;
+
+	alignas(inotify_event) u8 events[16 * 1024];
+	for (;;) {
+		const ssize_t size = read(inotify_fd, events, sizeof(events));
+		if (size <= 0) break;
+
+		for (const u8* p = events; p < events + size;) {
+			const inotify_event* event = (const inotify_event*)p;
+			p += sizeof(inotify_event) + event->len;
+
+			// Events got dropped, so anything could have changed
+			if (event->mask & IN_Q_OVERFLOW) {
+				for (const File_Watch& watch : file_watches) push_changed_watch(out_changed, watch.id);
+				continue;
+			}
+			if (!event->len) continue;
+
+			for (const File_Watch& watch : file_watches) {
+				if (watch.wd == event->wd && strcmp(watch.path.data + watch.name_offset, event->name) == 0) {
+					push_changed_watch(out_changed, watch.id);
+				}
+			}
+		}
+	}
+}
+
+struct Tree_Directory {
+	int wd;
+	ch::Path path;
+};
+
+// @NOTE: The tree gets an inotify of its own, so its watches can't share a wd with the ones of open files and swap
+// masks with them
+static int tree_fd = -1;
+// Sorted by wd, which only goes up
+static ch::Array<Tree_Directory> tree_directories;
+
+static const u32 tree_watch_mask = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+static usize find_tree_directory(int wd) {
+	usize low = 0;
+	usize high = tree_directories.count;
+	while (low < high) {
+		const usize mid = low + (high - low) / 2;
+		if (tree_directories[mid].wd < wd) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+// Whether path is dir or anything under it
+static bool is_in_directory(const ch::Path& path, const ch::Path& dir) {
+	if (path.count < dir.count || strncmp(path.data, dir.data, dir.count) != 0) return false;
+	return path.count == dir.count || path.data[dir.count] == '/';
+}
+
+// Watches path and every directory under it but hidden ones. The files in them get pushed to out_files when it's set.
+static bool add_tree_directory(const ch::Path& path, ch::Array<ch::Path>* out_files) {
+	// @NOTE: The watch goes on before the listing, so anything made in between shows up in one or the other
+	const int wd = inotify_add_watch(tree_fd, path.data, tree_watch_mask);
+	if (wd < 0) return false;
+
+	// A directory that moved inside the tree keeps its wd
+	const usize at = find_tree_directory(wd);
+	if (at < tree_directories.count && tree_directories[at].wd == wd) {
+		tree_directories[at].path = path;
+	} else {
+		Tree_Directory directory;
+		directory.wd = wd;
+		directory.path = path;
+		tree_directories.insert(directory, at);
+	}
+
+	// Gone already, its parent's event says so
+	DIR* dir = opendir(path.data);
+	if (!dir) return true;
+	defer(closedir(dir));
+
+	bool watched = true;
+	const int dir_fd = dirfd(dir);
+	while (const struct dirent* ent = readdir(dir)) {
+		const char* name = ent->d_name;
+		if (name[0] == '.') continue;
+
+		// d_type saves a stat per entry where the file system fills it in. Links go the way list_directory has them.
+		bool is_directory = ent->d_type == DT_DIR;
+		bool is_file = ent->d_type == DT_REG;
+		if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK) {
+			struct stat st;
+			if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+			if (S_ISLNK(st.st_mode)) {
+				is_file = fstatat(dir_fd, name, &st, 0) == 0 && S_ISREG(st.st_mode);
+			} else {
+				is_directory = S_ISDIR(st.st_mode);
+				is_file = S_ISREG(st.st_mode);
+			}
+		}
+
+		ch::Path child = path;
+		if (!append_path_name(&child, name)) continue;
+		if (is_directory) {
+			if (!add_tree_directory(child, out_files)) watched = false;
+		} else if (is_file && out_files) {
+			out_files->push(child);
+		}
+	}
+	return watched;
+}
+
+// Drops the watches of dir and of everything under it, like once it moved out of the tree
+static void remove_tree_directories(const ch::Path& dir) {
+	for (usize i = 0; i < tree_directories.count;) {
+		if (is_in_directory(tree_directories[i].path, dir)) {
+			inotify_rm_watch(tree_fd, tree_directories[i].wd);
+			tree_directories.remove(i);
+			continue;
+		}
+		i += 1;
+	}
+}
+
+bool watch_directory_tree(const ch::Path& root) {
+	unwatch_directory_tree();
+	tree_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (tree_fd < 0) return false;
+	tree_directories.allocator = ch::get_heap_allocator();
+	return add_tree_directory(root, nullptr);
+}
+
+void unwatch_directory_tree() {
+	if (tree_fd < 0) return;
+
+	// Closing it drops every watch on it
+	close(tree_fd);
+	tree_fd = -1;
+	tree_directories.count = 0;
+}
+
+bool poll_tree_changes(ch::Array<ch::Path>* out_changed) {
+	if (tree_fd < 0) return true;
+
+	bool complete = true;
+	alignas(inotify_event) u8 events[16 * 1024];
+	for (;;) {
+		const ssize_t size = read(tree_fd, events, sizeof(events));
+		if (size <= 0) break;
+
+		for (const u8* p = events; p < events + size;) {
+			const inotify_event* event = (const inotify_event*)p;
+			p += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				complete = false;
+				continue;
+			}
+
+			const usize at = find_tree_directory(event->wd);
+			if (at == tree_directories.count || tree_directories[at].wd != event->wd) continue;
+			// The directory itself went away, the event of its parent has the path
+			if (event->mask & IN_IGNORED) {
+				tree_directories.remove(at);
+				continue;
+			}
+			if (!event->len || event->name[0] == '.') continue;
+
+			ch::Path path = tree_directories[at].path;
+			if (!append_path_name(&path, event->name)) continue;
+
+			if (event->mask & IN_ISDIR) {
+				if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+					if (!add_tree_directory(path, out_changed)) complete = false;
+				} else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+					remove_tree_directories(path);
+					out_changed->push(path);
+				}
+				continue;
+			}
+
+			// @NOTE: A write tends to come with its close right after, one path is enough for both
+			if (out_changed->count && strcmp(out_changed->data[out_changed->count - 1].data, path.data) == 0) continue;
+			out_changed->push(path);
+		}
+	}
+	return complete;
+}
@@ -0,0 +1,570 @@
+#include "project_index.h"
+#include "project_walk.h"
+#include "sort.h"
+#include "jobs.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/memory.h>
+#include <ch_stl/string.h>
+#include <ch_stl/hash.h>
+
+#include <thread>
+
+// The index gets rebuilt once this many changed files pile up on top of it, or an eighth of its files if that's more
+static const usize min_rebuild_changes = 1024;
+
+struct Index_Build {
+	Project_Walk walk;
+	const Index_Procs* procs;
+	std::atomic<u32> next_file;
+
+	std::mutex mutex;
+	ch::Array<Index_Batch*> batches;
+
+	ch::Path cache_path;
+	bool write_pushed = false;
+	std::atomic<bool> write_done;
+	bool written = false;
+};
+
+// Checks every file's stamp against the index, or indexes the files whose watch fired again
+struct Index_Refresh {
+	Project_Walk walk;
+	const Project_Index* index;
+	bool is_check;
+	// The files handed to a reindex
+	ch::Array<ch::Path> paths;
+	// Those of them that weren't there anymore, which could have been directories
+	ch::Array<ch::Path> gone;
+	// One per file of the mapped index, set when a check comes across it
+	ch::Array<u8> seen;
+
+	std::mutex mutex;
+	ch::Array<Changed_File*> changed;
+};
+
+CH_FORCEINLINE static u64 hash_relative_path(const tchar* path, usize count) {
+	return ch::fnv1_hash(path, count * sizeof(tchar));
+}
+
+CH_FORCEINLINE static bool is_indexed_path(const Index_Procs* procs, const ch::Path& path) {
+	return !procs->is_indexed_path || procs->is_indexed_path(path);
+}
+
+// Payloads start right after the paths, lined up for what's in them
+CH_FORCEINLINE static u64 get_payload_offset(u64 paths_offset, u64 paths_count) {
+	return (paths_offset + paths_count * sizeof(tchar) + 7) & ~(u64)7;
+}
+
+static void free_batch(const Index_Procs* procs, Index_Batch* batch) {
+	batch->files.free();
+	batch->paths.free();
+	procs->free_payload(batch->payload);
+	ch_delete batch;
+}
+
+static void free_changed_file(const Index_Procs* procs, Changed_File* file) {
+	procs->free_payload(file->payload);
+	ch_delete file;
+}
+
+// Walk proc of a build. Files the index turns down aren't in it at all.
+static void index_files(Project_Walk* walk, const ch::Path* paths, usize count) {
+	Index_Build* build = (Index_Build*)walk->user;
+	const Index_Procs* procs = build->procs;
+
+	usize indexed_count = 0;
+	for (usize i = 0; i < count; i++) {
+		if (is_indexed_path(procs, paths[i])) indexed_count += 1;
+	}
+	if (!indexed_count) return;
+
+	Index_Batch* batch = ch_new Index_Batch;
+	batch->first_file = build->next_file.fetch_add((u32)indexed_count);
+	batch->files.allocator = ch::get_heap_allocator();
+	batch->paths.allocator = ch::get_heap_allocator();
+	batch->payload = procs->new_payload();
+
+	void* scratch = procs->new_scratch();
+	defer(procs->free_scratch(scratch));
+
+	for (usize i = 0; i < count; i++) {
+		if (!is_indexed_path(procs, paths[i])) continue;
+
+		Indexed_File file = {};
+		procs->index_file(scratch, paths[i], (u32)batch->files.count, batch->payload, &file);
+
+		usize path_count;
+		const tchar* relative_path = get_relative_path(walk->root, paths[i], &path_count);
+		file.path_offset = batch->paths.count;
+		file.path_count = path_count;
+		for (usize j = 0; j < path_count; j++) batch->paths.push(relative_path[j]);
+		batch->paths.push(0);
+		batch->files.push(file);
+	}
+	procs->finish_payload(scratch, batch->payload);
+
+	std::lock_guard<std::mutex> lock(build->mutex);
+	build->batches.push(batch);
+}
+
+// Puts the batches of a finished walk together and writes them out as the saved index
+static bool write_index(Index_Build* build) {
+	ch::Array<Index_Batch*>& batches = build->batches;
+	ch::Array<Index_Batch*> temp_batches(ch::get_heap_allocator());
+	defer(temp_batches.free());
+	temp_batches.reserve(batches.count);
+	Index_Batch** sorted = radix_sort(batches.data, temp_batches.data, batches.count, 4, [](const Index_Batch* batch) { return (u64)batch->first_file; });
+	if (sorted != batches.data) ch::mem_copy(batches.data, sorted, batches.count * sizeof(Index_Batch*));
+
+	// Paths go out batch by batch, so every file's offset moves by what came before its batch
+	u64 file_count = 0;
+	u64 paths_count = 0;
+	for (Index_Batch* batch : batches) {
+		for (Indexed_File& file : batch->files) file.path_offset += paths_count;
+		file_count += batch->files.count;
+		paths_count += batch->paths.count;
+	}
+
+	ch::Array<Index_Path_Hash> path_hashes(ch::get_heap_allocator());
+	defer(path_hashes.free());
+	path_hashes.reserve(file_count);
+	u64 paths_before = 0;
+	for (const Index_Batch* batch : batches) {
+		for (usize i = 0; i < batch->files.count; i++) {
+			const Indexed_File& file = batch->files[i];
+			const tchar* path = batch->paths.data + (file.path_offset - paths_before);
+			path_hashes.push({ hash_relative_path(path, (usize)file.path_count), batch->first_file + i });
+		}
+		paths_before += batch->paths.count;
+	}
+	ch::Array<Index_Path_Hash> temp_hashes(ch::get_heap_allocator());
+	defer(temp_hashes.free());
+	temp_hashes.reserve(path_hashes.count);
+	const Index_Path_Hash* sorted_hashes = radix_sort(path_hashes.data, temp_hashes.data, path_hashes.count, 8, [](const Index_Path_Hash& it) { return it.hash; });
+
+	Project_Index_Header header = {};
+	ch::mem_copy(header.magic, build->procs->magic, sizeof(header.magic));
+	header.file_count = file_count;
+	header.files_offset = sizeof(header);
+	header.path_hashes_offset = header.files_offset + file_count * sizeof(Indexed_File);
+	header.paths_offset = header.path_hashes_offset + file_count * sizeof(Index_Path_Hash);
+	header.paths_count = paths_count;
+	header.payload_offset = get_payload_offset(header.paths_offset, paths_count);
+
+	static const u8 padding[8] = {};
+	ch::Array<IO_Slice> slices(ch::get_heap_allocator());
+	defer(slices.free());
+	slices.push({ &header, sizeof(header) });
+	for (const Index_Batch* batch : batches) slices.push({ batch->files.data, batch->files.count * sizeof(Indexed_File) });
+	slices.push({ sorted_hashes, path_hashes.count * sizeof(Index_Path_Hash) });
+	for (const Index_Batch* batch : batches) slices.push({ batch->paths.data, batch->paths.count * sizeof(tchar) });
+	slices.push({ padding, (usize)(header.payload_offset - (header.paths_offset + paths_count * sizeof(tchar))) });
+
+	// Written aside and renamed into place so a reader never maps half an index
+	ch::Path temp_path = build->cache_path;
+	if (!append_path_suffix(&temp_path, CH_TEXT(".tmp"))) return false;
+
+	const OS_File file = create_write_file(temp_path);
+	if (file == invalid_os_file) return false;
+	const bool written = write_file_gather(file, slices.data, slices.count) && build->procs->write_payload(batches.data, batches.count, file);
+	close_os_file(file);
+
+	if (!written || !replace_file(temp_path, build->cache_path)) {
+		delete_file(temp_path);
+		return false;
+	}
+	return true;
+}
+
+static void run_write_index(void* user) {
+	Index_Build* build = (Index_Build*)user;
+	build->written = !build->walk.cancel.load(std::memory_order_relaxed) && write_index(build);
+	build->write_done.store(true, std::memory_order_release);
+}
+
+static void start_build(Project_Index* index) {
+	Index_Build* build = ch_new Index_Build;
+	init_project_walk(&build->walk, index->root, max_searched_file_size, index_files, build);
+	build->procs = index->procs;
+	build->next_file.store(0);
+	build->batches.allocator = ch::get_heap_allocator();
+	build->cache_path = index->cache_path;
+	build->write_done.store(false);
+
+	index->build = build;
+	push_walk_root(&build->walk);
+}
+
+CH_FORCEINLINE static bool is_build_done(const Index_Build* build) {
+	return build->walk.is_done() && (!build->write_pushed || build->write_done.load(std::memory_order_acquire));
+}
+
+// The write job goes once the walk is done, whether it got cancelled or not
+static void push_write_once_walked(Index_Build* build) {
+	if (!build->walk.is_done() || build->write_pushed) return;
+	build->write_pushed = true;
+	push_job(run_write_index, build);
+}
+
+static void free_build(Index_Build* build) {
+	for (Index_Batch* batch : build->batches) free_batch(build->procs, batch);
+	build->batches.free();
+	free_project_walk(&build->walk);
+	ch_delete build;
+}
+
+// Index of the mapped file with the relative path, or the file count when it isn't in there
+static usize find_indexed_file(const Project_Index* index, const tchar* path, usize count) {
+	if (!index->header) return 0;
+
+	const u64 hash = hash_relative_path(path, count);
+	const usize file_count = (usize)index->header->file_count;
+	usize low = 0;
+	usize high = file_count;
+	while (low < high) {
+		const usize mid = low + (high - low) / 2;
+		if (index->path_hashes[mid].hash < hash) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	for (; low < file_count && index->path_hashes[low].hash == hash; low++) {
+		const Indexed_File& file = index->files[index->path_hashes[low].file];
+		if (file.path_count != count) continue;
+
+		const tchar* indexed_path = index->paths + file.path_offset;
+		usize i = 0;
+		while (i < count && indexed_path[i] == path[i]) i += 1;
+		if (i == count) return (usize)index->path_hashes[low].file;
+	}
+	return file_count;
+}
+
+// Like is_path_under, for paths relative to the root
+static bool is_relative_path_under(const tchar* path, usize count, const tchar* directory, usize directory_count) {
+	if (count <= directory_count || (path[directory_count] != '/' && path[directory_count] != '\\')) return false;
+	for (usize i = 0; i < directory_count; i++) {
+		if (path[i] != directory[i]) return false;
+	}
+	return true;
+}
+
+// Walk proc of a refresh. Files whose stamp still matches the index are left alone.
+static void refresh_files(Project_Walk* walk, const ch::Path* paths, usize count) {
+	Index_Refresh* refresh = (Index_Refresh*)walk->user;
+	const Project_Index* index = refresh->index;
+	const Index_Procs* procs = index->procs;
+
+	void* scratch = procs->new_scratch();
+	defer(procs->free_scratch(scratch));
+
+	for (usize i = 0; i < count && !walk->cancel.load(std::memory_order_relaxed); i++) {
+		// Watches see everything under the root, even what a walk wouldn't come across
+		if (!refresh->is_check) {
+			if (!is_walked_path(walk->root, paths[i])) continue;
+			File_Stamp stamp;
+			if (!get_file_stamp(paths[i], &stamp)) {
+				std::lock_guard<std::mutex> lock(refresh->mutex);
+				refresh->gone.push(paths[i]);
+				continue;
+			}
+		}
+		if (!is_indexed_path(procs, paths[i])) continue;
+
+		usize path_count;
+		const tchar* relative_path = get_relative_path(walk->root, paths[i], &path_count);
+		const usize indexed = find_indexed_file(index, relative_path, path_count);
+		if (refresh->is_check && indexed < get_indexed_file_count(index)) {
+			// @NOTE: Every job sets bytes of its own files only
+			refresh->seen[indexed] = 1;
+
+			File_Stamp stamp;
+			const Indexed_File& file = index->files[indexed];
+			if (get_file_stamp(paths[i], &stamp) && stamp.size == file.size && stamp.mtime == file.mtime) continue;
+		}
+
+		Changed_File* changed = ch_new Changed_File;
+		changed->path = paths[i];
+		changed->hash = hash_relative_path(relative_path, path_count);
+		changed->file = {};
+		changed->payload = procs->new_payload();
+		procs->index_file(scratch, paths[i], 0, changed->payload, &changed->file);
+		procs->finish_payload(scratch, changed->payload);
+
+		std::lock_guard<std::mutex> lock(refresh->mutex);
+		refresh->changed.push(changed);
+	}
+}
+
+static void start_refresh(Project_Index* index, bool is_check) {
+	Index_Refresh* refresh = ch_new Index_Refresh;
+	init_project_walk(&refresh->walk, index->root, max_searched_file_size, refresh_files, refresh);
+	refresh->index = index;
+	refresh->is_check = is_check;
+	refresh->paths.allocator = ch::get_heap_allocator();
+	refresh->seen.allocator = ch::get_heap_allocator();
+	refresh->gone.allocator = ch::get_heap_allocator();
+	refresh->changed.allocator = ch::get_heap_allocator();
+	index->refresh = refresh;
+
+	if (is_check) {
+		const usize file_count = get_indexed_file_count(index);
+		refresh->seen.reserve(file_count);
+		refresh->seen.count = file_count;
+		ch::mem_zero(refresh->seen.data, file_count);
+		push_walk_root(&refresh->walk);
+	} else {
+		// The dirty files move into the refresh, anything that changes from here on is dirty again
+		refresh->paths = index->dirty;
+		index->dirty = ch::Array<ch::Path>(ch::get_heap_allocator());
+		push_walk_files(&refresh->walk, refresh->paths.data, refresh->paths.count);
+	}
+}
+
+static void free_refresh(const Index_Procs* procs, Index_Refresh* refresh) {
+	for (Changed_File* file : refresh->changed) free_changed_file(procs, file);
+	refresh->changed.free();
+	refresh->paths.free();
+	refresh->seen.free();
+	refresh->gone.free();
+	free_project_walk(&refresh->walk);
+	ch_delete refresh;
+}
+
+// Takes the files a refresh indexed again over into the index
+static void finish_refresh(Project_Index* index, Index_Refresh* refresh) {
+	const usize file_count = get_indexed_file_count(index);
+	if (refresh->is_check) {
+		// Files the walk didn't come across were deleted or are ignored now
+		for (usize i = 0; i < file_count; i++) {
+			if (!refresh->seen[i]) index->dead[i] = 1;
+		}
+		// A cancelled walk didn't come across everything
+		if (!index->wants_check && !refresh->walk.cancel.load(std::memory_order_relaxed)) index->is_current = true;
+	}
+
+	// Everything that was at or under a path that's gone is gone as well
+	for (const ch::Path& path : refresh->gone) {
+		usize path_count;
+		const tchar* relative_path = get_relative_path(index->root, path, &path_count);
+		const usize indexed = find_indexed_file(index, relative_path, path_count);
+		if (indexed < file_count) {
+			index->dead[indexed] = 1;
+		} else {
+			for (usize i = 0; i < file_count; i++) {
+				const Indexed_File& file = index->files[i];
+				if (is_relative_path_under(index->paths + file.path_offset, (usize)file.path_count, relative_path, path_count)) index->dead[i] = 1;
+			}
+		}
+
+		for (usize i = 0; i < index->changed.count;) {
+			const ch::Path& changed_path = index->changed[i]->path;
+			if (is_same_path(changed_path, path) || is_path_under(changed_path, path)) {
+				free_changed_file(index->procs, index->changed[i]);
+				index->changed.remove(i);
+				continue;
+			}
+			i += 1;
+		}
+	}
+
+	for (Changed_File* file : refresh->changed) {
+		usize path_count;
+		const tchar* relative_path = get_relative_path(index->root, file->path, &path_count);
+		const usize indexed = find_indexed_file(index, relative_path, path_count);
+		if (indexed < file_count) index->dead[indexed] = 1;
+
+		for (usize i = 0; i < index->changed.count; i++) {
+			if (index->changed[i]->hash == file->hash && is_same_path(index->changed[i]->path, file->path)) {
+				free_changed_file(index->procs, index->changed[i]);
+				index->changed.remove(i);
+				break;
+			}
+		}
+		index->changed.push(file);
+	}
+	refresh->changed.count = 0;
+}
+
+static void unmap_index(Project_Index* index) {
+	unmap_file(&index->file);
+	index->header = nullptr;
+	index->files = nullptr;
+	index->path_hashes = nullptr;
+	index->paths = nullptr;
+	index->payload = nullptr;
+	index->payload_size = 0;
+	index->dead.count = 0;
+}
+
+// Maps the saved index and checks that everything in it stays inside the file
+static bool map_index(Project_Index* index) {
+	Mapped_File file;
+	if (!map_file(index->cache_path, &file)) return false;
+
+	const Project_Index_Header* header = (const Project_Index_Header*)file.data;
+	bool valid = file.size >= sizeof(Project_Index_Header);
+	for (usize i = 0; valid && i < sizeof(header->magic); i++) {
+		valid = header->magic[i] == index->procs->magic[i];
+	}
+	valid = valid && header->files_offset == sizeof(Project_Index_Header);
+	valid = valid && header->file_count < (u64)file.size / sizeof(Indexed_File);
+	valid = valid && header->path_hashes_offset == header->files_offset + header->file_count * sizeof(Indexed_File);
+	valid = valid && header->paths_offset == header->path_hashes_offset + header->file_count * sizeof(Index_Path_Hash);
+	valid = valid && header->paths_count < (u64)file.size / sizeof(tchar);
+	valid = valid && header->payload_offset == get_payload_offset(header->paths_offset, header->paths_count);
+	valid = valid && header->payload_offset <= (u64)file.size;
+	if (!valid) {
+		unmap_file(&file);
+		return false;
+	}
+
+	const Indexed_File* files = (const Indexed_File*)(file.data + header->files_offset);
+	const Index_Path_Hash* path_hashes = (const Index_Path_Hash*)(file.data + header->path_hashes_offset);
+	const tchar* paths = (const tchar*)(file.data + header->paths_offset);
+	for (u64 i = 0; valid && i < header->file_count; i++) {
+		valid = files[i].path_offset + files[i].path_count < header->paths_count && !paths[files[i].path_offset + files[i].path_count];
+		valid = valid && path_hashes[i].file < header->file_count;
+	}
+	const u8* payload = file.data + header->payload_offset;
+	const usize payload_size = file.size - (usize)header->payload_offset;
+	valid = valid && index->procs->is_valid_payload(payload, payload_size, header->file_count);
+	if (!valid) {
+		unmap_file(&file);
+		return false;
+	}
+
+	index->file = file;
+	index->header = header;
+	index->files = files;
+	index->path_hashes = path_hashes;
+	index->paths = paths;
+	index->payload = payload;
+	index->payload_size = payload_size;
+
+	index->dead.reserve((usize)header->file_count);
+	index->dead.count = (usize)header->file_count;
+	ch::mem_zero(index->dead.data, index->dead.count);
+	return true;
+}
+
+// Swaps in the index a build just saved. Whatever changed before it started is in it now.
+static void finish_build(Project_Index* index, Index_Build* build) {
+	if (!build->written) return;
+
+	unmap_index(index);
+	for (Changed_File* file : index->changed) free_changed_file(index->procs, file);
+	index->changed.count = 0;
+	// @NOTE: The build walked every file, whatever changed behind it since is dirty or wants a check
+	if (map_index(index) && !index->wants_check) index->is_current = true;
+}
+
+Project_Index* open_project_index(const ch::Path& root, const Index_Procs* procs) {
+	Project_Index* index = ch_new Project_Index;
+	index->procs = procs;
+	index->root = root;
+	index->dead.allocator = ch::get_heap_allocator();
+	index->changed.allocator = ch::get_heap_allocator();
+	index->dirty.allocator = ch::get_heap_allocator();
+
+	// Index files are named after a hash of the project's root
+	ch::Path cache_path;
+	if (!get_cache_directory(&cache_path)) return index;
+	tchar name[32];
+	ch::sprintf(name, CH_TEXT("%016llx.%s"), (unsigned long long)ch::fnv1_hash(root.data, root.count * sizeof(tchar)), procs->extension);
+	if (!append_path_name(&cache_path, name)) return index;
+	index->cache_path = cache_path;
+
+	if (map_index(index)) {
+		start_refresh(index, true);
+	} else {
+		start_build(index);
+	}
+	return index;
+}
+
+void close_project_index(Project_Index* index) {
+	if (index->build) index->build->walk.cancel.store(true);
+	if (index->refresh) index->refresh->walk.cancel.store(true);
+	while ((index->build && !is_build_done(index->build)) || (index->refresh && !index->refresh->walk.is_done())) {
+		if (index->build) push_write_once_walked(index->build);
+		std::this_thread::yield();
+	}
+	if (index->build) free_build(index->build);
+	if (index->refresh) free_refresh(index->procs, index->refresh);
+
+	unmap_index(index);
+	index->dead.free();
+	for (Changed_File* file : index->changed) free_changed_file(index->procs, file);
+	index->changed.free();
+	index->dirty.free();
+	ch_delete index;
+}
+
+void note_indexed_file_changed(Project_Index* index, const ch::Path& path) {
+	// @NOTE: Paths the index turns down still count, they could be directories that went away with indexed files in them
+	if (!is_path_under(path, index->root)) return;
+
+	for (const ch::Path& it : index->dirty) {
+		if (is_same_path(it, path)) return;
+	}
+	index->dirty.push(path);
+}
+
+void check_project_index(Project_Index* index) {
+	// @NOTE: A check or build that's already running could have gone past a file before it changed, so a new check
+	// starts after it
+	index->wants_check = true;
+	index->is_current = false;
+}
+
+bool is_indexed_root(const Project_Index* index, const ch::Path& root) {
+	return is_same_path(root, index->root) || is_path_under(root, index->root);
+}
+
+ch::Path get_indexed_path(const Project_Index* index, usize file) {
+	ch::Path path = index->root;
+	path.append(index->paths + index->files[file].path_offset);
+	return path;
+}
+
+const ch::Path* get_reindexing_files(const Project_Index* index, usize* out_count) {
+	if (!index->refresh || index->refresh->is_check) {
+		*out_count = 0;
+		return nullptr;
+	}
+	*out_count = index->refresh->paths.count;
+	return index->refresh->paths.data;
+}
+
+void tick_project_index(Project_Index* index) {
+	if (Index_Build* build = index->build) {
+		push_write_once_walked(build);
+		if (!is_build_done(build)) return;
+
+		index->build = nullptr;
+		finish_build(index, build);
+		free_build(build);
+	}
+
+	if (Index_Refresh* refresh = index->refresh) {
+		if (!refresh->walk.is_done()) return;
+
+		index->refresh = nullptr;
+		finish_refresh(index, refresh);
+		free_refresh(index->procs, refresh);
+	}
+
+	if (!index->header) return;
+	if (index->wants_check) {
+		index->wants_check = false;
+		start_refresh(index, true);
+	} else if (index->dirty.count) {
+		start_refresh(index, false);
+	} else if (index->changed.count > ch::max(min_rebuild_changes, get_indexed_file_count(index) / 8)) {
+		start_build(index);
+	}
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "platform.h"
+
+#include <ch_stl/filesystem.h>
+
+/* What the indexes of a project's files share. Each one is built on the job pool during the same walk project
+   searches do and saved in the cache directory as a file that's mapped and used in place: a file table with a hash
+   table from relative paths to files, followed by the index's own payload.
+
+   Opening a project maps it and then checks every file's stamp in the background, indexing again only what changed.
+   After that the index is kept current by the watch on the project's tree: files it sees change get indexed again
+   and directories it sees go away take their files with them. Changed files pile up in memory on top of the mapped
+   index until there are enough to make rebuilding worth it. Indexes only say how to index files into a payload, how to
+   write a build's payloads out and how to check a saved one. */
+
+// The layout of the saved index. Everything is used straight out of the mapping.
+struct Project_Index_Header {
+	u8 magic[8];
+	u64 file_count;
+	// Indexed_File for every file
+	u64 files_offset;
+	// Index_Path_Hash for every file, sorted by hash
+	u64 path_hashes_offset;
+	// Relative paths, each followed by a 0
+	u64 paths_offset;
+	u64 paths_count;
+	// The index's own, 8 byte aligned and up to the end of the file
+	u64 payload_offset;
+};
+
+struct Indexed_File {
+	// In tchars from the start of the paths
+	u64 path_offset;
+	u64 path_count;
+	u64 size;
+	u64 mtime;
+	// The index's own
+	u64 flags;
+};
+
+struct Index_Path_Hash {
+	u64 hash;
+	u64 file;
+};
+
+// Files indexed by one job of a build. Their indices start at first_file, the payload numbers them from 0.
+struct Index_Batch {
+	u32 first_file;
+	ch::Array<Indexed_File> files;
+	ch::Array<tchar> paths;
+	void* payload;
+};
+
+// A file that changed since the index was saved, indexed again in memory as a payload of its own
+struct Changed_File {
+	ch::Path path;
+	u64 hash;
+	Indexed_File file;
+	void* payload;
+};
+
+// How an index goes from files to its payload. Everything but is_valid_payload runs on job threads.
+struct Index_Procs {
+	u8 magic[8];
+	// Of the saved index, which is named after a hash of the project's root
+	const tchar* extension;
+	// Files it turns down aren't in the index at all. Every file is when it's null.
+	bool (*is_indexed_path)(const ch::Path& path);
+
+	// Whatever a job needs to index one file after another
+	void* (*new_scratch)();
+	void (*free_scratch)(void* scratch);
+
+	void* (*new_payload)();
+	// Indexes path into payload as its local_file and sets the size, mtime and flags of out_file
+	void (*index_file)(void* scratch, const ch::Path& path, u32 local_file, void* payload, Indexed_File* out_file);
+	// Called once every file of the payload is in
+	void (*finish_payload)(void* scratch, void* payload);
+	void (*free_payload)(void* payload);
+
+	// Appends the payload of the batches, which are in file order, to the saved index
+	bool (*write_payload)(const Index_Batch* const* batches, usize count, OS_File file);
+	// Checks that everything in a saved payload stays inside it
+	bool (*is_valid_payload)(const u8* payload, usize size, u64 file_count);
+};
+
+struct Index_Build;
+struct Index_Refresh;
+
+struct Project_Index {
+	const Index_Procs* procs;
+	ch::Path root;
+	ch::Path cache_path;
+
+	// The saved index. Nothing is mapped until the first build is done.
+	Mapped_File file;
+	const Project_Index_Header* header = nullptr;
+	const Indexed_File* files = nullptr;
+	const Index_Path_Hash* path_hashes = nullptr;
+	const tchar* paths = nullptr;
+	const u8* payload = nullptr;
+	usize payload_size = 0;
+
+	// One per file of the mapped index. Set once the file changed or went away, changed has what's there now.
+	ch::Array<u8> dead;
+	ch::Array<Changed_File*> changed;
+	// Paths whose watch fired and that no refresh has picked up yet
+	ch::Array<ch::Path> dirty;
+	// Set by check_project_index until its check starts
+	bool wants_check = false;
+	// Set once a check or build went over every file and no check was asked for since. It stays set for as long as
+	// the watch doesn't lose track of changes.
+	bool is_current = false;
+
+	// At most one of these runs at a time
+	Index_Build* build = nullptr;
+	Index_Refresh* refresh = nullptr;
+};
+
+// Maps root's index from the cache directory or starts building it
+Project_Index* open_project_index(const ch::Path& root, const Index_Procs* procs);
+
+// Stops every job, waits for them and frees the index
+void close_project_index(Project_Index* index);
+
+// Has path indexed again soon, or everything under it dropped when it went away. Called when a watch sees it change.
+void note_indexed_file_changed(Project_Index* index, const ch::Path& path);
+
+// Has every file's stamp checked against the index again, like after the watch lost track of changes. The index
+// isn't current until that's done.
+void check_project_index(Project_Index* index);
+
+// Whether root is the index's root or under it
+bool is_indexed_root(const Project_Index* index, const ch::Path& root);
+
+CH_FORCEINLINE usize get_indexed_file_count(const Project_Index* index) {
+	return index->header ? (usize)index->header->file_count : 0;
+}
+
+// Full path of a file of the mapped index
+ch::Path get_indexed_path(const Project_Index* index, usize file);
+
+// The files handed to a refresh that isn't done with them yet, which could have anything in them now
+const ch::Path* get_reindexing_files(const Project_Index* index, usize* out_count);
+
+// Installs finished builds and indexes changed files again. Called once a tick on the main thread.
+void tick_project_index(Project_Index* index);
@@ -0,0 +1,199 @@
+#include "project_loader.h"
+#include "editor.h"
+#include "jobs.h"
+#include "binary_data.h"
+#include "file_watch.h"
+#include "journal.h"
+#include "project_walk.h"
+
+#include <ch_stl/math.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// Most codepoint storage the file jobs of every load may have allocated at once
+static const usize project_memory_budget = 256 * 1024 * 1024;
+// Files bigger than this are left for opening one at a time, where they get streamed or mapped
+static const u64 project_max_file_size = 64 * 1024 * 1024;
+// New buffers registered per tick so a big tree doesn't stall a frame
+static const usize max_buffers_per_tick = 256;
+
+struct Project_File {
+	ch::Path path;
+	u64 size;
+};
+
+struct Project_Load {
+	// The same walk project searches and indexes do, so the same files are left out
+	Project_Walk walk;
+
+	// Pushed by the walk's jobs as they go, so decoding starts long before the walk is done
+	std::mutex files_mutex;
+	ch::Array<Project_File> files;
+
+	// Main thread only
+	usize next_file = 0;
+	usize jobs_in_flight = 0;
+};
+
+// One file decoded on a worker into a buffer that isn't registered yet
+struct Loaded_File {
+	Project_Load* load;
+	ch::Path path;
+	usize cost;
+
+	Buffer buffer;
+	bool succeeded;
+};
+
+static ch::Array<Project_Load*> project_loads;
+// Main thread only. What every file handed to a job and not registered yet costs against the budget.
+static usize bytes_in_flight = 0;
+
+static std::mutex finished_mutex;
+static ch::Array<Loaded_File*> finished_files;
+
+// Sizes go with the paths so files can be handed out against the budget without another look at the disk
+static void add_walked_files(Project_Walk* walk, const ch::Path* paths, usize count) {
+	Project_Load* load = (Project_Load*)walk->user;
+
+	ch::Array<Project_File> found(ch::get_heap_allocator());
+	defer(found.free());
+	found.reserve(count);
+	for (usize i = 0; i < count; i++) {
+		File_Stamp stamp;
+		if (!get_file_stamp(paths[i], &stamp)) continue;
+
+		Project_File file;
+		file.path = paths[i];
+		file.size = stamp.size;
+		found.push(file);
+	}
+
+	std::lock_guard<std::mutex> lock(load->files_mutex);
+	for (const Project_File& file : found) load->files.push(file);
+}
+
+// Everything load_file does short of touching the buffer registry, which is the main thread's
+static void load_project_file(void* user) {
+	Loaded_File* loaded = (Loaded_File*)user;
+
+	loaded->succeeded = false;
+	File_Stamp stamp;
+	Mapped_File file;
+	if (!loaded->load->walk.cancel.load(std::memory_order_relaxed) && get_file_stamp(loaded->path, &stamp) && map_file(loaded->path, &file)) {
+		// One mapping for both telling binary apart and decoding, most files are small enough that opening them twice shows
+		if (looks_binary(file.data, file.size)) {
+			loaded->succeeded = loaded->buffer.open_binary(loaded->path);
+		} else {
+			loaded->buffer.load_from_memory(file.data, file.size);
+			loaded->buffer.full_path = loaded->path;
+			loaded->buffer.disk_stamp = stamp;
+			loaded->succeeded = true;
+		}
+		unmap_file(&file);
+	}
+
+	std::lock_guard<std::mutex> lock(finished_mutex);
+	finished_files.push(loaded);
+}
+
+void start_project_load(const ch::Path& root) {
+	Project_Load* load = ch_new Project_Load;
+	init_project_walk(&load->walk, root, project_max_file_size, add_walked_files, load);
+	load->files.allocator = ch::get_heap_allocator();
+
+	project_loads.allocator = ch::get_heap_allocator();
+	finished_files.allocator = ch::get_heap_allocator();
+	project_loads.push(load);
+	push_walk_root(&load->walk);
+}
+
+// Returns the new buffer, or nullptr when the file didn't make it
+static Buffer* register_loaded_file(Loaded_File* loaded) {
+	Project_Load* load = loaded->load;
+	load->jobs_in_flight -= 1;
+	bytes_in_flight -= loaded->cost;
+
+	if (!loaded->succeeded || load->walk.cancel.load(std::memory_order_relaxed)) {
+		loaded->buffer.free();
+		return nullptr;
+	}
+
+	// The worker's buffer moves into the one the registry made, which keeps its id
+	Buffer* buffer = create_buffer();
+	const Buffer_ID id = buffer->id;
+	buffer->free();
+	*buffer = loaded->buffer;
+	buffer->id = id;
+
+	watch_buffer(buffer);
+	return buffer;
+}
+
+// Hands out files until the budget is used up. A file always goes when nothing else is in flight, however big.
+static void dispatch_files(Project_Load* load) {
+	std::lock_guard<std::mutex> lock(load->files_mutex);
+	while (load->next_file < load->files.count) {
+		const Project_File& file = load->files[load->next_file];
+		const usize cost = (usize)file.size * sizeof(u32);
+		if (bytes_in_flight && bytes_in_flight + cost > project_memory_budget) break;
+
+		Loaded_File* loaded = ch_new Loaded_File;
+		loaded->load = load;
+		loaded->path = file.path;
+		loaded->cost = cost;
+
+		load->next_file += 1;
+		load->jobs_in_flight += 1;
+		bytes_in_flight += cost;
+		push_job(load_project_file, loaded);
+	}
+}
+
+void tick_project_loads() {
+	Loaded_File* batch[max_buffers_per_tick];
+	usize batch_count = 0;
+	{
+		std::lock_guard<std::mutex> lock(finished_mutex);
+		batch_count = ch::min(finished_files.count, max_buffers_per_tick);
+		for (usize i = 0; i < batch_count; i++) batch[i] = finished_files[i];
+		for (usize i = batch_count; i < finished_files.count; i++) finished_files[i - batch_count] = finished_files[i];
+		finished_files.count -= batch_count;
+	}
+	Buffer_ID registered[max_buffers_per_tick];
+	usize registered_count = 0;
+	for (usize i = 0; i < batch_count; i++) {
+		const Buffer* buffer = register_loaded_file(batch[i]);
+		if (buffer) registered[registered_count++] = buffer->id;
+		ch_delete batch[i];
+	}
+	recover_buffers(registered, registered_count);
+
+	for (usize i = 0; i < project_loads.count;) {
+		Project_Load* load = project_loads[i];
+		if (!load->walk.cancel.load(std::memory_order_relaxed)) dispatch_files(load);
+
+		const bool walked = load->walk.is_done();
+		const bool dispatched = load->walk.cancel.load(std::memory_order_relaxed) || load->next_file == load->files.count;
+		if (walked && dispatched && !load->jobs_in_flight) {
+			free_project_walk(&load->walk);
+			load->files.free();
+			ch_delete load;
+			project_loads.remove(i);
+			continue;
+		}
+		i += 1;
+	}
+}
+
+void shutdown_project_loads() {
+	for (Project_Load* load : project_loads) load->walk.cancel.store(true);
+	while (project_loads.count) {
+		tick_project_loads();
+		std::this_thread::yield();
+	}
+	project_loads.free();
+	finished_files.free();
+}
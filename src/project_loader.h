@@ -0,0 +1,16 @@
+#pragma once
+
+#include <ch_stl/filesystem.h>
+
+/* Opens every file under a directory. Walking the tree, reading, decoding, normalizing line endings and building
+   line indexes all happen on the job pool with a cap on the bytes being decoded at once, so a huge tree can't run
+   memory out. Finished buffers get registered on the main thread a batch per tick. */
+
+// Leaves out what project walks do, hidden and ignored files, and anything too big to be worth decoding in bulk
+void start_project_load(const ch::Path& root);
+
+// Registers finished buffers and feeds the job pool more files. Called once a tick on the main thread.
+void tick_project_loads();
+
+// Stops every load and waits for its jobs. Called before the job pool goes away.
+void shutdown_project_loads();
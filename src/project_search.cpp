@@ -0,0 +1,415 @@
+#include "project_search.h"
+#include "editor.h"
+#include "buffer_view.h"
+#include "find.h"
+#include "text_scan.h"
+#include "simd.h"
+#include "project_walk.h"
+#include "session.h"
+#include "trigram_index.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/memory.h>
+#include <ch_stl/string.h>
+
+#include <thread>
+
+// Codepoints of open buffers searched per tick so a frame doesn't stall
+static const usize open_buffer_budget = 16 * 1024 * 1024;
+// Result lines get cut after this many codepoints of their text
+static const usize max_result_text = 200;
+// The search stops after this many result lines, nobody reads further
+static const usize max_result_lines = 100000;
+
+struct Project_Search {
+	Project_Walk walk;
+	Find_Query query;
+
+	// The query as bytes when a file can't match without having them in it, empty otherwise
+	ch::Array<u8> required_bytes;
+
+	// Hashes of the paths of open buffers under root, sorted. Those files are searched from their buffer.
+	ch::Array<u64> open_paths;
+
+	std::mutex mutex;
+	// Result lines not moved into the results buffer yet
+	ch::Array<u32> results;
+	usize result_lines = 0;
+	usize file_count = 0;
+
+	// Main thread only
+	ch::Array<Buffer_ID> open_buffers;
+	usize next_open_buffer = 0;
+	bool finished = false;
+};
+
+static Project_Search* active_search = nullptr;
+// Cancelled searches whose jobs haven't all returned yet
+static ch::Array<Project_Search*> dropped_searches;
+
+static Buffer_ID results_buffer;
+static bool has_results_buffer = false;
+
+CH_FORCEINLINE static u32 get_codepoint(const Buffer_Halves& halves, usize index) {
+	return index < halves.front_count ? halves.front[index] : halves.back[index - halves.front_count];
+}
+
+CH_FORCEINLINE static u64 hash_path(const tchar* path, usize count) {
+	return ch::fnv1_hash(path, count * sizeof(tchar));
+}
+
+// Index of the first open path hash that isn't below hash
+static usize find_open_path(const Project_Search* search, u64 hash) {
+	usize low = 0;
+	usize high = search->open_paths.count;
+	while (low < high) {
+		const usize mid = low + (high - low) / 2;
+		if (search->open_paths[mid] < hash) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+static bool is_open_path(const Project_Search* search, const ch::Path& path) {
+	const u64 hash = hash_path(path.data, path.count);
+	const usize index = find_open_path(search, hash);
+	return index < search->open_paths.count && search->open_paths[index] == hash;
+}
+
+static void push_result_line(ch::Array<u32>* out, const tchar* path, usize path_count, usize line, usize column, const Buffer_Halves& halves, usize line_start, usize line_end) {
+	for (usize i = 0; i < path_count; i++) out->push((u32)path[i]);
+
+	tchar position[64];
+	ch::sprintf(position, CH_TEXT(":%llu:%llu: "), (unsigned long long)(line + 1), (unsigned long long)(column + 1));
+	for (usize i = 0; position[i]; i++) out->push((u32)position[i]);
+
+	const usize end = ch::min(line_end, line_start + max_result_text);
+	out->reserve(end - line_start + 1);
+	copy_codepoints(halves, line_start, end, out->data + out->count);
+	out->count += end - line_start;
+	out->push(ch::eol);
+}
+
+// Pushes a result line for every line of halves with a match on it and returns how many that was. Only the first match
+// of a line is looked for.
+static usize search_text(const Find_Query& query, Regex_Cache* cache, const Buffer_Halves& halves, const tchar* path, usize path_count, ch::Array<u32>* out) {
+	const usize total = halves.front_count + halves.back_count;
+
+	Regex_Match match;
+	defer(match.groups.free());
+	usize lines = 0;
+	usize line = 0;
+	usize line_start = 0;
+	usize counted_to = 0;
+	usize last_end = no_match;
+	usize index = 0;
+	while (index <= total && find_next(query, halves, cache, index, last_end, total + 1, &match)) {
+		const usize eols = count_codepoint(halves, counted_to, match.start, ch::eol);
+		if (eols) {
+			line += eols;
+			line_start = match.start;
+			while (get_codepoint(halves, line_start - 1) != ch::eol) line_start -= 1;
+		}
+		counted_to = match.start;
+
+		const usize line_end = find_codepoint(halves, match.start, total, ch::eol);
+		push_result_line(out, path, path_count, line, match.start - line_start, halves, line_start, line_end);
+		lines += 1;
+
+		// @NOTE: The rest of the line is skipped since it already has its result
+		last_end = match.end;
+		index = ch::max(line_end, match.end > match.start ? match.end : match.end + 1);
+	}
+	return lines;
+}
+
+// True when needle shows up in data. Filters 16 positions at a time on its first and last byte like find_literal does.
+static bool contains_bytes(const u8* data, usize size, const u8* needle, usize count) {
+	if (count > size) return false;
+	auto matches_at = [&](usize i) {
+		for (usize j = 0; j < count; j++) {
+			if (data[i + j] != needle[j]) return false;
+		}
+		return true;
+	};
+
+	const usize last = size - count;
+	usize i = 0;
+	for (; i + 16 <= last + 1; i += 16) {
+		u32 mask = match_bytes_16(data + i, needle[0]) & match_bytes_16(data + i + count - 1, needle[count - 1]);
+		while (mask) {
+			if (matches_at(i + count_trailing_zeros(mask))) return true;
+			mask &= mask - 1;
+		}
+	}
+	for (; i <= last; i++) {
+		if (matches_at(i)) return true;
+	}
+	return false;
+}
+
+// What a job keeps around between the files it searches
+struct Search_Scratch {
+	ch::Array<u32> text;
+	ch::Array<Line_Ending_Exception> exceptions;
+	ch::Array<u32> results;
+	Regex_Cache cache;
+
+	void init(const Find_Query& query) {
+		text.allocator = ch::get_heap_allocator();
+		exceptions.allocator = ch::get_heap_allocator();
+		results.allocator = ch::get_heap_allocator();
+		if (query.is_regex()) cache.init(&query.regex);
+	}
+
+	void free(const Find_Query& query) {
+		text.free();
+		exceptions.free();
+		results.free();
+		if (query.is_regex()) cache.free();
+	}
+};
+
+static void search_file(Project_Search* search, const ch::Path& path, Search_Scratch* scratch) {
+	if (is_open_path(search, path)) return;
+
+	Mapped_File file;
+	if (!map_file(path, &file)) return;
+	defer(unmap_file(&file));
+	if (looks_binary(file.data, file.size)) return;
+
+	usize bom_size = 0;
+	const Text_Format format = detect_text_format(file.data, file.size, &bom_size);
+
+	// @NOTE: Most files don't match at all, and telling from the bytes skips decoding them
+	const ch::Array<u8>& required = search->required_bytes;
+	const bool is_ascii_compatible = format.encoding == TE_UTF8 || format.encoding == TE_Latin1;
+	if (required.count && is_ascii_compatible && !contains_bytes(file.data + bom_size, file.size - bom_size, required.data, required.count)) return;
+
+	scratch->text.count = 0;
+	scratch->text.reserve(file.size - bom_size + 1);
+	usize count = decode_text(format.encoding, file.data + bom_size, file.size - bom_size, scratch->text.data);
+	scratch->exceptions.count = 0;
+	count = normalize_line_endings(scratch->text.data, count, detect_line_ending(scratch->text.data, count), 0, &scratch->exceptions);
+
+	const Buffer_Halves halves = { scratch->text.data, count, nullptr, 0 };
+	usize path_count;
+	const tchar* relative_path = get_relative_path(search->walk.root, path, &path_count);
+	scratch->results.count = 0;
+	const usize lines = search_text(search->query, search->query.is_regex() ? &scratch->cache : nullptr, halves, relative_path, path_count, &scratch->results);
+	if (!lines) return;
+
+	std::lock_guard<std::mutex> lock(search->mutex);
+	for (u32 c : scratch->results) search->results.push(c);
+	search->result_lines += lines;
+	search->file_count += 1;
+	if (search->result_lines >= max_result_lines) search->walk.cancel.store(true, std::memory_order_relaxed);
+}
+
+static void search_files(Project_Walk* walk, const ch::Path* paths, usize count) {
+	Project_Search* search = (Project_Search*)walk->user;
+
+	Search_Scratch scratch;
+	scratch.init(search->query);
+	for (usize i = 0; i < count && !walk->cancel.load(std::memory_order_relaxed); i++) {
+		search_file(search, paths[i], &scratch);
+	}
+	scratch.free(search->query);
+}
+
+static void free_search(Project_Search* search) {
+	search->query.free();
+	search->required_bytes.free();
+	search->open_paths.free();
+	search->results.free();
+	free_project_walk(&search->walk);
+	search->open_buffers.free();
+	ch_delete search;
+}
+
+static void append_results(const u32* text, usize count) {
+	Buffer* buffer = has_results_buffer ? find_buffer(results_buffer) : nullptr;
+	if (!buffer) return;
+	buffer->insert_text(buffer->gap_buffer.count(), text, count);
+}
+
+static void append_results(const tchar* text) {
+	ch::Array<u32> codepoints(ch::get_heap_allocator());
+	defer(codepoints.free());
+	for (usize i = 0; text[i]; i++) codepoints.push((u32)text[i]);
+	append_results(codepoints.data, codepoints.count);
+}
+
+bool start_project_search(const ch::Path& root, const u32* query, usize count, u32 flags) {
+	if (!count) return false;
+
+	Project_Search* search = ch_new Project_Search;
+	if (!search->query.compile(query, count, flags)) {
+		ch_delete search;
+		return false;
+	}
+	stop_project_search();
+
+	init_project_walk(&search->walk, root, max_searched_file_size, search_files, search);
+	search->required_bytes.allocator = ch::get_heap_allocator();
+	search->open_paths.allocator = ch::get_heap_allocator();
+	search->results.allocator = ch::get_heap_allocator();
+	search->open_buffers.allocator = ch::get_heap_allocator();
+
+	// Line endings get normalized after decoding and case folding works on codepoints, so those queries can't be
+	// looked for in the raw bytes
+	if (!search->query.is_regex() && !(flags & SF_Ignore_Case)) {
+		for (usize i = 0; i < count; i++) {
+			if (query[i] >= 0x80 || query[i] == '\r' || query[i] == '\n') {
+				search->required_bytes.count = 0;
+				break;
+			}
+			search->required_bytes.push((u8)query[i]);
+		}
+	}
+
+	// @NOTE: Open buffers are picked before any job runs so a file is never searched both on disk and in memory
+	for (Buffer_ID id : get_buffer_ids()) {
+		const Buffer* buffer = find_buffer(id);
+		if (!buffer || !is_path_under(buffer->full_path, root) || buffer->is_binary()) continue;
+		// Mapped and loading buffers aren't text in memory, and session buffers nothing showed yet are still empty, so
+		// their file gets searched instead
+		if (buffer->is_read_only() || buffer->is_loading() || is_pending_buffer(id)) continue;
+		const u64 hash = hash_path(buffer->full_path.data, buffer->full_path.count);
+		search->open_paths.insert(hash, find_open_path(search, hash));
+		search->open_buffers.push(id);
+	}
+
+	Buffer* buffer = has_results_buffer ? find_buffer(results_buffer) : nullptr;
+	if (buffer) {
+		Text_Edit cleared = {};
+		cleared.removed = buffer->gap_buffer.count();
+		buffer->remove_text(0, cleared.removed);
+		shift_view_cursors(buffer->id, cleared);
+	} else {
+		buffer = create_buffer();
+		results_buffer = buffer->id;
+		has_results_buffer = true;
+		push_view(buffer->id);
+	}
+
+	append_results(CH_TEXT("Searching "));
+	append_results(root.data);
+	append_results(CH_TEXT("\n"));
+
+	active_search = search;
+	dropped_searches.allocator = ch::get_heap_allocator();
+	// Only the files that have every trigram of the query get searched when the index can tell which those are
+	ch::Array<ch::Path> candidates(ch::get_heap_allocator());
+	defer(candidates.free());
+	if (find_trigram_candidates(root, query, count, flags, &candidates)) {
+		push_walk_files(&search->walk, candidates.data, candidates.count);
+	} else {
+		push_walk_root(&search->walk);
+	}
+	return true;
+}
+
+bool is_results_buffer(Buffer_ID id) {
+	return has_results_buffer && results_buffer == id;
+}
+
+void stop_project_search() {
+	if (!active_search) return;
+	active_search->walk.cancel.store(true);
+	dropped_searches.push(active_search);
+	active_search = nullptr;
+}
+
+// Searches open buffers until the budget for the tick runs out
+static void search_open_buffers(Project_Search* search) {
+	Regex_Cache cache;
+	if (search->query.is_regex()) cache.init(&search->query.regex);
+	ch::Array<u32> results(ch::get_heap_allocator());
+
+	usize searched = 0;
+	while (search->next_open_buffer < search->open_buffers.count && searched < open_buffer_budget) {
+		if (search->walk.cancel.load(std::memory_order_relaxed)) break;
+
+		const Buffer_ID id = search->open_buffers[search->next_open_buffer];
+		const Buffer* buffer = find_buffer(id);
+		search->next_open_buffer += 1;
+		if (!buffer || buffer->is_binary() || buffer->is_read_only() || buffer->is_loading() || is_pending_buffer(id)) continue;
+
+		const Buffer_Halves halves = buffer->get_halves();
+		usize path_count;
+		const tchar* relative_path = get_relative_path(search->walk.root, buffer->full_path, &path_count);
+		results.count = 0;
+		const usize lines = search_text(search->query, search->query.is_regex() ? &cache : nullptr, halves, relative_path, path_count, &results);
+		searched += halves.front_count + halves.back_count;
+		if (!lines) continue;
+
+		std::lock_guard<std::mutex> lock(search->mutex);
+		for (u32 c : results) search->results.push(c);
+		search->result_lines += lines;
+		search->file_count += 1;
+		if (search->result_lines >= max_result_lines) search->walk.cancel.store(true, std::memory_order_relaxed);
+	}
+
+	results.free();
+	if (search->query.is_regex()) cache.free();
+}
+
+void tick_project_search() {
+	for (usize i = 0; i < dropped_searches.count;) {
+		Project_Search* search = dropped_searches[i];
+		if (search->walk.is_done()) {
+			free_search(search);
+			dropped_searches.remove(i);
+			continue;
+		}
+		i += 1;
+	}
+
+	Project_Search* search = active_search;
+	if (!search || search->finished) return;
+
+	// The results went away with their buffer, so nothing would show what's still found
+	if (!find_buffer(results_buffer)) {
+		has_results_buffer = false;
+		stop_project_search();
+		return;
+	}
+
+	search_open_buffers(search);
+
+	// The walk is checked before taking the results so the last ones can't slip in after the footer
+	const bool jobs_done = search->walk.is_done();
+	ch::Array<u32> results(ch::get_heap_allocator());
+	defer(results.free());
+	{
+		std::lock_guard<std::mutex> lock(search->mutex);
+		results = search->results;
+		search->results.data = nullptr;
+		search->results.count = 0;
+		search->results.allocated = 0;
+	}
+	if (results.count) append_results(results.data, results.count);
+
+	const bool cancelled = search->walk.cancel.load(std::memory_order_relaxed);
+	if (!jobs_done || (!cancelled && search->next_open_buffer < search->open_buffers.count)) return;
+
+	search->finished = true;
+	tchar footer[256];
+	ch::sprintf(footer, CH_TEXT("%llu lines in %llu files%s%s"), (unsigned long long)search->result_lines, (unsigned long long)search->file_count,
+		search->result_lines >= max_result_lines ? CH_TEXT(" (stopped early)") : CH_TEXT(""),
+		search->walk.skipped_count ? CH_TEXT(", skipped some files too big to search") : CH_TEXT(""));
+	append_results(footer);
+}
+
+void shutdown_project_search() {
+	stop_project_search();
+	while (dropped_searches.count) {
+		tick_project_search();
+		std::this_thread::yield();
+	}
+	dropped_searches.free();
+}
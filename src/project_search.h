@@ -0,0 +1,27 @@
+#pragma once
+
+#include "buffer.h"
+
+#include <ch_stl/filesystem.h>
+
+/* Searching every file under a directory. Each directory gets listed by a job of its own, so the walk spreads over the
+   pool as soon as the tree branches, and its files get mapped, decoded and searched in batches on the pool as well.
+   .gitignore files are honoured on the way down with git's pattern rules. Files that are open get searched from their
+   buffer on the main thread instead, so what's shown is what's being edited rather than what was last saved.
+
+   Results stream into a buffer of their own as path:line:column: text, one line per line with a match. Starting a
+   new search drops the one before it. */
+
+// Starts searching every file under root for query with Search_Flags. Returns false when query is a regex that
+// doesn't compile.
+bool start_project_search(const ch::Path& root, const u32* query, usize count, u32 flags);
+void stop_project_search();
+
+// Whether the buffer is the one results go into
+bool is_results_buffer(Buffer_ID id);
+
+// Searches open buffers and moves results into the results buffer. Called once a tick on the main thread.
+void tick_project_search();
+
+// Stops the search and waits for its jobs. Called before the job pool goes away.
+void shutdown_project_search();
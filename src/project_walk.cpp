@@ -0,0 +1,433 @@
+#include "project_walk.h"
+#include "jobs.h"
+#include "platform.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/string.h>
+
+// Bytes of files in one batch. The rest of a directory gets split into more batches.
+static const u64 walk_batch_size = 8 * 1024 * 1024;
+// Files in one batch when their size isn't known
+static const usize walk_batch_files = 64;
+
+struct Ignore_Rule {
+	ch::Array<tchar> pattern;
+	bool negated;
+	bool directory_only;
+	// Matched against the path from the .gitignore's directory rather than only the name
+	bool anchored;
+};
+
+// The rules of one .gitignore. The ones of the directories above it are in parent.
+struct Ignore_Level {
+	const Ignore_Level* parent;
+	// Length of the path from the walk's root to the .gitignore's directory
+	usize base_count;
+	ch::Array<Ignore_Rule> rules;
+};
+
+CH_FORCEINLINE static bool is_separator(tchar c) {
+	return c == '/' || c == '\\';
+}
+
+const tchar* get_relative_path(const ch::Path& root, const ch::Path& path, usize* out_count) {
+	usize start = ch::min(root.count, path.count);
+	if (start < path.count && is_separator(path.data[start])) start += 1;
+	*out_count = path.count - start;
+	return path.data + start;
+}
+
+bool is_path_under(const ch::Path& path, const ch::Path& root) {
+	if (path.count <= root.count) return false;
+	for (usize i = 0; i < root.count; i++) {
+		if (path.data[i] != root.data[i]) return false;
+	}
+	return is_separator(root.data[root.count - 1]) || is_separator(path.data[root.count]);
+}
+
+bool is_same_path(const ch::Path& a, const ch::Path& b) {
+	if (a.count != b.count) return false;
+	for (usize i = 0; i < a.count; i++) {
+		if (a.data[i] != b.data[i]) return false;
+	}
+	return true;
+}
+
+// Glob matching the way git does it. '*' and '?' stay inside a path component, "**" doesn't and "**/" can also match
+// no directories at all.
+static bool match_glob(const tchar* p, const tchar* p_end, const tchar* t, const tchar* t_end) {
+	while (p < p_end) {
+		const tchar c = *p;
+		if (c == '*') {
+			if (p + 1 < p_end && p[1] == '*') {
+				p += 2;
+				if (p < p_end && *p == '/') {
+					p += 1;
+					for (const tchar* s = t; s <= t_end; s++) {
+						if ((s == t || is_separator(s[-1])) && match_glob(p, p_end, s, t_end)) return true;
+					}
+					return false;
+				}
+				for (const tchar* s = t; s <= t_end; s++) {
+					if (match_glob(p, p_end, s, t_end)) return true;
+				}
+				return false;
+			}
+
+			p += 1;
+			for (const tchar* s = t;; s++) {
+				if (match_glob(p, p_end, s, t_end)) return true;
+				if (s == t_end || is_separator(*s)) return false;
+			}
+		}
+
+		if (t == t_end) return false;
+		if (c == '?') {
+			if (is_separator(*t)) return false;
+		} else if (c == '[') {
+			const tchar* q = p + 1;
+			const bool negated = q < p_end && (*q == '!' || *q == '^');
+			if (negated) q += 1;
+
+			bool matched = false;
+			const tchar* class_start = q;
+			while (q < p_end && (*q != ']' || q == class_start)) {
+				tchar low = *q;
+				if (low == '\\' && q + 1 < p_end) low = *++q;
+				tchar high = low;
+				if (q + 2 < p_end && q[1] == '-' && q[2] != ']') {
+					q += 2;
+					high = *q;
+					if (high == '\\' && q + 1 < p_end) high = *++q;
+				}
+				if (*t >= low && *t <= high) matched = true;
+				q += 1;
+			}
+
+			if (q == p_end) {
+				// No closing bracket, so it's just a '['
+				if (*t != '[') return false;
+			} else {
+				if (matched == negated || is_separator(*t)) return false;
+				p = q;
+			}
+		} else if (c == '/') {
+			if (!is_separator(*t)) return false;
+		} else {
+			tchar literal = c;
+			if (c == '\\' && p + 1 < p_end) literal = *++p;
+			if (*t != literal) return false;
+		}
+		p += 1;
+		t += 1;
+	}
+	return t == t_end;
+}
+
+// path is relative to the walk's root and name_start is where its last component starts. The deepest .gitignore
+// with a matching rule decides, and within one the last matching rule does.
+static bool is_ignored(const Ignore_Level* level, const tchar* path, usize count, usize name_start, bool is_directory) {
+	for (; level; level = level->parent) {
+		const usize base = level->base_count ? level->base_count + 1 : 0;
+		if (base > count) continue;
+
+		for (usize i = level->rules.count; i > 0; i--) {
+			const Ignore_Rule& rule = level->rules[i - 1];
+			if (rule.directory_only && !is_directory) continue;
+
+			const tchar* text = rule.anchored ? path + base : path + name_start;
+			if (match_glob(rule.pattern.data, rule.pattern.data + rule.pattern.count, text, path + count)) return !rule.negated;
+		}
+	}
+	return false;
+}
+
+static void parse_ignore_line(const u8* line, usize count, ch::Array<Ignore_Rule>* rules) {
+	if (count && line[count - 1] == '\r') count -= 1;
+	// Trailing spaces don't count unless they're escaped
+	while (count && line[count - 1] == ' ' && !(count > 1 && line[count - 2] == '\\')) count -= 1;
+	if (!count || line[0] == '#') return;
+
+	Ignore_Rule rule = {};
+	usize start = 0;
+	if (line[0] == '!') {
+		rule.negated = true;
+		start = 1;
+	}
+	if (count > start && line[count - 1] == '/') {
+		rule.directory_only = true;
+		count -= 1;
+	}
+	if (start == count) return;
+
+	// A slash anywhere but the end ties the pattern to the .gitignore's directory
+	for (usize i = start; i < count; i++) {
+		if (line[i] == '/') rule.anchored = true;
+	}
+	if (line[start] == '/') start += 1;
+
+	// @NOTE: Patterns are taken a byte at a time, so non-ASCII ones only match where paths are UTF-8 as well
+	rule.pattern.allocator = ch::get_heap_allocator();
+	rule.pattern.reserve(count - start);
+	for (usize i = start; i < count; i++) rule.pattern.push((tchar)line[i]);
+	rules->push(rule);
+}
+
+static void free_ignore_level(Ignore_Level* level) {
+	for (Ignore_Rule& rule : level->rules) rule.pattern.free();
+	level->rules.free();
+	ch_delete level;
+}
+
+// The rules of the .gitignore at path, or nullptr when it has none
+static Ignore_Level* parse_ignore_file(const ch::Path& path, const Ignore_Level* parent, usize base_count) {
+	Mapped_File file;
+	if (!map_file(path, &file)) return nullptr;
+	defer(unmap_file(&file));
+
+	Ignore_Level* level = ch_new Ignore_Level;
+	level->parent = parent;
+	level->base_count = base_count;
+	level->rules.allocator = ch::get_heap_allocator();
+
+	usize line_start = 0;
+	for (usize i = 0; i <= file.size; i++) {
+		if (i < file.size && file.data[i] != '\n') continue;
+		parse_ignore_line(file.data + line_start, i - line_start, &level->rules);
+		line_start = i + 1;
+	}
+
+	if (!level->rules.count) {
+		free_ignore_level(level);
+		return nullptr;
+	}
+	return level;
+}
+
+// The level for a directory with a .gitignore, or parent when it has no rules in it
+static const Ignore_Level* read_ignore_file(Project_Walk* walk, const ch::Path& path, const Ignore_Level* parent, usize base_count) {
+	Ignore_Level* level = parse_ignore_file(path, parent, base_count);
+	if (!level) return parent;
+
+	std::lock_guard<std::mutex> lock(walk->mutex);
+	walk->ignore_levels.push(level);
+	return level;
+}
+
+struct Walk_Batch {
+	Project_Walk* walk;
+	ch::Array<ch::Path> files;
+};
+
+static void run_batch(void* user) {
+	Walk_Batch* batch = (Walk_Batch*)user;
+	Project_Walk* walk = batch->walk;
+	if (!walk->cancel.load(std::memory_order_relaxed)) walk->proc(walk, batch->files.data, batch->files.count);
+
+	batch->files.free();
+	ch_delete batch;
+	walk->jobs_left.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+static Walk_Batch* make_batch(Project_Walk* walk) {
+	Walk_Batch* batch = ch_new Walk_Batch;
+	batch->walk = walk;
+	batch->files.allocator = ch::get_heap_allocator();
+	return batch;
+}
+
+static void push_batch(Walk_Batch* batch) {
+	batch->walk->jobs_left.fetch_add(1, std::memory_order_relaxed);
+	push_job(run_batch, batch);
+}
+
+struct Walk_Directory {
+	Project_Walk* walk;
+	ch::Path path;
+	const Ignore_Level* ignore;
+};
+
+struct Listed_Entry {
+	ch::Path path;
+	u64 size;
+	bool is_directory;
+	usize name_count;
+};
+
+struct Directory_Listing {
+	const ch::Path* directory;
+	ch::Array<Listed_Entry> entries;
+	bool has_ignore_file;
+};
+
+static bool is_name(const tchar* name, const tchar* expected) {
+	for (; *name && *name == *expected; name++, expected++) {}
+	return *name == *expected;
+}
+
+static void on_walk_entry(void* user, const Directory_Entry& entry) {
+	Directory_Listing* listing = (Directory_Listing*)user;
+	if (entry.name[0] == '.') {
+		if (!entry.is_directory && is_name(entry.name, CH_TEXT(".gitignore"))) listing->has_ignore_file = true;
+		return;
+	}
+
+	Listed_Entry listed;
+	listed.path = *listing->directory;
+	listed.path.append(entry.name);
+	listed.size = entry.size;
+	listed.is_directory = entry.is_directory;
+	listed.name_count = ch::strlen(entry.name);
+	listing->entries.push(listed);
+}
+
+
+static void push_directory(Project_Walk* walk, const ch::Path& path, const Ignore_Level* ignore);
+
+// Lists one directory, pushes a job for every directory in it and hands its files out in batches
+static void walk_directory(const Walk_Directory* directory) {
+	Project_Walk* walk = directory->walk;
+
+	Directory_Listing listing;
+	listing.directory = &directory->path;
+	listing.entries.allocator = ch::get_heap_allocator();
+	listing.has_ignore_file = false;
+	defer(listing.entries.free());
+	list_directory(directory->path, on_walk_entry, &listing);
+
+	usize directory_count;
+	get_relative_path(walk->root, directory->path, &directory_count);
+	const Ignore_Level* ignore = directory->ignore;
+	if (listing.has_ignore_file) {
+		ch::Path ignore_path = directory->path;
+		ignore_path.append(CH_TEXT(".gitignore"));
+		ignore = read_ignore_file(walk, ignore_path, ignore, directory_count);
+	}
+
+	Walk_Batch* batch = nullptr;
+	u64 batch_size = 0;
+	for (const Listed_Entry& entry : listing.entries) {
+		usize count;
+		const tchar* relative_path = get_relative_path(walk->root, entry.path, &count);
+		if (is_ignored(ignore, relative_path, count, count - entry.name_count, entry.is_directory)) continue;
+
+		if (entry.is_directory) {
+			push_directory(walk, entry.path, ignore);
+			continue;
+		}
+		if (entry.size > walk->max_file_size) {
+			std::lock_guard<std::mutex> lock(walk->mutex);
+			walk->skipped_count += 1;
+			continue;
+		}
+
+		if (!batch) {
+			batch = make_batch(walk);
+			batch_size = 0;
+		}
+		batch->files.push(entry.path);
+		batch_size += entry.size;
+		if (batch_size >= walk_batch_size) {
+			push_batch(batch);
+			batch = nullptr;
+		}
+	}
+
+	// @NOTE: The last batch runs right here, small directories don't need a job of their own
+	if (batch) {
+		walk->jobs_left.fetch_add(1, std::memory_order_relaxed);
+		run_batch(batch);
+	}
+}
+
+static void run_directory(void* user) {
+	Walk_Directory* directory = (Walk_Directory*)user;
+	Project_Walk* walk = directory->walk;
+	if (!walk->cancel.load(std::memory_order_relaxed)) walk_directory(directory);
+	ch_delete directory;
+	walk->jobs_left.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+static void push_directory(Project_Walk* walk, const ch::Path& path, const Ignore_Level* ignore) {
+	Walk_Directory* directory = ch_new Walk_Directory;
+	directory->walk = walk;
+	directory->path = path;
+	directory->ignore = ignore;
+	walk->jobs_left.fetch_add(1, std::memory_order_relaxed);
+	push_job(run_directory, directory);
+}
+
+void init_project_walk(Project_Walk* walk, const ch::Path& root, u64 max_file_size, Walk_Proc proc, void* user) {
+	walk->root = root;
+	walk->proc = proc;
+	walk->user = user;
+	walk->max_file_size = max_file_size;
+	walk->cancel.store(false);
+	walk->jobs_left.store(0);
+	walk->ignore_levels.allocator = ch::get_heap_allocator();
+	walk->skipped_count = 0;
+}
+
+void push_walk_root(Project_Walk* walk) {
+	push_directory(walk, walk->root, nullptr);
+}
+
+void push_walk_files(Project_Walk* walk, const ch::Path* paths, usize count) {
+	for (usize i = 0; i < count; i += walk_batch_files) {
+		Walk_Batch* batch = make_batch(walk);
+		const usize batch_count = ch::min(count - i, walk_batch_files);
+		batch->files.reserve(batch_count);
+		for (usize j = 0; j < batch_count; j++) batch->files.push(paths[i + j]);
+		push_batch(batch);
+	}
+}
+
+void free_project_walk(Project_Walk* walk) {
+	for (Ignore_Level* level : walk->ignore_levels) free_ignore_level(level);
+	walk->ignore_levels.free();
+}
+
+bool is_walked_path(const ch::Path& root, const ch::Path& path) {
+	if (!is_path_under(path, root)) return false;
+
+	ch::Array<Ignore_Level*> levels(ch::get_heap_allocator());
+	defer(levels.free());
+
+	usize count;
+	const tchar* relative_path = get_relative_path(root, path, &count);
+	const usize root_count = relative_path - path.data;
+
+	// Goes down the way the walk does, reading each directory's .gitignore before anything in it gets checked
+	ch::Path directory = root;
+	const Ignore_Level* ignore = nullptr;
+	usize name_start = 0;
+	bool walked = true;
+	for (;;) {
+		ch::Path ignore_path = directory;
+		if (append_path_name(&ignore_path, CH_TEXT(".gitignore"))) {
+			if (Ignore_Level* level = parse_ignore_file(ignore_path, ignore, name_start ? name_start - 1 : 0)) {
+				levels.push(level);
+				ignore = level;
+			}
+		}
+
+		usize name_end = name_start;
+		while (name_end < count && !is_separator(relative_path[name_end])) name_end += 1;
+		const bool is_directory = name_end < count;
+
+		// The walk never goes into hidden entries, nor past ignored ones
+		if (relative_path[name_start] == '.' || is_ignored(ignore, relative_path, name_end, name_start, is_directory)) {
+			walked = false;
+			break;
+		}
+		if (!is_directory) break;
+
+		directory = path;
+		directory.count = root_count + name_end;
+		directory.data[directory.count] = 0;
+		name_start = name_end + 1;
+	}
+
+	for (Ignore_Level* level : levels) free_ignore_level(level);
+	return walked;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <ch_stl/filesystem.h>
+
+#include <atomic>
+#include <mutex>
+
+/* Going over every file under a directory on the job pool. Each directory is listed by a job of its own, so the walk
+   spreads over the pool as soon as the tree branches, and the files in it are handed to the walk's proc in batches of
+   roughly the same size, also on the pool. Hidden entries are skipped and .gitignore files are honoured on the way
+   down with git's pattern rules. */
+
+// Files bigger than this are left out of project searches and the trigram index, decoding one whole would take too
+// much memory
+const u64 max_searched_file_size = 256 * 1024 * 1024;
+
+struct Project_Walk;
+struct Ignore_Level;
+
+// Called on a worker with a batch of full paths. The batch is gone once it returns.
+using Walk_Proc = void(*)(Project_Walk* walk, const ch::Path* paths, usize count);
+
+struct Project_Walk {
+	ch::Path root;
+	Walk_Proc proc;
+	void* user;
+	// Bigger files are left out and counted in skipped_count
+	u64 max_file_size;
+
+	std::atomic<bool> cancel;
+	// Directory and batch jobs that haven't returned. The walk is over once it's back to 0.
+	std::atomic<usize> jobs_left;
+
+	std::mutex mutex;
+	ch::Array<Ignore_Level*> ignore_levels;
+	usize skipped_count;
+
+	CH_FORCEINLINE bool is_done() const { return jobs_left.load(std::memory_order_acquire) == 0; }
+};
+
+void init_project_walk(Project_Walk* walk, const ch::Path& root, u64 max_file_size, Walk_Proc proc, void* user);
+// Walks everything under root
+void push_walk_root(Project_Walk* walk);
+// Hands paths to proc in batches as they are, without listing or ignoring anything
+void push_walk_files(Project_Walk* walk, const ch::Path* paths, usize count);
+// Only once the walk is done
+void free_project_walk(Project_Walk* walk);
+
+// Whether walking root would come across the file at path, going by hidden names and the .gitignore files on the way
+// down to it. Reads those files, so it's meant for jobs.
+bool is_walked_path(const ch::Path& root, const ch::Path& path);
+
+// Start of path relative to root, which path has to be under
+const tchar* get_relative_path(const ch::Path& root, const ch::Path& path, usize* out_count);
+bool is_path_under(const ch::Path& path, const ch::Path& root);
+bool is_same_path(const ch::Path& a, const ch::Path& b);
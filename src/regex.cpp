@@ -0,0 +1,1451 @@
+#include "regex.h"
+#include "text_scan.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/hash.h>
+
+static const u32 no_index = (u32)-1;
+static const u32 max_codepoint = (u32)-1;
+// Counted repeats get expanded, this keeps something like (a{1000}){1000} from eating all memory
+static const usize max_regex_insts = 64 * 1024;
+// Deepest the syntax tree can get, groups and stacked quantifiers counted. Parsing and compiling recurse down it.
+static const usize max_regex_depth = 256;
+// Caches go back to empty when their states and transitions take more than this
+static const usize max_dfa_cache_size = 16 * 1024 * 1024;
+
+// Transitions not built yet
+static const u32 unknown_transition = (u32)-1;
+// Set on a transition when a match ended right before the codepoint it steps over
+static const u32 match_bit = 0x80000000;
+static const u32 dead_state = 0;
+
+enum Regex_Class_Flags : u8 {
+	RC_Eol  = 0x1,
+	RC_Word = 0x2,
+};
+
+// What the codepoint before a DFA state was
+enum Dfa_Flags : u32 {
+	DF_Line_Start = 0x1,
+	DF_Word       = 0x2,
+};
+
+CH_FORCEINLINE static u32 get_codepoint(const Buffer_Halves& halves, usize index) {
+	return index < halves.front_count ? halves.front[index] : halves.back[index - halves.front_count];
+}
+
+enum Regex_Ast_Kind : u8 {
+	RK_Empty,
+	RK_Set,
+	RK_Assert,
+	RK_Concat,
+	RK_Alternate,
+	RK_Repeat,
+	RK_Group,
+};
+
+struct Regex_Ast {
+	Regex_Ast_Kind kind;
+	Regex_Assert assert;
+	bool greedy;
+	// Set index for RK_Set, capture group for RK_Group or no_index when it doesn't capture
+	u32 arg;
+	// First child of RK_Concat and RK_Alternate, the body of RK_Repeat and RK_Group
+	u32 child;
+	u32 sibling;
+	// RK_Repeat bounds, max is no_index when there isn't one
+	u32 min;
+	u32 max;
+};
+
+struct Regex_Set_Ranges {
+	u32 first_range;
+	u32 range_count;
+};
+
+struct Regex_Range {
+	u32 first;
+	u32 last;
+};
+
+struct Regex_Parser {
+	const u32* p;
+	usize count;
+	usize at = 0;
+	u32 flags;
+	bool failed = false;
+	// Groups open around at
+	usize depth = 0;
+
+	ch::Array<Regex_Ast> nodes;
+	ch::Array<Regex_Range> ranges;
+	ch::Array<Regex_Set_Ranges> sets;
+	ch::Array<Regex_Range> scratch;
+	usize group_count = 1;
+
+	CH_FORCEINLINE bool at_end() const { return at >= count; }
+	CH_FORCEINLINE u32 peek() const { return p[at]; }
+};
+
+static void sort_ranges(ch::Array<Regex_Range>* ranges) {
+	for (usize i = 1; i < ranges->count; i++) {
+		const Regex_Range range = (*ranges)[i];
+		usize j = i;
+		while (j > 0 && (*ranges)[j - 1].first > range.first) {
+			(*ranges)[j] = (*ranges)[j - 1];
+			j -= 1;
+		}
+		(*ranges)[j] = range;
+	}
+}
+
+// Sorts and merges ranges that touch
+static void normalize_ranges(ch::Array<Regex_Range>* ranges) {
+	sort_ranges(ranges);
+	usize n = 0;
+	for (usize i = 0; i < ranges->count; i++) {
+		const Regex_Range range = (*ranges)[i];
+		if (n && (*ranges)[n - 1].last != max_codepoint && range.first <= (*ranges)[n - 1].last + 1) {
+			(*ranges)[n - 1].last = ch::max((*ranges)[n - 1].last, range.last);
+		} else if (n && (*ranges)[n - 1].last == max_codepoint) {
+			continue;
+		} else {
+			(*ranges)[n++] = range;
+		}
+	}
+	ranges->count = n;
+}
+
+// Normalized ranges to everything they leave out
+static void negate_ranges(ch::Array<Regex_Range>* ranges) {
+	ch::Array<Regex_Range> result(ch::get_heap_allocator());
+	u32 next = 0;
+	bool done = false;
+	for (const Regex_Range& range : *ranges) {
+		if (range.first > next) result.push({ next, range.first - 1 });
+		if (range.last == max_codepoint) {
+			done = true;
+			break;
+		}
+		next = range.last + 1;
+	}
+	if (!done) result.push({ next, max_codepoint });
+
+	ranges->count = 0;
+	for (const Regex_Range& range : result) ranges->push(range);
+	result.free();
+}
+
+static void add_word_ranges(ch::Array<Regex_Range>* ranges) {
+	ranges->push({ '0', '9' });
+	ranges->push({ 'A', 'Z' });
+	ranges->push({ '_', '_' });
+	ranges->push({ 'a', 'z' });
+	ranges->push({ 0xC0, 0xD6 });
+	ranges->push({ 0xD8, 0xF6 });
+	ranges->push({ 0xF8, max_codepoint });
+}
+
+static void add_space_ranges(ch::Array<Regex_Range>* ranges) {
+	ranges->push({ '\t', '\r' });
+	ranges->push({ ' ', ' ' });
+	ranges->push({ 0xA0, 0xA0 });
+}
+
+// Adds the other case of everything in ranges. Only the scripts to_lower and to_upper know about can have one.
+static void fold_ranges(ch::Array<Regex_Range>* ranges) {
+	const usize count = ranges->count;
+	for (usize i = 0; i < count; i++) {
+		const Regex_Range range = (*ranges)[i];
+		const u32 last = ch::min(range.last, (u32)0x45F);
+		for (u32 c = range.first; c <= last; c++) {
+			const u32 lower = to_lower(c);
+			const u32 upper = to_upper(c);
+			if (lower != c) ranges->push({ lower, lower });
+			if (upper != c) ranges->push({ upper, upper });
+		}
+	}
+}
+
+static u32 push_node(Regex_Parser* parser, Regex_Ast_Kind kind) {
+	Regex_Ast node = {};
+	node.kind = kind;
+	node.arg = no_index;
+	node.child = no_index;
+	node.sibling = no_index;
+	return (u32)parser->nodes.push(node);
+}
+
+// Turns the parser's scratch ranges into a new set node
+static u32 push_set(Regex_Parser* parser, bool negate) {
+	if (parser->flags & RF_Ignore_Case) fold_ranges(&parser->scratch);
+	normalize_ranges(&parser->scratch);
+	if (negate) negate_ranges(&parser->scratch);
+
+	Regex_Set_Ranges set;
+	set.first_range = (u32)parser->ranges.count;
+	set.range_count = (u32)parser->scratch.count;
+	for (const Regex_Range& range : parser->scratch) parser->ranges.push(range);
+	parser->scratch.count = 0;
+
+	const u32 node = push_node(parser, RK_Set);
+	parser->nodes[node].arg = (u32)parser->sets.push(set);
+	return node;
+}
+
+static bool parse_hex(Regex_Parser* parser, usize digits, u32* out) {
+	u32 result = 0;
+	for (usize i = 0; i < digits; i++) {
+		if (parser->at_end()) return false;
+		const u32 c = parser->peek();
+		u32 value;
+		if (c >= '0' && c <= '9') {
+			value = c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			value = c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F') {
+			value = c - 'A' + 10;
+		} else {
+			return false;
+		}
+		result = result * 16 + value;
+		parser->at += 1;
+	}
+	*out = result;
+	return true;
+}
+
+// Parses what comes after a '\' that stands for one codepoint or a class. Classes go to the scratch ranges and
+// set out_negate when they're the negated kind. Returns false for escapes that aren't either.
+static bool parse_escape(Regex_Parser* parser, u32* out_c, bool* out_is_class, bool* out_negate) {
+	if (parser->at_end()) {
+		parser->failed = true;
+		return false;
+	}
+	const u32 c = parser->peek();
+	parser->at += 1;
+	*out_is_class = false;
+	*out_negate = false;
+
+	switch (c) {
+	case 'd':
+	case 'D':
+		parser->scratch.push({ '0', '9' });
+		*out_is_class = true;
+		*out_negate = c == 'D';
+		return true;
+	case 'w':
+	case 'W':
+		add_word_ranges(&parser->scratch);
+		*out_is_class = true;
+		*out_negate = c == 'W';
+		return true;
+	case 's':
+	case 'S':
+		add_space_ranges(&parser->scratch);
+		*out_is_class = true;
+		*out_negate = c == 'S';
+		return true;
+	case 'n': *out_c = '\n'; return true;
+	case 't': *out_c = '\t'; return true;
+	case 'r': *out_c = '\r'; return true;
+	case 'f': *out_c = '\f'; return true;
+	case 'v': *out_c = '\v'; return true;
+	case '0': *out_c = 0; return true;
+	case 'x':
+		if (!parse_hex(parser, 2, out_c)) parser->failed = true;
+		return !parser->failed;
+	case 'u':
+		if (!parse_hex(parser, 4, out_c)) parser->failed = true;
+		return !parser->failed;
+	}
+
+	// @NOTE: Escaped letters and digits are kept free for meanings added later, anything else is itself
+	if (is_word_codepoint(c) && c < 0x80) {
+		parser->at -= 1;
+		return false;
+	}
+	*out_c = c;
+	return true;
+}
+
+static u32 parse_class(Regex_Parser* parser) {
+	bool negate = false;
+	if (!parser->at_end() && parser->peek() == '^') {
+		negate = true;
+		parser->at += 1;
+	}
+
+	bool first = true;
+	while (true) {
+		if (parser->at_end()) {
+			parser->failed = true;
+			return no_index;
+		}
+		u32 c = parser->peek();
+		if (c == ']' && !first) {
+			parser->at += 1;
+			break;
+		}
+		first = false;
+		parser->at += 1;
+
+		if (c == '\\') {
+			const usize before = parser->scratch.count;
+			bool is_class;
+			bool class_negate;
+			if (!parse_escape(parser, &c, &is_class, &class_negate)) {
+				parser->failed = true;
+				return no_index;
+			}
+			if (is_class) {
+				// @NOTE: A negated class inside a class gets negated on its own before joining the rest
+				if (class_negate) {
+					ch::Array<Regex_Range> added(ch::get_heap_allocator());
+					defer(added.free());
+					for (usize i = before; i < parser->scratch.count; i++) added.push(parser->scratch[i]);
+					normalize_ranges(&added);
+					negate_ranges(&added);
+					parser->scratch.count = before;
+					for (const Regex_Range& range : added) parser->scratch.push(range);
+				}
+				continue;
+			}
+		}
+
+		u32 last = c;
+		if (parser->at + 1 < parser->count && parser->peek() == '-' && parser->p[parser->at + 1] != ']') {
+			parser->at += 1;
+			last = parser->peek();
+			parser->at += 1;
+			if (last == '\\') {
+				bool is_class;
+				bool class_negate;
+				if (!parse_escape(parser, &last, &is_class, &class_negate) || is_class) {
+					parser->failed = true;
+					return no_index;
+				}
+			}
+			if (last < c) {
+				parser->failed = true;
+				return no_index;
+			}
+		}
+		parser->scratch.push({ c, last });
+	}
+
+	return push_set(parser, negate);
+}
+
+static u32 parse_alternate(Regex_Parser* parser);
+
+static u32 parse_atom(Regex_Parser* parser) {
+	const u32 c = parser->peek();
+	parser->at += 1;
+
+	switch (c) {
+	case '(': {
+		if (parser->depth >= max_regex_depth) {
+			parser->failed = true;
+			return no_index;
+		}
+		u32 group = no_index;
+		if (parser->at + 1 < parser->count && parser->peek() == '?' && parser->p[parser->at + 1] == ':') {
+			parser->at += 2;
+		} else {
+			group = (u32)parser->group_count;
+			parser->group_count += 1;
+		}
+		parser->depth += 1;
+		const u32 body = parse_alternate(parser);
+		parser->depth -= 1;
+		if (parser->failed || parser->at_end() || parser->peek() != ')') {
+			parser->failed = true;
+			return no_index;
+		}
+		parser->at += 1;
+
+		const u32 node = push_node(parser, RK_Group);
+		parser->nodes[node].arg = group;
+		parser->nodes[node].child = body;
+		return node;
+	}
+	case '[':
+		return parse_class(parser);
+	case '.':
+		parser->scratch.push({ 0, '\n' - 1 });
+		parser->scratch.push({ '\n' + 1, max_codepoint });
+		return push_set(parser, false);
+	case '^':
+	case '$': {
+		const u32 node = push_node(parser, RK_Assert);
+		parser->nodes[node].assert = c == '^' ? RA_Line_Start : RA_Line_End;
+		return node;
+	}
+	case '*':
+	case '+':
+	case '?':
+	case ')':
+		parser->failed = true;
+		return no_index;
+	case '\\': {
+		if (!parser->at_end() && (parser->peek() == 'b' || parser->peek() == 'B')) {
+			const u32 node = push_node(parser, RK_Assert);
+			parser->nodes[node].assert = parser->peek() == 'b' ? RA_Word_Boundary : RA_Not_Word_Boundary;
+			parser->at += 1;
+			return node;
+		}
+		u32 escaped;
+		bool is_class;
+		bool negate;
+		if (!parse_escape(parser, &escaped, &is_class, &negate)) {
+			parser->failed = true;
+			return no_index;
+		}
+		if (is_class) return push_set(parser, negate);
+		parser->scratch.push({ escaped, escaped });
+		return push_set(parser, false);
+	}
+	}
+
+	parser->scratch.push({ c, c });
+	return push_set(parser, false);
+}
+
+static bool parse_number(Regex_Parser* parser, u32* out) {
+	const usize start = parser->at;
+	u32 result = 0;
+	while (!parser->at_end() && parser->peek() >= '0' && parser->peek() <= '9') {
+		result = result * 10 + (parser->peek() - '0');
+		if (result > max_regex_insts) return false;
+		parser->at += 1;
+	}
+	*out = result;
+	return parser->at > start;
+}
+
+// Parses {m}, {m,} or {m,n}. Leaves at alone and returns false when what's there isn't one.
+static bool parse_counted_repeat(Regex_Parser* parser, u32* out_min, u32* out_max) {
+	const usize start = parser->at;
+	parser->at += 1;
+
+	u32 min;
+	u32 max;
+	if (!parse_number(parser, &min)) {
+		parser->at = start;
+		return false;
+	}
+	max = min;
+	if (!parser->at_end() && parser->peek() == ',') {
+		parser->at += 1;
+		if (!parse_number(parser, &max)) max = no_index;
+	}
+	if (parser->at_end() || parser->peek() != '}' || (max != no_index && max < min)) {
+		parser->at = start;
+		return false;
+	}
+	parser->at += 1;
+
+	*out_min = min;
+	*out_max = max;
+	return true;
+}
+
+static u32 parse_repeat(Regex_Parser* parser) {
+	u32 node = parse_atom(parser);
+	while (!parser->failed && !parser->at_end()) {
+		const u32 c = parser->peek();
+		u32 min;
+		u32 max;
+		if (c == '*') {
+			min = 0;
+			max = no_index;
+			parser->at += 1;
+		} else if (c == '+') {
+			min = 1;
+			max = no_index;
+			parser->at += 1;
+		} else if (c == '?') {
+			min = 0;
+			max = 1;
+			parser->at += 1;
+		} else if (c != '{' || !parse_counted_repeat(parser, &min, &max)) {
+			break;
+		}
+
+		bool greedy = true;
+		if (!parser->at_end() && parser->peek() == '?') {
+			greedy = false;
+			parser->at += 1;
+		}
+
+		const u32 repeat = push_node(parser, RK_Repeat);
+		parser->nodes[repeat].child = node;
+		parser->nodes[repeat].min = min;
+		parser->nodes[repeat].max = max;
+		parser->nodes[repeat].greedy = greedy;
+		node = repeat;
+	}
+	return node;
+}
+
+static u32 parse_concat(Regex_Parser* parser) {
+	u32 first = no_index;
+	u32 last = no_index;
+	usize child_count = 0;
+	while (!parser->failed && !parser->at_end() && parser->peek() != '|' && parser->peek() != ')') {
+		const u32 child = parse_repeat(parser);
+		if (parser->failed) return no_index;
+		if (last == no_index) {
+			first = child;
+		} else {
+			parser->nodes[last].sibling = child;
+		}
+		last = child;
+		child_count += 1;
+	}
+
+	if (!child_count) return push_node(parser, RK_Empty);
+	if (child_count == 1) return first;
+	const u32 node = push_node(parser, RK_Concat);
+	parser->nodes[node].child = first;
+	return node;
+}
+
+static u32 parse_alternate(Regex_Parser* parser) {
+	const u32 first = parse_concat(parser);
+	if (parser->failed || parser->at_end() || parser->peek() != '|') return first;
+
+	u32 last = first;
+	while (!parser->failed && !parser->at_end() && parser->peek() == '|') {
+		parser->at += 1;
+		const u32 child = parse_concat(parser);
+		if (parser->failed) return no_index;
+		parser->nodes[last].sibling = child;
+		last = child;
+	}
+
+	const u32 node = push_node(parser, RK_Alternate);
+	parser->nodes[node].child = first;
+	return node;
+}
+
+// Whether no node is more than max_regex_depth below root. Quantifiers stack without any group around them, so the
+// parser's own depth doesn't cover everything.
+static bool is_within_depth(const Regex_Parser& parser, u32 root) {
+	struct Pending_Node {
+		u32 index;
+		usize depth;
+	};
+	ch::Array<Pending_Node> pending(ch::get_heap_allocator());
+	defer(pending.free());
+
+	pending.push({ root, 1 });
+	while (pending.count) {
+		const Pending_Node at = pending[pending.count - 1];
+		pending.count -= 1;
+		if (at.depth > max_regex_depth) return false;
+
+		for (u32 child = parser.nodes[at.index].child; child != no_index; child = parser.nodes[child].sibling) {
+			pending.push({ child, at.depth + 1 });
+		}
+	}
+	return true;
+}
+
+struct Regex_Compiler {
+	const Regex_Parser* parser;
+	Regex_Program* program;
+	bool backward;
+	bool failed = false;
+	ch::Array<u32> children;
+};
+
+static u32 emit(Regex_Compiler* compiler, Regex_Op op, u32 next, u32 arg = 0) {
+	if (compiler->program->insts.count >= max_regex_insts) {
+		compiler->failed = true;
+		return 0;
+	}
+	Regex_Inst inst = {};
+	inst.op = op;
+	inst.next = next;
+	inst.arg = arg;
+	return (u32)compiler->program->insts.push(inst);
+}
+
+// Compiles node so it carries on to next when it matches. Returns where it starts.
+static u32 compile_node(Regex_Compiler* compiler, u32 index, u32 next) {
+	if (compiler->failed) return next;
+	const Regex_Ast node = compiler->parser->nodes[index];
+
+	switch (node.kind) {
+	case RK_Empty:
+		return next;
+	case RK_Set:
+		return emit(compiler, RO_Set, next, node.arg);
+	case RK_Assert: {
+		Regex_Assert assert = node.assert;
+		// @NOTE: Backwards, the codepoint before is the one after
+		if (compiler->backward && assert == RA_Line_Start) {
+			assert = RA_Line_End;
+		} else if (compiler->backward && assert == RA_Line_End) {
+			assert = RA_Line_Start;
+		}
+		const u32 pc = emit(compiler, RO_Assert, next);
+		compiler->program->insts[pc].assert = assert;
+		return pc;
+	}
+	case RK_Concat: {
+		const usize first = compiler->children.count;
+		for (u32 child = node.child; child != no_index; child = compiler->parser->nodes[child].sibling) compiler->children.push(child);
+		const usize last = compiler->children.count;
+
+		// Built back to front since each part has to know where the one after it starts
+		if (compiler->backward) {
+			for (usize i = first; i < last; i++) next = compile_node(compiler, compiler->children[i], next);
+		} else {
+			for (usize i = last; i > first; i--) next = compile_node(compiler, compiler->children[i - 1], next);
+		}
+		compiler->children.count = first;
+		return next;
+	}
+	case RK_Alternate: {
+		const usize first = compiler->children.count;
+		for (u32 child = node.child; child != no_index; child = compiler->parser->nodes[child].sibling) compiler->children.push(child);
+		const usize last = compiler->children.count;
+
+		u32 result = compile_node(compiler, compiler->children[last - 1], next);
+		for (usize i = last - 1; i > first; i--) {
+			const u32 option = compile_node(compiler, compiler->children[i - 1], next);
+			result = emit(compiler, RO_Split, option, result);
+		}
+		compiler->children.count = first;
+		return result;
+	}
+	case RK_Group: {
+		if (node.arg == no_index || compiler->backward) return compile_node(compiler, node.child, next);
+		const u32 end = emit(compiler, RO_Save, next, node.arg * 2 + 1);
+		const u32 body = compile_node(compiler, node.child, end);
+		return emit(compiler, RO_Save, body, node.arg * 2);
+	}
+	case RK_Repeat: {
+		u32 result = next;
+		u32 copies = node.min;
+		if (node.max == no_index) {
+			// The loop is a split after the body that either goes round again or leaves. With a minimum the body
+			// comes first, which keeps one copy of it rather than a copy in front of a loop that can also be empty.
+			const u32 loop = emit(compiler, RO_Split, 0, 0);
+			const u32 body = compile_node(compiler, node.child, loop);
+			if (compiler->failed) return next;
+			compiler->program->insts[loop].next = node.greedy ? body : next;
+			compiler->program->insts[loop].arg = node.greedy ? next : body;
+			result = loop;
+			if (copies) {
+				result = body;
+				copies -= 1;
+			}
+		} else {
+			for (u32 i = node.min; i < node.max && !compiler->failed; i++) {
+				const u32 body = compile_node(compiler, node.child, result);
+				result = node.greedy ? emit(compiler, RO_Split, body, next) : emit(compiler, RO_Split, next, body);
+			}
+		}
+		for (u32 i = 0; i < copies && !compiler->failed; i++) result = compile_node(compiler, node.child, result);
+		return result;
+	}
+	}
+	return next;
+}
+
+static bool compile_program(const Regex_Parser& parser, u32 root, u32 any_set, bool backward, Regex_Program* program) {
+	Regex_Compiler compiler;
+	compiler.parser = &parser;
+	compiler.program = program;
+	compiler.backward = backward;
+	compiler.children.allocator = ch::get_heap_allocator();
+	defer(compiler.children.free());
+
+	program->insts.allocator = ch::get_heap_allocator();
+	u32 next = emit(&compiler, RO_Match, 0);
+	if (!backward) next = emit(&compiler, RO_Save, next, 1);
+	next = compile_node(&compiler, root, next);
+	if (!backward) next = emit(&compiler, RO_Save, next, 0);
+	program->start = next;
+
+	// Searching is the pattern with a loop over anything in front of it, tried after the pattern at every step
+	program->search_start = emit(&compiler, RO_Split, program->start, 0);
+	const u32 any = emit(&compiler, RO_Set, program->search_start, any_set);
+	if (!compiler.failed) program->insts[program->search_start].arg = any;
+	return !compiler.failed;
+}
+
+// A set that takes exactly one codepoint, or both cases of one letter when case is ignored. Writes it lowered.
+static bool get_single_codepoint(const Regex_Parser& parser, u32 set_index, bool ignore_case, u32* out) {
+	const Regex_Set_Ranges& set = parser.sets[set_index];
+	usize size = 0;
+	u32 lowered = 0;
+	for (u32 i = 0; i < set.range_count; i++) {
+		const Regex_Range& range = parser.ranges[set.first_range + i];
+		if (range.last - range.first >= 2) return false;
+		for (u32 c = range.first; ; c++) {
+			const u32 folded = ignore_case ? to_lower(c) : c;
+			if (size && folded != lowered) return false;
+			lowered = folded;
+			size += 1;
+			if (c == range.last) break;
+		}
+	}
+	if (!size) return false;
+	*out = lowered;
+	return true;
+}
+
+// Longest run of single codepoints the pattern can't match without
+static void find_required_literal(const Regex_Parser& parser, u32 root, bool ignore_case, ch::Array<u32>* out) {
+	ch::Array<u32> parts(ch::get_heap_allocator());
+	defer(parts.free());
+	ch::Array<u32> pending(ch::get_heap_allocator());
+	defer(pending.free());
+
+	// @NOTE: Groups that aren't repeated or alternated are as required as the parts around them
+	pending.push(root);
+	while (pending.count) {
+		const u32 index = pending[pending.count - 1];
+		pending.count -= 1;
+		const Regex_Ast& node = parser.nodes[index];
+		if (node.kind == RK_Concat) {
+			const usize first = pending.count;
+			for (u32 child = node.child; child != no_index; child = parser.nodes[child].sibling) pending.push(child);
+			// Reversed so they come off the stack in order
+			for (usize i = first, j = pending.count - 1; i < j; i++, j--) {
+				const u32 t = pending[i];
+				pending[i] = pending[j];
+				pending[j] = t;
+			}
+		} else if (node.kind == RK_Group) {
+			pending.push(node.child);
+		} else {
+			parts.push(index);
+		}
+	}
+
+	ch::Array<u32> run(ch::get_heap_allocator());
+	defer(run.free());
+	out->count = 0;
+	for (usize i = 0; i <= parts.count; i++) {
+		u32 c;
+		if (i < parts.count && parser.nodes[parts[i]].kind == RK_Set && get_single_codepoint(parser, parser.nodes[parts[i]].arg, ignore_case, &c)) {
+			run.push(c);
+			continue;
+		}
+		if (i < parts.count && parser.nodes[parts[i]].kind == RK_Empty) continue;
+		if (run.count > out->count) {
+			out->count = 0;
+			for (u32 r : run) out->push(r);
+		}
+		run.count = 0;
+	}
+}
+
+// Most codepoints node can match, or no_match when that's unbounded
+static usize get_max_length(const Regex_Parser& parser, u32 index) {
+	const Regex_Ast& node = parser.nodes[index];
+	switch (node.kind) {
+	case RK_Set:
+		return 1;
+	case RK_Concat:
+	case RK_Alternate: {
+		usize result = 0;
+		for (u32 child = node.child; child != no_index; child = parser.nodes[child].sibling) {
+			const usize length = get_max_length(parser, child);
+			if (length == no_match) return no_match;
+			result = node.kind == RK_Concat ? result + length : ch::max(result, length);
+		}
+		return result;
+	}
+	case RK_Group:
+		return get_max_length(parser, node.child);
+	case RK_Repeat: {
+		const usize length = get_max_length(parser, node.child);
+		if (length == 0) return 0;
+		if (length == no_match || node.max == no_index) return no_match;
+		return length * node.max;
+	}
+	default:
+		return 0;
+	}
+}
+
+u32 Regex::get_wide_class(u32 c) const {
+	usize lo = 0;
+	usize hi = interval_starts.count;
+	while (hi - lo > 1) {
+		const usize mid = lo + (hi - lo) / 2;
+		if (interval_starts[mid] <= c) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return interval_classes[lo];
+}
+
+// Splits all codepoints at every edge of every set, then gives intervals nothing tells apart the same class
+static void build_classes(Regex* regex, const Regex_Parser& parser) {
+	ch::Array<Regex_Range> edges(ch::get_heap_allocator());
+	defer(edges.free());
+	auto add_edges = [&](u32 first, u32 last) {
+		edges.push({ first, first });
+		if (last != max_codepoint) edges.push({ last + 1, last + 1 });
+	};
+	add_edges(0, max_codepoint);
+	add_edges('\n', '\n');
+	for (const Regex_Range& range : parser.ranges) add_edges(range.first, range.last);
+	{
+		ch::Array<Regex_Range> word(ch::get_heap_allocator());
+		defer(word.free());
+		add_word_ranges(&word);
+		for (const Regex_Range& range : word) add_edges(range.first, range.last);
+	}
+	normalize_ranges(&edges);
+	// Normalizing merged neighbouring edges into ranges, every codepoint in them starts an interval
+	ch::Array<u32> starts(ch::get_heap_allocator());
+	defer(starts.free());
+	for (const Regex_Range& range : edges) {
+		for (u32 c = range.first; ; c++) {
+			starts.push(c);
+			if (c == range.last) break;
+		}
+	}
+
+	const usize set_count = parser.sets.count;
+	ch::Array<u8> signatures(ch::get_heap_allocator());
+	defer(signatures.free());
+	ch::Array<u8> signature(ch::get_heap_allocator());
+	defer(signature.free());
+
+	regex->interval_starts.allocator = ch::get_heap_allocator();
+	regex->interval_classes.allocator = ch::get_heap_allocator();
+	regex->class_flags.allocator = ch::get_heap_allocator();
+	for (u32 start : starts) {
+		signature.count = 0;
+		for (usize s = 0; s < set_count; s++) {
+			const Regex_Set_Ranges& set = parser.sets[s];
+			bool has = false;
+			for (u32 i = 0; i < set.range_count && !has; i++) {
+				const Regex_Range& range = parser.ranges[set.first_range + i];
+				has = start >= range.first && start <= range.last;
+			}
+			signature.push(has);
+		}
+		u8 flags = 0;
+		if (start == '\n') flags |= RC_Eol;
+		if (is_word_codepoint(start)) flags |= RC_Word;
+		signature.push(flags);
+
+		const usize stride = set_count + 1;
+		u32 k = 0;
+		for (; k < regex->class_flags.count; k++) {
+			bool same = true;
+			for (usize i = 0; i < stride && same; i++) same = signatures[k * stride + i] == signature[i];
+			if (same) break;
+		}
+		if (k == regex->class_flags.count) {
+			for (u8 b : signature) signatures.push(b);
+			regex->class_flags.push(flags);
+		}
+		regex->interval_starts.push(start);
+		regex->interval_classes.push(k);
+	}
+
+	regex->class_count = regex->class_flags.count;
+	regex->set_count = set_count;
+	regex->set_classes.allocator = ch::get_heap_allocator();
+	for (usize s = 0; s < set_count; s++) {
+		for (usize k = 0; k < regex->class_count; k++) regex->set_classes.push(signatures[k * (set_count + 1) + s]);
+	}
+	for (u32 c = 0; c < 128; c++) regex->ascii_classes[c] = (u8)regex->get_wide_class(c);
+}
+
+bool Regex::compile(const u32* pattern, usize count, u32 flags) {
+	Regex_Parser parser;
+	parser.p = pattern;
+	parser.count = count;
+	parser.flags = flags;
+	parser.nodes.allocator = ch::get_heap_allocator();
+	parser.ranges.allocator = ch::get_heap_allocator();
+	parser.sets.allocator = ch::get_heap_allocator();
+	parser.scratch.allocator = ch::get_heap_allocator();
+	defer(parser.nodes.free());
+	defer(parser.ranges.free());
+	defer(parser.sets.free());
+	defer(parser.scratch.free());
+
+	const u32 root = parse_alternate(&parser);
+	if (parser.failed || !parser.at_end()) {
+		error_at = parser.at;
+		return false;
+	}
+	if (!is_within_depth(parser, root)) {
+		error_at = count;
+		return false;
+	}
+
+	line_bounded = true;
+	for (const Regex_Range& range : parser.ranges) {
+		if (range.first <= '\n' && range.last >= '\n') line_bounded = false;
+	}
+
+	// The search loop's set, added after checking for line breaks since it takes everything
+	Regex_Set_Ranges any;
+	any.first_range = (u32)parser.ranges.push({ 0, max_codepoint });
+	any.range_count = 1;
+	const u32 any_set = (u32)parser.sets.push(any);
+
+	if (!compile_program(parser, root, any_set, false, &forward) || !compile_program(parser, root, any_set, true, &backward)) {
+		error_at = count;
+		free();
+		return false;
+	}
+	group_count = parser.group_count;
+	max_length = get_max_length(parser, root);
+	build_classes(this, parser);
+
+	ch::Array<u32> text(ch::get_heap_allocator());
+	defer(text.free());
+	find_required_literal(parser, root, (flags & RF_Ignore_Case) != 0, &text);
+	has_literal = text.count > 0;
+	if (has_literal) literal.set(text.data, text.count, (flags & RF_Ignore_Case) ? (u32)SF_Ignore_Case : 0);
+	return true;
+}
+
+void Regex::free() {
+	forward.insts.free();
+	backward.insts.free();
+	set_classes.free();
+	class_flags.free();
+	interval_starts.free();
+	interval_classes.free();
+	if (has_literal) literal.free();
+	has_literal = false;
+}
+
+void Lazy_Dfa::init(const Regex* _regex, const Regex_Program* _program, bool _longest) {
+	regex = _regex;
+	program = _program;
+	longest = _longest;
+
+	nodes.allocator = ch::get_heap_allocator();
+	states.allocator = ch::get_heap_allocator();
+	transitions.allocator = ch::get_heap_allocator();
+	slots.allocator = ch::get_heap_allocator();
+	stack.allocator = ch::get_heap_allocator();
+	closure_stack.allocator = ch::get_heap_allocator();
+	next_nodes.allocator = ch::get_heap_allocator();
+	resolve_marks.allocator = ch::get_heap_allocator();
+	add_marks.allocator = ch::get_heap_allocator();
+
+	const usize inst_count = program->insts.count;
+	resolve_marks.reserve(inst_count);
+	add_marks.reserve(inst_count);
+	resolve_marks.count = inst_count;
+	add_marks.count = inst_count;
+	for (usize i = 0; i < inst_count; i++) {
+		resolve_marks[i] = 0;
+		add_marks[i] = 0;
+	}
+	reset();
+}
+
+void Lazy_Dfa::free() {
+	nodes.free();
+	states.free();
+	transitions.free();
+	slots.free();
+	stack.free();
+	closure_stack.free();
+	next_nodes.free();
+	resolve_marks.free();
+	add_marks.free();
+}
+
+void Lazy_Dfa::reset() {
+	nodes.count = 0;
+	states.count = 0;
+	transitions.count = 0;
+
+	slots.count = 0;
+	slots.reserve(1024);
+	slots.count = 1024;
+	for (u32& slot : slots) slot = 0;
+	for (u32& start : start_states) start = no_index;
+
+	// Dead state goes first so it's always 0
+	next_nodes.count = 0;
+	add_state(0);
+}
+
+static u64 hash_state(const u32* nodes, usize count, u32 flags) {
+	u64 result = ch::fnv1_hash(&flags, sizeof(flags));
+	return result ^ (ch::fnv1_hash(nodes, count * sizeof(u32)) * 31);
+}
+
+// Finds or adds the state made of next_nodes
+u32 Lazy_Dfa::add_state(u32 flags) {
+	// @NOTE: With nothing left to match, what came before doesn't matter
+	if (!next_nodes.count) flags = 0;
+
+	const u64 hash = hash_state(next_nodes.data, next_nodes.count, flags);
+	usize slot = (usize)hash & (slots.count - 1);
+	while (slots[slot]) {
+		const Dfa_State& state = states[slots[slot] - 1];
+		if (state.flags == flags && state.node_count == next_nodes.count) {
+			bool same = true;
+			for (usize i = 0; i < next_nodes.count && same; i++) same = nodes[state.first_node + i] == next_nodes[i];
+			if (same) return slots[slot] - 1;
+		}
+		slot = (slot + 1) & (slots.count - 1);
+	}
+
+	Dfa_State state;
+	state.first_node = (u32)nodes.count;
+	state.node_count = (u32)next_nodes.count;
+	state.flags = flags;
+	for (u32 node : next_nodes) nodes.push(node);
+	const u32 index = (u32)states.push(state);
+	slots[slot] = index + 1;
+
+	const usize stride = regex->class_count + 1;
+	transitions.reserve(stride);
+	for (usize i = 0; i < stride; i++) transitions.push(index == dead_state ? dead_state : unknown_transition);
+
+	// Kept at most half full
+	if (states.count * 2 > slots.count) {
+		slots.count = 0;
+		slots.reserve(slots.allocated * 2);
+		slots.count = slots.allocated;
+		for (u32& s : slots) s = 0;
+		for (u32 i = 0; i < states.count; i++) {
+			const Dfa_State& it = states[i];
+			usize at = (usize)hash_state(nodes.data + it.first_node, it.node_count, it.flags) & (slots.count - 1);
+			while (slots[at]) at = (at + 1) & (slots.count - 1);
+			slots[at] = i + 1;
+		}
+	}
+	return index;
+}
+
+// Adds everything pc leads to without stepping over a codepoint to next_nodes, in priority order
+void Lazy_Dfa::add_closure(u32 pc) {
+	closure_stack.push(pc);
+	while (closure_stack.count) {
+		const u32 at = closure_stack[closure_stack.count - 1];
+		closure_stack.count -= 1;
+		if (add_marks[at] == generation) continue;
+		add_marks[at] = generation;
+
+		const Regex_Inst& inst = program->insts[at];
+		switch (inst.op) {
+		case RO_Split:
+			closure_stack.push(inst.arg);
+			closure_stack.push(inst.next);
+			break;
+		case RO_Jump:
+		case RO_Save:
+			closure_stack.push(inst.next);
+			break;
+		default:
+			next_nodes.push(at);
+			break;
+		}
+	}
+}
+
+u32 Lazy_Dfa::get_start_state(u32 flags, bool search) {
+	const u32 slot = flags | (search ? 4 : 0);
+	if (start_states[slot] != no_index) return start_states[slot];
+
+	generation += 1;
+	next_nodes.count = 0;
+	add_closure(search ? program->search_start : program->start);
+	start_states[slot] = add_state(flags);
+	return start_states[slot];
+}
+
+CH_FORCEINLINE static bool is_assert_true(Regex_Assert assert, u32 flags, bool next_eol, bool next_word) {
+	switch (assert) {
+	case RA_Line_Start: return (flags & DF_Line_Start) != 0;
+	case RA_Line_End: return next_eol;
+	case RA_Word_Boundary: return ((flags & DF_Word) != 0) != next_word;
+	case RA_Not_Word_Boundary: return ((flags & DF_Word) != 0) == next_word;
+	}
+	return false;
+}
+
+u32 Lazy_Dfa::compute_transition(u32 state_index, u32 k) {
+	// @NOTE: Starting over keeps the state being stepped out of, it's the only one anybody is holding on to
+	if ((transitions.count + nodes.count) * sizeof(u32) > max_dfa_cache_size) {
+		const Dfa_State old = states[state_index];
+		ch::Array<u32> kept(ch::get_heap_allocator());
+		defer(kept.free());
+		for (u32 i = 0; i < old.node_count; i++) kept.push(nodes[old.first_node + i]);
+
+		reset();
+		next_nodes.count = 0;
+		for (u32 node : kept) next_nodes.push(node);
+		state_index = add_state(old.flags);
+	}
+
+	const Dfa_State state = states[state_index];
+	const bool at_end = k == regex->class_count;
+	const bool next_eol = at_end || (regex->class_flags[k] & RC_Eol);
+	const bool next_word = !at_end && (regex->class_flags[k] & RC_Word);
+
+	generation += 1;
+	next_nodes.count = 0;
+	bool matched = false;
+	bool cut = false;
+	for (u32 i = 0; i < state.node_count && !cut; i++) {
+		stack.count = 0;
+		stack.push(nodes[state.first_node + i]);
+		// @NOTE: Depth first with the preferred way on top keeps everything in priority order
+		while (stack.count) {
+			const u32 pc = stack[stack.count - 1];
+			stack.count -= 1;
+			if (resolve_marks[pc] == generation) continue;
+			resolve_marks[pc] = generation;
+
+			const Regex_Inst& inst = program->insts[pc];
+			if (inst.op == RO_Set) {
+				if (!at_end && regex->set_has_class(inst.arg, k)) {
+					add_closure(inst.next);
+				}
+			} else if (inst.op == RO_Split) {
+				stack.push(inst.arg);
+				stack.push(inst.next);
+			} else if (inst.op == RO_Jump || inst.op == RO_Save) {
+				stack.push(inst.next);
+			} else if (inst.op == RO_Assert) {
+				if (is_assert_true(inst.assert, state.flags, next_eol, next_word)) stack.push(inst.next);
+			} else if (inst.op == RO_Match) {
+				matched = true;
+				// Leftmost first: whatever is lower in priority than a match can't win over it
+				if (!longest) {
+					cut = true;
+					break;
+				}
+			}
+		}
+	}
+
+	u32 next = dead_state;
+	if (!at_end) {
+		u32 flags = 0;
+		if (next_eol) flags |= DF_Line_Start;
+		if (next_word) flags |= DF_Word;
+		next = add_state(flags);
+	}
+	const u32 result = next | (matched ? match_bit : 0);
+	transitions[(usize)state_index * (regex->class_count + 1) + k] = result;
+	return result;
+}
+
+// Flags of a DFA state that just stepped over the codepoint before index
+static u32 get_flags_before(const Buffer_Halves& halves, usize index) {
+	if (!index) return DF_Line_Start;
+	const u32 c = get_codepoint(halves, index - 1);
+	u32 flags = 0;
+	if (c == ch::eol) flags |= DF_Line_Start;
+	if (is_word_codepoint(c)) flags |= DF_Word;
+	return flags;
+}
+
+// Where the leftmost first match starting in [from, to) ends, or no_match
+static usize scan_forward(Lazy_Dfa* dfa, const Buffer_Halves& halves, usize from, usize to) {
+	const Regex& regex = *dfa->regex;
+	const usize stride = regex.class_count + 1;
+	const usize total = halves.front_count + halves.back_count;
+
+	u32 state = dfa->get_start_state(get_flags_before(halves, from), true);
+	usize result = no_match;
+	const u32* transitions = dfa->transitions.data;
+
+	for (usize run = 0; run < 2; run++) {
+		const u32* p;
+		usize run_start;
+		usize run_end;
+		if (run == 0) {
+			p = halves.front;
+			run_start = from;
+			run_end = ch::min(to, halves.front_count);
+		} else {
+			p = halves.back - halves.front_count;
+			run_start = ch::max(from, halves.front_count);
+			run_end = to;
+		}
+
+		for (usize i = run_start; i < run_end; i++) {
+			const u32 k = regex.get_class(p[i]);
+			u32 t = transitions[(usize)state * stride + k];
+			if (t == unknown_transition) {
+				t = dfa->compute_transition(state, k);
+				transitions = dfa->transitions.data;
+			}
+			if (t & match_bit) result = i;
+			state = t & ~match_bit;
+			if (state == dead_state) return result;
+		}
+	}
+
+	// @NOTE: What comes after the range still decides whether a match can end right at it
+	const u32 k = to < total ? regex.get_class(get_codepoint(halves, to)) : (u32)regex.class_count;
+	u32 t = transitions[(usize)state * stride + k];
+	if (t == unknown_transition) t = dfa->compute_transition(state, k);
+	if (t & match_bit) result = to;
+	return result;
+}
+
+// Where the longest match of the backward program that ends at end starts, going no further back than limit
+static usize scan_backward(Lazy_Dfa* dfa, const Buffer_Halves& halves, usize end, usize limit) {
+	const Regex& regex = *dfa->regex;
+	const usize stride = regex.class_count + 1;
+	const usize total = halves.front_count + halves.back_count;
+
+	// Going backwards the codepoint before is the one at end
+	u32 flags = DF_Line_Start;
+	if (end < total) {
+		const u32 c = get_codepoint(halves, end);
+		flags = 0;
+		if (c == ch::eol) flags |= DF_Line_Start;
+		if (is_word_codepoint(c)) flags |= DF_Word;
+	}
+	u32 state = dfa->get_start_state(flags, false);
+	usize result = no_match;
+	const u32* transitions = dfa->transitions.data;
+
+	for (usize run = 0; run < 2; run++) {
+		const u32* p;
+		usize run_start;
+		usize run_end;
+		if (run == 0) {
+			p = halves.back - halves.front_count;
+			run_start = ch::max(limit, halves.front_count);
+			run_end = end;
+		} else {
+			p = halves.front;
+			run_start = limit;
+			run_end = ch::min(end, halves.front_count);
+		}
+
+		for (usize i = run_end; i > run_start; i--) {
+			const u32 k = regex.get_class(p[i - 1]);
+			u32 t = transitions[(usize)state * stride + k];
+			if (t == unknown_transition) {
+				t = dfa->compute_transition(state, k);
+				transitions = dfa->transitions.data;
+			}
+			if (t & match_bit) result = i;
+			state = t & ~match_bit;
+			if (state == dead_state) return result;
+		}
+	}
+
+	const u32 k = limit > 0 ? regex.get_class(get_codepoint(halves, limit - 1)) : (u32)regex.class_count;
+	u32 t = transitions[(usize)state * stride + k];
+	if (t == unknown_transition) t = dfa->compute_transition(state, k);
+	if (t & match_bit) result = limit;
+	return result;
+}
+
+struct Pike_Context {
+	u32 flags;
+	bool next_eol;
+	bool next_word;
+};
+
+static Pike_Context get_pike_context(const Buffer_Halves& halves, usize index) {
+	const usize total = halves.front_count + halves.back_count;
+	Pike_Context result;
+	result.flags = get_flags_before(halves, index);
+	result.next_eol = index >= total || get_codepoint(halves, index) == ch::eol;
+	result.next_word = index < total && is_word_codepoint(get_codepoint(halves, index));
+	return result;
+}
+
+// Adds a thread at pc to list, following everything that doesn't step over a codepoint. slots is restored after.
+// @NOTE: A chain of empty groups can be as long as the program, so this goes off a stack of its own instead of recursing
+static void add_thread(Regex_Cache* cache, usize list, u32 pc, usize* slots, usize index, const Pike_Context& context) {
+	ch::Array<Pike_Frame>& stack = cache->thread_stack;
+	stack.count = 0;
+	stack.push({ pc, 0, 0 });
+	while (stack.count) {
+		const Pike_Frame frame = stack[stack.count - 1];
+		stack.count -= 1;
+		if (frame.pc == no_index) {
+			slots[frame.slot] = frame.old_value;
+			continue;
+		}
+		if (cache->marks[frame.pc] == cache->generation) continue;
+		cache->marks[frame.pc] = cache->generation;
+
+		// Pushed in reverse so they come off the stack in priority order
+		const Regex_Inst& inst = cache->regex->forward.insts[frame.pc];
+		switch (inst.op) {
+		case RO_Split:
+			stack.push({ inst.arg, 0, 0 });
+			stack.push({ inst.next, 0, 0 });
+			break;
+		case RO_Jump:
+			stack.push({ inst.next, 0, 0 });
+			break;
+		case RO_Save:
+			stack.push({ no_index, inst.arg, slots[inst.arg] });
+			slots[inst.arg] = index;
+			stack.push({ inst.next, 0, 0 });
+			break;
+		case RO_Assert:
+			if (is_assert_true(inst.assert, context.flags, context.next_eol, context.next_word)) stack.push({ inst.next, 0, 0 });
+			break;
+		default: {
+			const usize slot_count = cache->regex->group_count * 2;
+			cache->threads[list].push(frame.pc);
+			for (usize i = 0; i < slot_count; i++) cache->thread_slots[list].push(slots[i]);
+			break;
+		}
+		}
+	}
+}
+
+// Runs the forward NFA from start to end, which the DFAs already found to be the match, for where its groups are
+static void fill_groups(Regex_Cache* cache, const Buffer_Halves& halves, usize start, usize end, Regex_Match* out) {
+	const Regex& regex = *cache->regex;
+	const usize slot_count = regex.group_count * 2;
+
+	out->groups.allocator = ch::get_heap_allocator();
+	out->groups.count = 0;
+	for (usize i = 0; i < regex.group_count; i++) out->groups.push({ no_match, no_match });
+
+	ch::Array<usize> initial(ch::get_heap_allocator());
+	defer(initial.free());
+	for (usize i = 0; i < slot_count; i++) initial.push(no_match);
+
+	usize list = 0;
+	cache->threads[list].count = 0;
+	cache->thread_slots[list].count = 0;
+	cache->generation += 1;
+	add_thread(cache, list, regex.forward.start, initial.data, start, get_pike_context(halves, start));
+
+	for (usize index = start; cache->threads[list].count; index++) {
+		const usize next_list = list ^ 1;
+		cache->threads[next_list].count = 0;
+		cache->thread_slots[next_list].count = 0;
+		cache->generation += 1;
+
+		const bool can_step = index < end;
+		u32 k = 0;
+		Pike_Context context = {};
+		if (can_step) {
+			k = regex.get_class(get_codepoint(halves, index));
+			context = get_pike_context(halves, index + 1);
+		}
+		for (usize i = 0; i < cache->threads[list].count; i++) {
+			const Regex_Inst& inst = regex.forward.insts[cache->threads[list][i]];
+			usize* slots = cache->thread_slots[list].data + i * slot_count;
+			if (inst.op == RO_Match) {
+				for (usize g = 0; g < regex.group_count; g++) {
+					out->groups[g].start = slots[g * 2];
+					out->groups[g].end = slots[g * 2 + 1];
+				}
+				// Threads after this one come later in priority
+				break;
+			}
+			if (can_step && regex.set_has_class(inst.arg, k)) add_thread(cache, next_list, inst.next, slots, index + 1, context);
+		}
+		if (!can_step) break;
+		list = next_list;
+	}
+}
+
+static usize find_line_start(const Buffer_Halves& halves, usize limit, usize index) {
+	while (index > limit && get_codepoint(halves, index - 1) != ch::eol) index -= 1;
+	return index;
+}
+
+bool find_regex(Regex_Cache* cache, const Buffer_Halves& halves, usize start, usize end, Regex_Match* out, bool with_groups) {
+	const Regex& regex = *cache->regex;
+
+	usize index = start;
+	while (index <= end) {
+		usize from = index;
+		usize to = end;
+		if (regex.has_literal) {
+			const usize at = find_literal(halves, regex.literal, index, end);
+			if (at == no_match) return false;
+
+			// @NOTE: Lines before the literal's hold no match when none crosses a line break, and neither does
+			//        anything after its line unless this one comes up empty
+			if (regex.line_bounded) {
+				from = find_line_start(halves, index, at);
+				to = find_codepoint(halves, at + regex.literal.text.count, end, ch::eol);
+			}
+		}
+
+		const usize match_end = scan_forward(&cache->forward, halves, from, to);
+		if (match_end == no_match) {
+			if (to == end) return false;
+			index = to + 1;
+			continue;
+		}
+
+		const usize match_start = scan_backward(&cache->backward, halves, match_end, from);
+		assert(match_start != no_match);
+		out->start = match_start;
+		out->end = match_end;
+		if (with_groups) fill_groups(cache, halves, match_start, match_end, out);
+		return true;
+	}
+	return false;
+}
+
+void find_all_regex(Regex_Cache* cache, const Buffer_Halves& halves, usize start, usize end, ch::Array<Text_Span>* out) {
+	Regex_Match match;
+	usize index = start;
+	usize last_end = no_match;
+	while (index <= end && find_regex(cache, halves, index, end, &match)) {
+		if (match.start == match.end && match.start == last_end) {
+			index = match.start + 1;
+			continue;
+		}
+		out->push({ match.start, match.end });
+		last_end = match.end;
+		index = match.end > match.start ? match.end : match.end + 1;
+	}
+}
+
+void Regex_Cache::init(const Regex* _regex) {
+	regex = _regex;
+	forward.init(regex, &regex->forward, false);
+	backward.init(regex, &regex->backward, true);
+
+	for (usize i = 0; i < 2; i++) {
+		threads[i].allocator = ch::get_heap_allocator();
+		thread_slots[i].allocator = ch::get_heap_allocator();
+	}
+	marks.allocator = ch::get_heap_allocator();
+	thread_stack.allocator = ch::get_heap_allocator();
+	marks.reserve(regex->forward.insts.count);
+	marks.count = regex->forward.insts.count;
+	for (u32& mark : marks) mark = 0;
+	generation = 0;
+}
+
+void Regex_Cache::free() {
+	forward.free();
+	backward.free();
+	for (usize i = 0; i < 2; i++) {
+		threads[i].free();
+		thread_slots[i].free();
+	}
+	marks.free();
+	thread_stack.free();
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "buffer.h"
+#include "search.h"
+
+/* Regular expressions run straight over the halves of a gap buffer, the text is never joined into a string. A
+   pattern compiles to an NFA twice, once forwards and once backwards. A search runs a DFA built lazily out of the
+   forward NFA to find where the leftmost match ends, then one out of the backward NFA from there to find where it
+   starts. Only when capture groups are wanted does the NFA itself run, as a Pike VM over just the match, so nothing
+   ever backtracks. A literal every match has to contain is looked for with the SIMD literal search first, which keeps
+   most of a big buffer away from the DFAs entirely.
+
+   Syntax: literals, '.', [classes] with ranges and negation, \d \w \s \D \W \S, \n \t \r \f \v, \xHH, \uHHHH,
+   ^ $ (line anchors), \b \B, (groups), (?:non capturing groups), alternation with '|' and the quantifiers
+   * + ? {m} {m,} {m,n}, each of which is lazy when followed by '?'. Matches are leftmost first like Perl's. */
+
+enum Regex_Flags : u32 {
+	RF_Ignore_Case = 0x1,
+};
+
+enum Regex_Op : u8 {
+	RO_Set,
+	RO_Split,
+	RO_Jump,
+	RO_Save,
+	RO_Assert,
+	RO_Match,
+};
+
+enum Regex_Assert : u8 {
+	RA_Line_Start,
+	RA_Line_End,
+	RA_Word_Boundary,
+	RA_Not_Word_Boundary,
+};
+
+struct Regex_Inst {
+	Regex_Op op;
+	Regex_Assert assert;
+	// Where to go next. Split prefers it over arg.
+	u32 next;
+	// Set index for RO_Set, the other way for RO_Split, capture slot for RO_Save
+	u32 arg;
+};
+
+struct Regex_Program {
+	ch::Array<Regex_Inst> insts;
+	u32 start;
+	// Start of the program with a lowest priority loop over any codepoint in front, for searching
+	u32 search_start;
+};
+
+struct Regex {
+	Regex_Program forward;
+	// The same pattern compiled to match reversed text. Has no captures.
+	Regex_Program backward;
+
+	// Codepoints are grouped into classes that no set tells apart. Sets are stored as which classes they take.
+	usize class_count = 0;
+	usize set_count = 0;
+	ch::Array<u8> set_classes;
+	// Whether each class is a line break or a word codepoint, which is what assertions look at
+	ch::Array<u8> class_flags;
+	u8 ascii_classes[128];
+	// Classes of everything past ASCII, by the sorted first codepoint of every interval
+	ch::Array<u32> interval_starts;
+	ch::Array<u32> interval_classes;
+
+	// Including group 0, the whole match
+	usize group_count = 0;
+	// Most codepoints a match can take, or no_match when there's no limit
+	usize max_length = 0;
+
+	// A run of codepoints every match contains
+	Literal_Pattern literal;
+	bool has_literal = false;
+	// Set when no match can cross a line break. Searches then only need to look at lines the literal is on.
+	bool line_bounded = false;
+
+	// Where in the pattern compiling gave up
+	usize error_at = 0;
+
+	bool compile(const u32* pattern, usize count, u32 flags);
+	void free();
+
+	CH_FORCEINLINE u32 get_class(u32 c) const {
+		if (c < 128) return ascii_classes[c];
+		return get_wide_class(c);
+	}
+	u32 get_wide_class(u32 c) const;
+	CH_FORCEINLINE bool set_has_class(u32 set, u32 k) const { return set_classes[set * class_count + k] != 0; }
+};
+
+struct Dfa_State {
+	u32 first_node;
+	u32 node_count;
+	u32 flags;
+};
+
+// States get built the first time a search steps into them and are kept until the cache gets too big
+struct Lazy_Dfa {
+	const Regex* regex = nullptr;
+	const Regex_Program* program = nullptr;
+	// Keeps going past a match for a longer one rather than stopping at the first in priority order
+	bool longest = false;
+
+	// NFA instructions each state is made of, in priority order
+	ch::Array<u32> nodes;
+	ch::Array<Dfa_State> states;
+	// class_count + 1 entries per state, the last one for the end of the text
+	ch::Array<u32> transitions;
+	// Open addressing table of state index + 1 by node list
+	ch::Array<u32> slots;
+	// By flags, searching ones after anchored ones
+	u32 start_states[8];
+
+	// Scratch for building states
+	ch::Array<u32> stack;
+	ch::Array<u32> closure_stack;
+	ch::Array<u32> next_nodes;
+	ch::Array<u32> resolve_marks;
+	ch::Array<u32> add_marks;
+	u32 generation = 0;
+
+	void init(const Regex* regex, const Regex_Program* program, bool longest);
+	void free();
+	void reset();
+
+	u32 get_start_state(u32 flags, bool search);
+	// Builds the transition out of state on class k. class_count stands for the end of the text.
+	u32 compute_transition(u32 state, u32 k);
+
+	void add_closure(u32 pc);
+	u32 add_state(u32 flags);
+};
+
+// Work left while adding a Pike VM thread. A pc to follow, or with pc at -1 a slot to put back once everything
+// after its save was added.
+struct Pike_Frame {
+	u32 pc;
+	u32 slot;
+	usize old_value;
+};
+
+// What searching with a regex writes to, kept between searches so DFA states get reused. One per thread.
+struct Regex_Cache {
+	const Regex* regex = nullptr;
+	Lazy_Dfa forward;
+	Lazy_Dfa backward;
+
+	// Pike VM thread lists
+	ch::Array<u32> threads[2];
+	ch::Array<usize> thread_slots[2];
+	ch::Array<u32> marks;
+	ch::Array<Pike_Frame> thread_stack;
+	u32 generation = 0;
+
+	void init(const Regex* regex);
+	void free();
+};
+
+struct Regex_Match {
+	usize start;
+	usize end;
+	// By group number with 0 the whole match. Groups that didn't take part have both ends at no_match.
+	ch::Array<Text_Span> groups;
+};
+
+// Finds the leftmost match lying in the logical range [start, end) of halves. Groups only get filled in when asked for.
+bool find_regex(Regex_Cache* cache, const Buffer_Halves& halves, usize start, usize end, Regex_Match* out, bool with_groups = false);
+// Pushes every match lying in [start, end) in order. An empty match right where one ended is skipped.
+void find_all_regex(Regex_Cache* cache, const Buffer_Halves& halves, usize start, usize end, ch::Array<Text_Span>* out);
@@ -0,0 +1,221 @@
+#include "replace.h"
+#include "buffer_view.h"
+#include "find.h"
+#include "text_scan.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/memory.h>
+
+// Room left after the new text so the first edits don't have to grow the gap
+static const usize replace_gap_size = 4096;
+
+// Part of a replacement. Either a run of its literal text or a group of the match.
+struct Replace_Part {
+	bool is_group;
+	usize group;
+	usize start;
+	usize count;
+};
+
+// Splits a regex replacement into literal runs and group references. Unescaped literal text goes to text.
+static void parse_replacement(const u32* replacement, usize count, ch::Array<Replace_Part>* parts, ch::Array<u32>* text) {
+	auto push_literal = [&](u32 c) {
+		if (!parts->count || parts->data[parts->count - 1].is_group) parts->push({ false, 0, text->count, 0 });
+		text->push(c);
+		parts->data[parts->count - 1].count += 1;
+	};
+
+	for (usize i = 0; i < count; i++) {
+		const u32 c = replacement[i];
+		if (c != '$' || i + 1 == count) {
+			push_literal(c);
+			continue;
+		}
+
+		const u32 next = replacement[i + 1];
+		if (next == '$') {
+			push_literal('$');
+			i += 1;
+		} else if (next >= '0' && next <= '9') {
+			parts->push({ true, next - '0', 0, 0 });
+			i += 1;
+		} else if (next == '{') {
+			usize group = 0;
+			usize j = i + 2;
+			while (j < count && replacement[j] >= '0' && replacement[j] <= '9') {
+				group = group * 10 + (replacement[j] - '0');
+				j += 1;
+			}
+			if (j < count && j > i + 2 && replacement[j] == '}') {
+				parts->push({ true, group, 0, 0 });
+				i = j;
+			} else {
+				push_literal(c);
+			}
+		} else {
+			push_literal(c);
+		}
+	}
+}
+
+// The new text as it gets built
+struct Replace_Output {
+	u32* data = nullptr;
+	usize count = 0;
+	usize capacity = 0;
+
+	u32* reserve(usize amount) {
+		if (count + amount > capacity) {
+			const usize new_capacity = ch::max(count + amount, capacity + capacity / 2);
+			u32* new_data = (u32*)ch::get_heap_allocator().alloc(new_capacity * sizeof(u32));
+			if (data) {
+				ch::mem_copy(new_data, data, count * sizeof(u32));
+				ch::get_heap_allocator().free(data);
+			}
+			data = new_data;
+			capacity = new_capacity;
+		}
+		return data + count;
+	}
+
+	void push(const Buffer_Halves& halves, usize start, usize end) {
+		copy_codepoints(halves, start, end, reserve(end - start));
+		count += end - start;
+	}
+
+	void push(const u32* text, usize amount) {
+		ch::mem_copy(reserve(amount), text, amount * sizeof(u32));
+		count += amount;
+	}
+};
+
+// Carries the line ending exceptions over to the new text. Old lines are counted by their eols as the text goes by.
+// Lines whose eol was in a match are gone and new ones take the main ending, like with any other edit.
+struct Replace_Lines {
+	const ch::Array<Line_Ending_Exception>* old_exceptions;
+	ch::Array<Line_Ending_Exception> exceptions;
+	usize next_exception = 0;
+	usize old_line = 0;
+	ssize line_delta = 0;
+
+	CH_FORCEINLINE bool is_needed() const { return old_exceptions->count > 0; }
+
+	// The eols of the old text in kept were copied over as they are
+	void on_kept(const u32* kept, usize count) {
+		old_line += count_codepoint(kept, count, ch::eol);
+		for (; next_exception < old_exceptions->count && (*old_exceptions)[next_exception].line < old_line; next_exception++) {
+			Line_Ending_Exception it = (*old_exceptions)[next_exception];
+			it.line = (usize)((ssize)it.line + line_delta);
+			exceptions.push(it);
+		}
+	}
+
+	void on_replaced(usize removed_eols, usize inserted_eols) {
+		old_line += removed_eols;
+		while (next_exception < old_exceptions->count && (*old_exceptions)[next_exception].line < old_line) next_exception += 1;
+		line_delta += (ssize)inserted_eols - (ssize)removed_eols;
+	}
+};
+
+// Builds the new text and swaps it in. cache is only there for regexes.
+static usize replace_matches(Buffer* buffer, const Find_Query& compiled, Regex_Cache* cache, const u32* replacement, usize replacement_count) {
+	ch::Array<Replace_Part> parts(ch::get_heap_allocator());
+	defer(parts.free());
+	ch::Array<u32> part_text(ch::get_heap_allocator());
+	defer(part_text.free());
+	if (compiled.is_regex()) {
+		parse_replacement(replacement, replacement_count, &parts, &part_text);
+	} else if (replacement_count) {
+		parts.push({ false, 0, 0, replacement_count });
+		part_text.reserve(replacement_count);
+		for (usize i = 0; i < replacement_count; i++) part_text.push(replacement[i]);
+	}
+	bool with_groups = false;
+	for (const Replace_Part& part : parts) with_groups |= part.is_group;
+
+	Replace_Lines lines;
+	lines.old_exceptions = &buffer->line_endings.exceptions;
+	lines.exceptions.allocator = ch::get_heap_allocator();
+
+	const Buffer_Halves halves = buffer->get_halves();
+	const usize total = halves.front_count + halves.back_count;
+
+	// @NOTE: Some headroom so replacements a bit longer than what they replace don't make the whole text move again
+	Replace_Output output;
+	output.reserve(total + total / 16 + replace_gap_size);
+
+	Regex_Match match;
+	defer(match.groups.free());
+	usize replaced = 0;
+	usize first_start = 0;
+	usize last_end = no_match;
+	usize copied_to = 0;
+	usize index = 0;
+	while (index <= total && find_next(compiled, halves, cache, index, last_end, total + 1, &match, with_groups)) {
+		if (!replaced) first_start = match.start;
+		replaced += 1;
+
+		const usize kept_at = output.count;
+		output.push(halves, copied_to, match.start);
+		if (lines.is_needed()) lines.on_kept(output.data + kept_at, output.count - kept_at);
+
+		const usize replacement_at = output.count;
+		for (const Replace_Part& part : parts) {
+			if (!part.is_group) {
+				output.push(part_text.data + part.start, part.count);
+			} else if (part.group < match.groups.count && match.groups[part.group].start != no_match) {
+				output.push(halves, match.groups[part.group].start, match.groups[part.group].end);
+			}
+		}
+		if (lines.is_needed()) {
+			const usize removed_eols = count_codepoint(halves, match.start, match.end, ch::eol);
+			lines.on_replaced(removed_eols, count_codepoint(output.data + replacement_at, output.count - replacement_at, ch::eol));
+		}
+
+		copied_to = match.end;
+		last_end = match.end;
+		index = match.end > match.start ? match.end : match.end + 1;
+	}
+
+	if (!replaced) {
+		ch::get_heap_allocator().free(output.data);
+		lines.exceptions.free();
+		return 0;
+	}
+
+	// @NOTE: Only [first_start, last_end) changed, which is all the edit hooks need to know
+	Text_Edit edit;
+	edit.index = first_start;
+	edit.removed = last_end - first_start;
+	edit.inserted = output.count - first_start;
+	output.push(halves, copied_to, total);
+
+	if (lines.is_needed()) {
+		lines.on_kept(output.data + output.count - (total - copied_to), total - copied_to);
+		buffer->line_endings.exceptions.free();
+		buffer->line_endings.exceptions = lines.exceptions;
+	} else {
+		lines.exceptions.free();
+	}
+
+	output.reserve(replace_gap_size);
+	buffer->replace_contents(output.data, output.count, output.capacity, edit);
+	// Cursors past the last match would end up past the end when the text shrinks
+	shift_view_cursors(buffer->id, edit);
+	return replaced;
+}
+
+usize replace_all(Buffer* buffer, const u32* query, usize query_count, u32 flags, const u32* replacement, usize replacement_count) {
+	if (!query_count || buffer->is_read_only() || buffer->is_binary() || buffer->is_loading()) return 0;
+
+	Find_Query compiled;
+	if (!compiled.compile(query, query_count, flags)) return no_match;
+	defer(compiled.free());
+
+	if (!compiled.is_regex()) return replace_matches(buffer, compiled, nullptr, replacement, replacement_count);
+
+	Regex_Cache cache;
+	cache.init(&compiled.regex);
+	defer(cache.free());
+	return replace_matches(buffer, compiled, &cache, replacement, replacement_count);
+}
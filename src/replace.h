@@ -0,0 +1,14 @@
+#pragma once
+
+#include "search.h"
+
+/* Replacing every match of a query at once. The new text gets built in one pass over the old one, copying what lies
+   between matches in bulk, and then swapped in whole. The line index is rebuilt once and edit hooks hear about it as a
+   single edit spanning the first match to the last, so the journal gets one record rather than one per match.
+
+   With SF_Regex the replacement can take groups of the match: $0 to $9, ${n} for any group and $$ for a '$'.
+   Literal queries put the replacement in as it is. */
+
+// Replaces every match of query in buffer with Search_Flags. Cursors of the views on buffer move with the edit.
+// Returns how many got replaced, or no_match when query is a regex that doesn't compile.
+usize replace_all(Buffer* buffer, const u32* query, usize query_count, u32 flags, const u32* replacement, usize replacement_count);
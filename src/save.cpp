@@ -0,0 +1,268 @@
+#include "save.h"
+#include "editor.h"
+#include "jobs.h"
+#include "platform.h"
+#include "text_writer.h"
+#include "encoding.h"
+#include "io.h"
+#include "binary_data.h"
+
+#include <ch_stl/memory.h>
+#include <ch_stl/string.h>
+
+#include <atomic>
+#include <mutex>
+
+struct Save_Record;
+
+struct Save_Job {
+	Save_Record* record;
+	u64 generation;
+	u64 version;
+
+	ch::Path path;
+	ch::Path temp_path;
+
+	u32* text;
+	usize count;
+	Line_Endings line_endings;
+	Text_Format format;
+
+	std::atomic<bool> cancel;
+	bool succeeded;
+	// What the file looks like after the rename, so our own save doesn't read as an outside change
+	File_Stamp stamp;
+};
+
+struct Save_Record {
+	Buffer_ID buffer_id;
+	Save_State state = SS_Idle;
+
+	// Newest save requested. Older jobs check this before they rename so they can never land on top of a newer one.
+	std::atomic<u64> latest_generation;
+	Save_Job* in_flight = nullptr;
+};
+
+static ch::Array<Save_Record*> save_records;
+
+static std::mutex finished_mutex;
+static ch::Array<Save_Job*> finished_saves;
+
+// Buffers up to this many codepoints get encoded in memory and saved together in save_all_buffers.
+// Anything bigger streams through its own save so memory stays bounded.
+static const usize batch_save_limit = 1024 * 1024;
+
+// Held while checking the generation and renaming so the two happen together
+static std::mutex rename_mutex;
+
+static Save_Record* find_record(Buffer_ID id) {
+	for (Save_Record* record : save_records) {
+		if (record->buffer_id == id) return record;
+	}
+	return nullptr;
+}
+
+// Renames the temp file into place unless a newer save came along, then hands the job back to the main thread
+static void finish_save(Save_Job* job, bool written) {
+	bool succeeded = written && !job->cancel.load();
+	if (succeeded) {
+		std::lock_guard<std::mutex> lock(rename_mutex);
+		const bool superseded = job->record->latest_generation.load() != job->generation;
+		// @NOTE: A rename keeps size and mtime, so the temp file's stamp is the one path ends up with
+		succeeded = !superseded && get_file_stamp(job->temp_path, &job->stamp) && replace_file(job->temp_path, job->path);
+	}
+	if (!succeeded) delete_file(job->temp_path);
+	job->succeeded = succeeded;
+
+	ch_delete[] job->text;
+	job->text = nullptr;
+	job->line_endings.free();
+
+	std::lock_guard<std::mutex> lock(finished_mutex);
+	finished_saves.push(job);
+}
+
+static void run_save(void* user) {
+	Save_Job* job = (Save_Job*)user;
+
+	bool written = false;
+	const OS_File file = create_write_file(job->temp_path);
+	if (file != invalid_os_file) {
+		Buffer_Halves halves = {};
+		halves.front = job->text;
+		halves.front_count = job->count;
+
+		written = write_text(file, halves, &job->line_endings, job->format, &job->cancel) && sync_os_file(file);
+		close_os_file(file);
+	}
+
+	finish_save(job, written);
+}
+
+struct Save_Batch {
+	ch::Array<Save_Job*> jobs;
+};
+
+// Small buffers get encoded in memory and go out as one batch of writes instead of a blocking write each
+static void run_save_batch(void* user) {
+	Save_Batch* batch = (Save_Batch*)user;
+
+	ch::Array<IO_Request> requests(ch::get_heap_allocator());
+	requests.reserve(batch->jobs.count);
+	for (Save_Job* job : batch->jobs) {
+		Buffer_Halves halves = {};
+		halves.front = job->text;
+		halves.front_count = job->count;
+
+		// @NOTE: A CRLF is two code units for one eol so this is still big enough with those
+		const usize capacity = job->count * max_encoded_size + max_bom_size;
+		IO_Request request;
+		request.path = job->temp_path;
+		request.data = ch_new u8[capacity];
+		Text_Encoder encoder(halves, &job->line_endings, job->format);
+		request.size = encoder.encode(request.data, capacity);
+		request.sync = true;
+		requests.push(request);
+	}
+
+	io_write_files(requests.data, requests.count);
+
+	for (usize i = 0; i < batch->jobs.count; i++) {
+		ch_delete[] requests[i].data;
+		finish_save(batch->jobs[i], requests[i].succeeded);
+	}
+
+	requests.free();
+	batch->jobs.free();
+	ch_delete batch;
+}
+
+static Save_Record* get_record(Buffer_ID id) {
+	Save_Record* record = find_record(id);
+	if (!record) {
+		record = ch_new Save_Record;
+		record->buffer_id = id;
+		record->latest_generation.store(0);
+		save_records.allocator = ch::get_heap_allocator();
+		save_records.push(record);
+	}
+	return record;
+}
+
+// Null when the name of the temp file doesn't fit in a path, which fails the save
+static Save_Job* begin_save(Buffer* buffer) {
+	assert(!buffer->is_read_only() && !buffer->is_loading() && !buffer->is_binary());
+
+	Save_Record* record = get_record(buffer->id);
+
+	// Every job gets its own temp file so a superseded one can still be cleaning up while the new one writes
+	const u64 generation = record->latest_generation.load() + 1;
+	ch::Path temp_path = buffer->full_path;
+	tchar suffix[32];
+	ch::sprintf(suffix, CH_TEXT(".%llu.save"), (unsigned long long)generation);
+	if (!append_path_suffix(&temp_path, suffix)) {
+		record->state = SS_Failed;
+		return nullptr;
+	}
+
+	if (record->in_flight) record->in_flight->cancel.store(true);
+
+	Save_Job* job = ch_new Save_Job;
+	job->record = record;
+	job->generation = generation;
+	job->version = buffer->version;
+	job->path = buffer->full_path;
+	job->cancel.store(false);
+	job->succeeded = false;
+	job->temp_path = temp_path;
+
+	// @NOTE: Snapshot is a flat copy of both halves. A memcpy on the main thread is cheap next to encoding and writing.
+	const Buffer_Halves halves = buffer->get_halves();
+	job->count = halves.front_count + halves.back_count;
+	job->text = ch_new u32[job->count];
+	ch::mem_copy(job->text, halves.front, halves.front_count * sizeof(u32));
+	ch::mem_copy(job->text + halves.front_count, halves.back, halves.back_count * sizeof(u32));
+	job->line_endings = buffer->line_endings.copy();
+	job->format = buffer->format;
+
+	record->latest_generation.store(job->generation);
+	record->in_flight = job;
+	record->state = SS_Saving;
+
+	finished_saves.allocator = ch::get_heap_allocator();
+	return job;
+}
+
+// @NOTE: Binary buffers copy the whole file only while it's small and write just the pages that changed otherwise,
+//        so it happens right here instead of on the job pool.
+static void save_binary(Buffer* buffer) {
+	Save_Record* record = get_record(buffer->id);
+	if (buffer->binary->save()) {
+		record->state = SS_Idle;
+		buffer->saved_version = buffer->version;
+		get_file_stamp(buffer->full_path, &buffer->disk_stamp);
+	} else {
+		record->state = SS_Failed;
+	}
+}
+
+void save_buffer_async(Buffer* buffer) {
+	if (buffer->is_binary()) {
+		save_binary(buffer);
+		return;
+	}
+	Save_Job* job = begin_save(buffer);
+	if (job) push_job(run_save, job);
+}
+
+void save_all_buffers() {
+	Save_Batch* batch = ch_new Save_Batch;
+	batch->jobs.allocator = ch::get_heap_allocator();
+
+	for (Buffer_ID id : get_buffer_ids()) {
+		Buffer* buffer = find_buffer(id);
+		if (!buffer->is_dirty() || !buffer->full_path.count || buffer->is_read_only() || buffer->is_loading()) continue;
+
+		if (buffer->is_binary()) {
+			save_binary(buffer);
+			continue;
+		}
+
+		if (buffer->gap_buffer.count() > batch_save_limit) {
+			save_buffer_async(buffer);
+			continue;
+		}
+		if (Save_Job* job = begin_save(buffer)) batch->jobs.push(job);
+	}
+
+	if (!batch->jobs.count) {
+		batch->jobs.free();
+		ch_delete batch;
+		return;
+	}
+	push_job(run_save_batch, batch);
+}
+
+Save_State get_save_state(Buffer_ID id) {
+	const Save_Record* record = find_record(id);
+	return record ? record->state : SS_Idle;
+}
+
+void tick_saves() {
+	std::lock_guard<std::mutex> lock(finished_mutex);
+	for (Save_Job* job : finished_saves) {
+		Save_Record* record = job->record;
+		if (record->in_flight == job) {
+			record->in_flight = nullptr;
+			record->state = job->succeeded ? SS_Idle : SS_Failed;
+
+			Buffer* buffer = find_buffer(record->buffer_id);
+			if (buffer && job->succeeded) {
+				buffer->saved_version = job->version;
+				buffer->disk_stamp = job->stamp;
+			}
+		}
+		ch_delete job;
+	}
+	finished_saves.count = 0;
+}
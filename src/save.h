@@ -0,0 +1,23 @@
+#pragma once
+
+#include "buffer.h"
+
+/* Saves happen on the job pool against a snapshot of the buffer, so editing carries on while they run. The file is
+   written next to full_path, synced and renamed over the original so a crash never leaves half a file behind. */
+
+enum Save_State {
+	SS_Idle = 0,
+	SS_Saving,
+	SS_Failed,
+};
+
+// Starts saving buffer to its full_path. A save of the same buffer that's still running gets cancelled and replaced.
+void save_buffer_async(Buffer* buffer);
+
+// Saves every dirty buffer. Small ones are written as one batch.
+void save_all_buffers();
+
+Save_State get_save_state(Buffer_ID id);
+
+// Hands finished saves back to their buffers. Called once a tick on the main thread.
+void tick_saves();
@@ -0,0 +1,200 @@
+#include "search.h"
+#include "simd.h"
+#include "text_scan.h"
+
+#include <ch_stl/math.h>
+
+// Window searched backwards at a time by find_literal_reverse
+static const usize reverse_window_size = 64 * 1024;
+
+u32 to_lower(u32 c) {
+	if (c < 0x80) return (c >= 'A' && c <= 'Z') ? c + 0x20 : c;
+	if (c >= 0xC0 && c <= 0xDE && c != 0xD7) return c + 0x20;
+	if (c >= 0x391 && c <= 0x3A9 && c != 0x3A2) return c + 0x20;
+	if (c >= 0x410 && c <= 0x42F) return c + 0x20;
+	if (c >= 0x400 && c <= 0x40F) return c + 0x50;
+	return c;
+}
+
+u32 to_upper(u32 c) {
+	if (c < 0x80) return (c >= 'a' && c <= 'z') ? c - 0x20 : c;
+	if (c >= 0xE0 && c <= 0xFE && c != 0xF7) return c - 0x20;
+	if (c >= 0x3B1 && c <= 0x3C9 && c != 0x3C2) return c - 0x20;
+	if (c >= 0x430 && c <= 0x44F) return c - 0x20;
+	if (c >= 0x450 && c <= 0x45F) return c - 0x50;
+	return c;
+}
+
+bool is_word_codepoint(u32 c) {
+	if (c < 0x80) return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+	return c >= 0xC0 && c != 0xD7 && c != 0xF7;
+}
+
+void Literal_Pattern::set(const u32* _text, usize count, u32 _flags) {
+	text.allocator = ch::get_heap_allocator();
+	text.count = 0;
+	text.reserve(count);
+	flags = _flags;
+	for (usize i = 0; i < count; i++) {
+		text.push((flags & SF_Ignore_Case) ? to_lower(_text[i]) : _text[i]);
+	}
+	if (!count) return;
+
+	first[0] = first[1] = text[0];
+	last[0] = last[1] = text[count - 1];
+	if (flags & SF_Ignore_Case) {
+		first[1] = to_upper(first[0]);
+		last[1] = to_upper(last[0]);
+	}
+}
+
+void Literal_Pattern::free() {
+	text.free();
+}
+
+// Mask with bit i set when codepoint i of the 16 at p is either of c
+CH_FORCEINLINE static u32 match_either_16(const u32* p, const u32 c[2]) {
+	u32 mask = match_codepoints_16(p, c[0]);
+	if (c[1] != c[0]) mask |= match_codepoints_16(p, c[1]);
+	return mask;
+}
+
+CH_FORCEINLINE static bool is_either(u32 a, const u32 c[2]) {
+	return a == c[0] || a == c[1];
+}
+
+// Full comparison of a candidate whose first and last codepoint already passed the filter
+CH_FORCEINLINE static bool verify_match(const u32* p, const Literal_Pattern& pattern) {
+	const usize n = pattern.text.count;
+	if (n <= 2) return true;
+	if (!(pattern.flags & SF_Ignore_Case)) return find_mismatch(p + 1, pattern.text.data + 1, n - 2) == n - 2;
+
+	for (usize i = 1; i < n - 1; i++) {
+		if (to_lower(p[i]) != pattern.text[i]) return false;
+	}
+	return true;
+}
+
+// Calls f with every index in p a match starts at. A match has to fit in count. f returns false to stop.
+template <typename F>
+static bool scan_run(const u32* p, usize count, const Literal_Pattern& pattern, F&& f) {
+	const usize n = pattern.text.count;
+	if (count < n) return true;
+
+	// @NOTE: The last codepoint is loaded n - 1 further on, so the last block read still ends inside p
+	const usize start_count = count - n + 1;
+	const u32* last_p = p + n - 1;
+	usize i = 0;
+	for (; i + 16 <= start_count; i += 16) {
+		u32 mask = match_either_16(p + i, pattern.first) & match_either_16(last_p + i, pattern.last);
+		while (mask) {
+			const usize at = i + count_trailing_zeros(mask);
+			if (verify_match(p + at, pattern) && !f(at)) return false;
+			mask &= mask - 1;
+		}
+	}
+	for (; i < start_count; i++) {
+		if (is_either(p[i], pattern.first) && is_either(last_p[i], pattern.last) && verify_match(p + i, pattern) && !f(i)) return false;
+	}
+	return true;
+}
+
+CH_FORCEINLINE static u32 get_codepoint(const Buffer_Halves& halves, usize index) {
+	return index < halves.front_count ? halves.front[index] : halves.back[index - halves.front_count];
+}
+
+// Whether the match at index has no word codepoints running on from either end of it
+static bool is_whole_word(const Buffer_Halves& halves, const Literal_Pattern& pattern, usize index) {
+	const usize n = pattern.text.count;
+	const usize total = halves.front_count + halves.back_count;
+	if (index > 0 && is_word_codepoint(pattern.text[0]) && is_word_codepoint(get_codepoint(halves, index - 1))) return false;
+	if (index + n < total && is_word_codepoint(pattern.text[n - 1]) && is_word_codepoint(get_codepoint(halves, index + n))) return false;
+	return true;
+}
+
+// Calls f with the logical start of every match lying in [start, end), in order. f returns false to stop.
+template <typename F>
+static void search_range(const Buffer_Halves& halves, const Literal_Pattern& pattern, usize start, usize end, F&& f) {
+	const usize n = pattern.text.count;
+	if (!n || start >= end || end - start < n) return;
+
+	auto found = [&](usize index) {
+		if ((pattern.flags & SF_Whole_Word) && !is_whole_word(halves, pattern, index)) return true;
+		return f(index);
+	};
+
+	const usize gap = halves.front_count;
+	if (start < gap) {
+		const usize front_end = ch::min(end, gap);
+		const bool go_on = scan_run(halves.front + start, front_end - start, pattern, [&](usize at) {
+			return found(start + at);
+		});
+		if (!go_on) return;
+	}
+
+	// @NOTE: Anything starting in the last n - 1 codepoints before the gap and ending after it. Those get copied
+	//        out so the same scan can run over them.
+	if (n > 1 && start < gap && end > gap) {
+		const usize lo = ch::max(start, gap - ch::min(gap, n - 1));
+		const usize hi = ch::min(end, gap + n - 1);
+
+		u32 local[256];
+		u32* heap_window = hi - lo > 256 ? ch_new u32[hi - lo] : nullptr;
+		defer(ch_delete[] heap_window);
+		u32* window = heap_window ? heap_window : local;
+
+		for (usize i = lo; i < hi; i++) window[i - lo] = get_codepoint(halves, i);
+		const bool go_on = scan_run(window, hi - lo, pattern, [&](usize at) {
+			return found(lo + at);
+		});
+		if (!go_on) return;
+	}
+
+	if (end > gap) {
+		const usize back_start = ch::max(start, gap);
+		scan_run(halves.back + (back_start - gap), end - back_start, pattern, [&](usize at) {
+			return found(back_start + at);
+		});
+	}
+}
+
+usize find_literal(const Buffer_Halves& halves, const Literal_Pattern& pattern, usize start, usize end) {
+	usize result = no_match;
+	search_range(halves, pattern, start, end, [&](usize index) {
+		result = index;
+		return false;
+	});
+	return result;
+}
+
+usize find_literal_reverse(const Buffer_Halves& halves, const Literal_Pattern& pattern, usize start, usize end) {
+	const usize n = pattern.text.count;
+	if (!n) return no_match;
+
+	// @NOTE: Windows step back from the end and overlap by n - 1 so nothing that crosses a window edge is missed
+	const usize window_size = ch::max(reverse_window_size, n * 4);
+	usize window_end = end;
+	while (window_end > start && window_end - start >= n) {
+		const usize window_start = window_end - ch::min(window_end - start, window_size);
+
+		usize result = no_match;
+		search_range(halves, pattern, window_start, window_end, [&](usize index) {
+			result = index;
+			return true;
+		});
+		if (result != no_match || window_start == start) return result;
+		window_end = window_start + n - 1;
+	}
+	return no_match;
+}
+
+void find_all_literal(const Buffer_Halves& halves, const Literal_Pattern& pattern, usize start, usize end, ch::Array<usize>* out) {
+	const usize n = pattern.text.count;
+	usize next_allowed = start;
+	search_range(halves, pattern, start, end, [&](usize index) {
+		if (index < next_allowed) return true;
+		out->push(index);
+		next_allowed = index + n;
+		return true;
+	});
+}
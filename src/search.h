@@ -0,0 +1,50 @@
+#pragma once
+
+#include "buffer.h"
+
+/* Literal search straight over the two halves of a gap buffer. Every 16 positions get filtered at once on the first
+   and last codepoint of the pattern and only the survivors are compared in full. Matches that run across the gap
+   are looked for separately in a small copy of the text around it, so the halves never have to be joined. */
+
+enum Search_Flags : u32 {
+	SF_Ignore_Case = 0x1,
+	SF_Whole_Word  = 0x2,
+	// Query is a regex. Only looked at by find.h, literal patterns ignore it.
+	SF_Regex       = 0x4,
+};
+
+// Returned by searches that found nothing
+const usize no_match = (usize)-1;
+
+// Simple one to one case mappings for ASCII, Latin-1, Greek and Cyrillic. Everything else maps to itself.
+u32 to_lower(u32 c);
+u32 to_upper(u32 c);
+
+// Letters, digits and '_'. Anything past Latin-1 punctuation counts as a letter.
+bool is_word_codepoint(u32 c);
+
+// Letters, digits, '_', '$' and anything past ASCII. What completions and definitions take a name to be made of.
+CH_FORCEINLINE bool is_name_codepoint(u32 c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '$' || c >= 0x80;
+}
+
+struct Literal_Pattern {
+	// Lowered when SF_Ignore_Case is set
+	ch::Array<u32> text;
+	u32 flags = 0;
+
+	// What the filter looks for at the first and last position of a match. Both cases of a letter when case is
+	// ignored, the same codepoint twice otherwise.
+	u32 first[2];
+	u32 last[2];
+
+	void set(const u32* text, usize count, u32 flags);
+	void free();
+};
+
+// Start of the first match lying in the logical range [start, end) of halves, or no_match
+usize find_literal(const Buffer_Halves& halves, const Literal_Pattern& pattern, usize start, usize end);
+// Start of the last match lying in [start, end), or no_match
+usize find_literal_reverse(const Buffer_Halves& halves, const Literal_Pattern& pattern, usize start, usize end);
+// Pushes the start of every match lying in [start, end) in order. Matches don't overlap.
+void find_all_literal(const Buffer_Halves& halves, const Literal_Pattern& pattern, usize start, usize end, ch::Array<usize>* out);
@@ -0,0 +1,361 @@
+#include "session.h"
+#include "editor.h"
+#include "buffer_view.h"
+#include "mapped_text.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/string.h>
+
+static const u8 session_magic[8] = { 'Y', 'E', 'E', 'T', 'S', 'E', 'S', '1' };
+static const u64 no_focused_view = (u64)-1;
+
+// @NOTE: Every part of the file is a multiple of 8 bytes so the line sizes that follow the tables stay aligned
+//        and can be used straight out of the mapping.
+struct Session_Header {
+	u8 magic[8];
+	u64 buffer_count;
+	u64 view_count;
+	u64 focused_view;
+};
+
+struct Session_Buffer {
+	// Offsets are from the start of the file. The path is null terminated.
+	u64 path_offset;
+	u64 path_size;
+	u64 file_size;
+	u64 file_mtime;
+	// Line sizes as in eol_table. line_count is 0 when the buffer didn't have a line index worth keeping.
+	u64 lines_offset;
+	u64 line_count;
+};
+
+struct Session_View {
+	u64 buffer;
+	s64 cursor;
+	s64 selection;
+	f32 scroll_y;
+	f32 width_ratio;
+};
+
+// A buffer restored from the session that hasn't been shown yet. Its entry stays in the mapping until then.
+struct Pending_Buffer {
+	Buffer_ID id;
+	usize entry;
+};
+
+// A view restored on a buffer that was still loading. Its cursor goes back once the text is there to put it in.
+struct Restored_Cursor {
+	Buffer_View* view;
+	Buffer_ID buffer;
+	s64 cursor;
+	s64 selection;
+};
+
+static Mapped_File session_file;
+static ch::Array<Pending_Buffer> pending_buffers;
+static ch::Array<Restored_Cursor> restored_cursors;
+
+static bool get_session_path(ch::Path* out_path) {
+	return get_cache_directory(out_path) && append_path_name(out_path, CH_TEXT("session"));
+}
+
+CH_FORCEINLINE static const Session_Header* get_header() {
+	return (const Session_Header*)session_file.data;
+}
+
+CH_FORCEINLINE static const Session_Buffer* get_entries() {
+	return (const Session_Buffer*)(session_file.data + sizeof(Session_Header));
+}
+
+CH_FORCEINLINE static const Session_View* get_views() {
+	return (const Session_View*)(get_entries() + get_header()->buffer_count);
+}
+
+CH_FORCEINLINE static bool is_in_file(u64 offset, u64 size) {
+	return offset <= session_file.size && size <= session_file.size - offset;
+}
+
+static bool is_valid_session() {
+	if (session_file.size < sizeof(Session_Header)) return false;
+
+	const Session_Header* header = get_header();
+	for (usize i = 0; i < sizeof(session_magic); i++) {
+		if (header->magic[i] != session_magic[i]) return false;
+	}
+
+	const u64 room = session_file.size - sizeof(Session_Header);
+	if (header->buffer_count > room / sizeof(Session_Buffer)) return false;
+	if (header->view_count > (room - header->buffer_count * sizeof(Session_Buffer)) / sizeof(Session_View)) return false;
+
+	const Session_Buffer* entries = get_entries();
+	for (u64 i = 0; i < header->buffer_count; i++) {
+		const Session_Buffer& entry = entries[i];
+		if (entry.path_size < sizeof(tchar) || entry.path_offset % sizeof(tchar) != 0) return false;
+		if (!is_in_file(entry.path_offset, entry.path_size)) return false;
+
+		const tchar* path = (const tchar*)(session_file.data + entry.path_offset);
+		if (path[entry.path_size / sizeof(tchar) - 1] != 0) return false;
+
+		if (entry.lines_offset % sizeof(u64) != 0 || entry.line_count > session_file.size / sizeof(u64)) return false;
+		if (!is_in_file(entry.lines_offset, entry.line_count * sizeof(u64))) return false;
+	}
+	return true;
+}
+
+static void close_session_file() {
+	unmap_file(&session_file);
+	session_file = Mapped_File();
+	pending_buffers.free();
+}
+
+// Mapped buffers are clamped to their size in bytes, that's all that's known up front
+static ssize clamp_saved_position(const Buffer* buffer, s64 position) {
+	const usize count = buffer->mapped ? (usize)buffer->mapped->file.size : buffer->gap_buffer.count();
+	return ch::min(ch::max((ssize)position, (ssize)-1), (ssize)count - 1);
+}
+
+bool restore_session() {
+	static_assert(sizeof(usize) == sizeof(u64), "Line sizes are used straight out of the mapping");
+
+	ch::Path path;
+	if (!get_session_path(&path) || !map_file(path, &session_file)) return false;
+	if (!is_valid_session()) {
+		close_session_file();
+		return false;
+	}
+
+	const Session_Header* header = get_header();
+	const Session_Buffer* entries = get_entries();
+
+	// Showing the last pending buffer lets go of the mapping, so the views get copied out first
+	const u64 focused = header->focused_view;
+	ch::Array<Session_View> views(ch::get_heap_allocator());
+	defer(views.free());
+	views.reserve((usize)header->view_count);
+	for (u64 i = 0; i < header->view_count; i++) views.push(get_views()[i]);
+
+	ch::Array<Buffer_ID> ids(ch::get_heap_allocator());
+	defer(ids.free());
+
+	// Nothing is read here, buffers only get their paths
+	pending_buffers.allocator = ch::get_heap_allocator();
+	for (u64 i = 0; i < header->buffer_count; i++) {
+		Buffer* buffer = create_buffer();
+		buffer->full_path = (const tchar*)(session_file.data + entries[i].path_offset);
+		ids.push(buffer->id);
+
+		Pending_Buffer pending;
+		pending.id = buffer->id;
+		pending.entry = (usize)i;
+		pending_buffers.push(pending);
+	}
+
+	// Showing a buffer is what loads it
+	for (usize i = 0; i < views.count; i++) {
+		const Session_View& saved = views[i];
+		if (saved.buffer >= ids.count) continue;
+
+		Buffer_View* view = get_view(push_view(ids[(usize)saved.buffer]));
+		const Buffer* buffer = find_buffer(view->the_buffer);
+		if (buffer->is_loading()) {
+			Restored_Cursor restored = { view, buffer->id, saved.cursor, saved.selection };
+			restored_cursors.allocator = ch::get_heap_allocator();
+			restored_cursors.push(restored);
+		} else {
+			view->cursor = clamp_saved_position(buffer, saved.cursor);
+			view->selection = clamp_saved_position(buffer, saved.selection);
+		}
+		view->current_scroll_y = saved.scroll_y;
+		view->target_scroll_y = saved.scroll_y;
+		view->width_ratio = ch::max(saved.width_ratio, min_width_ratio);
+
+		if (i == focused) focused_view = view;
+	}
+
+	if (!pending_buffers.count) close_session_file();
+	return true;
+}
+
+void fault_in_buffer(Buffer_ID id) {
+	for (usize i = 0; i < pending_buffers.count; i++) {
+		if (pending_buffers[i].id != id) continue;
+
+		const Session_Buffer& entry = get_entries()[pending_buffers[i].entry];
+		pending_buffers.remove(i);
+
+		Buffer* buffer = find_buffer(id);
+		if (buffer) {
+			Known_Lines known;
+			known.stamp.size = entry.file_size;
+			known.stamp.mtime = entry.file_mtime;
+			known.sizes = (const usize*)(session_file.data + entry.lines_offset);
+			known.count = (usize)entry.line_count;
+
+			// @NOTE: A file that went away in the meantime stays an empty buffer with its path. Saving it puts it back.
+			const ch::Path path = buffer->full_path;
+			load_file(buffer, path, &known);
+		}
+
+		if (!pending_buffers.count) close_session_file();
+		return;
+	}
+}
+
+// Views closed or switched to another buffer while it was loading don't want their cursor back
+CH_FORCEINLINE static bool is_still_waiting(const Restored_Cursor& restored) {
+	return get_view_index(restored.view) != -1 && restored.view->the_buffer == restored.buffer;
+}
+
+void restore_session_cursors(Buffer_ID id) {
+	const Buffer* buffer = find_buffer(id);
+	for (usize i = 0; i < restored_cursors.count;) {
+		const Restored_Cursor& restored = restored_cursors[i];
+		if (is_still_waiting(restored) && restored.buffer != id) {
+			i += 1;
+			continue;
+		}
+
+		// Left alone if the cursor got moved in the part that was already loaded
+		Buffer_View* view = restored.view;
+		if (is_still_waiting(restored) && view->cursor == -1 && view->selection == -1) {
+			view->cursor = clamp_saved_position(buffer, restored.cursor);
+			view->selection = clamp_saved_position(buffer, restored.selection);
+		}
+		restored_cursors.remove(i);
+	}
+	if (!restored_cursors.count) restored_cursors.free();
+}
+
+static const Restored_Cursor* find_restored(const Buffer_View* view) {
+	for (const Restored_Cursor& restored : restored_cursors) {
+		if (restored.view == view && is_still_waiting(restored)) return &restored;
+	}
+	return nullptr;
+}
+
+static const Pending_Buffer* find_pending(Buffer_ID id) {
+	for (const Pending_Buffer& pending : pending_buffers) {
+		if (pending.id == id) return &pending;
+	}
+	return nullptr;
+}
+
+bool is_pending_buffer(Buffer_ID id) {
+	return find_pending(id) != nullptr;
+}
+
+static bool save_session() {
+	ch::Array<Session_Buffer> entries(ch::get_heap_allocator());
+	ch::Array<Buffer_ID> saved_ids(ch::get_heap_allocator());
+	ch::Array<Session_View> saved_views(ch::get_heap_allocator());
+	// Line sizes first, then paths, in entry order
+	ch::Array<IO_Slice> blobs(ch::get_heap_allocator());
+	defer(entries.free());
+	defer(saved_ids.free());
+	defer(saved_views.free());
+	defer(blobs.free());
+
+	for (Buffer_ID id : get_buffer_ids()) {
+		const Buffer* buffer = find_buffer(id);
+		if (!buffer->full_path.count) continue;
+
+		Session_Buffer entry = {};
+		IO_Slice lines = { nullptr, 0 };
+		if (const Pending_Buffer* pending = find_pending(id)) {
+			entry = get_entries()[pending->entry];
+			lines.data = session_file.data + entry.lines_offset;
+		} else {
+			entry.file_size = buffer->disk_stamp.size;
+			entry.file_mtime = buffer->disk_stamp.mtime;
+			// Mapped buffers have their own line cache and binary ones have no lines. Loading or edited ones don't match the file.
+			if (!buffer->is_read_only() && !buffer->is_loading() && !buffer->is_binary() && !buffer->is_dirty()) {
+				lines.data = buffer->eol_table.data;
+				entry.line_count = buffer->eol_table.count;
+			}
+		}
+		lines.size = (usize)entry.line_count * sizeof(u64);
+
+		entries.push(entry);
+		saved_ids.push(id);
+		blobs.push(lines);
+	}
+
+	u64 focused = no_focused_view;
+	for (usize i = 0; i < get_view_count(); i++) {
+		const Buffer_View* view = get_view(i);
+		const ssize entry = saved_ids.find(view->the_buffer);
+		if (entry == -1) continue;
+
+		if (view == focused_view) focused = saved_views.count;
+
+		// Still loading, the cursor it had last time hasn't gone back yet
+		const Restored_Cursor* restored = find_restored(view);
+
+		Session_View saved;
+		saved.buffer = (u64)entry;
+		saved.cursor = restored ? restored->cursor : view->cursor;
+		saved.selection = restored ? restored->selection : view->selection;
+		saved.scroll_y = view->target_scroll_y;
+		saved.width_ratio = view->width_ratio;
+		saved_views.push(saved);
+	}
+
+	Session_Header header = {};
+	ch::mem_copy(header.magic, session_magic, sizeof(session_magic));
+	header.buffer_count = entries.count;
+	header.view_count = saved_views.count;
+	header.focused_view = focused;
+
+	static const u8 padding[sizeof(u64)] = {};
+	u64 offset = sizeof(Session_Header) + entries.count * sizeof(Session_Buffer) + saved_views.count * sizeof(Session_View);
+	for (usize i = 0; i < entries.count; i++) {
+		entries[i].lines_offset = offset;
+		offset += blobs[i].size;
+	}
+
+	ch::Array<IO_Slice> slices(ch::get_heap_allocator());
+	defer(slices.free());
+	const IO_Slice header_slice = { &header, sizeof(header) };
+	const IO_Slice entries_slice = { entries.data, entries.count * sizeof(Session_Buffer) };
+	const IO_Slice views_slice = { saved_views.data, saved_views.count * sizeof(Session_View) };
+	slices.push(header_slice);
+	slices.push(entries_slice);
+	slices.push(views_slice);
+	for (const IO_Slice& lines : blobs) slices.push(lines);
+
+	for (usize i = 0; i < entries.count; i++) {
+		const Buffer* buffer = find_buffer(saved_ids[i]);
+		const usize size = (buffer->full_path.count + 1) * sizeof(tchar);
+		entries[i].path_offset = offset;
+		entries[i].path_size = size;
+
+		const IO_Slice path_slice = { buffer->full_path.data, size };
+		slices.push(path_slice);
+		const IO_Slice pad = { padding, (sizeof(u64) - size % sizeof(u64)) % sizeof(u64) };
+		if (pad.size) slices.push(pad);
+		offset += size + pad.size;
+	}
+
+	ch::Path path;
+	if (!get_session_path(&path)) return false;
+	ch::Path temp_path = path;
+	if (!append_path_suffix(&temp_path, CH_TEXT(".tmp"))) return false;
+
+	const OS_File file = create_write_file(temp_path);
+	if (file == invalid_os_file) return false;
+	const bool written = write_file_gather(file, slices.data, slices.count);
+	close_os_file(file);
+
+	// The old session can't stay mapped while it gets replaced
+	close_session_file();
+	if (!written || !replace_file(temp_path, path)) {
+		delete_file(temp_path);
+		return false;
+	}
+	return true;
+}
+
+void shutdown_session() {
+	if (!save_session()) close_session_file();
+	restored_cursors.free();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "buffer.h"
+
+/* The open files and views, saved on the way out so the next start picks up where this one left off. The session
+   file is mapped and read in place. Only buffers a view shows load right away, every other one stays an empty
+   buffer with its path until something first shows it, so starting up doesn't read more files the bigger the session. */
+
+// Brings back the last saved session. Returns false when there isn't a usable one.
+bool restore_session();
+
+// Loads id if it came from the session and hasn't been shown yet. Cheap for every other buffer.
+void fault_in_buffer(Buffer_ID id);
+// Whether id came from the session and is still empty, waiting to be shown
+bool is_pending_buffer(Buffer_ID id);
+
+// Puts back the cursors the session saved for views on id. Called when id finishes loading in the background.
+void restore_session_cursors(Buffer_ID id);
+
+// Saves the session for next time and lets go of the old one. Buffers that were never shown keep what the old
+// session knew about them.
+void shutdown_session();
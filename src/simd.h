@@ -0,0 +1,59 @@
+#pragma once
+
+#include <ch_stl/types.h>
+
+// @NOTE: x64 is the only architecture we build for so SSE2 is always there
+#include <emmintrin.h>
+
+#if CH_PLATFORM_WINDOWS
+#include <intrin.h>
+#endif
+
+CH_FORCEINLINE u32 count_trailing_zeros(u32 mask) {
+	assert(mask);
+#if CH_PLATFORM_WINDOWS
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (u32)index;
+#else
+	return (u32)__builtin_ctz(mask);
+#endif
+}
+
+CH_FORCEINLINE u32 count_bits(u32 mask) {
+#if CH_PLATFORM_WINDOWS
+	return (u32)__popcnt(mask);
+#else
+	return (u32)__builtin_popcount(mask);
+#endif
+}
+
+// Mask with bit i set when byte i of the 16 at p equals c
+CH_FORCEINLINE u32 match_bytes_16(const u8* p, u8 c) {
+	const __m128i v = _mm_loadu_si128((const __m128i*)p);
+	return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)c)));
+}
+
+// Zero extends 16 bytes into 16 codepoints
+CH_FORCEINLINE void widen_bytes_16(__m128i v, u32* dst) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lo = _mm_unpacklo_epi8(v, zero);
+	const __m128i hi = _mm_unpackhi_epi8(v, zero);
+	_mm_storeu_si128((__m128i*)(dst + 0), _mm_unpacklo_epi16(lo, zero));
+	_mm_storeu_si128((__m128i*)(dst + 4), _mm_unpackhi_epi16(lo, zero));
+	_mm_storeu_si128((__m128i*)(dst + 8), _mm_unpacklo_epi16(hi, zero));
+	_mm_storeu_si128((__m128i*)(dst + 12), _mm_unpackhi_epi16(hi, zero));
+}
+
+// Mask with bit i set when codepoint i of the 16 at p equals c
+CH_FORCEINLINE u32 match_codepoints_16(const u32* p, u32 c) {
+	const __m128i needle = _mm_set1_epi32((s32)c);
+	const __m128i m0 = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(p + 0)), needle);
+	const __m128i m1 = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(p + 4)), needle);
+	const __m128i m2 = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(p + 8)), needle);
+	const __m128i m3 = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(p + 12)), needle);
+	// Compare results are all ones or all zeros so saturating packs keep them intact
+	const __m128i lo = _mm_packs_epi32(m0, m1);
+	const __m128i hi = _mm_packs_epi32(m2, m3);
+	return (u32)_mm_movemask_epi8(_mm_packs_epi16(lo, hi));
+}
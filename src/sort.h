@@ -0,0 +1,40 @@
+#pragma once
+
+#include <ch_stl/memory.h>
+
+/* Stable sorts for the indexes, which sort big arrays of plain structs on the job pool. */
+
+// Sorts by key, a byte at a time from the lowest. temp has to hold count items. Returns whichever of items and temp
+// the result ended up in.
+template <typename T, typename F>
+T* radix_sort(T* items, T* temp, usize count, usize key_bytes, F get_key) {
+	for (usize b = 0; b < key_bytes; b++) {
+		usize offsets[257] = {};
+		for (usize i = 0; i < count; i++) offsets[((get_key(items[i]) >> (b * 8)) & 0xFF) + 1] += 1;
+		for (usize i = 1; i < 257; i++) offsets[i] += offsets[i - 1];
+		for (usize i = 0; i < count; i++) temp[offsets[(get_key(items[i]) >> (b * 8)) & 0xFF]++] = items[i];
+
+		T* swap = items;
+		items = temp;
+		temp = swap;
+	}
+	return items;
+}
+
+// Sorts in place by comparing. temp has to hold count items.
+template <typename T, typename F>
+void merge_sort(T* items, T* temp, usize count, F is_before) {
+	if (count < 2) return;
+	const usize half = count / 2;
+	merge_sort(items, temp, half, is_before);
+	merge_sort(items + half, temp, count - half, is_before);
+	if (!is_before(items[half], items[half - 1])) return;
+
+	usize a = 0;
+	usize b = half;
+	usize out = 0;
+	while (a < half && b < count) temp[out++] = is_before(items[b], items[a]) ? items[b++] : items[a++];
+	while (a < half) temp[out++] = items[a++];
+	while (b < count) temp[out++] = items[b++];
+	ch::mem_copy(items, temp, count * sizeof(T));
+}
@@ -0,0 +1,383 @@
+#include "symbol_index.h"
+#include "project_index.h"
+#include "project_walk.h"
+#include "platform.h"
+#include "encoding.h"
+#include "sort.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/memory.h>
+#include <ch_stl/string.h>
+#include <ch_stl/hash.h>
+
+// Longer names than this don't get saved
+static const usize max_symbol_name_size = 0xFFFF;
+
+// The layout of the payload after the file table. Offsets are from its start.
+struct Symbol_Payload_Header {
+	u64 symbol_count;
+	u64 slot_count;
+	// Saved_Symbol for every symbol, sorted by name and then by file and line
+	u64 symbols_offset;
+	// A power of two of u32s. Each one is 0 or the index of the first symbol with some name plus one.
+	u64 slots_offset;
+	// Every name once, in order
+	u64 names_offset;
+	u64 names_size;
+};
+
+struct Saved_Symbol {
+	// In bytes from the start of the names. Symbols with the same name share it.
+	u32 name_offset;
+	u16 name_size;
+	Symbol_Kind kind;
+	u8 pad;
+	u32 file;
+	u32 line;
+};
+
+// The payload of a batch, or of a changed file with its one file
+struct Symbol_List {
+	// Names are in names and files are local
+	ch::Array<Saved_Symbol> symbols;
+	ch::Array<u8> names;
+};
+
+// The mapped payload
+struct Symbol_Table {
+	const Symbol_Payload_Header* header;
+	const Saved_Symbol* symbols;
+	const u32* slots;
+	const u8* names;
+};
+
+static Project_Index* the_symbols = nullptr;
+
+static bool is_scanned_path(const ch::Path& path) {
+	return get_symbol_language(path.data, path.count) != SL_None;
+}
+
+// Byte order, and shorter first when one starts with the other
+static s32 compare_names(const u8* a, usize a_size, const u8* b, usize b_size) {
+	const usize size = ch::min(a_size, b_size);
+	for (usize i = 0; i < size; i++) {
+		if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+	}
+	if (a_size == b_size) return 0;
+	return a_size < b_size ? -1 : 1;
+}
+
+CH_FORCEINLINE static bool is_same_name(const u8* a, usize a_size, const u8* b, usize b_size) {
+	return a_size == b_size && !compare_names(a, a_size, b, b_size);
+}
+
+// Scans path and pushes its symbols with their names copied into names. Files that can't be read or aren't UTF-8
+// have none.
+static void scan_file(const ch::Path& path, File_Stamp* out_stamp, ch::Array<Scanned_Symbol>* scratch, u32 file, ch::Array<Saved_Symbol>* out_symbols, ch::Array<u8>* out_names) {
+	*out_stamp = File_Stamp();
+	Mapped_File mapped;
+	if (!get_file_stamp(path, out_stamp) || !map_file(path, &mapped)) return;
+	defer(unmap_file(&mapped));
+
+	if (looks_binary(mapped.data, mapped.size)) return;
+	usize bom_size;
+	if (detect_text_format(mapped.data, mapped.size, &bom_size).encoding != TE_UTF8) return;
+
+	const u8* data = mapped.data + bom_size;
+	scratch->count = 0;
+	scan_symbols(get_symbol_language(path.data, path.count), data, mapped.size - bom_size, scratch);
+
+	out_symbols->reserve(scratch->count);
+	for (const Scanned_Symbol& it : *scratch) {
+		if (it.name_size > max_symbol_name_size) continue;
+		Saved_Symbol symbol = {};
+		symbol.name_offset = (u32)out_names->count;
+		symbol.name_size = (u16)it.name_size;
+		symbol.kind = it.kind;
+		symbol.file = file;
+		symbol.line = it.line;
+		out_symbols->push(symbol);
+
+		out_names->reserve(it.name_size);
+		ch::mem_copy(out_names->data + out_names->count, data + it.name_offset, it.name_size);
+		out_names->count += it.name_size;
+	}
+}
+
+static void* new_scratch() {
+	ch::Array<Scanned_Symbol>* scratch = ch_new ch::Array<Scanned_Symbol>;
+	scratch->allocator = ch::get_heap_allocator();
+	return scratch;
+}
+
+static void free_scratch(void* user) {
+	ch::Array<Scanned_Symbol>* scratch = (ch::Array<Scanned_Symbol>*)user;
+	scratch->free();
+	ch_delete scratch;
+}
+
+static void* new_payload() {
+	Symbol_List* list = ch_new Symbol_List;
+	list->symbols.allocator = ch::get_heap_allocator();
+	list->names.allocator = ch::get_heap_allocator();
+	return list;
+}
+
+static void free_payload(void* payload) {
+	Symbol_List* list = (Symbol_List*)payload;
+	list->symbols.free();
+	list->names.free();
+	ch_delete list;
+}
+
+static void index_file(void* user, const ch::Path& path, u32 local_file, void* payload, Indexed_File* out_file) {
+	Symbol_List* list = (Symbol_List*)payload;
+	File_Stamp stamp;
+	scan_file(path, &stamp, (ch::Array<Scanned_Symbol>*)user, local_file, &list->symbols, &list->names);
+	out_file->size = stamp.size;
+	out_file->mtime = stamp.mtime;
+}
+
+// Every file's symbols are in file and line order already
+static void finish_payload(void* user, void* payload) {}
+
+// A symbol of some batch on its way into the saved index
+struct Sorted_Symbol {
+	const u8* name;
+	Saved_Symbol symbol;
+};
+
+static bool write_payload(const Index_Batch* const* batches, usize count, OS_File file) {
+	usize symbol_count = 0;
+	for (usize i = 0; i < count; i++) symbol_count += ((const Symbol_List*)batches[i]->payload)->symbols.count;
+
+	// @NOTE: Batches go in in file order and every batch has its symbols in file and line order, so a stable sort by
+	// name leaves the symbols of each name in file and line order as well
+	ch::Array<Sorted_Symbol> sorted(ch::get_heap_allocator());
+	defer(sorted.free());
+	sorted.reserve(symbol_count);
+	for (usize i = 0; i < count; i++) {
+		const Symbol_List* list = (const Symbol_List*)batches[i]->payload;
+		for (Saved_Symbol symbol : list->symbols) {
+			const u8* name = list->names.data + symbol.name_offset;
+			symbol.file += batches[i]->first_file;
+			sorted.push({ name, symbol });
+		}
+	}
+	{
+		ch::Array<Sorted_Symbol> temp(ch::get_heap_allocator());
+		defer(temp.free());
+		temp.reserve(sorted.count);
+		merge_sort(sorted.data, temp.data, sorted.count, [](const Sorted_Symbol& a, const Sorted_Symbol& b) {
+			return compare_names(a.name, a.symbol.name_size, b.name, b.symbol.name_size) < 0;
+		});
+	}
+
+	ch::Array<Saved_Symbol> symbols(ch::get_heap_allocator());
+	defer(symbols.free());
+	symbols.reserve(sorted.count);
+	ch::Array<u8> names(ch::get_heap_allocator());
+	defer(names.free());
+	// Index of the first symbol of every name
+	ch::Array<u32> firsts(ch::get_heap_allocator());
+	defer(firsts.free());
+	for (usize i = 0; i < sorted.count; i++) {
+		Saved_Symbol symbol = sorted[i].symbol;
+		const bool is_new_name = !i || !is_same_name(sorted[i - 1].name, sorted[i - 1].symbol.name_size, sorted[i].name, symbol.name_size);
+		if (is_new_name) {
+			firsts.push((u32)i);
+			symbol.name_offset = (u32)names.count;
+			names.reserve(symbol.name_size);
+			ch::mem_copy(names.data + names.count, sorted[i].name, symbol.name_size);
+			names.count += symbol.name_size;
+		} else {
+			symbol.name_offset = symbols[i - 1].name_offset;
+		}
+		symbols.push(symbol);
+	}
+	if (names.count > 0xFFFFFFFF) return false;
+
+	// At least twice as many slots as names keeps probes short
+	usize slot_count = 16;
+	while (slot_count < firsts.count * 2) slot_count *= 2;
+	ch::Array<u32> slots(ch::get_heap_allocator());
+	defer(slots.free());
+	slots.reserve(slot_count);
+	slots.count = slot_count;
+	ch::mem_zero(slots.data, slot_count * sizeof(u32));
+	for (u32 first : firsts) {
+		const Saved_Symbol& symbol = symbols[first];
+		usize slot = ch::fnv1_hash(names.data + symbol.name_offset, symbol.name_size) & (slot_count - 1);
+		while (slots[slot]) slot = (slot + 1) & (slot_count - 1);
+		slots[slot] = first + 1;
+	}
+
+	Symbol_Payload_Header header = {};
+	header.symbol_count = symbols.count;
+	header.slot_count = slot_count;
+	header.symbols_offset = sizeof(header);
+	header.slots_offset = header.symbols_offset + symbols.count * sizeof(Saved_Symbol);
+	header.names_offset = header.slots_offset + slot_count * sizeof(u32);
+	header.names_size = names.count;
+
+	const IO_Slice slices[] = {
+		{ &header, sizeof(header) },
+		{ symbols.data, symbols.count * sizeof(Saved_Symbol) },
+		{ slots.data, slots.count * sizeof(u32) },
+		{ names.data, names.count },
+	};
+	return write_file_gather(file, slices, sizeof(slices) / sizeof(slices[0]));
+}
+
+static bool is_valid_payload(const u8* payload, usize size, u64 file_count) {
+	const Symbol_Payload_Header* header = (const Symbol_Payload_Header*)payload;
+	bool valid = size >= sizeof(Symbol_Payload_Header);
+	valid = valid && header->symbols_offset == sizeof(Symbol_Payload_Header);
+	valid = valid && header->symbol_count < (u64)size / sizeof(Saved_Symbol);
+	valid = valid && header->slot_count && !(header->slot_count & (header->slot_count - 1)) && header->slot_count < (u64)size / sizeof(u32);
+	valid = valid && header->slots_offset == header->symbols_offset + header->symbol_count * sizeof(Saved_Symbol);
+	valid = valid && header->names_offset == header->slots_offset + header->slot_count * sizeof(u32);
+	valid = valid && header->names_offset + header->names_size == (u64)size;
+	if (!valid) return false;
+
+	const Saved_Symbol* symbols = (const Saved_Symbol*)(payload + header->symbols_offset);
+	const u32* slots = (const u32*)(payload + header->slots_offset);
+	for (u64 i = 0; valid && i < header->symbol_count; i++) {
+		valid = (u64)symbols[i].name_offset + symbols[i].name_size <= header->names_size && symbols[i].file < file_count;
+	}
+	for (u64 i = 0; valid && i < header->slot_count; i++) {
+		valid = slots[i] <= header->symbol_count;
+	}
+	return valid;
+}
+
+static const Index_Procs symbol_procs = {
+	{ 'Y', 'E', 'E', 'T', 'S', 'Y', 'M', '2' },
+	CH_TEXT("symbols"),
+	is_scanned_path,
+	new_scratch,
+	free_scratch,
+	new_payload,
+	index_file,
+	finish_payload,
+	free_payload,
+	write_payload,
+	is_valid_payload,
+};
+
+static Symbol_Table get_symbol_table(const Project_Index* index) {
+	Symbol_Table table;
+	table.header = (const Symbol_Payload_Header*)index->payload;
+	table.symbols = (const Saved_Symbol*)(index->payload + table.header->symbols_offset);
+	table.slots = (const u32*)(index->payload + table.header->slots_offset);
+	table.names = index->payload + table.header->names_offset;
+	return table;
+}
+
+void open_symbol_index(const ch::Path& root) {
+	if (the_symbols && is_same_path(the_symbols->root, root)) return;
+	shutdown_symbol_index();
+	the_symbols = open_project_index(root, &symbol_procs);
+}
+
+void note_symbol_file_changed(const ch::Path& path) {
+	if (the_symbols) note_indexed_file_changed(the_symbols, path);
+}
+
+void check_symbol_index() {
+	if (the_symbols) check_project_index(the_symbols);
+}
+
+CH_FORCEINLINE static const u8* get_name(const Symbol_Table& table, const Saved_Symbol& symbol) {
+	return table.names + symbol.name_offset;
+}
+
+// Index of the first symbol named name, or the symbol count when there's none
+static usize find_name(const Symbol_Table& table, const u8* name, usize size) {
+	const usize mask = (usize)table.header->slot_count - 1;
+	usize slot = ch::fnv1_hash(name, size) & mask;
+	for (usize probes = 0; probes <= mask; probes++) {
+		const u32 first = table.slots[slot];
+		if (!first) break;
+		const Saved_Symbol& symbol = table.symbols[first - 1];
+		if (is_same_name(get_name(table, symbol), symbol.name_size, name, size)) return first - 1;
+		slot = (slot + 1) & mask;
+	}
+	return (usize)table.header->symbol_count;
+}
+
+// Index of the first symbol whose name doesn't come before name
+static usize find_first_name_from(const Symbol_Table& table, const u8* name, usize size) {
+	usize low = 0;
+	usize high = (usize)table.header->symbol_count;
+	while (low < high) {
+		const usize mid = low + (high - low) / 2;
+		const Saved_Symbol& symbol = table.symbols[mid];
+		if (compare_names(get_name(table, symbol), symbol.name_size, name, size) < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+CH_FORCEINLINE static bool is_match(const u8* symbol_name, usize symbol_size, const u8* name, usize size, bool prefix) {
+	if (prefix) return symbol_size >= size && is_same_name(symbol_name, size, name, size);
+	return is_same_name(symbol_name, symbol_size, name, size);
+}
+
+bool find_symbols(const ch::Path& root, const u32* name, usize count, bool prefix, usize max, ch::Array<Symbol_Location>* out) {
+	const Project_Index* index = the_symbols;
+	if (!index || !index->header || !is_indexed_root(index, root)) return false;
+
+	ch::Array<u8> bytes(ch::get_heap_allocator());
+	defer(bytes.free());
+	bytes.reserve(count * max_utf8_sequence);
+	usize consumed;
+	bytes.count = utf8_encode(name, count, bytes.data, count * max_utf8_sequence, &consumed);
+	if (!bytes.count) return true;
+
+	const usize first_out = out->count;
+	auto push_location = [&](const u8* symbol_name, const Saved_Symbol& symbol, const ch::Path& path) {
+		if (!is_path_under(path, root)) return;
+		Symbol_Location location;
+		location.name = symbol_name;
+		location.name_size = symbol.name_size;
+		location.kind = symbol.kind;
+		location.line = symbol.line;
+		location.path = path;
+		out->push(location);
+	};
+
+	const Symbol_Table table = get_symbol_table(index);
+	const usize symbol_count = (usize)table.header->symbol_count;
+	usize i = prefix ? find_first_name_from(table, bytes.data, bytes.count) : find_name(table, bytes.data, bytes.count);
+	for (; i < symbol_count && out->count - first_out < max; i++) {
+		const Saved_Symbol& symbol = table.symbols[i];
+		if (!is_match(get_name(table, symbol), symbol.name_size, bytes.data, bytes.count, prefix)) break;
+		if (index->dead[symbol.file]) continue;
+		push_location(get_name(table, symbol), symbol, get_indexed_path(index, symbol.file));
+	}
+
+	// @NOTE: Changed files are few, so going over all of their symbols is cheaper than keeping them sorted
+	for (const Changed_File* file : index->changed) {
+		const Symbol_List* list = (const Symbol_List*)file->payload;
+		for (const Saved_Symbol& symbol : list->symbols) {
+			if (out->count - first_out >= max) return true;
+			const u8* symbol_name = list->names.data + symbol.name_offset;
+			if (is_match(symbol_name, symbol.name_size, bytes.data, bytes.count, prefix)) push_location(symbol_name, symbol, file->path);
+		}
+	}
+	return true;
+}
+
+void tick_symbol_index() {
+	if (the_symbols) tick_project_index(the_symbols);
+}
+
+void shutdown_symbol_index() {
+	if (!the_symbols) return;
+	close_project_index(the_symbols);
+	the_symbols = nullptr;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "symbol_scan.h"
+
+#include <ch_stl/filesystem.h>
+
+/* Every symbol the files of a project define, for going to a definition and completing names. Files get scanned on
+   the job pool during the same walk project searches do, and the symbols are saved in the cache directory as a file
+   that's mapped and used in place: a file table, the symbols sorted by name and a hash table from each name to its
+   first symbol. Exact names are one probe of the hash table, prefixes a binary search.
+
+   Keeping it up to date is left to project_index.h, the same as for the trigram index. Opening a project checks every
+   file's stamp in the background, files the project's watch sees change get scanned again, and those go in memory on
+   top of the mapped index until there are enough of them to make rebuilding worth it. */
+
+// Where one symbol is defined. name points into the index, so it's only good until the next tick.
+struct Symbol_Location {
+	const u8* name;
+	usize name_size;
+	Symbol_Kind kind;
+	// Starting from 0
+	u32 line;
+	ch::Path path;
+};
+
+// Maps root's symbols from the cache directory or starts scanning them. Drops the symbols of any other root.
+void open_symbol_index(const ch::Path& root);
+
+// Has path scanned again soon. Called when a watch sees it change.
+void note_symbol_file_changed(const ch::Path& path);
+// Has every file's stamp checked again. Called when the watch lost track of changes.
+void check_symbol_index();
+
+// Pushes up to max symbols named name, or starting with it when prefix is set. Names are matched byte for byte in
+// UTF-8. Returns false when there's no index for root yet.
+bool find_symbols(const ch::Path& root, const u32* name, usize count, bool prefix, usize max, ch::Array<Symbol_Location>* out);
+
+// Installs finished builds and scans changed files. Called once a tick on the main thread.
+void tick_symbol_index();
+
+// Stops every job and waits for them. Called before the job pool goes away.
+void shutdown_symbol_index();
@@ -0,0 +1,778 @@
+#include "symbol_scan.h"
+
+#include <ch_stl/math.h>
+
+enum C_Token_Type : u8 {
+	CT_End,
+	CT_Identifier,
+	CT_Punct,
+	// Numbers, strings and characters
+	CT_Literal,
+	// The name of a #define
+	CT_Define,
+};
+
+struct C_Token {
+	C_Token_Type type = CT_End;
+	u32 start = 0;
+	u32 size = 0;
+	u32 line = 0;
+	// First byte for punctuation. "::" and "->" come through as one token of size 2.
+	u8 c = 0;
+};
+
+struct C_Lexer {
+	const u8* data;
+	usize size;
+	usize pos = 0;
+	u32 line = 0;
+	// Nothing but whitespace since the last line break, so a '#' starts a directive
+	bool line_start = true;
+
+	// One token can be put back
+	C_Token pending;
+	bool has_pending = false;
+};
+
+CH_FORCEINLINE static bool is_identifier_start(u8 c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$' || c >= 0x80;
+}
+
+CH_FORCEINLINE static bool is_identifier_byte(u8 c) {
+	return is_identifier_start(c) || (c >= '0' && c <= '9');
+}
+
+CH_FORCEINLINE static bool is_space(u8 c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static bool is_word(const u8* p, usize size, const char* word) {
+	usize i = 0;
+	for (; i < size && word[i]; i++) {
+		if (p[i] != (u8)word[i]) return false;
+	}
+	return i == size && !word[i];
+}
+
+template <usize N>
+static bool is_any_word(const u8* p, usize size, const char* const (&words)[N]) {
+	for (const char* word : words) {
+		if (is_word(p, size, word)) return true;
+	}
+	return false;
+}
+
+static void skip_block_comment(C_Lexer* lexer) {
+	lexer->pos += 2;
+	while (lexer->pos < lexer->size) {
+		const u8 c = lexer->data[lexer->pos];
+		if (c == '*' && lexer->pos + 1 < lexer->size && lexer->data[lexer->pos + 1] == '/') {
+			lexer->pos += 2;
+			return;
+		}
+		if (c == '\n') lexer->line += 1;
+		lexer->pos += 1;
+	}
+}
+
+// Skips a quoted literal up to and including the closing quote. Unterminated ones end at the line break.
+static void skip_quoted(C_Lexer* lexer, u8 quote) {
+	lexer->pos += 1;
+	while (lexer->pos < lexer->size) {
+		const u8 c = lexer->data[lexer->pos];
+		if (c == '\\' && lexer->pos + 1 < lexer->size) {
+			if (lexer->data[lexer->pos + 1] == '\n') lexer->line += 1;
+			lexer->pos += 2;
+			continue;
+		}
+		if (c == '\n') return;
+		lexer->pos += 1;
+		if (c == quote) return;
+	}
+}
+
+// R"delim(...)delim" with pos on the opening quote
+static void skip_raw_string(C_Lexer* lexer) {
+	const usize delim_start = lexer->pos + 1;
+	usize delim_end = delim_start;
+	while (delim_end < lexer->size && lexer->data[delim_end] != '(' && delim_end - delim_start < 16) delim_end += 1;
+	const usize delim_size = delim_end - delim_start;
+
+	lexer->pos = delim_end + 1;
+	while (lexer->pos < lexer->size) {
+		const u8 c = lexer->data[lexer->pos];
+		if (c == '\n') lexer->line += 1;
+		lexer->pos += 1;
+		if (c != ')' || lexer->pos + delim_size >= lexer->size) continue;
+
+		bool closes = lexer->data[lexer->pos + delim_size] == '"';
+		for (usize i = 0; closes && i < delim_size; i++) closes = lexer->data[lexer->pos + i] == lexer->data[delim_start + i];
+		if (closes) {
+			lexer->pos += delim_size + 1;
+			return;
+		}
+	}
+}
+
+// Skips to the line break that ends a directive, going over escaped line breaks and comments
+static void skip_directive(C_Lexer* lexer) {
+	while (lexer->pos < lexer->size) {
+		const u8 c = lexer->data[lexer->pos];
+		const u8 next = lexer->pos + 1 < lexer->size ? lexer->data[lexer->pos + 1] : 0;
+		if (c == '\n') return;
+		if (c == '\\' && (next == '\n' || next == '\r')) {
+			lexer->pos += 1;
+			if (lexer->data[lexer->pos] == '\r' && lexer->pos + 1 < lexer->size && lexer->data[lexer->pos + 1] == '\n') lexer->pos += 1;
+			lexer->pos += 1;
+			lexer->line += 1;
+			continue;
+		}
+		if (c == '/' && next == '*') {
+			skip_block_comment(lexer);
+			continue;
+		}
+		if (c == '/' && next == '/') {
+			while (lexer->pos < lexer->size && lexer->data[lexer->pos] != '\n') lexer->pos += 1;
+			return;
+		}
+		lexer->pos += 1;
+	}
+}
+
+static void skip_spaces(C_Lexer* lexer) {
+	while (lexer->pos < lexer->size && (lexer->data[lexer->pos] == ' ' || lexer->data[lexer->pos] == '\t')) lexer->pos += 1;
+}
+
+static void read_identifier(C_Lexer* lexer, usize* out_start, usize* out_size) {
+	*out_start = lexer->pos;
+	while (lexer->pos < lexer->size && is_identifier_byte(lexer->data[lexer->pos])) lexer->pos += 1;
+	*out_size = lexer->pos - *out_start;
+}
+
+static const char* const if_directives[] = { "if", "ifdef", "ifndef" };
+static const char* const else_directives[] = { "else", "elif", "elifdef", "elifndef" };
+
+// Skips the lines of a conditional group nobody reads. Stops after the #endif that closes it, or after an #else or
+// #elif when stop_at_else is set since that branch is the one that's used then.
+static void skip_conditional_group(C_Lexer* lexer, bool stop_at_else) {
+	usize depth = 0;
+	while (lexer->pos < lexer->size) {
+		skip_directive(lexer);
+		if (lexer->pos < lexer->size) {
+			lexer->pos += 1;
+			lexer->line += 1;
+		}
+
+		skip_spaces(lexer);
+		if (lexer->pos >= lexer->size || lexer->data[lexer->pos] != '#') continue;
+		lexer->pos += 1;
+		skip_spaces(lexer);
+		usize start, size;
+		read_identifier(lexer, &start, &size);
+		const u8* word = lexer->data + start;
+
+		if (is_any_word(word, size, if_directives)) {
+			depth += 1;
+		} else if (is_word(word, size, "endif")) {
+			if (!depth) break;
+			depth -= 1;
+		} else if (!depth && stop_at_else && is_any_word(word, size, else_directives)) {
+			break;
+		}
+	}
+	skip_directive(lexer);
+}
+
+// Handles the directive at pos. Returns true with out_token set for a #define.
+static bool read_directive(C_Lexer* lexer, C_Token* out_token) {
+	const u32 line = lexer->line;
+	lexer->pos += 1;
+	skip_spaces(lexer);
+	usize start, size;
+	read_identifier(lexer, &start, &size);
+	const u8* word = lexer->data + start;
+
+	if (is_word(word, size, "define")) {
+		skip_spaces(lexer);
+		usize name_start, name_size;
+		read_identifier(lexer, &name_start, &name_size);
+		skip_directive(lexer);
+		if (!name_size) return false;
+
+		out_token->type = CT_Define;
+		out_token->start = (u32)name_start;
+		out_token->size = (u32)name_size;
+		out_token->line = line;
+		return true;
+	}
+
+	// @NOTE: Only the first branch of a conditional is read, the way ctags does it, so the braces of the others
+	// can't throw the nesting off. #if 0 groups are skipped to their #else.
+	if (is_word(word, size, "if")) {
+		skip_spaces(lexer);
+		const usize at = lexer->pos;
+		if (at < lexer->size && lexer->data[at] == '0' && (at + 1 == lexer->size || !is_identifier_byte(lexer->data[at + 1]))) {
+			skip_conditional_group(lexer, true);
+			return false;
+		}
+	} else if (is_any_word(word, size, else_directives)) {
+		skip_conditional_group(lexer, false);
+		return false;
+	}
+	skip_directive(lexer);
+	return false;
+}
+
+static C_Token next_token(C_Lexer* lexer) {
+	if (lexer->has_pending) {
+		lexer->has_pending = false;
+		return lexer->pending;
+	}
+
+	const u8* data = lexer->data;
+	while (lexer->pos < lexer->size) {
+		const u8 c = data[lexer->pos];
+		const u8 next = lexer->pos + 1 < lexer->size ? data[lexer->pos + 1] : 0;
+		if (c == '\n') {
+			lexer->line += 1;
+			lexer->line_start = true;
+			lexer->pos += 1;
+			continue;
+		}
+		if (is_space(c) || (c == '\\' && (next == '\n' || next == '\r'))) {
+			lexer->pos += 1;
+			continue;
+		}
+		if (c == '/' && next == '/') {
+			while (lexer->pos < lexer->size && data[lexer->pos] != '\n') lexer->pos += 1;
+			continue;
+		}
+		if (c == '/' && next == '*') {
+			skip_block_comment(lexer);
+			continue;
+		}
+		if (c == '#' && lexer->line_start) {
+			C_Token token;
+			if (read_directive(lexer, &token)) return token;
+			continue;
+		}
+		lexer->line_start = false;
+
+		C_Token token;
+		token.start = (u32)lexer->pos;
+		token.line = lexer->line;
+		token.c = c;
+		if (is_identifier_start(c)) {
+			usize start, size;
+			read_identifier(lexer, &start, &size);
+			const u8 quote = lexer->pos < lexer->size ? data[lexer->pos] : 0;
+			// String and character literals with an encoding prefix, raw strings among them
+			if ((quote == '"' || quote == '\'') && size <= 3) {
+				const u8* word = data + start;
+				const bool is_raw = quote == '"' && word[size - 1] == 'R';
+				const usize prefix_size = is_raw ? size - 1 : size;
+				if (!prefix_size || is_word(word, prefix_size, "u8") || is_word(word, prefix_size, "u") || is_word(word, prefix_size, "U") || is_word(word, prefix_size, "L")) {
+					if (is_raw) {
+						skip_raw_string(lexer);
+					} else {
+						skip_quoted(lexer, quote);
+					}
+					token.type = CT_Literal;
+					token.size = (u32)(lexer->pos - token.start);
+					return token;
+				}
+			}
+			token.type = CT_Identifier;
+			token.size = (u32)size;
+			return token;
+		}
+		if ((c >= '0' && c <= '9') || (c == '.' && next >= '0' && next <= '9')) {
+			lexer->pos += 1;
+			while (lexer->pos < lexer->size) {
+				const u8 d = data[lexer->pos];
+				const u8 prev = data[lexer->pos - 1];
+				const bool is_exponent_sign = (d == '+' || d == '-') && (prev == 'e' || prev == 'E' || prev == 'p' || prev == 'P');
+				if (!is_identifier_byte(d) && d != '.' && d != '\'' && !is_exponent_sign) break;
+				lexer->pos += 1;
+			}
+			token.type = CT_Literal;
+			token.size = (u32)(lexer->pos - token.start);
+			return token;
+		}
+		if (c == '"' || c == '\'') {
+			skip_quoted(lexer, c);
+			token.type = CT_Literal;
+			token.size = (u32)(lexer->pos - token.start);
+			return token;
+		}
+
+		token.type = CT_Punct;
+		token.size = (c == ':' && next == ':') || (c == '-' && next == '>') ? 2 : 1;
+		lexer->pos += token.size;
+		return token;
+	}
+
+	C_Token end;
+	end.line = lexer->line;
+	return end;
+}
+
+CH_FORCEINLINE static void put_back(C_Lexer* lexer, const C_Token& token) {
+	lexer->pending = token;
+	lexer->has_pending = true;
+}
+
+CH_FORCEINLINE static bool is_punct(const C_Token& token, u8 c) {
+	return token.type == CT_Punct && token.size == 1 && token.c == c;
+}
+
+// Skips to the close that matches an open that was just read. Stops in front of anything that ends a declaration
+// when stop_at_end is set, since angle brackets can't be told apart from less than for sure.
+static void skip_balanced(C_Lexer* lexer, u8 open, u8 close, bool stop_at_end) {
+	usize depth = 1;
+	for (;;) {
+		const C_Token token = next_token(lexer);
+		if (token.type == CT_End) return;
+		if (stop_at_end && (is_punct(token, ';') || is_punct(token, '{') || is_punct(token, '}'))) {
+			put_back(lexer, token);
+			return;
+		}
+		if (is_punct(token, open)) {
+			depth += 1;
+		} else if (is_punct(token, close)) {
+			depth -= 1;
+			if (!depth) return;
+		}
+	}
+}
+
+// Keywords whose parentheses hold no declarator, so they never name a function
+static const char* const paren_keywords[] = {
+	"if", "for", "while", "switch", "sizeof", "alignof", "alignas", "_Alignas", "decltype", "typeof",
+	"__typeof__", "noexcept", "throw", "static_assert", "_Static_assert", "__attribute__", "__declspec", "requires",
+	"asm", "__asm__", "catch", "defined",
+};
+
+// Keywords that start code rather than a declaration
+static const char* const statement_keywords[] = { "return", "case", "goto", "break", "continue", "delete", "co_return", "co_yield" };
+
+static const char* const access_keywords[] = { "public", "private", "protected" };
+static const char* const type_keywords[] = { "struct", "class", "union", "enum" };
+
+// What's known about the declaration being read
+struct C_Statement {
+	u32 token_count = 0;
+	// Only identifiers that can be a name are kept here, keywords leave it empty
+	C_Token last;
+	// The name after struct, class, union, enum or namespace
+	C_Token type_name;
+	// The name in front of the last parentheses, which is what a function definition is called
+	C_Token function;
+	// The name in front of the first '=', '[', ':' or ','
+	C_Token variable;
+	// The name of a declarator in parentheses like (*name)
+	C_Token paren_name;
+
+	bool is_typedef = false;
+	bool is_using = false;
+	bool is_namespace = false;
+	// extern, friend, explicit instantiations and code, which name things that are defined elsewhere
+	bool defines_nothing = false;
+	bool is_enum = false;
+	// Operators and destructors, whose parentheses don't get a name
+	bool is_unnamed = false;
+	bool has_type_keyword = false;
+	bool has_paren = false;
+	bool has_equals = false;
+	// After the ':' of a constructor's member initializers
+	bool in_init_list = false;
+	// A struct body closed inside this declaration, like typedef struct { } name;
+	bool after_body = false;
+};
+
+enum C_Scope_Kind : u8 {
+	// Files, namespaces and extern blocks
+	CS_Namespace,
+	// Class bodies give the declaration that opened them back when they close
+	CS_Type,
+};
+
+struct C_Scope {
+	C_Scope_Kind kind;
+	C_Statement statement;
+};
+
+struct C_Parser {
+	C_Lexer lexer;
+	ch::Array<C_Scope> scopes;
+	ch::Array<Scanned_Symbol>* out;
+};
+
+CH_FORCEINLINE static bool is_name(const C_Token& token) {
+	return token.type == CT_Identifier;
+}
+
+// A token that stands in for what was skipped, so it's no name
+static C_Token make_punct(u8 c, u32 line) {
+	C_Token token;
+	token.type = CT_Punct;
+	token.size = 1;
+	token.line = line;
+	token.c = c;
+	return token;
+}
+
+static void push_symbol(C_Parser* parser, const C_Token& name, Symbol_Kind kind) {
+	if (name.type != CT_Identifier && name.type != CT_Define) return;
+	Scanned_Symbol symbol;
+	symbol.name_offset = name.start;
+	symbol.name_size = name.size;
+	symbol.line = name.line;
+	symbol.kind = kind;
+	parser->out->push(symbol);
+}
+
+static void read_enum_body(C_Parser* parser) {
+	bool expect_name = true;
+	for (;;) {
+		const C_Token token = next_token(&parser->lexer);
+		if (token.type == CT_End || is_punct(token, '}')) return;
+		if (token.type == CT_Define) {
+			push_symbol(parser, token, SK_Macro);
+		} else if (is_name(token)) {
+			if (expect_name) push_symbol(parser, token, SK_Enumerator);
+			expect_name = false;
+		} else if (is_punct(token, ',')) {
+			expect_name = true;
+		} else if (is_punct(token, '(')) {
+			skip_balanced(&parser->lexer, '(', ')', false);
+		} else if (is_punct(token, '{')) {
+			skip_balanced(&parser->lexer, '{', '}', false);
+		}
+	}
+}
+
+// Reads parentheses that were just opened. (*name) and friends are declarators, anything else gets skipped.
+static void read_parens(C_Parser* parser, C_Statement* statement) {
+	C_Lexer* lexer = &parser->lexer;
+	const C_Token before = statement->last;
+
+	const C_Token first = next_token(lexer);
+	bool is_declarator = false;
+	if (is_punct(first, '*') || is_punct(first, '&') || is_punct(first, '^')) {
+		const C_Token name = next_token(lexer);
+		const C_Token close = is_name(name) ? next_token(lexer) : name;
+		if (is_name(name) && is_punct(close, ')')) {
+			is_declarator = true;
+			if (!is_name(statement->paren_name) && !statement->has_equals) statement->paren_name = name;
+		} else {
+			put_back(lexer, close);
+			skip_balanced(lexer, '(', ')', false);
+		}
+	} else if (!is_punct(first, ')')) {
+		put_back(lexer, first);
+		skip_balanced(lexer, '(', ')', false);
+	}
+
+	if (!statement->has_equals && !statement->in_init_list) {
+		statement->has_paren = true;
+		if (!is_declarator) statement->function = is_name(before) && !statement->is_unnamed ? before : C_Token();
+	}
+	statement->last = make_punct(')', first.line);
+}
+
+// The end of a declaration at ';'
+static void finish_statement(C_Parser* parser, const C_Statement& statement) {
+	if (statement.is_typedef) {
+		if (is_name(statement.paren_name)) {
+			push_symbol(parser, statement.paren_name, SK_Typedef);
+		} else if (is_name(statement.last)) {
+			push_symbol(parser, statement.last, SK_Typedef);
+		} else if (statement.has_paren) {
+			// typedef int Proc(int);
+			push_symbol(parser, statement.function, SK_Typedef);
+		}
+		return;
+	}
+	if (statement.is_using || statement.is_namespace || statement.defines_nothing) return;
+
+	// Forward declarations and prototypes don't define anything, struct Name name; does
+	const bool names_type = is_name(statement.last) && statement.last.start == statement.type_name.start;
+	if (statement.has_type_keyword && !statement.after_body && (names_type || !is_name(statement.last))) return;
+	if (statement.has_paren && !is_name(statement.paren_name)) return;
+	if (statement.token_count < 2) return;
+
+	if (is_name(statement.variable)) {
+		push_symbol(parser, statement.variable, SK_Variable);
+	} else if (is_name(statement.paren_name)) {
+		push_symbol(parser, statement.paren_name, SK_Variable);
+	} else {
+		push_symbol(parser, statement.last, SK_Variable);
+	}
+}
+
+// A '{' where declarations are read
+static void open_brace(C_Parser* parser, C_Statement* statement, u32 line) {
+	C_Lexer* lexer = &parser->lexer;
+
+	// A brace initialized member of a constructor, its body comes after
+	if (statement->in_init_list && (is_name(statement->last) || is_punct(statement->last, '>'))) {
+		skip_balanced(lexer, '{', '}', false);
+		statement->last = make_punct('}', line);
+		return;
+	}
+
+	if (statement->is_namespace) {
+		push_symbol(parser, statement->type_name, SK_Namespace);
+		parser->scopes.push({ CS_Namespace, C_Statement() });
+		*statement = C_Statement();
+		return;
+	}
+
+	if (statement->has_type_keyword && !statement->has_paren && !statement->has_equals) {
+		push_symbol(parser, statement->type_name, SK_Type);
+		if (statement->is_enum) {
+			read_enum_body(parser);
+			statement->after_body = true;
+			statement->last = make_punct('}', line);
+			return;
+		}
+		parser->scopes.push({ CS_Type, *statement });
+		*statement = C_Statement();
+		return;
+	}
+
+	if (statement->has_paren && !statement->has_equals && (is_name(statement->function) || statement->is_unnamed)) {
+		push_symbol(parser, statement->function, SK_Function);
+		skip_balanced(lexer, '{', '}', false);
+		*statement = C_Statement();
+		return;
+	}
+
+	// Initializers, the declaration goes on to its ';'
+	if (statement->has_equals || (is_name(statement->last) && statement->token_count >= 2)) {
+		if (!statement->has_equals && !is_name(statement->variable)) statement->variable = statement->last;
+		skip_balanced(lexer, '{', '}', false);
+		statement->last = make_punct('}', line);
+		return;
+	}
+
+	// extern "C" and blocks that open a file or a namespace without a name
+	if (statement->defines_nothing || !statement->token_count) {
+		parser->scopes.push({ CS_Namespace, C_Statement() });
+		*statement = C_Statement();
+		return;
+	}
+
+	skip_balanced(lexer, '{', '}', false);
+	*statement = C_Statement();
+}
+
+// Handles an identifier in a declaration
+static void read_identifier_token(C_Parser* parser, C_Statement* statement, const C_Token& token) {
+	C_Lexer* lexer = &parser->lexer;
+	const u8* word = lexer->data + token.start;
+	const usize size = token.size;
+	statement->token_count += 1;
+
+	if (is_any_word(word, size, statement_keywords)) {
+		statement->defines_nothing = true;
+		statement->last = C_Token();
+		return;
+	}
+
+	if (is_any_word(word, size, paren_keywords)) {
+		const C_Token next = next_token(lexer);
+		if (is_punct(next, '(')) {
+			skip_balanced(lexer, '(', ')', false);
+		} else {
+			put_back(lexer, next);
+		}
+		statement->last = C_Token();
+		return;
+	}
+
+	if (is_any_word(word, size, access_keywords)) {
+		const C_Token next = next_token(lexer);
+		if (is_punct(next, ':')) {
+			*statement = C_Statement();
+		} else {
+			put_back(lexer, next);
+			statement->last = C_Token();
+		}
+		return;
+	}
+
+	if (is_any_word(word, size, type_keywords)) {
+		if (!statement->has_type_keyword) {
+			statement->has_type_keyword = true;
+			statement->is_enum = is_word(word, size, "enum");
+		}
+		statement->last = C_Token();
+		return;
+	}
+
+	if (is_word(word, size, "operator")) {
+		// Everything up to the parameters is the operator, operator() included
+		statement->is_unnamed = true;
+		C_Token next = next_token(lexer);
+		if (is_punct(next, '(')) next = next_token(lexer);
+		while (next.type != CT_End && !is_punct(next, '(') && !is_punct(next, ';') && !is_punct(next, '{') && !is_punct(next, '}')) {
+			next = next_token(lexer);
+		}
+		put_back(lexer, next);
+		statement->last = C_Token();
+		return;
+	}
+
+	if (is_word(word, size, "template")) {
+		const C_Token next = next_token(lexer);
+		if (is_punct(next, '<')) {
+			skip_balanced(lexer, '<', '>', true);
+		} else {
+			// template class Name<int>; instantiates what's defined elsewhere
+			statement->defines_nothing = true;
+			put_back(lexer, next);
+		}
+		statement->last = C_Token();
+		return;
+	}
+
+	if (is_word(word, size, "typedef")) {
+		statement->is_typedef = true;
+	} else if (is_word(word, size, "using")) {
+		statement->is_using = true;
+	} else if (is_word(word, size, "namespace")) {
+		statement->is_namespace = true;
+	} else if (is_word(word, size, "extern") || is_word(word, size, "friend")) {
+		statement->defines_nothing = true;
+	} else {
+		if ((statement->has_type_keyword || statement->is_namespace) && statement->type_name.type == CT_End && !statement->has_paren) {
+			statement->type_name = token;
+		}
+		statement->last = token;
+		return;
+	}
+	statement->last = C_Token();
+}
+
+// Handles punctuation in a declaration other than braces and ';'
+static void read_punct_token(C_Parser* parser, C_Statement* statement, const C_Token& token) {
+	C_Lexer* lexer = &parser->lexer;
+	statement->token_count += 1;
+	const bool after_name = is_name(statement->last);
+	const bool can_name_variable = after_name && !statement->has_paren && !statement->has_equals && !is_name(statement->variable);
+
+	if (token.size == 2) {
+		// "::" keeps going with the name after it, "->" starts a trailing return type
+		if (token.c != ':') statement->last = C_Token();
+		return;
+	}
+
+	switch (token.c) {
+	case '(':
+		read_parens(parser, statement);
+		return;
+	case '[':
+		if (can_name_variable) statement->variable = statement->last;
+		skip_balanced(lexer, '[', ']', false);
+		statement->last = make_punct(']', token.line);
+		return;
+	case '<':
+		// Template arguments. The name in front of them is still the one a '(' after them goes with.
+		if (after_name && !statement->has_equals && !statement->is_unnamed) {
+			skip_balanced(lexer, '<', '>', true);
+			return;
+		}
+		break;
+	case '=':
+		if (statement->is_using && after_name && !statement->has_equals) push_symbol(parser, statement->last, SK_Typedef);
+		if (can_name_variable) statement->variable = statement->last;
+		statement->has_equals = true;
+		break;
+	case ',':
+		if (can_name_variable && !statement->has_type_keyword) statement->variable = statement->last;
+		break;
+	case ':':
+		if (statement->has_paren && !statement->has_equals && is_name(statement->function)) {
+			statement->in_init_list = true;
+		} else if (can_name_variable && !statement->has_type_keyword) {
+			// Bit fields
+			statement->variable = statement->last;
+		}
+		break;
+	case '~':
+		if (!statement->has_equals) statement->is_unnamed = true;
+		break;
+	}
+	statement->last = token;
+}
+
+static void scan_c_symbols(const u8* data, usize size, ch::Array<Scanned_Symbol>* out) {
+	C_Parser parser;
+	parser.lexer.data = data;
+	parser.lexer.size = size;
+	parser.scopes.allocator = ch::get_heap_allocator();
+	parser.out = out;
+	defer(parser.scopes.free());
+
+	C_Statement statement;
+	for (;;) {
+		const C_Token token = next_token(&parser.lexer);
+		if (token.type == CT_End) break;
+
+		if (token.type == CT_Define) {
+			push_symbol(&parser, token, SK_Macro);
+		} else if (token.type == CT_Identifier) {
+			read_identifier_token(&parser, &statement, token);
+		} else if (token.type == CT_Literal) {
+			statement.token_count += 1;
+			statement.last = token;
+		} else if (is_punct(token, ';')) {
+			finish_statement(&parser, statement);
+			statement = C_Statement();
+		} else if (is_punct(token, '{')) {
+			open_brace(&parser, &statement, token.line);
+		} else if (is_punct(token, '}')) {
+			if (parser.scopes.count && parser.scopes[parser.scopes.count - 1].kind == CS_Type) {
+				statement = parser.scopes[parser.scopes.count - 1].statement;
+				statement.after_body = true;
+				statement.last = make_punct('}', token.line);
+			} else {
+				statement = C_Statement();
+			}
+			if (parser.scopes.count) parser.scopes.count -= 1;
+		} else {
+			read_punct_token(&parser, &statement, token);
+		}
+	}
+}
+
+static const char* const c_extensions[] = { "c", "h", "cpp", "hpp", "cc", "hh", "cxx", "hxx", "c++", "h++", "inl", "ipp", "tpp", "m", "mm" };
+
+Symbol_Language get_symbol_language(const tchar* path, usize count) {
+	usize dot = count;
+	while (dot > 0 && path[dot - 1] != '.' && path[dot - 1] != '/' && path[dot - 1] != '\\') dot -= 1;
+	if (!dot || path[dot - 1] != '.') return SL_None;
+
+	// Extensions are matched without case, so .H and .CPP count too
+	u8 extension[8];
+	const usize size = count - dot;
+	if (size > sizeof(extension)) return SL_None;
+	for (usize i = 0; i < size; i++) {
+		const tchar c = path[dot + i];
+		extension[i] = c >= 'A' && c <= 'Z' ? (u8)(c + ('a' - 'A')) : (u8)c;
+	}
+	if (is_any_word(extension, size, c_extensions)) return SL_C;
+	return SL_None;
+}
+
+void scan_symbols(Symbol_Language language, const u8* data, usize size, ch::Array<Scanned_Symbol>* out) {
+	switch (language) {
+	case SL_C:
+		scan_c_symbols(data, size, out);
+		break;
+	case SL_None:
+		break;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <ch_stl/array.h>
+
+/* Pulling the names a file defines out of its bytes, the way ctags does it: a tokenizer that knows about comments,
+   literals and the preprocessor, and a few patterns over the tokens of each declaration. Bodies of functions are
+   skipped, so only what can be looked up from elsewhere shows up. */
+
+enum Symbol_Kind : u8 {
+	SK_Macro,
+	SK_Namespace,
+	// Structs, classes, unions and enums
+	SK_Type,
+	SK_Typedef,
+	SK_Enumerator,
+	SK_Function,
+	SK_Variable,
+};
+
+enum Symbol_Language : u8 {
+	SL_None,
+	SL_C,
+};
+
+struct Scanned_Symbol {
+	// Bytes of the name in the scanned data
+	u32 name_offset;
+	u32 name_size;
+	// Starting from 0
+	u32 line;
+	Symbol_Kind kind;
+};
+
+// Language of a file going by its extension. SL_None for files that don't get scanned.
+Symbol_Language get_symbol_language(const tchar* path, usize count);
+
+// Pushes every symbol data defines, in the order they show up. Only what's UTF-8 or ASCII compatible makes sense.
+void scan_symbols(Symbol_Language language, const u8* data, usize size, ch::Array<Scanned_Symbol>* out);
@@ -0,0 +1,228 @@
+#include "text_scan.h"
+#include "simd.h"
+#include "jobs.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/memory.h>
+
+// Below this many codepoints per chunk threading costs more than it saves
+static const usize min_scan_chunk_size = 1024 * 1024;
+
+// Calls f with the index of every c in p
+template <typename F>
+CH_FORCEINLINE static void for_each_codepoint(const u32* p, usize count, u32 c, F&& f) {
+	usize i = 0;
+	for (; i + 16 <= count; i += 16) {
+		u32 mask = match_codepoints_16(p + i, c);
+		while (mask) {
+			f(i + count_trailing_zeros(mask));
+			mask &= mask - 1;
+		}
+	}
+	for (; i < count; i++) {
+		if (p[i] == c) f(i);
+	}
+}
+
+usize count_codepoint(const u32* p, usize count, u32 c) {
+	usize result = 0;
+	usize i = 0;
+	for (; i + 16 <= count; i += 16) {
+		result += count_bits(match_codepoints_16(p + i, c));
+	}
+	for (; i < count; i++) {
+		if (p[i] == c) result += 1;
+	}
+	return result;
+}
+
+usize find_codepoint(const u32* p, usize count, u32 c) {
+	usize i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const u32 mask = match_codepoints_16(p + i, c);
+		if (mask) return i + count_trailing_zeros(mask);
+	}
+	for (; i < count; i++) {
+		if (p[i] == c) return i;
+	}
+	return count;
+}
+
+struct Scan_Span {
+	const u32* p;
+	usize count;
+	usize logical_start;
+};
+
+// Splits the logical range [start, end) into the physical runs on either side of the gap
+static usize get_scan_spans(const Buffer_Halves& halves, usize start, usize end, Scan_Span out[2]) {
+	usize n = 0;
+	if (start < halves.front_count) {
+		const usize front_end = ch::min(end, halves.front_count);
+		out[n].p = halves.front + start;
+		out[n].count = front_end - start;
+		out[n].logical_start = start;
+		n += 1;
+	}
+	if (end > halves.front_count) {
+		const usize back_start = ch::max(start, halves.front_count);
+		out[n].p = halves.back + (back_start - halves.front_count);
+		out[n].count = end - back_start;
+		out[n].logical_start = back_start;
+		n += 1;
+	}
+	return n;
+}
+
+usize count_codepoint(const Buffer_Halves& halves, usize start, usize end, u32 c) {
+	Scan_Span spans[2];
+	const usize span_count = get_scan_spans(halves, start, end, spans);
+
+	usize result = 0;
+	for (usize i = 0; i < span_count; i++) {
+		result += count_codepoint(spans[i].p, spans[i].count, c);
+	}
+	return result;
+}
+
+usize find_codepoint(const Buffer_Halves& halves, usize start, usize end, u32 c) {
+	Scan_Span spans[2];
+	const usize span_count = get_scan_spans(halves, start, end, spans);
+
+	for (usize i = 0; i < span_count; i++) {
+		const usize at = find_codepoint(spans[i].p, spans[i].count, c);
+		if (at < spans[i].count) return spans[i].logical_start + at;
+	}
+	return end;
+}
+
+void copy_codepoints(const Buffer_Halves& halves, usize start, usize end, u32* out) {
+	Scan_Span spans[2];
+	const usize span_count = get_scan_spans(halves, start, end, spans);
+
+	for (usize i = 0; i < span_count; i++) {
+		ch::mem_copy(out, spans[i].p, spans[i].count * sizeof(u32));
+		out += spans[i].count;
+	}
+}
+
+// Mask with bit i set when codepoints i of a and b differ
+CH_FORCEINLINE static u32 mismatch_mask_16(const u32* a, const u32* b) {
+	__m128i eq = _mm_set1_epi32(-1);
+	for (usize i = 0; i < 16; i += 4) {
+		const __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+		const __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+		eq = _mm_and_si128(eq, _mm_cmpeq_epi32(va, vb));
+	}
+	if (_mm_movemask_epi8(eq) == 0xFFFF) return 0;
+
+	u32 mask = 0;
+	for (u32 i = 0; i < 16; i++) {
+		if (a[i] != b[i]) mask |= 1u << i;
+	}
+	return mask;
+}
+
+usize find_mismatch(const u32* a, const u32* b, usize count) {
+	usize i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const u32 mask = mismatch_mask_16(a + i, b + i);
+		if (mask) return i + count_trailing_zeros(mask);
+	}
+	for (; i < count; i++) {
+		if (a[i] != b[i]) return i;
+	}
+	return count;
+}
+
+usize find_mismatch_reverse(const u32* a, const u32* b, usize count) {
+	usize n = 0;
+	for (; n + 16 <= count; n += 16) {
+		const usize at = count - n - 16;
+		const u32 mask = mismatch_mask_16(a + at, b + at);
+		if (mask) {
+			// Highest differing codepoint is the one nearest the end
+			u32 last = 15;
+			while (!(mask & (1u << last))) last -= 1;
+			return n + (15 - last);
+		}
+	}
+	for (; n < count; n++) {
+		if (a[count - n - 1] != b[count - n - 1]) return n;
+	}
+	return count;
+}
+
+struct Eol_Chunk {
+	usize start;
+	usize end;
+
+	// Where each line that ends in the chunk ends, eol included
+	ch::Array<usize> line_ends;
+
+	usize first_slot;
+	usize prev_line_end;
+};
+
+void build_eol_table(const Buffer_Halves& halves, ch::Array<usize>* table) {
+	const usize total = halves.front_count + halves.back_count;
+
+	usize chunk_count = ch::max(total / min_scan_chunk_size, (usize)1);
+	chunk_count = ch::min(chunk_count, (get_worker_count() + 1) * 4);
+
+	ch::Array<Eol_Chunk> chunks(ch::get_heap_allocator());
+	defer(chunks.free());
+	for (usize i = 0; i < chunk_count; i++) {
+		Eol_Chunk chunk = {};
+		chunk.start = total * i / chunk_count;
+		chunk.end = total * (i + 1) / chunk_count;
+		chunk.line_ends.allocator = ch::get_heap_allocator();
+		chunks.push(chunk);
+	}
+
+	// @NOTE: The text is only read once. Chunks keep their line ends until every chunk knows where its lines go in
+	// the table, which is a lot less to go over again than the text.
+	auto scan_chunk = [&](usize index) {
+		Eol_Chunk* chunk = &chunks[index];
+
+		Scan_Span spans[2];
+		const usize span_count = get_scan_spans(halves, chunk->start, chunk->end, spans);
+		for (usize i = 0; i < span_count; i++) {
+			const Scan_Span& span = spans[i];
+			for_each_codepoint(span.p, span.count, ch::eol, [&](usize at) {
+				chunk->line_ends.push(span.logical_start + at + 1);
+			});
+		}
+	};
+	parallel_for(chunk_count, scan_chunk);
+
+	usize slot = 0;
+	usize prev_line_end = 0;
+	for (Eol_Chunk& chunk : chunks) {
+		chunk.first_slot = slot;
+		chunk.prev_line_end = prev_line_end;
+		slot += chunk.line_ends.count;
+		if (chunk.line_ends.count) prev_line_end = chunk.line_ends[chunk.line_ends.count - 1];
+	}
+
+	table->count = 0;
+	table->reserve(slot + 1);
+	table->count = slot + 1;
+
+	auto fill_chunk = [&](usize index) {
+		const Eol_Chunk& chunk = chunks[index];
+
+		usize* out = table->data + chunk.first_slot;
+		usize prev = chunk.prev_line_end;
+		for (usize line_end : chunk.line_ends) {
+			*out++ = line_end - prev;
+			prev = line_end;
+		}
+	};
+	parallel_for(chunk_count, fill_chunk);
+
+	// Whatever is after the last eol is the last line
+	(*table)[slot] = total - prev_line_end;
+
+	for (Eol_Chunk& chunk : chunks) chunk.line_ends.free();
+}
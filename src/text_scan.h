@@ -0,0 +1,23 @@
+#pragma once
+
+#include "buffer.h"
+
+// Amount of times c shows up in p
+usize count_codepoint(const u32* p, usize count, u32 c);
+// Index of the first c in p, or count when there isn't one
+usize find_codepoint(const u32* p, usize count, u32 c);
+// Amount of times c shows up in the logical range [start, end) of halves
+usize count_codepoint(const Buffer_Halves& halves, usize start, usize end, u32 c);
+// Index of the first c in the logical range [start, end) of halves, or end when there isn't one
+usize find_codepoint(const Buffer_Halves& halves, usize start, usize end, u32 c);
+// Copies the logical range [start, end) of halves to out
+void copy_codepoints(const Buffer_Halves& halves, usize start, usize end, u32* out);
+
+// Length of the run a and b have in common at the start
+usize find_mismatch(const u32* a, const u32* b, usize count);
+// Length of the run a and b have in common at the end
+usize find_mismatch_reverse(const u32* a, const u32* b, usize count);
+
+// Rebuilds table as line lengths (eol included) for everything in halves. Big buffers are split into
+// chunks that get scanned on the job pool.
+void build_eol_table(const Buffer_Halves& halves, ch::Array<usize>* table);
@@ -0,0 +1,91 @@
+#include "text_writer.h"
+#include "text_scan.h"
+
+Text_Encoder::Text_Encoder(const Buffer_Halves& halves, const Line_Endings* _endings, Text_Format _format) : endings(_endings), format(_format) {
+	bom_pending = format.bom;
+	runs[0] = halves.front;
+	runs[1] = halves.back;
+	run_counts[0] = halves.front_count;
+	run_counts[1] = halves.back_count;
+}
+
+usize Text_Encoder::encode(u8* dst, usize dst_size) {
+	const bool plain = !endings || (endings->ending == LE_LF && !endings->exceptions.count);
+
+	usize written = 0;
+	if (bom_pending) {
+		if (dst_size < max_bom_size) return 0;
+		written += write_bom(format.encoding, dst);
+		bom_pending = false;
+	}
+
+	while (run < 2) {
+		if (run_index == run_counts[run]) {
+			run += 1;
+			run_index = 0;
+			continue;
+		}
+
+		const u32* p = runs[run] + run_index;
+		const usize count = run_counts[run] - run_index;
+
+		// Text up to the next eol goes through untouched
+		const usize line_length = plain ? count : find_codepoint(p, count, ch::eol);
+		if (line_length) {
+			if (written + max_encoded_size > dst_size) break;
+
+			usize consumed;
+			written += encode_text(format.encoding, p, line_length, dst + written, dst_size - written, &consumed);
+			run_index += consumed;
+			continue;
+		}
+
+		const ch::Array<Line_Ending_Exception>& exceptions = endings->exceptions;
+		while (next_exception < exceptions.count && exceptions[next_exception].line < line) next_exception += 1;
+
+		Line_Ending ending = endings->ending;
+		if (next_exception < exceptions.count && exceptions[next_exception].line == line) ending = exceptions[next_exception].ending;
+
+		u32 ending_text[2];
+		usize ending_count = 0;
+		if (ending != LE_LF) ending_text[ending_count++] = '\r';
+		if (ending != LE_CR) ending_text[ending_count++] = '\n';
+
+		if (written + ending_count * get_code_unit_size(format.encoding) > dst_size) break;
+
+		usize consumed;
+		written += encode_text(format.encoding, ending_text, ending_count, dst + written, dst_size - written, &consumed);
+		line += 1;
+		run_index += 1;
+	}
+
+	return written;
+}
+
+bool write_text(OS_File file, const Buffer_Halves& halves, const Line_Endings* endings, Text_Format format, const std::atomic<bool>* cancel) {
+	u8* storage = ch_new u8[save_chunk_size * save_chunk_count];
+	defer(ch_delete[] storage);
+
+	Text_Encoder encoder(halves, endings, format);
+	for (;;) {
+		if (cancel && cancel->load(std::memory_order_relaxed)) return false;
+
+		IO_Slice slices[save_chunk_count];
+		usize slice_count = 0;
+
+		for (usize i = 0; i < save_chunk_count; i++) {
+			u8* chunk = storage + i * save_chunk_size;
+			const usize written = encoder.encode(chunk, save_chunk_size);
+			if (!written) break;
+
+			slices[slice_count].data = chunk;
+			slices[slice_count].size = written;
+			slice_count += 1;
+		}
+
+		if (!slice_count) break;
+		if (!write_file_gather(file, slices, slice_count)) return false;
+	}
+
+	return true;
+}
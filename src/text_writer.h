@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+
+#include "buffer.h"
+#include "platform.h"
+#include "encoding.h"
+
+// Bytes per encode buffer and how many of them go out in one gathered write
+const usize save_chunk_size = 64 * 1024;
+const usize save_chunk_count = 4;
+
+// Turns buffer text into file bytes a piece at a time, in the encoding the file had and with its BOM if it had one.
+// Every eol goes out as the line ending its line had on disk, so there's no separate pass to put them back.
+// Files that are all LF skip the per line work entirely.
+struct Text_Encoder {
+	const u32* runs[2];
+	usize run_counts[2];
+	usize run = 0;
+	usize run_index = 0;
+
+	const Line_Endings* endings;
+	usize line = 0;
+	usize next_exception = 0;
+
+	Text_Format format;
+	bool bom_pending;
+
+	Text_Encoder(const Buffer_Halves& halves, const Line_Endings* _endings, Text_Format _format);
+
+	// Fills as much of dst as it can. Returns 0 once everything has been encoded.
+	usize encode(u8* dst, usize dst_size);
+};
+
+// Encodes halves straight out of the buffer's storage and writes it out. Extra memory is a fixed
+// save_chunk_count * save_chunk_size bytes no matter how big the text is. Setting cancel stops between chunks and fails.
+bool write_text(OS_File file, const Buffer_Halves& halves, const Line_Endings* endings, Text_Format format, const std::atomic<bool>* cancel = nullptr);
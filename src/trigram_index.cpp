@@ -0,0 +1,515 @@
+#include "trigram_index.h"
+#include "project_index.h"
+#include "project_walk.h"
+#include "sort.h"
+#include "platform.h"
+#include "encoding.h"
+#include "search.h"
+
+#include <ch_stl/memory.h>
+#include <ch_stl/string.h>
+
+// Trigrams take the low 24 bits. This one lists the files that couldn't be indexed, which every query has to search.
+static const u32 unindexed_trigram = 0xFFFFFFFF;
+// One bit per possible trigram in the set a file's trigrams are gathered in
+static const usize trigram_set_words = (1 << 24) / 64;
+
+enum Index_File_Flags : u64 {
+	// Not UTF-8, so its bytes don't line up with the query's. Searched for every query.
+	IF_Unindexed = 0x1,
+	// Binary or gone. Never searched.
+	IF_Skipped   = 0x2,
+};
+
+// The layout of the payload after the file table. Offsets are from its start.
+struct Trigram_Payload_Header {
+	u64 trigram_count;
+	// Index_Trigram for every trigram with files, sorted
+	u64 trigrams_offset;
+	// File indices of each trigram as varint deltas, the first one from 0
+	u64 postings_offset;
+	u64 postings_size;
+};
+
+struct Index_Trigram {
+	u32 trigram;
+	u32 file_count;
+	// Its postings end where the next trigram's start
+	u64 postings_offset;
+};
+
+// The payload of a batch, or of a changed file with its one file
+struct Trigram_Postings {
+	// Sorted, and what the local file indices of each end at in postings
+	ch::Array<u32> trigrams;
+	ch::Array<usize> posting_ends;
+	ch::Array<u8> postings;
+	// Trigram in the high half, local file index in the low one, until the payload is finished
+	ch::Array<u64> pairs;
+};
+
+// The mapped payload
+struct Trigram_Table {
+	const Trigram_Payload_Header* header;
+	const Index_Trigram* trigrams;
+	const u8* postings;
+};
+
+static Project_Index* the_index = nullptr;
+
+CH_FORCEINLINE static u8 fold_byte(u8 c) {
+	return c >= 'A' && c <= 'Z' ? (u8)(c + ('a' - 'A')) : c;
+}
+
+// Line endings get normalized when files are decoded, so trigrams never span one
+CH_FORCEINLINE static bool is_line_byte(u8 c) {
+	return c == '\n' || c == '\r';
+}
+
+static void push_varint(ch::Array<u8>* out, u64 value) {
+	while (value >= 0x80) {
+		out->push((u8)(value | 0x80));
+		value >>= 7;
+	}
+	out->push((u8)value);
+}
+
+// Returns false when the varint runs past end
+CH_FORCEINLINE static bool read_varint(const u8** p, const u8* end, u64* out_value) {
+	u64 value = 0;
+	for (u32 shift = 0; *p < end && shift < 64; shift += 7) {
+		const u8 b = *(*p)++;
+		value |= (u64)(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			*out_value = value;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Pushes every trigram of data once. set has a bit per trigram, all clear, and is left that way.
+static void gather_trigrams(const u8* data, usize size, u64* set, ch::Array<u32>* out) {
+	const usize first = out->count;
+	u32 trigram = 0;
+	usize run = 0;
+	for (usize i = 0; i < size; i++) {
+		const u8 c = fold_byte(data[i]);
+		if (is_line_byte(c)) {
+			run = 0;
+			continue;
+		}
+		trigram = ((trigram << 8) | c) & 0xFFFFFF;
+		run += 1;
+		if (run < 3) continue;
+
+		const u64 bit = 1ull << (trigram & 63);
+		if (set[trigram >> 6] & bit) continue;
+		set[trigram >> 6] |= bit;
+		out->push(trigram);
+	}
+	for (usize i = first; i < out->count; i++) set[(*out)[i] >> 6] = 0;
+}
+
+// Whatever a job needs to index one file after another
+struct Index_Scratch {
+	u64* set;
+	ch::Array<u32> trigrams;
+};
+
+static void* new_scratch() {
+	Index_Scratch* scratch = ch_new Index_Scratch;
+	scratch->set = (u64*)ch::get_heap_allocator().alloc(trigram_set_words * sizeof(u64));
+	ch::mem_zero(scratch->set, trigram_set_words * sizeof(u64));
+	scratch->trigrams.allocator = ch::get_heap_allocator();
+	return scratch;
+}
+
+static void free_scratch(void* user) {
+	Index_Scratch* scratch = (Index_Scratch*)user;
+	ch::get_heap_allocator().free(scratch->set);
+	scratch->trigrams.free();
+	ch_delete scratch;
+}
+
+// Fills scratch->trigrams with the file's trigrams, unsorted, and returns its Index_File_Flags
+static u64 read_trigrams(const ch::Path& path, File_Stamp* out_stamp, Index_Scratch* scratch) {
+	scratch->trigrams.count = 0;
+	*out_stamp = File_Stamp();
+	Mapped_File file;
+	if (!get_file_stamp(path, out_stamp) || !map_file(path, &file)) return IF_Skipped;
+	defer(unmap_file(&file));
+
+	if (looks_binary(file.data, file.size)) return IF_Skipped;
+	usize bom_size;
+	if (detect_text_format(file.data, file.size, &bom_size).encoding != TE_UTF8) return IF_Unindexed;
+
+	gather_trigrams(file.data, file.size, scratch->set, &scratch->trigrams);
+	return 0;
+}
+
+static void* new_payload() {
+	Trigram_Postings* postings = ch_new Trigram_Postings;
+	postings->trigrams.allocator = ch::get_heap_allocator();
+	postings->posting_ends.allocator = ch::get_heap_allocator();
+	postings->postings.allocator = ch::get_heap_allocator();
+	postings->pairs.allocator = ch::get_heap_allocator();
+	return postings;
+}
+
+static void free_payload(void* payload) {
+	Trigram_Postings* postings = (Trigram_Postings*)payload;
+	postings->trigrams.free();
+	postings->posting_ends.free();
+	postings->postings.free();
+	postings->pairs.free();
+	ch_delete postings;
+}
+
+static void index_file(void* user, const ch::Path& path, u32 local_file, void* payload, Indexed_File* out_file) {
+	Index_Scratch* scratch = (Index_Scratch*)user;
+	Trigram_Postings* postings = (Trigram_Postings*)payload;
+
+	File_Stamp stamp;
+	out_file->flags = read_trigrams(path, &stamp, scratch);
+	out_file->size = stamp.size;
+	out_file->mtime = stamp.mtime;
+
+	if (out_file->flags & IF_Unindexed) postings->pairs.push(((u64)unindexed_trigram << 32) | local_file);
+	postings->pairs.reserve(scratch->trigrams.count);
+	for (u32 trigram : scratch->trigrams) postings->pairs.push(((u64)trigram << 32) | local_file);
+}
+
+// Turns the trigrams of the files into posting lists of their own
+static void finish_payload(void* user, void* payload) {
+	Trigram_Postings* postings = (Trigram_Postings*)payload;
+	ch::Array<u64>& pairs = postings->pairs;
+
+	// @NOTE: Files went in in order and the sort is stable, so every trigram's files stay sorted
+	ch::Array<u64> temp(ch::get_heap_allocator());
+	defer(temp.free());
+	temp.reserve(pairs.count);
+	const u64* sorted = radix_sort(pairs.data, temp.data, pairs.count, 4, [](u64 pair) { return pair >> 32; });
+
+	for (usize i = 0; i < pairs.count;) {
+		const u32 trigram = (u32)(sorted[i] >> 32);
+		u64 last = 0;
+		for (; i < pairs.count && (u32)(sorted[i] >> 32) == trigram; i++) {
+			const u64 file = sorted[i] & 0xFFFFFFFF;
+			push_varint(&postings->postings, file - last);
+			last = file;
+		}
+		postings->trigrams.push(trigram);
+		postings->posting_ends.push(postings->postings.count);
+	}
+	pairs.free();
+}
+
+// Where a batch is in the merge of every batch's postings
+struct Merge_Cursor {
+	const Trigram_Postings* postings;
+	u32 first_file;
+	usize trigram;
+};
+
+CH_FORCEINLINE static bool is_merged_before(const Merge_Cursor& a, const Merge_Cursor& b) {
+	const u32 ta = a.postings->trigrams[a.trigram];
+	const u32 tb = b.postings->trigrams[b.trigram];
+	return ta < tb || (ta == tb && a.first_file < b.first_file);
+}
+
+static void sift_down(Merge_Cursor* heap, usize count, usize i) {
+	for (;;) {
+		usize smallest = i;
+		const usize left = i * 2 + 1;
+		const usize right = left + 1;
+		if (left < count && is_merged_before(heap[left], heap[smallest])) smallest = left;
+		if (right < count && is_merged_before(heap[right], heap[smallest])) smallest = right;
+		if (smallest == i) return;
+
+		const Merge_Cursor swap = heap[i];
+		heap[i] = heap[smallest];
+		heap[smallest] = swap;
+		i = smallest;
+	}
+}
+
+// Merges the postings of every batch into one list per trigram, in trigram order. Batches hold files in runs that
+// don't overlap, so each trigram's postings are the ones of its batches one after another in file order.
+static void merge_postings(const Index_Batch* const* batches, usize batch_count, ch::Array<Index_Trigram>* trigrams, ch::Array<u8>* postings) {
+	ch::Array<Merge_Cursor> heap(ch::get_heap_allocator());
+	defer(heap.free());
+	for (usize i = 0; i < batch_count; i++) {
+		const Trigram_Postings* it = (const Trigram_Postings*)batches[i]->payload;
+		if (it->trigrams.count) heap.push({ it, batches[i]->first_file, 0 });
+	}
+	for (usize i = heap.count / 2; i > 0; i--) sift_down(heap.data, heap.count, i - 1);
+
+	Index_Trigram current = {};
+	bool has_current = false;
+	u64 last = 0;
+	while (heap.count) {
+		Merge_Cursor& top = heap[0];
+		const Trigram_Postings* batch = top.postings;
+		const u32 trigram = batch->trigrams[top.trigram];
+		if (!has_current || current.trigram != trigram) {
+			if (has_current) trigrams->push(current);
+			current = { trigram, 0, postings->count };
+			has_current = true;
+			last = 0;
+		}
+
+		const usize start = top.trigram ? batch->posting_ends[top.trigram - 1] : 0;
+		const u8* p = batch->postings.data + start;
+		const u8* end = batch->postings.data + batch->posting_ends[top.trigram];
+		u64 local = 0;
+		u64 delta;
+		while (p < end && read_varint(&p, end, &delta)) {
+			local += delta;
+			const u64 file = top.first_file + local;
+			push_varint(postings, file - last);
+			last = file;
+			current.file_count += 1;
+		}
+
+		top.trigram += 1;
+		if (top.trigram == batch->trigrams.count) {
+			heap[0] = heap[heap.count - 1];
+			heap.count -= 1;
+		}
+		sift_down(heap.data, heap.count, 0);
+	}
+	if (has_current) trigrams->push(current);
+}
+
+static bool write_payload(const Index_Batch* const* batches, usize count, OS_File file) {
+	ch::Array<Index_Trigram> trigrams(ch::get_heap_allocator());
+	defer(trigrams.free());
+	ch::Array<u8> postings(ch::get_heap_allocator());
+	defer(postings.free());
+	merge_postings(batches, count, &trigrams, &postings);
+
+	Trigram_Payload_Header header = {};
+	header.trigram_count = trigrams.count;
+	header.trigrams_offset = sizeof(header);
+	header.postings_offset = header.trigrams_offset + trigrams.count * sizeof(Index_Trigram);
+	header.postings_size = postings.count;
+
+	const IO_Slice slices[] = {
+		{ &header, sizeof(header) },
+		{ trigrams.data, trigrams.count * sizeof(Index_Trigram) },
+		{ postings.data, postings.count },
+	};
+	return write_file_gather(file, slices, sizeof(slices) / sizeof(slices[0]));
+}
+
+static bool is_valid_payload(const u8* payload, usize size, u64 file_count) {
+	const Trigram_Payload_Header* header = (const Trigram_Payload_Header*)payload;
+	bool valid = size >= sizeof(Trigram_Payload_Header);
+	valid = valid && header->trigrams_offset == sizeof(Trigram_Payload_Header);
+	valid = valid && header->trigram_count < (u64)size / sizeof(Index_Trigram);
+	valid = valid && header->postings_offset == header->trigrams_offset + header->trigram_count * sizeof(Index_Trigram);
+	valid = valid && header->postings_offset + header->postings_size == (u64)size;
+	if (!valid) return false;
+
+	const Index_Trigram* trigrams = (const Index_Trigram*)(payload + header->trigrams_offset);
+	for (u64 i = 0; valid && i < header->trigram_count; i++) {
+		const u64 end = i + 1 < header->trigram_count ? trigrams[i + 1].postings_offset : header->postings_size;
+		valid = trigrams[i].postings_offset <= end && end <= header->postings_size;
+	}
+	return valid;
+}
+
+static const Index_Procs trigram_procs = {
+	{ 'Y', 'E', 'E', 'T', 'T', 'R', 'I', '2' },
+	CH_TEXT("trigrams"),
+	nullptr,
+	new_scratch,
+	free_scratch,
+	new_payload,
+	index_file,
+	finish_payload,
+	free_payload,
+	write_payload,
+	is_valid_payload,
+};
+
+static Trigram_Table get_trigram_table(const Project_Index* index) {
+	Trigram_Table table;
+	table.header = (const Trigram_Payload_Header*)index->payload;
+	table.trigrams = (const Index_Trigram*)(index->payload + table.header->trigrams_offset);
+	table.postings = index->payload + table.header->postings_offset;
+	return table;
+}
+
+void open_trigram_index(const ch::Path& root) {
+	if (the_index && is_same_path(the_index->root, root)) return;
+	shutdown_trigram_index();
+	the_index = open_project_index(root, &trigram_procs);
+}
+
+void check_trigram_index() {
+	if (the_index) check_project_index(the_index);
+}
+
+void note_file_changed(const ch::Path& path) {
+	if (the_index) note_indexed_file_changed(the_index, path);
+}
+
+// Utf-8 of query with ASCII folded, the way files are indexed
+static void get_query_trigrams(const u32* query, usize count, u32 flags, ch::Array<u32>* out) {
+	ch::Array<u8> bytes(ch::get_heap_allocator());
+	defer(bytes.free());
+	bytes.reserve(count * max_utf8_sequence);
+	usize consumed;
+	bytes.count = utf8_encode(query, count, bytes.data, count * max_utf8_sequence, &consumed);
+
+	for (usize i = 0; i + 3 <= bytes.count; i++) {
+		const u8 a = fold_byte(bytes[i]);
+		const u8 b = fold_byte(bytes[i + 1]);
+		const u8 c = fold_byte(bytes[i + 2]);
+		if (is_line_byte(a) || is_line_byte(b) || is_line_byte(c)) continue;
+		// Other cases of a letter past ASCII have bytes of their own
+		if ((flags & SF_Ignore_Case) && (a >= 0x80 || b >= 0x80 || c >= 0x80)) continue;
+
+		const u32 trigram = ((u32)a << 16) | ((u32)b << 8) | c;
+		if (out->find(trigram) == -1) out->push(trigram);
+	}
+}
+
+// Index into the trigram table, or trigram_count when it isn't in there
+static usize find_trigram(const Trigram_Table& table, u32 trigram) {
+	const usize trigram_count = (usize)table.header->trigram_count;
+	usize low = 0;
+	usize high = trigram_count;
+	while (low < high) {
+		const usize mid = low + (high - low) / 2;
+		if (table.trigrams[mid].trigram < trigram) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low < trigram_count && table.trigrams[low].trigram == trigram ? low : trigram_count;
+}
+
+static void read_postings(const Trigram_Table& table, usize file_count, usize trigram, ch::Array<u32>* out) {
+	const Index_Trigram& it = table.trigrams[trigram];
+	const u64 end = trigram + 1 < table.header->trigram_count ? table.trigrams[trigram + 1].postings_offset : table.header->postings_size;
+	const u8* p = table.postings + it.postings_offset;
+	const u8* p_end = table.postings + end;
+
+	out->reserve(it.file_count);
+	u64 file = 0;
+	u64 delta;
+	for (u32 i = 0; i < it.file_count && read_varint(&p, p_end, &delta); i++) {
+		file += delta;
+		if (file >= file_count) break;
+		out->push((u32)file);
+	}
+}
+
+// Keeps the files of a that are in b too. Both are sorted.
+static void intersect_files(ch::Array<u32>* a, const ch::Array<u32>& b) {
+	usize kept = 0;
+	usize j = 0;
+	for (usize i = 0; i < a->count; i++) {
+		while (j < b.count && b[j] < (*a)[i]) j += 1;
+		if (j == b.count) break;
+		if (b[j] == (*a)[i]) (*a)[kept++] = (*a)[i];
+	}
+	a->count = kept;
+}
+
+static bool has_trigrams(const Changed_File* file, const ch::Array<u32>& trigrams) {
+	const Trigram_Postings* postings = (const Trigram_Postings*)file->payload;
+	for (u32 trigram : trigrams) {
+		usize low = 0;
+		usize high = postings->trigrams.count;
+		while (low < high) {
+			const usize mid = low + (high - low) / 2;
+			if (postings->trigrams[mid] < trigram) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		if (low == postings->trigrams.count || postings->trigrams[low] != trigram) return false;
+	}
+	return true;
+}
+
+bool find_trigram_candidates(const ch::Path& root, const u32* query, usize count, u32 flags, ch::Array<ch::Path>* out) {
+	const Project_Index* index = the_index;
+	if (!index || !index->header || !index->is_current || (flags & SF_Regex)) return false;
+	if (!is_indexed_root(index, root)) return false;
+
+	ch::Array<u32> query_trigrams(ch::get_heap_allocator());
+	defer(query_trigrams.free());
+	get_query_trigrams(query, count, flags, &query_trigrams);
+	if (!query_trigrams.count) return false;
+
+	const Trigram_Table table = get_trigram_table(index);
+	const usize file_count = get_indexed_file_count(index);
+
+	// @NOTE: The rarest trigram goes first, so the list being narrowed starts out as short as it can
+	ch::Array<usize> order(ch::get_heap_allocator());
+	defer(order.free());
+	for (u32 trigram : query_trigrams) {
+		const usize found = find_trigram(table, trigram);
+		if (found == (usize)table.header->trigram_count) {
+			order.count = 0;
+			break;
+		}
+		usize at = order.count;
+		while (at > 0 && table.trigrams[order[at - 1]].file_count > table.trigrams[found].file_count) at -= 1;
+		order.insert(found, at);
+	}
+
+	ch::Array<u32> files(ch::get_heap_allocator());
+	defer(files.free());
+	ch::Array<u32> next(ch::get_heap_allocator());
+	defer(next.free());
+	for (usize i = 0; i < order.count; i++) {
+		if (i == 0) {
+			read_postings(table, file_count, order[0], &files);
+			continue;
+		}
+		if (!files.count) break;
+		next.count = 0;
+		read_postings(table, file_count, order[i], &next);
+		intersect_files(&files, next);
+	}
+	const usize unindexed = find_trigram(table, unindexed_trigram);
+	if (unindexed < (usize)table.header->trigram_count) read_postings(table, file_count, unindexed, &files);
+
+	auto push_candidate = [&](const ch::Path& path) {
+		if (is_path_under(path, root)) out->push(path);
+	};
+
+	for (u32 file : files) {
+		if (index->dead[file] || (index->files[file].flags & IF_Skipped)) continue;
+		push_candidate(get_indexed_path(index, file));
+	}
+	for (const Changed_File* file : index->changed) {
+		if (file->file.flags & IF_Skipped) continue;
+		if ((file->file.flags & IF_Unindexed) || has_trigrams(file, query_trigrams)) push_candidate(file->path);
+	}
+
+	// Files that changed and weren't indexed again yet could have anything in them now
+	for (const ch::Path& path : index->dirty) push_candidate(path);
+	usize reindexing_count;
+	const ch::Path* reindexing = get_reindexing_files(index, &reindexing_count);
+	for (usize i = 0; i < reindexing_count; i++) push_candidate(reindexing[i]);
+	return true;
+}
+
+void tick_trigram_index() {
+	if (the_index) tick_project_index(the_index);
+}
+
+void shutdown_trigram_index() {
+	if (!the_index) return;
+	close_project_index(the_index);
+	the_index = nullptr;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <ch_stl/filesystem.h>
+
+/* An index from every three byte sequence in the files of a project to the files it shows up in, so a search only has
+   to look at the files that have all of the query's trigrams. Bytes are indexed as they are on disk with ASCII
+   letters folded to lower case, which makes the index work for both cases and for every UTF-8 query.
+
+   The index is built on the job pool over the same files project searches walk and saved in the cache directory as
+   a file that's mapped and used in place: a file table, the trigram table and posting lists of file indices stored
+   as varint deltas. Opening a project maps it and then checks every file's stamp in the background, reindexing
+   only what changed. From then on the watch on the project's tree keeps it current: files it sees change get
+   reindexed and stay candidates for every query until they are, so searches use the index right away instead of
+   walking the tree first. Changes pile up in memory on top of the mapped index until there are enough to make
+   rebuilding worth it. */
+
+// Maps root's index from the cache directory or starts building it. Drops the index of any other root.
+void open_trigram_index(const ch::Path& root);
+
+// Has path reindexed soon. Called when a watch sees it change.
+void note_file_changed(const ch::Path& path);
+
+// Has every file's stamp checked again. Called when the watch lost track of changes, searches don't narrow anything
+// down until the check is done.
+void check_trigram_index();
+
+// Pushes the full path of every file under root that can have a match for query with Search_Flags. Returns false
+// when the index can't narrow the search down, like before it's built or checked, for regexes or for queries without
+// a trigram.
+bool find_trigram_candidates(const ch::Path& root, const u32* query, usize count, u32 flags, ch::Array<ch::Path>* out);
+
+// Installs finished builds and reindexes changed files. Called once a tick on the main thread.
+void tick_trigram_index();
+
+// Stops every job and waits for them. Called before the job pool goes away.
+void shutdown_trigram_index();
@@ -0,0 +1,438 @@
+#include "../platform.h"
+#include "../io.h"
+
+#include <ch_stl/math.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+bool get_file_stamp(const ch::Path& path, File_Stamp* out_stamp) {
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesEx(path.data, GetFileExInfoStandard, &data)) return false;
+
+	out_stamp->size = ((u64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	out_stamp->mtime = ((u64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+bool map_file(const ch::Path& path, Mapped_File* out_file) {
+	HANDLE file = CreateFile(path.data, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return false;
+	}
+
+	Mapped_File result;
+	result.size = (usize)size.QuadPart;
+	result.os_file = file;
+
+	// @NOTE: CreateFileMapping fails on empty files
+	if (result.size) {
+		HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping) {
+			CloseHandle(file);
+			return false;
+		}
+
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!data) {
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		result.os_mapping = mapping;
+		result.data = (const u8*)data;
+	}
+
+	*out_file = result;
+	return true;
+}
+
+void unmap_file(Mapped_File* file) {
+	if (file->data) UnmapViewOfFile(file->data);
+	if (file->os_mapping) CloseHandle((HANDLE)file->os_mapping);
+	if (file->os_file) CloseHandle((HANDLE)file->os_file);
+	*file = Mapped_File();
+}
+
+void discard_mapped_range(const Mapped_File& file, usize offset, usize size) {
+	if (!file.data || offset >= file.size) return;
+	if (offset + size > file.size) size = file.size - offset;
+
+	// @NOTE: VirtualUnlock on pages that aren't locked removes them from the working set.
+	//        It always "fails" with ERROR_NOT_LOCKED which is what we want.
+	VirtualUnlock((LPVOID)(file.data + offset), size);
+}
+
+bool is_memory_low() {
+	MEMORYSTATUSEX status = {};
+	status.dwLength = sizeof(status);
+	if (!GlobalMemoryStatusEx(&status)) return false;
+
+	return status.dwMemoryLoad >= 95;
+}
+
+OS_File create_write_file(const ch::Path& path) {
+	HANDLE file = CreateFile(path.data, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return invalid_os_file;
+	return (OS_File)file;
+}
+
+OS_File open_append_file(const ch::Path& path) {
+	HANDLE file = CreateFile(path.data, FILE_APPEND_DATA, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return invalid_os_file;
+	return (OS_File)file;
+}
+
+OS_File open_write_file(const ch::Path& path) {
+	// @NOTE: Shared like map_file's handle so a file can be written while it's mapped
+	HANDLE file = CreateFile(path.data, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return invalid_os_file;
+	return (OS_File)file;
+}
+
+bool write_file_gather(OS_File file, const IO_Slice* slices, usize count) {
+	// @NOTE: WriteFileGather only works on unbuffered page aligned I/O so just write the slices back to back
+	for (usize i = 0; i < count; i++) {
+		const u8* data = (const u8*)slices[i].data;
+		usize remaining = slices[i].size;
+		while (remaining) {
+			const DWORD amount = remaining > 0x40000000 ? 0x40000000 : (DWORD)remaining;
+			DWORD written;
+			if (!WriteFile((HANDLE)file, data, amount, &written, NULL)) return false;
+			data += written;
+			remaining -= written;
+		}
+	}
+	return true;
+}
+
+bool write_file_at(OS_File file, u64 offset, const void* data, usize size) {
+	const u8* bytes = (const u8*)data;
+	while (size) {
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+		const DWORD amount = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+		DWORD written;
+		if (!WriteFile((HANDLE)file, bytes, amount, &written, &overlapped)) return false;
+		bytes += written;
+		offset += written;
+		size -= written;
+	}
+	return true;
+}
+
+void close_os_file(OS_File file) {
+	if (file != invalid_os_file) CloseHandle((HANDLE)file);
+}
+
+bool sync_os_file(OS_File file) {
+	return FlushFileBuffers((HANDLE)file) != 0;
+}
+
+bool replace_file(const ch::Path& from, const ch::Path& to) {
+	return MoveFileEx(from.data, to.data, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
+bool delete_file(const ch::Path& path) {
+	return DeleteFile(path.data) != 0;
+}
+
+bool get_cache_directory(ch::Path* out_path) {
+	tchar local_app_data[MAX_PATH];
+	const DWORD length = GetEnvironmentVariable(CH_TEXT("LOCALAPPDATA"), local_app_data, MAX_PATH);
+	if (!length || length >= MAX_PATH) return false;
+
+	*out_path = local_app_data;
+	out_path->append(CH_TEXT("yeet"));
+	return CreateDirectory(out_path->data, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+bool is_directory(const ch::Path& path) {
+	const DWORD attributes = GetFileAttributes(path.data);
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+bool list_directory(const ch::Path& path, Directory_Proc proc, void* user) {
+	ch::Path pattern = path;
+	pattern.append(CH_TEXT("*"));
+
+	WIN32_FIND_DATA data;
+	HANDLE find = FindFirstFile(pattern.data, &data);
+	if (find == INVALID_HANDLE_VALUE) return false;
+	defer(FindClose(find));
+
+	do {
+		const tchar* name = data.cFileName;
+		if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) continue;
+
+		const bool directory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		// Junctions and directory symlinks
+		if (directory && (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) continue;
+
+		Directory_Entry entry;
+		entry.name = name;
+		entry.size = ((u64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+		entry.is_directory = directory;
+		proc(user, entry);
+	} while (FindNextFile(find, &data));
+	return true;
+}
+
+struct Watch_Directory {
+	HANDLE handle;
+	OVERLAPPED overlapped;
+	alignas(DWORD) u8 results[16 * 1024];
+
+	tchar path[MAX_PATH];
+	usize refs;
+	// Watches everything under path rather than only what's right in it
+	bool is_tree;
+};
+
+struct File_Watch {
+	Watch_ID id;
+	Watch_Directory* directory;
+	WCHAR name[MAX_PATH];
+	usize name_length;
+};
+
+static ch::Array<Watch_Directory*> watch_directories;
+static ch::Array<File_Watch> file_watches;
+static Watch_ID next_watch_id = 0;
+
+static bool issue_directory_read(Watch_Directory* directory) {
+	ZeroMemory(&directory->overlapped, sizeof(OVERLAPPED));
+	DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+	if (directory->is_tree) filter |= FILE_NOTIFY_CHANGE_DIR_NAME;
+	return ReadDirectoryChangesW(directory->handle, directory->results, sizeof(directory->results), directory->is_tree, filter, NULL, &directory->overlapped, NULL) != 0;
+}
+
+static void close_watch_directory(Watch_Directory* directory) {
+	CancelIoEx(directory->handle, &directory->overlapped);
+	// The kernel owns results until the read is done, wait it out before freeing
+	DWORD bytes;
+	GetOverlappedResult(directory->handle, &directory->overlapped, &bytes, TRUE);
+	CloseHandle(directory->handle);
+	ch_delete directory;
+}
+
+static Watch_Directory* new_watch_directory(const tchar* path, bool is_tree) {
+	HANDLE handle = CreateFile(path, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+	if (handle == INVALID_HANDLE_VALUE) return nullptr;
+
+	Watch_Directory* directory = ch_new Watch_Directory;
+	directory->handle = handle;
+	lstrcpyn(directory->path, path, MAX_PATH);
+	directory->refs = 1;
+	directory->is_tree = is_tree;
+	if (!issue_directory_read(directory)) {
+		CloseHandle(handle);
+		ch_delete directory;
+		return nullptr;
+	}
+	return directory;
+}
+
+static Watch_Directory* open_watch_directory(const tchar* path) {
+	for (Watch_Directory* directory : watch_directories) {
+		if (lstrcmpi(directory->path, path) == 0) {
+			directory->refs += 1;
+			return directory;
+		}
+	}
+
+	Watch_Directory* directory = new_watch_directory(path, false);
+	if (!directory) return nullptr;
+
+	watch_directories.allocator = ch::get_heap_allocator();
+	watch_directories.push(directory);
+	return directory;
+}
+
+Watch_ID watch_file(const ch::Path& path) {
+	tchar dir[MAX_PATH];
+	lstrcpyn(dir, path.data, MAX_PATH);
+
+	const tchar* name = path.data;
+	tchar* slash = nullptr;
+	for (tchar* c = dir; *c; c++) {
+		if (*c == '\\' || *c == '/') slash = c;
+	}
+	if (slash) {
+		name = path.data + (slash - dir) + 1;
+		*slash = 0;
+	} else {
+		lstrcpyn(dir, CH_TEXT("."), MAX_PATH);
+	}
+
+	Watch_Directory* directory = open_watch_directory(dir);
+	if (!directory) return invalid_watch_id;
+
+	// @NOTE: Change records always have wide names
+	File_Watch watch;
+	watch.id = next_watch_id++;
+	watch.directory = directory;
+#ifdef UNICODE
+	lstrcpynW(watch.name, name, MAX_PATH);
+#else
+	MultiByteToWideChar(CP_ACP, 0, name, -1, watch.name, MAX_PATH);
+#endif
+	watch.name_length = lstrlenW(watch.name);
+
+	file_watches.allocator = ch::get_heap_allocator();
+	file_watches.push(watch);
+	return watch.id;
+}
+
+void unwatch_file(Watch_ID id) {
+	for (usize i = 0; i < file_watches.count; i++) {
+		if (file_watches[i].id != id) continue;
+
+		Watch_Directory* directory = file_watches[i].directory;
+		file_watches.remove(i);
+
+		directory->refs -= 1;
+		if (!directory->refs) {
+			watch_directories.remove(watch_directories.find(directory));
+			close_watch_directory(directory);
+		}
+		return;
+	}
+}
+
+static void push_changed_watch(ch::Array<Watch_ID>* out_changed, Watch_ID id) {
+	if (out_changed->find(id) == -1) out_changed->push(id);
+}
+
+void poll_file_changes(ch::Array<Watch_ID>* out_changed) {
+	for (Watch_Directory* directory : watch_directories) {
+		DWORD bytes;
+		if (!GetOverlappedResult(directory->handle, &directory->overlapped, &bytes, FALSE)) continue;
+
+		// Nothing in results means they overflowed, so anything in the directory could have changed
+		const bool overflowed = bytes == 0;
+
+		for (const File_Watch& watch : file_watches) {
+			if (watch.directory != directory) continue;
+			if (overflowed) {
+				push_changed_watch(out_changed, watch.id);
+				continue;
+			}
+
+			const u8* p = directory->results;
+			for (;;) {
+				const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)p;
+				const usize length = info->FileNameLength / sizeof(WCHAR);
+				if (length == watch.name_length && CompareStringOrdinal(info->FileName, (int)length, watch.name, (int)length, TRUE) == CSTR_EQUAL) {
+					push_changed_watch(out_changed, watch.id);
+					break;
+				}
+				if (!info->NextEntryOffset) break;
+				p += info->NextEntryOffset;
+			}
+		}
+
+		issue_directory_read(directory);
+	}
+}
+
+static Watch_Directory* tree_directory = nullptr;
+
+bool watch_directory_tree(const ch::Path& root) {
+	unwatch_directory_tree();
+	tree_directory = new_watch_directory(root.data, true);
+	return tree_directory != nullptr;
+}
+
+void unwatch_directory_tree() {
+	if (!tree_directory) return;
+	close_watch_directory(tree_directory);
+	tree_directory = nullptr;
+}
+
+struct Tree_Listing {
+	const ch::Path* directory;
+	ch::Array<ch::Path>* out_files;
+};
+
+static void push_tree_files(const ch::Path& path, ch::Array<ch::Path>* out_files);
+
+static void on_tree_entry(void* user, const Directory_Entry& entry) {
+	const Tree_Listing* listing = (const Tree_Listing*)user;
+	if (entry.name[0] == '.') return;
+
+	ch::Path path = *listing->directory;
+	if (!append_path_name(&path, entry.name)) return;
+	if (entry.is_directory) {
+		push_tree_files(path, listing->out_files);
+	} else {
+		listing->out_files->push(path);
+	}
+}
+
+// Every file under path but hidden ones
+static void push_tree_files(const ch::Path& path, ch::Array<ch::Path>* out_files) {
+	Tree_Listing listing;
+	listing.directory = &path;
+	listing.out_files = out_files;
+	list_directory(path, on_tree_entry, &listing);
+}
+
+bool poll_tree_changes(ch::Array<ch::Path>* out_changed) {
+	Watch_Directory* directory = tree_directory;
+	DWORD bytes;
+	if (!directory || !GetOverlappedResult(directory->handle, &directory->overlapped, &bytes, FALSE)) return true;
+
+	// Nothing in results means they overflowed
+	if (!bytes) {
+		issue_directory_read(directory);
+		return false;
+	}
+
+	for (const u8* p = directory->results;;) {
+		const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)p;
+		const usize length = ch::min(info->FileNameLength / sizeof(WCHAR), (usize)MAX_PATH - 1);
+
+		// @NOTE: Names are wide and relative to the root, with every directory on the way in them
+		tchar name[MAX_PATH];
+#ifdef UNICODE
+		ch::mem_copy(name, info->FileName, length * sizeof(WCHAR));
+		name[length] = 0;
+#else
+		name[WideCharToMultiByte(CP_ACP, 0, info->FileName, (int)length, name, MAX_PATH - 1, NULL, NULL)] = 0;
+#endif
+		bool is_hidden = name[0] == '.';
+		for (const tchar* c = name; *c; c++) {
+			if ((c[0] == '\\' || c[0] == '/') && c[1] == '.') is_hidden = true;
+		}
+
+		ch::Path path = directory->path;
+		if (!is_hidden && append_path_name(&path, name)) {
+			const DWORD action = info->Action;
+			if (action == FILE_ACTION_ADDED || action == FILE_ACTION_RENAMED_NEW_NAME) {
+				// Only the directory shows up when one moves in, not what's in it
+				if (is_directory(path)) {
+					push_tree_files(path, out_changed);
+				} else {
+					out_changed->push(path);
+				}
+			} else if (action != FILE_ACTION_MODIFIED || !is_directory(path)) {
+				// Directories that went away get pushed like files, there's no telling them apart anymore
+				out_changed->push(path);
+			}
+		}
+
+		if (!info->NextEntryOffset) break;
+		p += info->NextEntryOffset;
+	}
+
+	issue_directory_read(directory);
+	return true;
+}
@@ -0,0 +1,466 @@
+#include "word_index.h"
+#include "editor.h"
+#include "text_scan.h"
+#include "search.h"
+#include "file_finder.h"
+#include "project_search.h"
+#include "sort.h"
+
+#include <ch_stl/math.h>
+#include <ch_stl/memory.h>
+#include <ch_stl/hash.h>
+
+// Longer runs are more likely data than names, and shorter ones aren't worth completing
+static const usize min_word_size = 2;
+static const usize max_word_size = 128;
+// Most codepoints of buffers that get read in full in one tick
+static const usize read_budget = 4 * 1024 * 1024;
+// Words nothing uses anymore get dropped once there are this many of them and they're half of all words
+static const usize min_compact_words = 4096;
+static const usize min_slot_count = 1024;
+
+struct Word {
+	// In codepoints from the start of the pool
+	u32 offset;
+	u32 count;
+	// How many times the open buffers have it. Words that drop to 0 stay until the next compaction.
+	u32 uses;
+};
+
+struct Word_Line {
+	// Codepoints, with the '\n' that ends it
+	usize size;
+	u32 word_count;
+};
+
+// The words of one buffer, line by line
+struct Buffer_Words {
+	Buffer_ID id;
+	// What the buffer was like when its words were last read. Edits are followed one version at a time.
+	u64 version = 0;
+	usize text_count = 0;
+	bool is_synced = false;
+	ch::Array<Word_Line> lines;
+	// Word ids, the ones of every line after those of the lines before it
+	ch::Array<u32> words;
+
+	// Where the line the last edit started on is. Edits don't change anything in front of them, and the next one is
+	// usually close by, so looking for its line starts from here.
+	usize hint_line = 0;
+	usize hint_start = 0;
+	usize hint_word = 0;
+};
+
+static ch::Array<u32> pool;
+static ch::Array<Word> words;
+// A power of two of word ids plus one, 0 for empty
+static ch::Array<u32> slots;
+// Every word id, in the order of their text
+static ch::Array<u32> sorted;
+// Ids of words that are new since sorted was last brought up to date
+static ch::Array<u32> unsorted;
+static usize unused_words = 0;
+
+static ch::Array<Buffer_Words*> tracked_buffers;
+
+// What lines being read again turn into
+static ch::Array<u32> scratch_text;
+static ch::Array<Word_Line> scratch_lines;
+static ch::Array<u32> scratch_words;
+
+CH_FORCEINLINE static u64 hash_word(const u32* text, usize count) {
+	return ch::fnv1_hash(text, count * sizeof(u32));
+}
+
+// Codepoint order, and shorter first when one starts with the other
+static s32 compare_words(const u32* a, usize a_count, const u32* b, usize b_count) {
+	const usize count = ch::min(a_count, b_count);
+	for (usize i = 0; i < count; i++) {
+		if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+	}
+	if (a_count == b_count) return 0;
+	return a_count < b_count ? -1 : 1;
+}
+
+CH_FORCEINLINE static const u32* get_text(const Word& word) {
+	return pool.data + word.offset;
+}
+
+// Index in sorted of the first word whose text doesn't come before text
+static usize find_sorted(const u32* text, usize count) {
+	usize low = 0;
+	usize high = sorted.count;
+	while (low < high) {
+		const usize mid = low + (high - low) / 2;
+		const Word& word = words[sorted[mid]];
+		if (compare_words(get_text(word), word.count, text, count) < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+CH_FORCEINLINE static bool is_sorted_before(u32 a, u32 b) {
+	return compare_words(get_text(words[a]), words[a].count, get_text(words[b]), words[b].count) < 0;
+}
+
+// Merges the new words into sorted. Reading a buffer can intern thousands of words, and putting each one in place as
+// it comes would move all of sorted every time.
+static void sort_new_words() {
+	if (!unsorted.count) return;
+
+	ch::Array<u32> temp(ch::get_heap_allocator());
+	defer(temp.free());
+	temp.reserve(unsorted.count);
+	merge_sort(unsorted.data, temp.data, unsorted.count, is_sorted_before);
+
+	ch::Array<u32> merged(ch::get_heap_allocator());
+	merged.reserve(sorted.count + unsorted.count);
+	usize a = 0;
+	usize b = 0;
+	while (a < sorted.count && b < unsorted.count) merged.push(is_sorted_before(unsorted[b], sorted[a]) ? unsorted[b++] : sorted[a++]);
+	while (a < sorted.count) merged.push(sorted[a++]);
+	while (b < unsorted.count) merged.push(unsorted[b++]);
+
+	sorted.free();
+	sorted = merged;
+	unsorted.count = 0;
+}
+
+static void rebuild_slots(usize slot_count) {
+	slots.count = 0;
+	slots.reserve(slot_count);
+	slots.count = slot_count;
+	ch::mem_zero(slots.data, slot_count * sizeof(u32));
+
+	const usize mask = slot_count - 1;
+	for (usize id = 0; id < words.count; id++) {
+		usize slot = hash_word(get_text(words[id]), words[id].count) & mask;
+		while (slots[slot]) slot = (slot + 1) & mask;
+		slots[slot] = (u32)id + 1;
+	}
+}
+
+// Id of the word with text, added with no uses when it's new
+static u32 intern_word(const u32* text, usize count) {
+	const usize mask = slots.count - 1;
+	usize slot = hash_word(text, count) & mask;
+	for (; slots[slot]; slot = (slot + 1) & mask) {
+		const Word& word = words[slots[slot] - 1];
+		if (!compare_words(get_text(word), word.count, text, count)) return slots[slot] - 1;
+	}
+
+	const u32 id = (u32)words.count;
+	words.push({ (u32)pool.count, (u32)count, 0 });
+	pool.reserve(count);
+	ch::mem_copy(pool.data + pool.count, text, count * sizeof(u32));
+	pool.count += count;
+	unsorted.push(id);
+	unused_words += 1;
+
+	// @NOTE: Slots stay at most half full so probes stay short
+	slots[slot] = id + 1;
+	if (words.count * 2 > slots.count) rebuild_slots(slots.count * 2);
+	return id;
+}
+
+CH_FORCEINLINE static void add_use(u32 id) {
+	if (!words[id].uses) unused_words -= 1;
+	words[id].uses += 1;
+}
+
+CH_FORCEINLINE static void remove_use(u32 id) {
+	words[id].uses -= 1;
+	if (!words[id].uses) unused_words += 1;
+}
+
+// Pushes the words of text line by line. text starts at the start of a line and ends with a '\n' unless it's the end
+// of the buffer, where the last line gets pushed even when it's empty.
+static void read_lines(const u32* text, usize count, bool is_end, ch::Array<Word_Line>* out_lines, ch::Array<u32>* out_words) {
+	Word_Line line = {};
+	usize line_start = 0;
+	usize i = 0;
+	while (i < count) {
+		const u32 c = text[i];
+		if (c == ch::eol) {
+			i += 1;
+			line.size = i - line_start;
+			out_lines->push(line);
+			line = {};
+			line_start = i;
+			continue;
+		}
+		if (!is_name_codepoint(c)) {
+			i += 1;
+			continue;
+		}
+
+		const usize start = i;
+		while (i < count && is_name_codepoint(text[i])) i += 1;
+		const usize size = i - start;
+		// Numbers aren't worth completing
+		if (size < min_word_size || size > max_word_size || (text[start] >= '0' && text[start] <= '9')) continue;
+
+		const u32 id = intern_word(text + start, size);
+		add_use(id);
+		out_words->push(id);
+		line.word_count += 1;
+	}
+	if (line_start < count || is_end) {
+		line.size = count - line_start;
+		out_lines->push(line);
+	}
+}
+
+// Replaces items [start, end) of array with every item of with
+template <typename T>
+static void replace_items(ch::Array<T>* array, usize start, usize end, const ch::Array<T>& with) {
+	const usize old_count = array->count;
+	const usize removed = end - start;
+	if (with.count > removed) array->reserve(with.count - removed);
+	if (with.count != removed) ch::mem_move(array->data + start + with.count, array->data + end, (old_count - end) * sizeof(T));
+	ch::mem_copy(array->data + start, with.data, with.count * sizeof(T));
+	array->count = old_count - removed + with.count;
+}
+
+static void drop_buffer_words(Buffer_Words* tracked) {
+	for (u32 id : tracked->words) remove_use(id);
+	tracked->words.count = 0;
+	tracked->lines.count = 0;
+	tracked->is_synced = false;
+	tracked->hint_line = 0;
+	tracked->hint_start = 0;
+	tracked->hint_word = 0;
+}
+
+// The finder and the project search results are paths and counts rather than text anyone typed
+CH_FORCEINLINE static bool has_words(const Buffer* buffer) {
+	if (is_finder_buffer(buffer->id) || is_results_buffer(buffer->id)) return false;
+	return !buffer->is_read_only() && !buffer->is_binary() && !buffer->is_loading();
+}
+
+// Copies codepoints [start, end) of the buffer into scratch_text
+static void copy_to_scratch(const Buffer* buffer, usize start, usize end) {
+	scratch_text.count = 0;
+	scratch_text.reserve(end - start);
+	copy_codepoints(buffer->get_halves(), start, end, scratch_text.data);
+	scratch_text.count = end - start;
+}
+
+static void read_buffer(Buffer_Words* tracked, const Buffer* buffer) {
+	drop_buffer_words(tracked);
+	const usize count = buffer->gap_buffer.count();
+	copy_to_scratch(buffer, 0, count);
+	read_lines(scratch_text.data, count, true, &tracked->lines, &tracked->words);
+
+	tracked->version = buffer->version;
+	tracked->text_count = count;
+	tracked->is_synced = true;
+}
+
+// Takes back the words of the lines the edit touched and reads what those lines are now
+static void follow_edit(Buffer_Words* tracked, const Buffer* buffer, const Text_Edit& edit) {
+	const ch::Array<Word_Line>& lines = tracked->lines;
+
+	// The lines the edit started and ended on, in the text from before it
+	usize first = tracked->hint_line;
+	usize first_start = tracked->hint_start;
+	usize first_word = tracked->hint_word;
+	while (first > 0 && edit.index < first_start) {
+		first -= 1;
+		first_start -= lines[first].size;
+		first_word -= lines[first].word_count;
+	}
+	for (; first + 1 < lines.count && edit.index >= first_start + lines[first].size; first++) {
+		first_start += lines[first].size;
+		first_word += lines[first].word_count;
+	}
+	usize last = first;
+	usize last_end = first_start + lines[first].size;
+	usize last_word_end = first_word + lines[first].word_count;
+	while (last + 1 < lines.count && edit.index + edit.removed >= last_end) {
+		last += 1;
+		last_end += lines[last].size;
+		last_word_end += lines[last].word_count;
+	}
+
+	for (usize i = first_word; i < last_word_end; i++) remove_use(tracked->words[i]);
+
+	// @NOTE: A line that isn't the last one keeps its '\n' through an edit that ends on it, so the stretch read again
+	// is whole lines
+	const usize end = last_end - edit.removed + edit.inserted;
+	copy_to_scratch(buffer, first_start, end);
+	scratch_lines.count = 0;
+	scratch_words.count = 0;
+	read_lines(scratch_text.data, scratch_text.count, last + 1 == lines.count, &scratch_lines, &scratch_words);
+
+	replace_items(&tracked->lines, first, last + 1, scratch_lines);
+	replace_items(&tracked->words, first_word, last_word_end, scratch_words);
+	tracked->hint_line = first;
+	tracked->hint_start = first_start;
+	tracked->hint_word = first_word;
+	tracked->version = buffer->version;
+	tracked->text_count = buffer->gap_buffer.count();
+}
+
+static Buffer_Words* find_tracked(Buffer_ID id) {
+	for (Buffer_Words* tracked : tracked_buffers) {
+		if (tracked->id == id) return tracked;
+	}
+	return nullptr;
+}
+
+static void on_buffer_edit(Buffer* buffer, const Text_Edit& edit, const u32* inserted) {
+	Buffer_Words* tracked = find_tracked(buffer->id);
+	if (!tracked || !tracked->is_synced) return;
+
+	// @NOTE: Buffers that missed an edit get read again in full in tick_word_index instead
+	const bool is_next_edit = tracked->version + 1 == buffer->version && tracked->text_count + edit.inserted == buffer->gap_buffer.count() + edit.removed;
+	if (!has_words(buffer) || !is_next_edit) {
+		tracked->is_synced = false;
+		return;
+	}
+	follow_edit(tracked, buffer, edit);
+}
+
+// Drops every word nothing uses and gives the rest new ids in text order
+static void compact_words() {
+	sort_new_words();
+
+	ch::Array<u32> new_ids(ch::get_heap_allocator());
+	defer(new_ids.free());
+	new_ids.reserve(words.count);
+	new_ids.count = words.count;
+
+	ch::Array<u32> new_pool(ch::get_heap_allocator());
+	ch::Array<Word> new_words(ch::get_heap_allocator());
+	for (u32 id : sorted) {
+		const Word& word = words[id];
+		if (!word.uses) continue;
+
+		new_ids[id] = (u32)new_words.count;
+		new_words.push({ (u32)new_pool.count, word.count, word.uses });
+		new_pool.reserve(word.count);
+		ch::mem_copy(new_pool.data + new_pool.count, get_text(word), word.count * sizeof(u32));
+		new_pool.count += word.count;
+	}
+	for (Buffer_Words* tracked : tracked_buffers) {
+		for (u32& id : tracked->words) id = new_ids[id];
+	}
+
+	pool.free();
+	pool = new_pool;
+	words.free();
+	words = new_words;
+	sorted.count = 0;
+	sorted.reserve(words.count);
+	for (usize id = 0; id < words.count; id++) sorted.push((u32)id);
+	unused_words = 0;
+
+	usize slot_count = min_slot_count;
+	while (slot_count < words.count * 2) slot_count *= 2;
+	rebuild_slots(slot_count);
+}
+
+void init_word_index() {
+	pool.allocator = ch::get_heap_allocator();
+	words.allocator = ch::get_heap_allocator();
+	slots.allocator = ch::get_heap_allocator();
+	sorted.allocator = ch::get_heap_allocator();
+	unsorted.allocator = ch::get_heap_allocator();
+	tracked_buffers.allocator = ch::get_heap_allocator();
+	scratch_text.allocator = ch::get_heap_allocator();
+	scratch_lines.allocator = ch::get_heap_allocator();
+	scratch_words.allocator = ch::get_heap_allocator();
+	rebuild_slots(min_slot_count);
+
+	add_buffer_edit_hook(on_buffer_edit);
+}
+
+CH_FORCEINLINE static bool is_better(const Word_Completion& a, const Word_Completion& b) {
+	return a.uses > b.uses || (a.uses == b.uses && a.count < b.count);
+}
+
+void find_completions(const u32* prefix, usize count, usize max, ch::Array<Word_Completion>* out) {
+	if (!count || !max) return;
+	sort_new_words();
+
+	// @NOTE: Words that start with prefix sort right after it, so they're one run. out is kept best first.
+	const usize first_out = out->count;
+	for (usize i = find_sorted(prefix, count); i < sorted.count; i++) {
+		const Word& word = words[sorted[i]];
+		if (word.count < count || compare_words(get_text(word), count, prefix, count)) break;
+		if (!word.uses) continue;
+
+		const Word_Completion completion = { get_text(word), word.count, word.uses };
+		usize at = out->count;
+		while (at > first_out && is_better(completion, (*out)[at - 1])) at -= 1;
+		if (at - first_out == max) continue;
+
+		if (out->count - first_out == max) out->count -= 1;
+		out->insert(completion, at);
+	}
+}
+
+void tick_word_index() {
+	// Closed buffers give their words back
+	for (usize i = 0; i < tracked_buffers.count;) {
+		Buffer_Words* tracked = tracked_buffers[i];
+		if (find_buffer(tracked->id)) {
+			i += 1;
+			continue;
+		}
+		drop_buffer_words(tracked);
+		tracked->lines.free();
+		tracked->words.free();
+		ch_delete tracked;
+		tracked_buffers.remove(i);
+	}
+
+	for (Buffer_ID id : get_buffer_ids()) {
+		if (find_tracked(id)) continue;
+		Buffer_Words* tracked = ch_new Buffer_Words;
+		tracked->id = id;
+		tracked->lines.allocator = ch::get_heap_allocator();
+		tracked->words.allocator = ch::get_heap_allocator();
+		tracked_buffers.push(tracked);
+	}
+
+	// @NOTE: Opening hundreds of buffers at once gets spread over a few ticks
+	usize budget = read_budget;
+	for (Buffer_Words* tracked : tracked_buffers) {
+		const Buffer* buffer = find_buffer(tracked->id);
+		if (!has_words(buffer)) {
+			if (tracked->words.count) drop_buffer_words(tracked);
+			continue;
+		}
+		if (tracked->is_synced && tracked->version == buffer->version && tracked->text_count == buffer->gap_buffer.count()) continue;
+		if (!budget) break;
+
+		read_buffer(tracked, buffer);
+		budget -= ch::min(budget, tracked->text_count);
+	}
+
+	sort_new_words();
+	if (unused_words > min_compact_words && unused_words * 2 > words.count) compact_words();
+}
+
+void shutdown_word_index() {
+	for (Buffer_Words* tracked : tracked_buffers) {
+		tracked->lines.free();
+		tracked->words.free();
+		ch_delete tracked;
+	}
+	tracked_buffers.free();
+	pool.free();
+	words.free();
+	slots.free();
+	sorted.free();
+	unsorted.free();
+	scratch_text.free();
+	scratch_lines.free();
+	scratch_words.free();
+	unused_words = 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "buffer.h"
+
+/* Every word in the open buffers, for completing the one being typed. Words are interned once into a pool and kept
+   in a hash table for edits and in an array sorted by text for prefix queries, with a count of how many times the
+   open buffers use each one. New words get merged into the sorted array all at once before the next query.
+
+   Every buffer keeps the ids of its words line by line, so an edit only takes back the words of the lines it touched
+   and reads those lines again. Buffers that missed an edit, like ones that were loading, get read again in full in
+   tick_word_index. */
+
+struct Word_Completion {
+	// Points into the index, so it's only good until the next edit or tick
+	const u32* text;
+	usize count;
+	u32 uses;
+};
+
+void init_word_index();
+
+// Pushes up to max words that start with prefix, the most used first. Case has to match.
+void find_completions(const u32* prefix, usize count, usize max, ch::Array<Word_Completion>* out);
+
+// Starts following buffers that were opened and drops closed ones. Called once a tick on the main thread.
+void tick_word_index();
+
+void shutdown_word_index();